@@ -23,6 +23,8 @@ extern "C" {
 #endif
 
 #include "syncs-types.h"
+#include "syncs-hash.h"
+#include "syncs-executor.h"
 
 	struct syncs_client_event {
 		syncsid_t id;
@@ -34,6 +36,85 @@ extern "C" {
 		uint32_t data_size;
 		uint32_t data_user_size;
 		pthread_mutex_t data_mutex;
+		// value of huge variable is collected here from chunks
+		uint8_t *huge_data;
+		uint32_t huge_capacity;
+		uint32_t huge_size;
+		uint32_t huge_offset;
+		uint32_t huge_transfer;
+		// sequence of the last stream element, jump means elements were lost
+		void (*gap_cb)(void *, char *, uint64_t);
+		uint64_t stream_sequence;
+		// sequence of the value which waits in data after conflation of the event queue
+		uint64_t queue_sequence;
+		// callback runs on the workers of executor instead of the receive thread
+		int async;
+	};
+
+	// handle of variable given by server, indexed by id for writes and by handle for events
+	struct syncs_client_handle {
+		syncsid_t id;
+		uint32_t handle;
+		struct syncs_client_event *event;
+	};
+
+	// records of a batch are sent together, a larger batch goes by several sends
+#define SYNCS_CLIENT_BATCH_SIZE	(16*1024)
+
+	struct syncs_write_batch {
+		struct syncs_connect *connect;
+		uint32_t size;
+		uint32_t count;
+		int error;
+		uint8_t buffer[SYNCS_CLIENT_BATCH_SIZE];
+	};
+
+	// corked write waits in the buffer, squashing finds the previous value of variable by id
+#define SYNCS_CLIENT_CORK_RECORDS	(SYNCS_CLIENT_BATCH_SIZE / 32)
+
+	// threadless connection waits so long before the next attempt to connect
+#define SYNCS_CLIENT_RECONNECT_MS	1000
+
+#define SYNCS_CONNECT_IDLE		0
+#define SYNCS_CONNECT_CONNECTING	1
+#define SYNCS_CONNECT_CONNECTED		2
+
+	struct syncs_cork_record {
+		syncsid_t id;
+		uint32_t offset;
+		uint32_t size;
+	};
+
+	// workers of executor which async subscriptions start when there is none
+#define SYNCS_CLIENT_EXECUTOR_WORKERS	4
+
+	// events of sync subscriptions wait in the ring between the receive thread and syncs_wait_event()
+#define SYNCS_CLIENT_QUEUE_ENTRIES	128
+#define SYNCS_CLIENT_QUEUE_PAYLOAD	(SYNCS_VARIABLE_SIZE_MAXIMUM + 1)
+
+	// id is copied, the subscription may be gone or reused when the slot is taken
+	struct syncs_event_slot {
+		uint64_t position;
+		syncsid_t id;
+		uint64_t sequence;
+		uint32_t flags;
+		uint32_t size;
+		uint8_t data[SYNCS_CLIENT_QUEUE_PAYLOAD];
+	};
+
+	/*
+	 * Bounded ring, every slot knows the position it waits for, so producers and
+	 * waiters take slots by CAS of tail and head without a lock. Conflated events
+	 * are marked in pending by index of subscription, their value is in event data.
+	 */
+	struct syncs_event_queue {
+		uint64_t head __attribute__((aligned(64)));
+		uint64_t tail __attribute__((aligned(64)));
+		uint64_t sequence;
+		uint64_t overflow __attribute__((aligned(64)));
+		uint64_t pending[SYNCS_EVENT_MAXIMUM / 64];
+		uint32_t mask;
+		struct syncs_event_slot slots[];
 	};
 
 	struct syncs_connect_channel {
@@ -77,13 +158,51 @@ extern "C" {
 		pthread_cond_t ticket_cond;
 
 		struct syncs_client_event events[SYNCS_EVENT_MAXIMUM];
-		struct syncs_client_event *events_queue;
+		struct syncs_hash events_by_id;
+		pthread_mutex_t event_mutex;
+		struct syncs_event_queue *events_queue;
+		uint32_t queue_entries;
+		uint32_t queue_policy;
+		struct syncs_executor *executor;
 
 		struct syncs_connect_channel channels[SYNCS_CHANNEL_MAXIMUM];
 		struct syncs_event_info *events_info;
 		struct syncs_client_info *clients_info;
 		struct syncs_channel_info *channels_info;
 
+		uint32_t protocol;
+		uint32_t server_protocol;
+		uint32_t tx_sequence;
+		uint32_t huge_transfer;
+		pthread_mutex_t huge_mutex;
+		struct syncs_hash handles_by_id;
+		struct syncs_hash handles_by_key;
+		pthread_mutex_t handle_mutex;
+
+		// corked writes are sent when the buffer is full, the timer fires or syncs_flush() is called
+		uint32_t cork;
+		uint32_t cork_us;
+		uint8_t *cork_buffer;
+		uint32_t cork_size;
+		uint32_t cork_count;
+		struct syncs_cork_record *cork_records;
+		struct syncs_hash cork_index;
+		int cork_timerfd;
+		uint64_t cork_deadline_us;
+		pthread_mutex_t cork_mutex;
+
+		// buffer of write batch is kept for the next one, a concurrent batch allocates its own
+		struct syncs_write_batch *batch;
+		int batch_busy;
+
+		// threadless connection is driven by syncs_process() of the application
+		int threadless;
+		int state;
+		int connecting_fd;
+		int processing;
+		int buffer_recv;
+		uint64_t reconnect_us;
+
 		uint8_t *current_key;
 		uint8_t server_key [SYNCS_CRYPT_KEY_SIZE];
 		uint8_t session_key [SYNCS_CRYPT_KEY_SIZE];
@@ -96,6 +215,7 @@ extern "C" {
 		char eventlist_sequence;
 		char eventlist_wait_packet;
 		int eventlist_recv;
+		int eventlist_size;
 		int eventlist_wait;
 		pthread_mutex_t eventlist_mutex;
 		pthread_cond_t eventlist_cond;
@@ -103,6 +223,7 @@ extern "C" {
 		char clientlist_sequence;
 		char clientlist_wait_packet;
 		int clientlist_recv;
+		int clientlist_size;
 		int clientlist_wait;
 		pthread_mutex_t clientlist_mutex;
 		pthread_cond_t clientlist_cond;
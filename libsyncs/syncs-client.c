@@ -25,12 +25,16 @@
 #include <error.h>
 #include <errno.h>
 #include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <poll.h>
 #include <fcntl.h>
 #include <ctype.h>
 
 #include "syncs-net.h"
 #include "syncs-common.h"
 #include "syncs-crypt.h"
+#include "syncs-hash.h"
+#include "syncs-frame.h"
 #include "syncs-client-types.h"
 
 #define MODULE_NAME "syncs-client"
@@ -38,12 +42,74 @@
 // #undef syncsd_debug
 // #define syncsd_debug(fmt,args...)
 
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+// writer waits so long for the server which doesn't read
+#define SYNCS_CLIENT_SEND_TIMEOUT_MS	3000
+
 extern int syncs_find_server(char *addr, int *port);
+int syncs_get_fd(struct syncs_connect *s, short *events);
+int syncs_process(struct syncs_connect *s);
+int syncs_next_timeout(struct syncs_connect *s);
+int syncs_flush(struct syncs_connect *s);
+
+static uint64_t syncs_monotonic_us(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/* buffer is sent as is, the records were encoded for the current connection */
+static int syncs_cork_send_locked(struct syncs_connect *s)
+{
+	int ret = 0;
+
+	if (!s->cork_size)
+		return 0;
+	if (s->socketfd > 0)
+		ret = syncs_stream_send(s->socketfd, s->cork_buffer, s->cork_size, MSG_NOSIGNAL, SYNCS_CLIENT_SEND_TIMEOUT_MS);
+	else
+		ret = -1;
+	s->cork_deadline_us = 0;
+	s->cork_size = 0;
+	s->cork_count = 0;
+	syncs_hash_clear(&s->cork_index);
+	return ret;
+}
+
+int syncs_flush(struct syncs_connect *s)
+{
+	int ret;
+
+	if (s->cork_buffer == NULL)
+		return 0;
+	pthread_mutex_lock(&s->cork_mutex);
+	ret = syncs_cork_send_locked(s);
+	pthread_mutex_unlock(&s->cork_mutex);
+	return ret;
+}
+
+/* handles of the buffered records belong to the lost connection */
+static void syncs_cork_drop(struct syncs_connect *s)
+{
+	if (s->cork_buffer == NULL)
+		return;
+	pthread_mutex_lock(&s->cork_mutex);
+	s->cork_deadline_us = 0;
+	s->cork_size = 0;
+	s->cork_count = 0;
+	syncs_hash_clear(&s->cork_index);
+	pthread_mutex_unlock(&s->cork_mutex);
+}
 
 static int syncs_connect_send(struct syncs_connect *c, void *buffer, uint32_t size)
 {
+	// corked writes go before anything which is sent after them
+	if (c->cork_size)
+		syncs_flush(c);
 	if (c->socketfd > 0)
-		return(syncs_blocking_send(c->socketfd, buffer, size, MSG_NOSIGNAL));
+		return(syncs_stream_send(c->socketfd, buffer, size, MSG_NOSIGNAL, SYNCS_CLIENT_SEND_TIMEOUT_MS));
 	else if (c->usocketfd > 0) {
 		syncs_udp_send(c->usocketfd, buffer, size, &c->saddr, c->saddr_size);
 		return 0;
@@ -51,44 +117,110 @@ static int syncs_connect_send(struct syncs_connect *c, void *buffer, uint32_t si
 	return -1;
 }
 
-static struct syncs_client_event *syncs_find_event(struct syncs_connect *s, syncsid_t *id)
+static int syncs_connect_send_frame(struct syncs_connect *s, struct syncs_header *header, void *data, const uint32_t *handle)
 {
-	int i;
-	for (i = 0; i < SYNCS_EVENT_MAXIMUM; i++)
-		if (syncs_idcmp(&s->events[i].id, id)) {
-			return &s->events[i];
-		}
-	return NULL;
+	uint64_t frame[SYNCS_FRAME_SIZE_MAXIMUM / sizeof(uint64_t)];
+	uint32_t sequence = __atomic_fetch_add(&s->tx_sequence, 1, __ATOMIC_RELAXED);
+
+	return syncs_connect_send(s, frame, syncs_frame_encode(frame, header, data, sequence, handle));
 }
 
-static struct syncs_client_event *syncs_find_event_str(struct syncs_connect *s, const char *cid)
+/* packets are built in v2 layout and encoded to v3 when the server accepted it */
+static int syncs_connect_send_packet(struct syncs_connect *s, struct syncs_packet *packet)
 {
-	int i;
-	for (i = 0; i < SYNCS_EVENT_MAXIMUM; i++)
-		if (syncs_idcmp_str(&s->events[i].id, cid)) {
-			return &s->events[i];
-		}
-	return NULL;
+	if (s->server_protocol & SYNCS_PROTOCOL_V3)
+		return syncs_connect_send_frame(s, &packet->header, packet->buffer, NULL);
+	return syncs_connect_send(s, packet, SYNCS_PACKET_SIZE(packet));
+}
+
+/* events are indexed by id, receive path finds the subscription without scanning all of them */
+static struct syncs_client_event *syncs_find_event(struct syncs_connect *s, syncsid_t *id)
+{
+	struct syncs_client_event *event;
+
+	pthread_mutex_lock(&s->event_mutex);
+	event = syncs_hash_find_id(&s->events_by_id, id);
+	pthread_mutex_unlock(&s->event_mutex);
+	return event;
 }
 
-static struct syncs_client_event *syncs_get_free_event(struct syncs_connect *s)
+static struct syncs_client_event *syncs_get_event_str(struct syncs_connect *s, const char *cid)
 {
+	struct syncs_client_event *event;
+	syncsid_t id;
 	int i;
-	for (i = 0; i < SYNCS_EVENT_MAXIMUM; i++)
+
+	syncs_idstr(&id, cid);
+	pthread_mutex_lock(&s->event_mutex);
+	event = syncs_hash_find_id(&s->events_by_id, &id);
+	for (i = 0; (event == NULL) && (i < SYNCS_EVENT_MAXIMUM); i++)
 		if (s->events[i].id.i[0] == -1) {
-			return &s->events[i];
+			syncs_idcpy(&s->events[i].id, &id);
+			if (syncs_hash_insert_id(&s->events_by_id, &s->events[i])) {
+				s->events[i].id.i[0] = -1;
+				break;
+			}
+			event = &s->events[i];
 		}
-	return NULL;
+	pthread_mutex_unlock(&s->event_mutex);
+	return event;
 }
 
-static struct syncs_client_event *syncs_get_event_str(struct syncs_connect *s, const char *cid)
+static void syncs_put_event(struct syncs_connect *s, struct syncs_client_event *event)
 {
-	struct syncs_client_event *event = syncs_find_event_str(s, cid);
-	if (event == NULL)
-		return syncs_get_free_event (s);
-	return event;
+	uint32_t index = event - s->events;
+
+	pthread_mutex_lock(&s->event_mutex);
+	syncs_hash_remove_id(&s->events_by_id, event);
+	// conflated value of the old subscription isn't delivered for the next one of the slot
+	if (s->events_queue != NULL)
+		__atomic_fetch_and(&s->events_queue->pending[index / 64], ~(1ULL << (index % 64)), __ATOMIC_RELEASE);
+	event->async = 0;
+	event->id.i[0] = -1;
+	pthread_mutex_unlock(&s->event_mutex);
 }
 
+static void syncs_bind_handle(struct syncs_connect *s, struct syncs_client_event *event)
+{
+	struct syncs_client_handle *handle;
+
+	pthread_mutex_lock(&s->handle_mutex);
+	handle = syncs_hash_find_id(&s->handles_by_id, &event->id);
+	if (handle != NULL)
+		handle->event = event;
+	pthread_mutex_unlock(&s->handle_mutex);
+}
+
+static void syncs_unbind_handle(struct syncs_connect *s, struct syncs_client_event *event)
+{
+	struct syncs_client_handle *handle;
+
+	pthread_mutex_lock(&s->handle_mutex);
+	handle = syncs_hash_find_id(&s->handles_by_id, &event->id);
+	if ((handle != NULL) && (handle->event == event))
+		handle->event = NULL;
+	pthread_mutex_unlock(&s->handle_mutex);
+}
+
+/* handles are valid only for the server session which gave them */
+static void syncs_release_handles(struct syncs_connect *s)
+{
+	struct syncs_hash_slot *slot;
+	uint32_t i;
+
+	pthread_mutex_lock(&s->handle_mutex);
+	for (i = 0; i <= s->handles_by_id.mask; i++) {
+		slot = &s->handles_by_id.slots[i];
+		if ((slot->item != NULL) && (slot->item != SYNCS_HASH_DELETED))
+			free(slot->item);
+	}
+	syncs_hash_release(&s->handles_by_id);
+	syncs_hash_release(&s->handles_by_key);
+	syncs_hash_init(&s->handles_by_id, 0);
+	syncs_hash_init(&s->handles_by_key, 0);
+	s->server_protocol = 0;
+	pthread_mutex_unlock(&s->handle_mutex);
+}
 
 static void syncs_wait_sync(struct syncdata *sync)
 {
@@ -113,10 +245,38 @@ static void syncs_wait_sync(struct syncdata *sync)
 }
 
 
-static int syncs_wait_for(int *wait, pthread_mutex_t *mutex, pthread_cond_t *cond, unsigned int timeout_sec)
+/* threadless connection has nobody else to take the answer, the waiting call processes the connection itself */
+static int syncs_wait_process(struct syncs_connect *s, int *wait, unsigned int timeout_sec)
+{
+	uint64_t end = syncs_monotonic_us() + (uint64_t) timeout_sec * 1000000;
+	uint64_t now;
+	struct pollfd pfd;
+	int timeout, left;
+
+	// callback of syncs_process() can't wait for the data which comes after it
+	if (s->processing)
+		return -EDEADLK;
+	while (*wait) {
+		now = syncs_monotonic_us();
+		if (now >= end)
+			return -ETIMEDOUT;
+		left = (end - now + 999) / 1000;
+		timeout = syncs_next_timeout(s);
+		if ((timeout < 0) || (timeout > left))
+			timeout = left;
+		pfd.fd = syncs_get_fd(s, &pfd.events);
+		poll(&pfd, (pfd.fd >= 0) ? 1 : 0, timeout);
+		syncs_process(s);
+	}
+	return 0;
+}
+
+static int syncs_wait_for(struct syncs_connect *s, int *wait, pthread_mutex_t *mutex, pthread_cond_t *cond, unsigned int timeout_sec)
 {
 	struct timespec to;
 
+	if (s->threadless)
+		return syncs_wait_process(s, wait, timeout_sec);
 	clock_gettime(CLOCK_MONOTONIC, &to);
 	to.tv_sec += timeout_sec;
 
@@ -140,13 +300,12 @@ static void syncs_notify_for(int *wait, pthread_mutex_t *mutex, pthread_cond_t *
 
 static int syncs_wait_for_read(struct syncs_connect *s, unsigned int timeout)
 {
-	return syncs_wait_for(&s->read_wait, &s->read_mutex, &s->read_cond, timeout);
+	return syncs_wait_for(s, &s->read_wait, &s->read_mutex, &s->read_cond, timeout);
 }
 
 int syncs_read(struct syncs_connect *s, uint32_t flags, const char *cid, void *data, uint32_t *data_size)
 {
 	struct syncs_packet packet;
-	int size = sizeof(struct syncs_header);
 
 	if (s->socketfd < 0)
 		return -EBADFD;
@@ -154,7 +313,7 @@ int syncs_read(struct syncs_connect *s, uint32_t flags, const char *cid, void *d
 	s->read_wait = 1;
 	syncs_fill_header_request_str (&packet.header, cid, SYNCS_TYPE_READ | (flags & SYNCS_TYPE_VAR_MASK));
 	syncs_idcpy(&s->read_id, &packet.header.id);
-	syncs_connect_send(s, &packet, size);
+	syncs_connect_send_packet(s, &packet);
 
 	if (syncs_wait_for_read(s, 3))
 		return -ETIMEDOUT;
@@ -196,30 +355,294 @@ int syncs_read_str(struct syncs_connect *s, uint32_t flags, const char *id, char
 	return(syncs_read(s, flags | SYNCS_TYPE_VAR_STRING, id, data, &size));
 }
 
+static int syncs_write_find_handle(struct syncs_connect *s, syncsid_t *id, uint32_t *value)
+{
+	struct syncs_client_handle *handle;
+
+	pthread_mutex_lock(&s->handle_mutex);
+	handle = syncs_hash_find_id(&s->handles_by_id, id);
+	if (handle != NULL)
+		*value = handle->handle;
+	pthread_mutex_unlock(&s->handle_mutex);
+	return (handle != NULL) ? 0 : -ENOENT;
+}
+
+static int syncs_write_handle(struct syncs_connect *s, uint32_t flags, syncsid_t *id, void *data, uint32_t data_size)
+{
+	struct syncs_handle_packet packet;
+	struct syncs_header header;
+	uint32_t value;
+
+	if (syncs_write_find_handle(s, id, &value))
+		return -ENOENT;
+
+	if (s->server_protocol & SYNCS_PROTOCOL_V3) {
+		syncs_fill_basic_header(&header, SYNCS_TYPE_WRITE | (flags & (SYNCS_TYPE_VAR_MASK | SYNCS_TYPE_FLAGS_MASK)));
+		header.data_size = (data != NULL) ? data_size & SYNCS_VARIABLE_SIZE_MAXIMUM : 0;
+		return syncs_connect_send_frame(s, &header, data, &value);
+	}
+
+	packet.header.handle = value;
+
+	packet.header.magic = SYNCS_PACKET_MAGIC_HANDLE;
+	packet.header.magic_data = SYNCS_PACKET_MAGIC_DATA;
+	packet.header.type = SYNCS_TYPE_WRITE | (flags & (SYNCS_TYPE_VAR_MASK | SYNCS_TYPE_FLAGS_MASK));
+	packet.header.update_counter = 0;
+	if (data_size && data != NULL) {
+		memcpy(packet.buffer, data, data_size);
+		packet.header.data_size = data_size & SYNCS_VARIABLE_SIZE_MAXIMUM;
+	} else packet.header.data_size = 0;
+
+	return syncs_connect_send(s, &packet, SYNCS_HANDLE_PACKET_SIZE(&packet));
+}
+
+/* chunks of one value go one after another, other threads may send small packets between them */
+static int syncs_write_huge(struct syncs_connect *s, uint32_t flags, syncsid_t *id, void *data, uint32_t data_size)
+{
+	struct syncs_header header;
+	struct syncs_huge_chunk chunk;
+	struct syncs_client_handle *handle;
+	uint32_t value, size, sequence;
+	uint8_t *frame;
+	int ret = 0;
+
+	if (!(s->server_protocol & SYNCS_PROTOCOL_HUGE))
+		return -ENOTSUP;
+	if (data_size > SYNCS_HUGE_SIZE_MAXIMUM)
+		return -EMSGSIZE;
+	frame = malloc(SYNCS_HUGE_FRAME_SIZE_MAXIMUM);
+	if (frame == NULL)
+		return -ENOMEM;
+
+	pthread_mutex_lock(&s->handle_mutex);
+	handle = syncs_hash_find_id(&s->handles_by_id, id);
+	if (handle != NULL)
+		value = handle->handle;
+	pthread_mutex_unlock(&s->handle_mutex);
+
+	syncs_fill_header(&header, id, SYNCS_TYPE_WRITE | SYNCS_TYPE_VAR_HUGE | (flags & SYNCS_TYPE_FLAGS_MASK));
+	chunk.size = data_size;
+	chunk.offset = 0;
+	chunk.reserved = 0;
+	pthread_mutex_lock(&s->huge_mutex);
+	chunk.transfer = s->huge_transfer++;
+	do {
+		size = MIN(data_size - chunk.offset, SYNCS_HUGE_CHUNK_SIZE);
+		sequence = __atomic_fetch_add(&s->tx_sequence, 1, __ATOMIC_RELAXED);
+		ret = syncs_connect_send(s, frame, syncs_frame_encode_chunk(frame, &header, &chunk, (uint8_t *) data + chunk.offset, size,
+			sequence, (handle != NULL) ? &value : NULL));
+		chunk.offset += size;
+	} while (!ret && (chunk.offset < data_size));
+	pthread_mutex_unlock(&s->huge_mutex);
+
+	free(frame);
+	syncsd_debug("write huge [%s] %u bytes, ret %d", id->c, data_size, ret);
+	return ret;
+}
+
+/* any record of write fits, it is encoded in the layout which the server accepted */
+union syncs_write_record {
+	uint64_t frame[SYNCS_FRAME_SIZE_MAXIMUM / sizeof(uint64_t)];
+	struct syncs_packet packet;
+	struct syncs_handle_packet handle_packet;
+};
+
+/* record is encoded as syncs_write() would send it, the server reads them one by one from the stream */
+static uint32_t syncs_write_encode(struct syncs_connect *s, uint32_t flags, syncsid_t *id, void *data, uint32_t data_size,
+	union syncs_write_record *record)
+{
+	struct syncs_header header;
+	uint32_t type = SYNCS_TYPE_WRITE | (flags & (SYNCS_TYPE_VAR_MASK | SYNCS_TYPE_FLAGS_MASK));
+	uint32_t value;
+	int handle;
+
+	if (data == NULL)
+		data_size = 0;
+	syncs_fill_header(&header, id, type);
+	header.data_size = data_size;
+	handle = (s->server_protocol & SYNCS_PROTOCOL_HANDLE) && !syncs_write_find_handle(s, id, &value);
+	if (s->server_protocol & SYNCS_PROTOCOL_V3)
+		return syncs_frame_encode(record->frame, &header, data, __atomic_fetch_add(&s->tx_sequence, 1, __ATOMIC_RELAXED),
+			handle ? &value : NULL);
+	if (handle) {
+		record->handle_packet.header.magic = SYNCS_PACKET_MAGIC_HANDLE;
+		record->handle_packet.header.magic_data = SYNCS_PACKET_MAGIC_DATA;
+		record->handle_packet.header.type = type;
+		record->handle_packet.header.update_counter = 0;
+		record->handle_packet.header.data_size = data_size;
+		record->handle_packet.header.handle = value;
+		memcpy(record->handle_packet.buffer, data, data_size);
+		return SYNCS_HANDLE_PACKET_SIZE(&record->handle_packet);
+	}
+	memcpy(&record->packet.header, &header, sizeof(struct syncs_header));
+	memcpy(record->packet.buffer, data, data_size);
+	return SYNCS_PACKET_SIZE(&record->packet);
+}
+
+/*
+ * Value of corked write waits in the buffer, with squashing it overwrites the waiting value of variable.
+ * Returns 1 when the connection isn't corked anymore.
+ */
+static int syncs_cork_write(struct syncs_connect *s, uint32_t flags, syncsid_t *id, void *data, uint32_t data_size)
+{
+	union syncs_write_record record;
+	struct syncs_cork_record *r;
+	struct itimerspec timer;
+	uint32_t size;
+	int ret = 0;
+
+	pthread_mutex_lock(&s->cork_mutex);
+	// cork was removed meanwhile, the value goes at once
+	if (!s->cork) {
+		pthread_mutex_unlock(&s->cork_mutex);
+		return 1;
+	}
+	size = syncs_write_encode(s, flags, id, data, data_size, &record);
+	if (s->cork & SYNCS_CORK_SQUASH) {
+		r = syncs_hash_find_id(&s->cork_index, id);
+		if ((r != NULL) && (r->size == size)) {
+			memcpy(s->cork_buffer + r->offset, &record, size);
+			pthread_mutex_unlock(&s->cork_mutex);
+			return 0;
+		}
+		// value of another size goes after the old one, the later wins on the server
+		if (r != NULL)
+			syncs_hash_remove_id(&s->cork_index, r);
+	}
+	// the record is not queued behind a lost flush, the caller sees the failed write
+	if (((s->cork_size + size > SYNCS_CLIENT_BATCH_SIZE) || (s->cork_count == SYNCS_CLIENT_CORK_RECORDS)) &&
+		((ret = syncs_cork_send_locked(s)) != 0)) {
+		pthread_mutex_unlock(&s->cork_mutex);
+		return ret;
+	}
+	if (!s->cork_count && s->cork_us && (s->cork_timerfd >= 0)) {
+		memset(&timer, 0, sizeof(timer));
+		timer.it_value.tv_sec = s->cork_us / 1000000;
+		timer.it_value.tv_nsec = (s->cork_us % 1000000) * 1000;
+		timerfd_settime(s->cork_timerfd, 0, &timer, NULL);
+	} else if (!s->cork_count && s->cork_us)
+		s->cork_deadline_us = syncs_monotonic_us() + s->cork_us;
+	r = &s->cork_records[s->cork_count++];
+	syncs_idcpy(&r->id, id);
+	r->offset = s->cork_size;
+	r->size = size;
+	if (s->cork & SYNCS_CORK_SQUASH)
+		syncs_hash_insert_id(&s->cork_index, r);
+	memcpy(s->cork_buffer + s->cork_size, &record, size);
+	s->cork_size += size;
+	pthread_mutex_unlock(&s->cork_mutex);
+	return ret;
+}
+
 int syncs_write(struct syncs_connect *s, uint32_t flags, const char *cid, void *data, uint32_t data_size)
 {
 	struct syncs_packet packet;
-	uint32_t size = sizeof(struct syncs_header);
 	int ret;
 
 	syncsd_debug("data ptr %p", s);
 	syncs_idstr(&packet.header.id, cid);
+	if ((flags & SYNCS_TYPE_VAR_MASK) == SYNCS_TYPE_VAR_HUGE)
+		return syncs_write_huge(s, flags, &packet.header.id, data, data_size);
+	if (!data_size)
+		data_size = syncs_get_size_by_type(flags);
+	if (data_size > SYNCS_VARIABLE_SIZE_MAXIMUM)
+		return -EMSGSIZE;
+	if (s->cork && (s->socketfd > 0) && ((ret = syncs_cork_write(s, flags, &packet.header.id, data, data_size)) <= 0))
+		return ret;
+
+	if (s->server_protocol & SYNCS_PROTOCOL_HANDLE) {
+		ret = syncs_write_handle(s, flags, &packet.header.id, data, data_size);
+		if (ret != -ENOENT)
+			return ret;
+	}
 
 	syncs_fill_header_str (&packet.header, cid, SYNCS_TYPE_WRITE | (flags & (SYNCS_TYPE_VAR_MASK | SYNCS_TYPE_FLAGS_MASK)));
 
-	if (!data_size)
-		data_size = syncs_get_size_by_type(flags);
 	if (data_size && data != NULL) {
 		memcpy(packet.buffer, data, data_size);
 		packet.header.data_size = data_size & SYNCS_VARIABLE_SIZE_MAXIMUM;
-		size += packet.header.data_size;
 	} else packet.header.data_size = 0;
 
-	ret = syncs_connect_send(s, &packet, size);
+	ret = syncs_connect_send_packet(s, &packet);
 	syncsd_debug("write [%s] type 0x%08x, data_size %d", cid, packet.header.type, packet.header.data_size);
 	return ret;
 }
 
+struct syncs_write_batch *syncs_write_batch_begin(struct syncs_connect *s)
+{
+	struct syncs_write_batch *b = NULL;
+
+	if (!__atomic_exchange_n(&s->batch_busy, 1, __ATOMIC_ACQUIRE)) {
+		if (s->batch == NULL)
+			s->batch = malloc(sizeof(struct syncs_write_batch));
+		b = s->batch;
+		if (b == NULL)
+			__atomic_store_n(&s->batch_busy, 0, __ATOMIC_RELEASE);
+	}
+	if (b == NULL)
+		b = malloc(sizeof(struct syncs_write_batch));
+	if (b == NULL)
+		return NULL;
+	b->connect = s;
+	b->size = 0;
+	b->count = 0;
+	b->error = 0;
+	return b;
+}
+
+/* full buffer is sent on its own, records keep their order anyway */
+static void syncs_write_batch_send(struct syncs_write_batch *b)
+{
+	int ret;
+
+	if (!b->size)
+		return;
+	ret = syncs_connect_send(b->connect, b->buffer, b->size);
+	if (ret && !b->error)
+		b->error = ret;
+	b->size = 0;
+}
+
+int syncs_write_batch_add(struct syncs_write_batch *b, uint32_t flags, const char *cid, void *data, uint32_t data_size)
+{
+	struct syncs_connect *s = b->connect;
+	union syncs_write_record record;
+	syncsid_t id;
+	uint32_t size;
+
+	if ((flags & SYNCS_TYPE_VAR_MASK) == SYNCS_TYPE_VAR_HUGE)
+		return -ENOTSUP;
+	// datagram takes one record only, so udp connection writes at once
+	if (s->socketfd <= 0)
+		return syncs_write(s, flags, cid, data, data_size);
+	if (!data_size)
+		data_size = syncs_get_size_by_type(flags);
+	if (data_size > SYNCS_VARIABLE_SIZE_MAXIMUM)
+		return -EMSGSIZE;
+
+	syncs_idstr(&id, cid);
+	size = syncs_write_encode(s, flags, &id, data, data_size, &record);
+	if (b->size + size > SYNCS_CLIENT_BATCH_SIZE)
+		syncs_write_batch_send(b);
+	memcpy(b->buffer + b->size, &record, size);
+	b->size += size;
+	b->count++;
+	return 0;
+}
+
+int syncs_write_batch_commit(struct syncs_write_batch *b)
+{
+	int ret;
+
+	syncs_write_batch_send(b);
+	ret = b->error;
+	syncsd_debug("write batch of %u records, ret %d", b->count, ret);
+	if (b == b->connect->batch)
+		__atomic_store_n(&b->connect->batch_busy, 0, __ATOMIC_RELEASE);
+	else free(b);
+	return ret;
+}
+
 int syncs_write_int32(struct syncs_connect *s, uint32_t flags, const char *id, int32_t data)
 {
 	syncsd_debug("data ptr %p", s);
@@ -251,50 +674,259 @@ int syncs_write_event(struct syncs_connect *s, uint32_t flags, const char *id)
 	return(syncs_write(s, flags | SYNCS_TYPE_VAR_EMPTY, id, NULL, 0));
 }
 
-const char *syncs_wait_event(struct syncs_connect *s, uint32_t *flags, void *data, uint32_t *data_size, unsigned int timeout_sec)
+static int syncs_queue_push(struct syncs_event_queue *q, struct syncs_client_event *event, uint64_t sequence)
 {
-	struct syncs_client_event *event = s->events_queue;
+	struct syncs_event_slot *slot;
+	uint64_t position = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+	int64_t diff;
 
-	if (event == NULL) {
-		if (syncs_wait_for(&s->event_wait, &s->event_wait_mutex, &s->event_wait_cond, timeout_sec))
-			return NULL;
-		event = s->events_queue;
-		if (event == NULL)
-			return NULL;
+	while (1) {
+		slot = &q->slots[position & q->mask];
+		diff = (int64_t) (__atomic_load_n(&slot->position, __ATOMIC_ACQUIRE) - position);
+		if (diff < 0)
+			return -1;
+		if ((diff == 0) && __atomic_compare_exchange_n(&q->tail, &position, position + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			break;
+		if (diff > 0)
+			position = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
 	}
+	slot->id = event->id;
+	slot->sequence = sequence;
+	slot->flags = event->flags;
+	slot->size = event->data_size;
+	memcpy(slot->data, event->data, event->data_size);
+	__atomic_store_n(&slot->position, position + 1, __ATOMIC_RELEASE);
+	return 0;
+}
 
-	pthread_mutex_lock(&event->data_mutex);
-	*flags = event->flags;
-	if (*data_size > event->data_size)
-		*data_size = event->data_size;
-	memcpy(data, event->data, *data_size);
-	s->events_queue = NULL;
+/* out is NULL when the oldest event is dropped */
+static int syncs_queue_pop(struct syncs_event_queue *q, struct syncs_queued_event *out)
+{
+	struct syncs_event_slot *slot;
+	uint64_t position = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+	int64_t diff;
+
+	while (1) {
+		slot = &q->slots[position & q->mask];
+		diff = (int64_t) (__atomic_load_n(&slot->position, __ATOMIC_ACQUIRE) - (position + 1));
+		if (diff < 0)
+			return 0;
+		if ((diff == 0) && __atomic_compare_exchange_n(&q->head, &position, position + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			break;
+		if (diff > 0)
+			position = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+	}
+	if (out != NULL) {
+		memcpy(out->id, slot->id.c, sizeof(syncsid_t));
+		out->flags = slot->flags;
+		out->sequence = slot->sequence;
+		if (out->data_size > slot->size)
+			out->data_size = slot->size;
+		memcpy(out->data, slot->data, out->data_size);
+	}
+	__atomic_store_n(&slot->position, position + q->mask + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+/* conflated events are taken only from the empty ring, so the queued values of variable go first */
+static int syncs_queue_take(struct syncs_connect *s, struct syncs_event_queue *q, struct syncs_queued_event *out)
+{
+	struct syncs_client_event *event;
+	uint64_t bits, bit;
+	int i, index;
+
+	if (syncs_queue_pop(q, out))
+		return 1;
+	for (i = 0; i < SYNCS_EVENT_MAXIMUM / 64; i++) {
+		bits = __atomic_load_n(&q->pending[i], __ATOMIC_ACQUIRE);
+		while (bits) {
+			index = __builtin_ctzll(bits);
+			bit = 1ULL << index;
+			bits &= ~bit;
+			event = &s->events[i * 64 + index];
+			pthread_mutex_lock(&event->data_mutex);
+			if (__atomic_fetch_and(&q->pending[i], ~bit, __ATOMIC_ACQ_REL) & bit) {
+				memcpy(out->id, event->id.c, sizeof(syncsid_t));
+				out->flags = event->flags;
+				out->sequence = event->queue_sequence;
+				if (out->data_size > event->data_size)
+					out->data_size = event->data_size;
+				memcpy(out->data, event->data, out->data_size);
+				pthread_mutex_unlock(&event->data_mutex);
+				return 1;
+			}
+			pthread_mutex_unlock(&event->data_mutex);
+		}
+	}
+	return 0;
+}
+
+/* called by receive thread with data mutex of event, the value is in event data already */
+static void syncs_queue_event(struct syncs_connect *s, struct syncs_client_event *event)
+{
+	struct syncs_event_queue *q = __atomic_load_n(&s->events_queue, __ATOMIC_ACQUIRE);
+	uint32_t index = event - s->events;
+	uint64_t bit = 1ULL << (index % 64);
+	uint64_t *pending;
+
+	if (q == NULL)
+		return;
+	pending = &q->pending[index / 64];
+	event->queue_sequence = __atomic_fetch_add(&q->sequence, 1, __ATOMIC_RELAXED);
+	if (__atomic_load_n(pending, __ATOMIC_ACQUIRE) & bit) {
+		// conflated value waits already, the new one replaces it
+		__atomic_fetch_add(&q->overflow, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	if (event->data_size > SYNCS_CLIENT_QUEUE_PAYLOAD) {
+		// huge value doesn't fit the slot and waits in event data
+		__atomic_fetch_or(pending, bit, __ATOMIC_RELEASE);
+		return;
+	}
+	while (syncs_queue_push(q, event, event->queue_sequence))
+		switch (s->queue_policy) {
+		case SYNCS_QUEUE_DROP_NEWEST:
+			__atomic_fetch_add(&q->overflow, 1, __ATOMIC_RELAXED);
+			return;
+		case SYNCS_QUEUE_CONFLATE:
+			__atomic_fetch_add(&q->overflow, 1, __ATOMIC_RELAXED);
+			__atomic_fetch_or(pending, bit, __ATOMIC_RELEASE);
+			return;
+		default:
+			// nothing is dropped while a waiter still copies the oldest slot
+			if (syncs_queue_pop(q, NULL))
+				__atomic_fetch_add(&q->overflow, 1, __ATOMIC_RELAXED);
+			break;
+		}
+}
+
+static int syncs_queue_create(struct syncs_connect *s)
+{
+	struct syncs_event_queue *q;
+	uint32_t entries = s->queue_entries, i;
+	size_t size;
+	int ret = 0;
+
+	pthread_mutex_lock(&s->event_mutex);
+	if (s->events_queue != NULL)
+		goto out;
+	size = sizeof(struct syncs_event_queue) + entries * sizeof(struct syncs_event_slot);
+	if (posix_memalign((void **) &q, 64, size)) {
+		syncsd_error("couldn't allocate event queue of %u entries", entries);
+		ret = -ENOMEM;
+		goto out;
+	}
+	memset(q, 0, size);
+	q->mask = entries - 1;
+	for (i = 0; i < entries; i++)
+		q->slots[i].position = i;
+	__atomic_store_n(&s->events_queue, q, __ATOMIC_RELEASE);
+out:
+	pthread_mutex_unlock(&s->event_mutex);
+	return ret;
+}
+
+int syncs_set_event_queue(struct syncs_connect *s, uint32_t entries, uint32_t policy)
+{
+	uint32_t real_entries = 2;
+
+	if (policy > SYNCS_QUEUE_CONFLATE)
+		return -EINVAL;
+	if (!entries)
+		entries = SYNCS_CLIENT_QUEUE_ENTRIES;
+	while (real_entries < entries)
+		real_entries <<= 1;
+	pthread_mutex_lock(&s->event_mutex);
+	// ring is shared with receive thread, its size is fixed once it exists
+	if ((s->events_queue != NULL) && (s->events_queue->mask + 1 != real_entries)) {
+		pthread_mutex_unlock(&s->event_mutex);
+		return -EBUSY;
+	}
+	s->queue_entries = real_entries;
+	s->queue_policy = policy;
+	pthread_mutex_unlock(&s->event_mutex);
+	return 0;
+}
+
+uint64_t syncs_get_event_overflow(struct syncs_connect *s)
+{
+	struct syncs_event_queue *q = __atomic_load_n(&s->events_queue, __ATOMIC_ACQUIRE);
+
+	return (q != NULL) ? __atomic_load_n(&q->overflow, __ATOMIC_RELAXED) : 0;
+}
+
+static int syncs_queue_take_many(struct syncs_connect *s, struct syncs_event_queue *q, struct syncs_queued_event *events, uint32_t count)
+{
+	uint32_t n = 0;
+
+	while ((n < count) && syncs_queue_take(s, q, &events[n]))
+		n++;
+	return n;
+}
+
+int syncs_wait_events(struct syncs_connect *s, struct syncs_queued_event *events, uint32_t count, unsigned int timeout_sec)
+{
+	struct syncs_event_queue *q = __atomic_load_n(&s->events_queue, __ATOMIC_ACQUIRE);
+	int n, ret;
+
+	if (!count)
+		return -EINVAL;
+	// waiter before the first sync subscription gets the ring which subscription will fill
+	if ((q == NULL) && ((ret = syncs_queue_create(s)) != 0))
+		return ret;
+	q = __atomic_load_n(&s->events_queue, __ATOMIC_ACQUIRE);
+	if ((n = syncs_queue_take_many(s, q, events, count)))
+		return n;
+
+	// waiter is marked before the last look, so an event queued after it notifies
+	pthread_mutex_lock(&s->event_wait_mutex);
 	s->event_wait = 1;
-	pthread_mutex_unlock(&event->data_mutex);
+	pthread_mutex_unlock(&s->event_wait_mutex);
+	if ((n = syncs_queue_take_many(s, q, events, count)))
+		return n;
+	ret = syncs_wait_for(s, &s->event_wait, &s->event_wait_mutex, &s->event_wait_cond, timeout_sec);
+	if (ret)
+		return (ret == -ETIMEDOUT) ? 0 : ret;
+	return syncs_queue_take_many(s, q, events, count);
+}
 
-	return event->id.c;
+const char *syncs_wait_event(struct syncs_connect *s, uint32_t *flags, void *data, uint32_t *data_size, unsigned int timeout_sec)
+{
+	struct syncs_queued_event event;
+	struct syncs_client_event *subscription;
+	syncsid_t id;
+
+	// id of the subscription slot stays for the caller, events of dropped subscriptions are skipped
+	do {
+		event.data = data;
+		event.data_size = *data_size;
+		if (syncs_wait_events(s, &event, 1, timeout_sec) <= 0)
+			return NULL;
+		memcpy(id.c, event.id, sizeof(syncsid_t));
+	} while ((subscription = syncs_find_event(s, &id)) == NULL);
+	*flags = event.flags;
+	*data_size = event.data_size;
+	return subscription->id.c;
 }
 
 int syncs_client_send_channel_anons(struct syncs_connect *s, syncsid_t *id, struct syncs_channel_ticket *ticket)
 {
 	struct syncs_packet packet;
-	uint32_t size = sizeof(struct syncs_header) + sizeof(struct syncs_channel_ticket);
 
 	syncs_fill_header(&packet.header, id, SYNCS_TYPE_CHANNEL | SYNCS_CHANNEL_ANONS);
 	packet.header.data_size = sizeof(struct syncs_channel_ticket);
 
 	memcpy(packet.buffer, ticket, sizeof(struct syncs_channel_ticket));
-	syncs_connect_send(s, &packet, size);
+	syncs_connect_send_packet(s, &packet);
 	return 0;
 }
 
 int syncs_define(struct syncs_connect *s, const char *cid, uint32_t flags)
 {
 	struct syncs_packet packet;
-	uint32_t size = sizeof(struct syncs_header);
 
 	syncs_fill_header_request_str(&packet.header, cid, SYNCS_TYPE_DEFINE | (flags & (SYNCS_TYPE_VAR_MASK | SYNCS_TYPE_FLAGS_MASK)));
-	syncs_connect_send(s, &packet, size);
+	syncs_connect_send_packet(s, &packet);
 	syncsd_debug("sent define event");
 	return 0;
 }
@@ -302,10 +934,9 @@ int syncs_define(struct syncs_connect *s, const char *cid, uint32_t flags)
 int syncs_undefine(struct syncs_connect *s, const char *cid)
 {
 	struct syncs_packet packet;
-	uint32_t size = sizeof(struct syncs_header);
 
 	syncs_fill_header_request_str(&packet.header, cid, SYNCS_TYPE_DEFINE);
-	syncs_connect_send(s, &packet, size);
+	syncs_connect_send_packet(s, &packet);
 	syncsd_debug("sent undefine event");
 	return 0;
 }
@@ -313,12 +944,11 @@ int syncs_undefine(struct syncs_connect *s, const char *cid)
 static int syncs_client_send_subscribe(struct syncs_connect *s, syncsid_t *id, int flags, uint64_t update_counter)
 {
 	struct syncs_packet packet;
-	int size = sizeof(struct syncs_header);
 
-	syncs_fill_header_request_id(&packet.header, id, SYNCS_TYPE_SUBSCRIBE | (flags & (SYNCS_TYPE_VAR_MASK | SYNCS_TYPE_FLAGS_MASK)));
+	syncs_fill_header_request_id(&packet.header, id, SYNCS_TYPE_SUBSCRIBE | (flags & (SYNCS_TYPE_VAR_MASK | SYNCS_TYPE_FLAGS_MASK | SYNCS_TYPE_OPTIONS_MASK)));
 	packet.header.update_counter = update_counter;
 
-	syncs_connect_send(s, &packet, size);
+	syncs_connect_send_packet(s, &packet);
 	syncsd_debug("sent subscribe event");
 	return 0;
 }
@@ -326,10 +956,9 @@ static int syncs_client_send_subscribe(struct syncs_connect *s, syncsid_t *id, i
 static int syncs_client_send_unsubscribe(struct syncs_connect *s, syncsid_t *id, int flags)
 {
 	struct syncs_packet packet;
-	int size = sizeof(struct syncs_header);
 
 	syncs_fill_header_request_id(&packet.header, id, SYNCS_TYPE_UNSUBSCRIBE | (flags & (SYNCS_TYPE_VAR_MASK | SYNCS_TYPE_FLAGS_MASK)));
-	syncs_connect_send(s, &packet, size);
+	syncs_connect_send_packet(s, &packet);
 	syncsd_debug("sent unsubscribe event");
 	return 0;
 }
@@ -341,7 +970,9 @@ static int syncs_client_send_id(struct syncs_connect *s, syncsid_t *id)
 	syncs_fill_header_request_id(&packet, id, SYNCS_TYPE_CLIENT_ID);
 	packet.sync.data0 = SYNCS_VERSION_MAJOR;
 	packet.sync.data1 = SYNCS_VERSION_MINOR;
+	packet.update_counter = ((uint64_t) SYNCS_PROTOCOL_SIGNATURE << 32) | s->protocol;
 
+	// always v2, the server learns from this packet which format the client reads
 	syncs_connect_send(s, &packet, sizeof(struct syncs_header));
 	syncsd_debug("sent client id");
 	return 0;
@@ -362,7 +993,48 @@ static void syncs_send_id(struct syncs_connect * s)
 	}
 }
 
-int syncs_subscribe_event(struct syncs_connect *s, int flags, const char *cid, void (*cb)(void *, char *, void *, uint32_t), void *args)
+static int syncs_executor_start(struct syncs_connect *s, uint32_t workers)
+{
+	struct syncs_executor *e;
+	int ret = 0;
+
+	pthread_mutex_lock(&s->event_mutex);
+	if (s->executor != NULL) {
+		ret = -EBUSY;
+		goto out;
+	}
+	e = syncs_executor_create(workers, SYNCS_EVENT_MAXIMUM);
+	if (e == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	__atomic_store_n(&s->executor, e, __ATOMIC_RELEASE);
+out:
+	pthread_mutex_unlock(&s->event_mutex);
+	return ret;
+}
+
+int syncs_set_executor(struct syncs_connect *s, uint32_t workers)
+{
+	if (!workers)
+		workers = SYNCS_CLIENT_EXECUTOR_WORKERS;
+	if (workers > SYNCS_EXECUTOR_WORKERS_MAXIMUM)
+		return -EINVAL;
+	return syncs_executor_start(s, workers);
+}
+
+void syncs_get_executor_stats(struct syncs_connect *s, uint64_t *executed, uint64_t *stolen)
+{
+	struct syncs_executor *e = __atomic_load_n(&s->executor, __ATOMIC_ACQUIRE);
+
+	*executed = 0;
+	*stolen = 0;
+	if (e != NULL)
+		syncs_executor_get_stats(e, executed, stolen);
+}
+
+static int syncs_subscribe_event_mode(struct syncs_connect *s, int flags, const char *cid, void (*cb)(void *, char *, void *, uint32_t), void *args,
+	int async)
 {
 	struct syncs_client_event *event = syncs_get_event_str(s, cid);
 	if (event == NULL)
@@ -370,23 +1042,58 @@ int syncs_subscribe_event(struct syncs_connect *s, int flags, const char *cid, v
 
 	syncsd_debug("data ptr s = %p; id = %s cb = %p event = %p ", s, cid, cb, event);
 
+	event->async = async;
 	event->cb = cb;
 	event->args = args;
 	event->flags = flags;
 	syncs_idstr(&event->id, cid);
-	if (s->socketfd >= 0) {
+	syncs_bind_handle(s, event);
+	if ((s->socketfd >= 0) || (s->usocketfd >= 0)) {
 		syncs_client_send_subscribe(s, &event->id, flags, event->update_counter);
 		syncsd_debug("event registrated");
 	}
 	return 0;
 }
 
-int syncs_subscribe_event_sync_user(struct syncs_connect *s, uint32_t flags, const char *cid, void *user_data, uint32_t user_data_size)
+int syncs_subscribe_event(struct syncs_connect *s, int flags, const char *cid, void (*cb)(void *, char *, void *, uint32_t), void *args)
+{
+	return syncs_subscribe_event_mode(s, flags, cid, cb, args, 0);
+}
+
+int syncs_subscribe_event_async(struct syncs_connect *s, int flags, const char *cid, void (*cb)(void *, char *, void *, uint32_t), void *args)
+{
+	int ret;
+
+	if (__atomic_load_n(&s->executor, __ATOMIC_ACQUIRE) == NULL) {
+		ret = syncs_executor_start(s, SYNCS_CLIENT_EXECUTOR_WORKERS);
+		if (ret && (ret != -EBUSY))
+			return ret;
+	}
+	return syncs_subscribe_event_mode(s, flags, cid, cb, args, 1);
+}
+
+int syncs_subscribe_stream(struct syncs_connect *s, uint32_t flags, const char *cid, void (*cb)(void *, char *, void *, uint32_t),
+	void (*gap_cb)(void *, char *, uint64_t), void *args)
 {
 	struct syncs_client_event *event = syncs_get_event_str(s, cid);
 	if (event == NULL)
 		return -ENOMEM;
 
+	event->gap_cb = gap_cb;
+	event->stream_sequence = 0;
+	return syncs_subscribe_event(s, flags | SYNCS_TYPE_VAR_STREAM, cid, cb, args);
+}
+
+int syncs_subscribe_event_sync_user(struct syncs_connect *s, uint32_t flags, const char *cid, void *user_data, uint32_t user_data_size)
+{
+	struct syncs_client_event *event;
+
+	if (syncs_queue_create(s))
+		return -ENOMEM;
+	event = syncs_get_event_str(s, cid);
+	if (event == NULL)
+		return -ENOMEM;
+
 	syncsd_debug("data ptr s = %p; id = %s data = %p event = %p ", s, cid, user_data, event);
 
 	pthread_mutex_lock(&event->data_mutex);
@@ -398,7 +1105,8 @@ int syncs_subscribe_event_sync_user(struct syncs_connect *s, uint32_t flags, con
 
 	event->flags = flags;
 	syncs_idstr(&event->id, cid);
-	if (s->socketfd >= 0) {
+	syncs_bind_handle(s, event);
+	if ((s->socketfd >= 0) || (s->usocketfd >= 0)) {
 		syncs_client_send_subscribe(s, &event->id, flags, event->update_counter);
 		syncsd_debug("sync event registrated");
 	}
@@ -408,7 +1116,11 @@ int syncs_subscribe_event_sync_user(struct syncs_connect *s, uint32_t flags, con
 int syncs_subscribe_event_sync(struct syncs_connect *s, uint32_t flags, const char *cid)
 {
 	uint8_t *event_data;
-	struct syncs_client_event *event = syncs_get_event_str(s, cid);
+	struct syncs_client_event *event;
+
+	if (syncs_queue_create(s))
+		return -ENOMEM;
+	event = syncs_get_event_str(s, cid);
 	if (event == NULL)
 		return -ENOMEM;
 
@@ -425,7 +1137,8 @@ int syncs_subscribe_event_sync(struct syncs_connect *s, uint32_t flags, const ch
 
 	event->flags = flags;
 	syncs_idstr(&event->id, cid);
-	if (s->socketfd >= 0) {
+	syncs_bind_handle(s, event);
+	if ((s->socketfd >= 0) || (s->usocketfd >= 0)) {
 		syncs_client_send_subscribe(s, &event->id, flags, event->update_counter);
 		syncsd_debug("sync event registrated");
 	}
@@ -441,31 +1154,30 @@ void syncs_unsubscribe_event(struct syncs_connect *s, const char *cid)
 	event = syncs_find_event(s, &id);
 	if (event != NULL) {
 		syncs_client_send_unsubscribe(s, &event->id, event->flags);
-		event->id.i[0] = -1;
+		syncs_unbind_handle(s, event);
+		event->gap_cb = NULL;
+		event->stream_sequence = 0;
+		syncs_put_event(s, event);
 	}
 	return;
 }
 
-void syncs_process_event(struct syncs_connect *s, struct syncs_packet *packet)
+static void syncs_deliver_event(struct syncs_connect *s, struct syncs_client_event *event, void *data, uint32_t data_size, uint64_t update_counter)
 {
-	struct syncs_client_event *event;
 	void (*cb)(void *, char *, void *, uint32_t);
-	syncsid_t *id = &(packet->header.id);
-	void *data = packet->buffer;
-	uint16_t data_size = packet->header.data_size;
-	uint64_t update_counter = packet->header.update_counter;
 
-	event = syncs_find_event(s, id);
 	if (event != NULL) {
 		cb = event->cb;
 		syncsd_debug("cb = %p", cb);
-		if (cb != NULL)
+		// callback runs inline when the value can't be queued for the workers
+		if ((cb != NULL) && (!event->async ||
+			syncs_executor_post(s->executor, event - s->events, cb, event->args, &event->id, data, data_size)))
 			cb(event->args, (char *) &event->id, data, data_size);
 		if (event->data != NULL) {
 			pthread_mutex_lock(&event->data_mutex);
-			memcpy(event->data, data, data_size);
-			event->data_size = data_size;
-			s->events_queue = event;
+			event->data_size = MIN(data_size, event->data_user_size);
+			memcpy(event->data, data, event->data_size);
+			syncs_queue_event(s, event);
 			pthread_mutex_unlock(&event->data_mutex);
 			syncs_notify_for(&s->event_wait, &s->event_wait_mutex, &s->event_wait_cond);
 		}
@@ -473,14 +1185,157 @@ void syncs_process_event(struct syncs_connect *s, struct syncs_packet *packet)
 	}
 }
 
-static void syncs_channel_process_packet(struct syncs_connect * s, struct syncs_packet *packet)
+/* huge value is delivered only when the last chunk comes */
+static void syncs_receive_chunk(struct syncs_connect *s, struct syncs_client_event *event, struct syncs_header *header, char *data)
+{
+	struct syncs_huge_chunk chunk;
+	uint32_t size;
+	uint8_t *huge_data;
+
+	if ((event == NULL) || (header->data_size < sizeof(struct syncs_huge_chunk)))
+		return;
+	memcpy(&chunk, data, sizeof(struct syncs_huge_chunk));
+	size = header->data_size - sizeof(struct syncs_huge_chunk);
+	if ((chunk.size > SYNCS_HUGE_SIZE_MAXIMUM) || (chunk.offset > chunk.size) || (size > chunk.size - chunk.offset))
+		return;
+
+	if (chunk.offset == 0) {
+		if (chunk.size > event->huge_capacity) {
+			huge_data = realloc(event->huge_data, chunk.size);
+			if (huge_data == NULL) {
+				syncsd_error("couldn't allocate %u bytes for %s", chunk.size, event->id.c);
+				return;
+			}
+			event->huge_data = huge_data;
+			event->huge_capacity = chunk.size;
+		}
+		event->huge_transfer = chunk.transfer;
+		event->huge_size = chunk.size;
+		event->huge_offset = 0;
+	} else if ((chunk.transfer != event->huge_transfer) || (chunk.offset != event->huge_offset) || (chunk.size != event->huge_size)) {
+		syncsd_debug("lost chunk of %s", event->id.c);
+		return;
+	}
+	memcpy(event->huge_data + chunk.offset, data + sizeof(struct syncs_huge_chunk), size);
+	event->huge_offset += size;
+	if (event->huge_offset == event->huge_size)
+		syncs_deliver_event(s, event, event->huge_data, event->huge_size, header->update_counter);
+}
+
+/* every element of stream batch is delivered as a separate event */
+static void syncs_receive_batch(struct syncs_connect *s, struct syncs_client_event *event, struct syncs_header *header, char *data)
+{
+	struct syncs_stream_batch batch;
+	struct syncs_stream_element element;
+	uint32_t offset = sizeof(struct syncs_stream_batch);
+	uint32_t i;
+
+	if ((event == NULL) || (header->data_size < sizeof(struct syncs_stream_batch)))
+		return;
+	memcpy(&batch, data, sizeof(struct syncs_stream_batch));
+	if (event->stream_sequence && (batch.sequence > event->stream_sequence + 1)) {
+		syncsd_debug("lost %lu elements of %s", batch.sequence - event->stream_sequence - 1, event->id.c);
+		if (event->gap_cb != NULL)
+			event->gap_cb(event->args, (char *) &event->id, batch.sequence - event->stream_sequence - 1);
+	}
+	for (i = 0; i < batch.count; i++) {
+		if (offset + sizeof(struct syncs_stream_element) > header->data_size)
+			break;
+		memcpy(&element, data + offset, sizeof(struct syncs_stream_element));
+		offset += sizeof(struct syncs_stream_element);
+		if (element.size > header->data_size - offset)
+			break;
+		syncs_deliver_event(s, event, data + offset, element.size, header->update_counter);
+		offset += SYNCS_FRAME_PAD(element.size);
+		event->stream_sequence = batch.sequence + i;
+	}
+}
+
+static void syncs_receive_event(struct syncs_connect *s, struct syncs_client_event *event, struct syncs_header *header, char *data)
+{
+	if ((header->type & SYNCS_TYPE_VAR_MASK) == SYNCS_TYPE_VAR_HUGE)
+		syncs_receive_chunk(s, event, header, data);
+	else if (((header->type & SYNCS_TYPE_VAR_MASK) == SYNCS_TYPE_VAR_STREAM) && (s->server_protocol & SYNCS_PROTOCOL_STREAM))
+		syncs_receive_batch(s, event, header, data);
+	else
+		syncs_deliver_event(s, event, data, header->data_size, header->update_counter);
+}
+
+void syncs_process_event(struct syncs_connect *s, struct syncs_header *header, char *data)
+{
+	syncs_receive_event(s, syncs_find_event(s, &header->id), header, data);
+}
+
+static void syncs_process_handle_event(struct syncs_connect *s, uint32_t value, struct syncs_header *header, char *data)
+{
+	struct syncs_client_handle *handle;
+	struct syncs_client_event *event = NULL;
+
+	if ((header->type & SYNCS_TYPE_MSG_MASK) != SYNCS_TYPE_EVENT)
+		return;
+	if (header->type & SYNCS_TYPE_SYNC)
+		syncs_wait_sync(&header->sync);
+	pthread_mutex_lock(&s->handle_mutex);
+	handle = syncs_hash_find_key(&s->handles_by_key, value);
+	if (handle != NULL)
+		event = handle->event;
+	pthread_mutex_unlock(&s->handle_mutex);
+	syncsd_debug("receive event handle 0x%08x type 0x%08x", value, header->type);
+	syncs_receive_event(s, event, header, data);
+}
+
+static void syncs_process_handle_packet(struct syncs_connect *s, struct syncs_handle_packet *packet)
+{
+	struct syncs_header header;
+
+	header.type = packet->header.type;
+	header.data_size = packet->header.data_size;
+	header.update_counter = packet->header.update_counter;
+	syncs_process_handle_event(s, packet->header.handle, &header, packet->buffer);
+}
+
+static void syncs_process_handle_ack(struct syncs_connect *s, struct syncs_header *header, char *data)
+{
+	struct syncs_client_handle *handle;
+	uint32_t value;
+
+	if (header->data_size != sizeof(uint32_t))
+		return;
+	memcpy(&value, data, sizeof(uint32_t));
+
+	pthread_mutex_lock(&s->handle_mutex);
+	handle = syncs_hash_find_id(&s->handles_by_id, &header->id);
+	if (handle == NULL) {
+		handle = malloc(sizeof(struct syncs_client_handle));
+		if (handle == NULL)
+			goto out;
+		syncs_idcpy(&handle->id, &header->id);
+		if (syncs_hash_insert_id(&s->handles_by_id, handle)) {
+			free(handle);
+			goto out;
+		}
+	} else if (handle->handle != value) {
+		syncs_hash_remove_key(&s->handles_by_key, handle->handle, handle);
+	} else
+		goto out;
+	handle->handle = value;
+	handle->event = syncs_find_event(s, &handle->id);
+	if (syncs_hash_insert_key(&s->handles_by_key, value, handle)) {
+		syncs_hash_remove_id(&s->handles_by_id, handle);
+		free(handle);
+	}
+out:
+	pthread_mutex_unlock(&s->handle_mutex);
+}
+
+static void syncs_channel_process_packet(struct syncs_connect * s, struct syncs_header *header, char *data)
 {
-	switch (packet->header.type & SYNCS_TYPE_CHANNEL_MASK) {
+	switch (header->type & SYNCS_TYPE_CHANNEL_MASK) {
 	case SYNCS_CHANNEL_TICKET:
-		syncsd_debug("receive ticket id %s type 0x%08x", packet->header.id.c, packet->header.type);
+		syncsd_debug("receive ticket id %s type 0x%08x", header->id.c, header->type);
 		pthread_mutex_lock(&s->ticket_mutex);
-		if (s->ticket_wait && syncs_idcmp(&packet->header.id, &s->ticket_id)) {
-			memcpy(&s->ticket_data, packet->buffer, sizeof(struct syncs_channel_ticket));
+		if (s->ticket_wait && syncs_idcmp(&header->id, &s->ticket_id)) {
+			memcpy(&s->ticket_data, data, sizeof(struct syncs_channel_ticket));
 			s->ticket_wait = 0;
 			pthread_cond_signal(&s->ticket_cond);
 		}
@@ -489,9 +1344,9 @@ static void syncs_channel_process_packet(struct syncs_connect * s, struct syncs_
 	}
 }
 
-static void syncs_process_error(struct syncs_connect *s, struct syncs_packet *packet)
+static void syncs_process_error(struct syncs_connect *s, struct syncs_header *header)
 {
-	switch (packet->header.update_counter) {
+	switch (header->update_counter) {
 	case SYNCS_ERROR_NOTSUPPORT:
 		s->onexit = 1;
 		syncsd_error("Server does not support the client protocol version");
@@ -506,28 +1361,47 @@ static void syncs_process_error(struct syncs_connect *s, struct syncs_packet *pa
 	}
 }
 
-static void syncs_process_packet(struct syncs_connect * s, struct syncs_packet *packet)
+static int syncs_grow_list(void **list, int *list_size, int count, size_t item_size)
 {
-	struct syncs_header *packet_header;
-	char *data;
+	void *items;
+	int size = *list_size;
 
-	//TODO: add packet decoder
-	packet_header = &packet->header;
-	data = packet->buffer;
+	if (count <= size)
+		return 0;
+	while (size < count)
+		size *= 2;
+	items = realloc(*list, size * item_size);
+	if (items == NULL) {
+		syncsd_error("couldn't allocate list for %d items", size);
+		return -ENOMEM;
+	}
+	*list = items;
+	*list_size = size;
+	return 0;
+}
 
+static void syncs_process_packet(struct syncs_connect * s, struct syncs_header *packet_header, char *data)
+{
 	switch (packet_header->type & SYNCS_TYPE_MSG_MASK) {
 	case SYNCS_TYPE_EVENT:
 		syncsd_debug("receive event id %s type 0x%08x", packet_header->id.c, packet_header->type);
 		if (packet_header->type & SYNCS_TYPE_SYNC)
 			syncs_wait_sync(&(packet_header->sync));
-		syncs_process_event(s, packet);
+		syncs_process_event(s, packet_header, data);
 		break;
 	case SYNCS_TYPE_CHANNEL:
-		syncs_channel_process_packet(s, packet);
+		syncs_channel_process_packet(s, packet_header, data);
+		break;
+	case SYNCS_TYPE_ACK:
+		syncsd_debug("receive handle for id %s", packet_header->id.c);
+		syncs_process_handle_ack(s, packet_header, data);
 		break;
 	case SYNCS_TYPE_SERVER_STATUS:
 		syncs_idcpy(&s->server_id, &packet_header->id);
-		syncs_process_error(s, packet);
+		if (packet_header->sync.data1 == SYNCS_PROTOCOL_SIGNATURE)
+			s->server_protocol = packet_header->sync.data0 & s->protocol;
+		else s->server_protocol = 0;
+		syncs_process_error(s, packet_header);
 		syncsd_debug("receive server status id %s type 0x%08x", s->server_id.c, packet_header->type);
 		break;
 	case SYNCS_TYPE_READ:
@@ -535,7 +1409,7 @@ static void syncs_process_packet(struct syncs_connect * s, struct syncs_packet *
 		pthread_mutex_lock(&s->read_mutex);
 		if (s->read_wait && syncs_idcmp(&packet_header->id, &s->read_id)) {
 			s->read_size = packet_header->data_size;
-			memcpy(s->read_data, packet->buffer, packet_header->data_size);
+			memcpy(s->read_data, data, packet_header->data_size);
 			s->read_wait = 0;
 			pthread_cond_signal(&s->read_cond);
 		}
@@ -549,6 +1423,9 @@ static void syncs_process_packet(struct syncs_connect * s, struct syncs_packet *
 		if (packet_header->id.c[3] != s->eventlist_sequence) return;
 		if (packet_header->id.c[0] != s->eventlist_wait_packet) return;
 
+		if (syncs_grow_list((void **) &s->events_info, &s->eventlist_size,
+				s->eventlist_recv + (uint8_t) packet_header->id.c[2], sizeof(struct syncs_event_info)))
+			return;
 		syncsd_debug("coping %d event list", packet_header->data_size);
 		memcpy(&s->events_info[s->eventlist_recv], data, packet_header->data_size);
 		s->eventlist_recv += packet_header->id.c[2];
@@ -564,6 +1441,9 @@ static void syncs_process_packet(struct syncs_connect * s, struct syncs_packet *
 		if (packet_header->id.c[3] != s->clientlist_sequence) return;
 		if (packet_header->id.c[0] != s->clientlist_wait_packet) return;
 
+		if (syncs_grow_list((void **) &s->clients_info, &s->clientlist_size,
+				s->clientlist_recv + (uint8_t) packet_header->id.c[2], sizeof(struct syncs_client_info)))
+			return;
 		syncsd_debug("coping client list");
 		memcpy(&s->clients_info[s->clientlist_recv], data, packet_header->data_size);
 		s->clientlist_recv += packet_header->id.c[2];
@@ -594,6 +1474,14 @@ static void syncs_process_packet(struct syncs_connect * s, struct syncs_packet *
 	}
 }
 
+static void syncs_process_frame(struct syncs_connect *s, struct syncs_frame *frame)
+{
+	if (frame->fields & SYNCS_FRAME_FIELD_ID)
+		syncs_process_packet(s, &frame->header, frame->data);
+	else
+		syncs_process_handle_event(s, frame->handle, &frame->header, frame->data);
+}
+
 void *syncs_connect_cb_thread(void *server)
 {
 	struct syncs_connect *s = server;
@@ -604,75 +1492,122 @@ void *syncs_connect_cb_thread(void *server)
 	pthread_exit(0);
 }
 
-static void syncs_recv(struct syncs_connect * s)
+/* complete records are dispatched, the rest is kept at the start of buffer */
+static int syncs_recv_parse(struct syncs_connect *s, int buffer_recv)
 {
-	int socketfd = s->socketfd;
-	fd_set set;
-	int res;
-
-	int read_size;
 	struct syncs_header *packet_header;
-	int buffer_head = 0;
-	int buffer_recv = 0;
+	struct syncs_handle_header *handle_header;
+	struct syncs_frame frame;
 	uint8_t *buffer = s->buffer;
+	int buffer_head = 0;
+	int ret;
 
+	while ((buffer_recv - buffer_head) >= sizeof(struct syncs_frame_header)) {
+		packet_header = (struct syncs_header *) (buffer + buffer_head);
+		if (packet_header->magic == SYNCS_PACKET_MAGIC_V3) {
+			ret = syncs_frame_decode(&frame, packet_header, buffer_recv - buffer_head);
+			if (ret == 0) break;
+			if (ret < 0) {
+				buffer_head++;
+				continue;
+			}
+			syncs_process_frame(s, &frame);
+			buffer_head += ret;
+			continue;
+		}
+		if (packet_header->magic == SYNCS_PACKET_MAGIC_HANDLE) {
+			if ((buffer_recv - buffer_head) < sizeof(struct syncs_handle_header)) break;
+			handle_header = (struct syncs_handle_header *) packet_header;
+			if (handle_header->magic_data != SYNCS_PACKET_MAGIC_DATA) {
+				buffer_head++;
+				continue;
+			}
+			handle_header->data_size &= SYNCS_VARIABLE_SIZE_MAXIMUM;
+			if ((buffer_recv - buffer_head) < (sizeof(struct syncs_handle_header) + handle_header->data_size)) break;
+			syncs_process_handle_packet(s, (struct syncs_handle_packet *) handle_header);
+			buffer_head += sizeof(struct syncs_handle_header) + handle_header->data_size;
+			continue;
+		}
+		if (packet_header->magic != SYNCS_PACKET_MAGIC) {
+			buffer_head++;
+			continue;
+		}
+		if ((buffer_recv - buffer_head) < sizeof(struct syncs_header)) break;
+		if (packet_header->magic_data != SYNCS_PACKET_MAGIC_DATA) {
+			buffer_head++;
+			continue;
+		}
+		packet_header->data_size &= SYNCS_VARIABLE_SIZE_MAXIMUM;
+		if ((buffer_recv - buffer_head) < (sizeof(struct syncs_header) + packet_header->data_size)) break;
+		syncs_process_packet(s, packet_header, (char *) (packet_header + 1));
+		buffer_head += sizeof(struct syncs_header) +packet_header->data_size;
+	}
+
+	if (buffer_head < buffer_recv) {
+		if (buffer_head)
+			memmove(buffer, buffer + buffer_head, buffer_recv - buffer_head);
+		return buffer_recv - buffer_head;
+	}
+	return 0;
+}
+
+/* connection is known to the server, the callback of threadless connection runs in the caller */
+static void syncs_connected(struct syncs_connect *s)
+{
 	syncs_send_id(s);
 	if ((s->connect_cb != NULL) && (s->connect_cb_status == 0)) {
-		s->connect_cb_status = 1;
-		pthread_create(&s->connect_thread, NULL, &syncs_connect_cb_thread, (void*) s);
+		if (s->threadless)
+			s->connect_cb(s->connect_arg);
+		else {
+			s->connect_cb_status = 1;
+			pthread_create(&s->connect_thread, NULL, &syncs_connect_cb_thread, (void*) s);
+		}
 	}
-
 	syncs_notify_for(&s->connect_wait, &s->connect_mutex, &s->connect_cond);
+	s->ready = 1;
+}
+
+static void syncs_recv(struct syncs_connect * s)
+{
+	int socketfd = s->socketfd;
+	fd_set set;
+	int res;
+
+	int read_size;
+	int buffer_recv = 0;
 
-	FD_ZERO(&set);
-	FD_SET(socketfd, &set);
+	syncs_connected(s);
 	syncsd_debug("start receive data");
-	s->ready = 1;
 	while (!s->onexit) {
-		res = select(socketfd + 1, &set, NULL, NULL, NULL);
+		FD_ZERO(&set);
+		FD_SET(socketfd, &set);
+		if (s->cork_timerfd >= 0)
+			FD_SET(s->cork_timerfd, &set);
+		res = select(((s->cork_timerfd > socketfd) ? s->cork_timerfd : socketfd) + 1, &set, NULL, NULL, NULL);
 		syncsd_debug("select return %d, errno %d, error[%s]", res, errno, strerror(errno));
 		if (res == 0) continue;
 		if ((res == -1) && (errno == EINTR)) {
 			continue;
 		}
-		read_size = recv(socketfd, buffer + buffer_recv, SYNCS_CLIENT_BUFFER_SIZE - buffer_recv, 0);
+		if ((s->cork_timerfd >= 0) && FD_ISSET(s->cork_timerfd, &set)) {
+			uint64_t expirations;
+
+			if (read(s->cork_timerfd, &expirations, sizeof(expirations)) > 0)
+				syncs_flush(s);
+			if (!FD_ISSET(socketfd, &set))
+				continue;
+		}
+		read_size = recv(socketfd, s->buffer + buffer_recv, SYNCS_CLIENT_BUFFER_SIZE - buffer_recv, 0);
 		syncsd_debug("recv return %d, errno %d, error[%s]", read_size, errno, strerror(errno));
-		if (read_size < (int) sizeof(struct syncs_header)) {
+		if (read_size <= 0) {
 			if (read_size == -1) {
 				if ((errno == EAGAIN) || (errno == EINTR))
 					continue;
 				break;
 			}
-			if (read_size == 0) {
-				break;
-			}
-			continue;
-		}
-
-		buffer_recv += read_size;
-		buffer_head = 0;
-
-		while ((buffer_recv - buffer_head) >= sizeof(struct syncs_header)) {
-			packet_header = (struct syncs_header *) (buffer + buffer_head);
-			if (packet_header->magic != SYNCS_PACKET_MAGIC) {
-				buffer_head++;
-				continue;
-			}
-			if (packet_header->magic_data != SYNCS_PACKET_MAGIC_DATA) {
-				buffer_head++;
-				continue;
-			}
-			packet_header->data_size &= SYNCS_VARIABLE_SIZE_MAXIMUM;
-			if ((buffer_recv - buffer_head) < (sizeof(struct syncs_header) + packet_header->data_size)) break;
-			syncs_process_packet(s, (struct syncs_packet *)packet_header);
-			buffer_head += sizeof(struct syncs_header) +packet_header->data_size;
+			break;
 		}
-
-		if (buffer_head < buffer_recv) {
-			if (buffer_head)
-				memmove(buffer, buffer + buffer_head, buffer_recv - buffer_head);
-			buffer_recv = buffer_recv - buffer_head;
-		} else buffer_recv = 0;
+		buffer_recv = syncs_recv_parse(s, buffer_recv + read_size);
 	}
 	s->ready = 0;
 }
@@ -699,6 +1634,8 @@ void *syncs_connect_thread(void *server)
 		syncs_set_keepalive(s->socketfd, 30, 3);
 		fcntl(s->socketfd, F_SETFD, FD_CLOEXEC);
 		syncs_recv(s);
+		syncs_cork_drop(s);
+		syncs_release_handles(s);
 		shutdown(s->socketfd, SHUT_RDWR);
 		s->socketfd = -1;
 		usleep(1000000);
@@ -706,14 +1643,28 @@ void *syncs_connect_thread(void *server)
 	return NULL;
 }
 
+/* server forgets udp session which is silent, subscriber reminds it about itself */
+static void syncs_send_keepalive(struct syncs_connect *s)
+{
+	struct syncs_header packet;
+
+	syncs_fill_header_request_id(&packet, &s->id, SYNCS_TYPE_EMPTY);
+	syncs_connect_send(s, &packet, sizeof(struct syncs_header));
+	syncsd_debug("sent keepalive");
+}
+
 static void syncs_udprecv(struct syncs_connect * s)
 {
 	int usocketfd = s->usocketfd;
 	fd_set set;
 	int res;
+	struct timespec now, keepalive;
+	struct timeval timeout;
 
 	int read_size;
 	struct syncs_header *packet_header;
+	struct syncs_handle_header *handle_header;
+	struct syncs_frame frame;
 	uint8_t *buffer = s->buffer;
 	struct sockaddr_in addr;
 	socklen_t addr_len;
@@ -725,13 +1676,29 @@ static void syncs_udprecv(struct syncs_connect * s)
 	pthread_cond_signal(&s->connect_cond);
 	pthread_mutex_unlock(&s->connect_mutex);
 
-	FD_ZERO(&set);
-	FD_SET(usocketfd, &set);
 	syncsd_debug("start receive data");
 
+	clock_gettime(CLOCK_MONOTONIC, &keepalive);
+	keepalive.tv_sec += SYNCS_UDP_KEEPALIVE_MS / 1000;
 	s->ready = 1;
 	while (!s->onexit) {
-		res = select(usocketfd + 1, &set, NULL, NULL, NULL);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		// busy subscriber doesn't wait for silence, the keepalive goes on schedule
+		if ((now.tv_sec > keepalive.tv_sec) || ((now.tv_sec == keepalive.tv_sec) && (now.tv_nsec >= keepalive.tv_nsec))) {
+			syncs_send_keepalive(s);
+			keepalive = now;
+			keepalive.tv_sec += SYNCS_UDP_KEEPALIVE_MS / 1000;
+			continue;
+		}
+		timeout.tv_sec = keepalive.tv_sec - now.tv_sec;
+		timeout.tv_usec = (keepalive.tv_nsec - now.tv_nsec) / 1000;
+		if (timeout.tv_usec < 0) {
+			timeout.tv_usec += 1000000;
+			timeout.tv_sec--;
+		}
+		FD_ZERO(&set);
+		FD_SET(usocketfd, &set);
+		res = select(usocketfd + 1, &set, NULL, NULL, &timeout);
 		syncsd_debug("select return %d, errno %d, error[%s]", res, errno, strerror(errno));
 		if (res == 0) continue;
 		if ((res == -1) && (errno == EINTR)) {
@@ -740,6 +1707,19 @@ static void syncs_udprecv(struct syncs_connect * s)
 
 		addr_len = sizeof(struct sockaddr_in);
 		read_size = recvfrom(usocketfd, buffer, SYNCS_CLIENT_BUFFER_SIZE, 0, (struct sockaddr *) &addr, &addr_len);
+		if ((read_size >= (int) sizeof(struct syncs_frame_header)) && (buffer[0] == SYNCS_PACKET_MAGIC_V3)) {
+			if (syncs_frame_decode(&frame, buffer, read_size) > 0)
+				syncs_process_frame(s, &frame);
+			continue;
+		}
+		if ((read_size >= (int) sizeof(struct syncs_handle_header)) && (buffer[0] == SYNCS_PACKET_MAGIC_HANDLE)) {
+			handle_header = (struct syncs_handle_header *) buffer;
+			handle_header->data_size &= SYNCS_VARIABLE_SIZE_MAXIMUM;
+			if ((handle_header->magic_data == SYNCS_PACKET_MAGIC_DATA) &&
+				(read_size >= (int) (sizeof(struct syncs_handle_header) + handle_header->data_size)))
+				syncs_process_handle_packet(s, (struct syncs_handle_packet *) handle_header);
+			continue;
+		}
 		if (read_size < (int) sizeof(struct syncs_header)) {
 			if (read_size == -1) {
 				if ((errno == EAGAIN) || (errno == EINTR))
@@ -760,7 +1740,7 @@ static void syncs_udprecv(struct syncs_connect * s)
 			continue;
 		}
 		packet_header->data_size &= SYNCS_VARIABLE_SIZE_MAXIMUM;
-		syncs_process_packet(s, (struct syncs_packet *)packet_header);
+		syncs_process_packet(s, packet_header, (char *) (packet_header + 1));
 	}
 	s->ready = 0;
 
@@ -786,6 +1766,7 @@ void *syncs_udpconnect_thread(void *server)
 		syncs_set_nonblocking_socket(s->usocketfd, 1024 * 1024, 1024 * 1024);
 		fcntl(s->usocketfd, F_SETFD, FD_CLOEXEC);
 		syncs_udprecv(s);
+		syncs_release_handles(s);
 		close(s->usocketfd);
 		s->usocketfd = -1;
 		usleep(1000000);
@@ -795,7 +1776,7 @@ void *syncs_udpconnect_thread(void *server)
 
 int syncs_connect_wait(struct syncs_connect *s, unsigned int timeout_sec)
 {
-	return syncs_wait_for(&s->connect_wait, &s->connect_mutex, &s->connect_cond, timeout_sec);
+	return syncs_wait_for(s, &s->connect_wait, &s->connect_mutex, &s->connect_cond, timeout_sec);
 }
 
 
@@ -821,6 +1802,14 @@ static void syncs_connect_structure_init(struct syncs_connect * s)
 	syncs_connect_mutex_init (&s->clientlist_mutex, &s->clientlist_cond, &attr);
 	syncs_connect_mutex_init (&s->ticket_mutex, &s->ticket_cond, &attr);
 	syncs_connect_mutex_init (&s->connect_mutex, &s->connect_cond, &attr);
+	pthread_mutex_init(&s->handle_mutex, NULL);
+	pthread_mutex_init(&s->huge_mutex, NULL);
+	pthread_mutex_init(&s->cork_mutex, NULL);
+	pthread_mutex_init(&s->event_mutex, NULL);
+	// all subscriptions fit without resize of the table
+	syncs_hash_init(&s->events_by_id, SYNCS_EVENT_MAXIMUM * 2);
+	syncs_hash_init(&s->handles_by_id, 0);
+	syncs_hash_init(&s->handles_by_key, 0);
 
 	s->socketfd = -1;
 	s->usocketfd = -1;
@@ -833,6 +1822,10 @@ static void syncs_connect_structure_init(struct syncs_connect * s)
 	s->connect_wait = 1;
 	s->event_wait = 1;
 	s->current_key = NULL;
+	s->cork_timerfd = -1;
+	s->connecting_fd = -1;
+	s->queue_entries = SYNCS_CLIENT_QUEUE_ENTRIES;
+	s->queue_policy = SYNCS_QUEUE_CONFLATE;
 
 	syncsd_debug("init structure");
 	for (i = 0; i < SYNCS_EVENT_MAXIMUM; i++) {
@@ -881,6 +1874,8 @@ struct syncs_connect *syncs_connect(const char *addr, int port, const char *id,
 		syncs_idstr(&s->id, id);
 	s->connect_cb = cb;
 	s->connect_arg = arg;
+	// receiving thread waits for the timer of corked writes together with the socket
+	s->cork_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
 	syncsd_debug("connecting to %s:%i create thread with data %p", addr, port, s);
 	pthread_create(&s->thread, NULL, &syncs_connect_thread, (void*) s);
 	return s;
@@ -891,6 +1886,159 @@ struct syncs_connect *syncs_connect_simple(const char *addr, int port, const cha
 	return syncs_connect(addr, port, id, NULL, NULL);
 }
 
+static void syncs_connect_start(struct syncs_connect *s, uint64_t now)
+{
+	s->connecting_fd = syncs_tcpclient_open_async(s->addr, s->port);
+	if (s->connecting_fd < 0) {
+		s->reconnect_us = now + SYNCS_CLIENT_RECONNECT_MS * 1000;
+		return;
+	}
+	fcntl(s->connecting_fd, F_SETFD, FD_CLOEXEC);
+	s->state = SYNCS_CONNECT_CONNECTING;
+}
+
+static void syncs_connect_lost(struct syncs_connect *s, uint64_t now)
+{
+	s->ready = 0;
+	syncs_cork_drop(s);
+	syncs_release_handles(s);
+	close(s->socketfd);
+	s->socketfd = -1;
+	s->state = SYNCS_CONNECT_IDLE;
+	s->reconnect_us = now + SYNCS_CLIENT_RECONNECT_MS * 1000;
+}
+
+/* socket is writable, so the connect is finished one way or another */
+static void syncs_connect_finish(struct syncs_connect *s, uint64_t now)
+{
+	struct pollfd pfd = { .fd = s->connecting_fd, .events = POLLOUT };
+	socklen_t size = sizeof(int);
+	int error = 0;
+
+	if (poll(&pfd, 1, 0) <= 0)
+		return;
+	if (getsockopt(s->connecting_fd, SOL_SOCKET, SO_ERROR, &error, &size) || error) {
+		syncsd_debug("couldn't connect to %s:%d: %s", s->addr, s->port, strerror(error));
+		close(s->connecting_fd);
+		s->connecting_fd = -1;
+		s->state = SYNCS_CONNECT_IDLE;
+		s->reconnect_us = now + SYNCS_CLIENT_RECONNECT_MS * 1000;
+		return;
+	}
+	syncs_set_nonblocking_socket(s->connecting_fd, 1024 * 1024, 1024 * 1024);
+	syncs_set_keepalive(s->connecting_fd, 30, 3);
+	s->socketfd = s->connecting_fd;
+	s->connecting_fd = -1;
+	s->buffer_recv = 0;
+	s->state = SYNCS_CONNECT_CONNECTED;
+	syncs_connected(s);
+}
+
+/* everything which the socket keeps is taken, so edge triggered loops work as well */
+static void syncs_connect_drain(struct syncs_connect *s, uint64_t now)
+{
+	int read_size;
+
+	while (s->state == SYNCS_CONNECT_CONNECTED) {
+		read_size = recv(s->socketfd, s->buffer + s->buffer_recv, SYNCS_CLIENT_BUFFER_SIZE - s->buffer_recv, 0);
+		if (read_size > 0) {
+			s->buffer_recv = syncs_recv_parse(s, s->buffer_recv + read_size);
+			continue;
+		}
+		if ((read_size < 0) && ((errno == EAGAIN) || (errno == EINTR)))
+			break;
+		syncsd_debug("connection to %s:%d is lost", s->addr, s->port);
+		syncs_connect_lost(s, now);
+	}
+}
+
+struct syncs_connect *syncs_connect_threadless(const char *addr, int port, const char *id, void (*cb)(void *), void *arg)
+{
+	struct syncs_connect *s;
+
+	// discovery of server blocks, so the address has to be known
+	if ((addr == NULL) || (addr[0] == 0) || (port == 0))
+		return NULL;
+	if ((s = calloc(1, sizeof(struct syncs_connect))) == NULL)
+		return NULL;
+	syncs_connect_structure_init(s);
+
+	strncpy(s->addr, addr, 20);
+	s->port = port;
+	if (id != NULL)
+		syncs_idstr(&s->id, id);
+	s->connect_cb = cb;
+	s->connect_arg = arg;
+	s->threadless = 1;
+	s->state = SYNCS_CONNECT_IDLE;
+	syncs_connect_start(s, syncs_monotonic_us());
+	return s;
+}
+
+int syncs_get_fd(struct syncs_connect *s, short *events)
+{
+	short wanted = POLLIN;
+	int fd = s->socketfd;
+
+	if (s->threadless)
+		switch (s->state) {
+		case SYNCS_CONNECT_CONNECTING:
+			fd = s->connecting_fd;
+			wanted = POLLOUT;
+			break;
+		case SYNCS_CONNECT_IDLE:
+			fd = -1;
+			break;
+		}
+	if (events != NULL)
+		*events = wanted;
+	return fd;
+}
+
+int syncs_process(struct syncs_connect *s)
+{
+	uint64_t now;
+
+	if (!s->threadless)
+		return -EINVAL;
+	if (s->processing)
+		return -EDEADLK;
+	s->processing = 1;
+	now = syncs_monotonic_us();
+	switch (s->state) {
+	case SYNCS_CONNECT_IDLE:
+		if (!s->onexit && (now >= s->reconnect_us))
+			syncs_connect_start(s, now);
+		break;
+	case SYNCS_CONNECT_CONNECTING:
+		syncs_connect_finish(s, now);
+		break;
+	case SYNCS_CONNECT_CONNECTED:
+		syncs_connect_drain(s, now);
+		if (s->cork_deadline_us && (now >= s->cork_deadline_us))
+			syncs_flush(s);
+		break;
+	}
+	s->processing = 0;
+	return (s->state == SYNCS_CONNECT_CONNECTED) ? 0 : -ENOTCONN;
+}
+
+int syncs_next_timeout(struct syncs_connect *s)
+{
+	uint64_t now, deadline = 0;
+
+	if (!s->threadless)
+		return -1;
+	if (s->state == SYNCS_CONNECT_IDLE)
+		deadline = s->reconnect_us;
+	else if ((s->state == SYNCS_CONNECT_CONNECTED) && s->cork_deadline_us)
+		deadline = s->cork_deadline_us;
+	else
+		return -1;
+	now = syncs_monotonic_us();
+	return (deadline > now) ? (deadline - now + 999) / 1000 : 0;
+}
+
 
 static int syncs_event_data_release(struct syncs_connect *s)
 {
@@ -900,6 +2048,9 @@ static int syncs_event_data_release(struct syncs_connect *s)
 			free (s->events[i].data);
 			s->events[i].data =  NULL;
 		}
+		free(s->events[i].huge_data);
+		s->events[i].huge_data = NULL;
+		s->events[i].huge_capacity = 0;
 	}
 	return 0;
 }
@@ -907,7 +2058,7 @@ static int syncs_event_data_release(struct syncs_connect *s)
 
 static int syncs_wait_for_clientlist(struct syncs_connect *s, int timeout)
 {
-	return syncs_wait_for(&s->clientlist_wait, &s->clientlist_mutex, &s->clientlist_cond, timeout);
+	return syncs_wait_for(s, &s->clientlist_wait, &s->clientlist_mutex, &s->clientlist_cond, timeout);
 }
 
 struct syncs_client_info *syncs_request_clientslist(struct syncs_connect *s, uint32_t *count,unsigned int timeout)
@@ -920,6 +2071,7 @@ struct syncs_client_info *syncs_request_clientslist(struct syncs_connect *s, uin
 		if (s->clients_info == NULL) {
 			return NULL;
 		}
+		s->clientlist_size = SYNCS_CLIENT_MAXIMUM;
 	}
 	if (s->socketfd < 0) {
 		*count = 0;
@@ -932,7 +2084,7 @@ struct syncs_client_info *syncs_request_clientslist(struct syncs_connect *s, uin
 	s->clientlist_wait_packet = 0;
 	s->clientlist_wait = 1;
 
-	syncs_connect_send(s, &packet, sizeof(struct syncs_header));
+	syncs_connect_send_packet(s, (struct syncs_packet *) &packet);
 	syncsd_debug("request clients info");
 
 	if (syncs_wait_for_clientlist(s, timeout))
@@ -947,6 +2099,7 @@ void syncs_free_clientslist(struct syncs_connect *s)
 	if (s->clients_info != NULL) {
 		free(s->clients_info);
 		s->clients_info = NULL;
+		s->clientlist_size = 0;
 	}
 }
 
@@ -954,6 +2107,9 @@ int syncs_wait_for_eventlist(struct syncs_connect *s, int timeout)
 {
 	struct timespec to;
 
+	if (s->threadless)
+		return syncs_wait_process(s, &s->eventlist_wait, timeout);
+
 	clock_gettime(CLOCK_MONOTONIC, &to);
 	to.tv_sec += timeout;
 
@@ -978,6 +2134,7 @@ struct syncs_event_info *syncs_request_eventslist(struct syncs_connect *s, uint3
 		if (s->events_info == NULL) {
 			return NULL;
 		}
+		s->eventlist_size = SYNCS_EVENT_MAXIMUM;
 	}
 
 	if (s->socketfd < 0) {
@@ -991,7 +2148,7 @@ struct syncs_event_info *syncs_request_eventslist(struct syncs_connect *s, uint3
 	s->eventlist_wait_packet = 0;
 	s->eventlist_wait = 1;
 
-	syncs_connect_send(s, &packet, sizeof(struct syncs_header));
+	syncs_connect_send_packet(s, (struct syncs_packet *) &packet);
 	syncsd_debug("request events info");
 
 	if (syncs_wait_for_eventlist(s, timeout))
@@ -1006,6 +2163,7 @@ void syncs_free_eventslist(struct syncs_connect *s)
 	if (s->events_info != NULL) {
 		free(s->events_info);
 		s->events_info = NULL;
+		s->eventlist_size = 0;
 	}
 }
 
@@ -1040,7 +2198,7 @@ struct syncs_connect_channel *syncs_find_free_channel(struct syncs_connect *s)
 
 int syncs_wait_for_ticket(struct syncs_connect *s, int timeout)
 {
-	return syncs_wait_for(&s->ticket_wait, &s->ticket_mutex, &s->ticket_cond, timeout);
+	return syncs_wait_for(s, &s->ticket_wait, &s->ticket_mutex, &s->ticket_cond, timeout);
 }
 
 int syncs_channel_anons(struct syncs_connect *s, const char *id, uint32_t flags, int port)
@@ -1062,7 +2220,6 @@ int syncs_channel_anons(struct syncs_connect *s, const char *id, uint32_t flags,
 int syncs_channel_request(struct syncs_connect *s, const char *id, struct syncs_channel_ticket *ticket)
 {
 	struct syncs_packet packet;
-	uint32_t size = sizeof(struct syncs_header);
 
 	if (s->socketfd < 0)
 		return -EBADFD;
@@ -1070,7 +2227,7 @@ int syncs_channel_request(struct syncs_connect *s, const char *id, struct syncs_
 	syncs_fill_header_request_str (&packet.header, id, SYNCS_TYPE_CHANNEL | SYNCS_CHANNEL_REQUEST);
 	s->ticket_id = packet.header.id;
 
-	syncs_connect_send(s, &packet, size);
+	syncs_connect_send_packet(s, &packet);
 	syncsd_debug("sent request");
 	if (syncs_wait_for_ticket(s, 3))
 		return -ETIMEDOUT;
@@ -1085,7 +2242,7 @@ int syncs_channel_request(struct syncs_connect *s, const char *id, struct syncs_
 
 static int syncs_wait_for_channellist(struct syncs_connect *s, int timeout)
 {
-	return syncs_wait_for(&s->channellist_wait, &s->channellist_mutex, &s->channellist_cond, timeout);
+	return syncs_wait_for(s, &s->channellist_wait, &s->channellist_mutex, &s->channellist_cond, timeout);
 }
 
 struct syncs_channel_info *syncs_request_channelslist(struct syncs_connect *s, uint32_t *count, unsigned int timeout)
@@ -1110,7 +2267,7 @@ struct syncs_channel_info *syncs_request_channelslist(struct syncs_connect *s, u
 	s->channellist_recv = 0;
 	s->channellist_wait_packet = 0;
 	s->channellist_wait = 1;
-	syncs_connect_send(s, &packet, sizeof(struct syncs_header));
+	syncs_connect_send_packet(s, (struct syncs_packet *) &packet);
 	syncsd_debug("request channels info");
 
 	if (syncs_wait_for_channellist(s, timeout))
@@ -1203,10 +2360,76 @@ void syncs_disconnect(struct syncs_connect *s)
 		pthread_cancel(s->connect_thread);
 	shutdown(s->usocketfd, SHUT_WR);
 	shutdown(s->socketfd, SHUT_WR);
-	pthread_join(s->thread, NULL);
+	if (s->threadless) {
+		if (s->connecting_fd >= 0)
+			close(s->connecting_fd);
+		if (s->socketfd >= 0)
+			close(s->socketfd);
+	} else
+		pthread_join(s->thread, NULL);
+	// nothing is posted after the receive thread
+	if (s->executor != NULL)
+		syncs_executor_destroy(s->executor);
 	syncs_free_clientslist(s);
 	syncs_free_eventslist(s);
 	syncs_free_channelslist(s);
 	syncs_event_data_release(s);
+	syncs_release_handles(s);
+	syncs_hash_release(&s->handles_by_id);
+	syncs_hash_release(&s->handles_by_key);
+	syncs_hash_release(&s->events_by_id);
+	free(s->events_queue);
+	if (s->cork_timerfd >= 0)
+		close(s->cork_timerfd);
+	free(s->cork_buffer);
+	free(s->cork_records);
+	syncs_hash_release(&s->cork_index);
+	free(s->batch);
 	free(s);
 }
+
+int syncs_set_cork(struct syncs_connect *s, uint32_t options, uint32_t flush_us)
+{
+	int ret;
+
+	if (options & ~SYNCS_CORK_MASK)
+		return -EINVAL;
+	if (!(options & SYNCS_CORK_ON))
+		options = 0;
+	if (options && (s->cork_buffer == NULL)) {
+		pthread_mutex_lock(&s->cork_mutex);
+		if (s->cork_buffer == NULL) {
+			s->cork_records = malloc(SYNCS_CLIENT_CORK_RECORDS * sizeof(struct syncs_cork_record));
+			s->cork_buffer = malloc(SYNCS_CLIENT_BATCH_SIZE);
+			if ((s->cork_records == NULL) || (s->cork_buffer == NULL) || syncs_hash_init(&s->cork_index, 0)) {
+				free(s->cork_records);
+				free(s->cork_buffer);
+				s->cork_records = NULL;
+				s->cork_buffer = NULL;
+				pthread_mutex_unlock(&s->cork_mutex);
+				return -ENOMEM;
+			}
+		}
+		pthread_mutex_unlock(&s->cork_mutex);
+	}
+	if (s->cork_buffer == NULL)
+		return 0;
+	// waiting writes go out with the old options
+	pthread_mutex_lock(&s->cork_mutex);
+	ret = syncs_cork_send_locked(s);
+	s->cork_us = flush_us;
+	s->cork = options;
+	pthread_mutex_unlock(&s->cork_mutex);
+	return ret;
+}
+
+int syncs_set_protocol(struct syncs_connect *s, uint32_t options)
+{
+	if (options & ~SYNCS_PROTOCOL_MASK)
+		return -EINVAL;
+	s->protocol = options;
+	// the server learns new options from client id, subscriptions are repeated to get handles
+	if (s->ready)
+		syncs_send_id(s);
+	return 0;
+}
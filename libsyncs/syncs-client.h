@@ -48,6 +48,55 @@ struct syncs_connect *syncs_connect(const char *addr, int port, const char *id,
  */
 struct syncs_connect *syncs_connect_simple(const char *addr, int port, const char *id);
 
+/**
+ * @brief Creates a tcp connection to the server without a private thread.
+ *
+ * The connection is driven by the loop of the application: it polls the
+ * descriptor of syncs_get_fd() with the returned events, calls syncs_process()
+ * when it is ready and limits the wait by syncs_next_timeout(). Callbacks run
+ * inside syncs_process(). Calls which wait for the answer of the server process
+ * the connection themselves, so they can't be used from callbacks.
+ *
+ * @param addr The server address, discovery isn't supported.
+ * @param port The server port.
+ * @param id The client ID.
+ * @param cb The callback function for the connection.
+ * @param args Additional arguments for the callback function.
+ * @return A pointer to the syncs_connect structure, NULL without the address or memory.
+ */
+struct syncs_connect *syncs_connect_threadless(const char *addr, int port, const char *id, void (*cb)(void *), void *args);
+
+/**
+ * @brief Returns the descriptor which the loop polls for the connection.
+ *
+ * The descriptor changes with the state of connection, so it is asked again
+ * after every syncs_process().
+ *
+ * @param s The syncs_connect structure.
+ * @param events The poll events to wait for, may be NULL.
+ * @return The descriptor, -1 while the connection waits for the next attempt.
+ */
+int syncs_get_fd(struct syncs_connect *s, short *events);
+
+/**
+ * @brief Processes the threadless connection without blocking.
+ *
+ * Finishes the connect, reads and dispatches everything the socket has,
+ * sends the corked writes which are due and reconnects the lost connection.
+ *
+ * @param s The syncs_connect structure.
+ * @return 0 when connected, -ENOTCONN, -EINVAL for a connection with thread, -EDEADLK from callbacks.
+ */
+int syncs_process(struct syncs_connect *s);
+
+/**
+ * @brief Returns the time until syncs_process() has to be called without events.
+ *
+ * @param s The syncs_connect structure.
+ * @return Timeout in milliseconds, -1 when only events of the descriptor matter.
+ */
+int syncs_next_timeout(struct syncs_connect *s);
+
 /**
  * @brief Establishes a UDP connection to the server.
  *
@@ -100,6 +149,22 @@ int syncs_connect_wait(struct syncs_connect *s, unsigned int timeout_sec);
  */
 void syncs_disconnect(struct syncs_connect *s);
 
+/**
+ * @brief Requests optional protocol features from the server.
+ *
+ * With SYNCS_PROTOCOL_HANDLE the server answers define and subscribe with
+ * a numeric handle, then writes and events of that variable use the short
+ * handle header. With SYNCS_PROTOCOL_V3 both sides switch to v3 frames with
+ * the aligned 16-byte header. SYNCS_PROTOCOL_HUGE together with V3 enables
+ * huge variables on TCP connections, SYNCS_PROTOCOL_STREAM with V3 enables batched
+ * delivery of streams. Servers without a feature keep the v2 header.
+ *
+ * @param s The syncs_connect structure.
+ * @param options SYNCS_PROTOCOL_* bits, 0 returns to the default protocol.
+ * @return 0 on success, -EINVAL on unknown options.
+ */
+int syncs_set_protocol(struct syncs_connect *s, uint32_t options);
+
 /**
  * @brief Defines a new event or variable on the server.
  *
@@ -123,7 +188,8 @@ int syncs_undefine(struct syncs_connect *s, const char *id);
  * @brief Subscribes to an event with a callback function for handling the event.
  *
  * @param s The syncs_connect structure.
- * @param flags Additional flags for the subscription.
+ * @param flags Additional flags for the subscription, SYNCS_TYPE_CONFLATE lets the server keep
+ * only the latest unsent value for a slow client.
  * @param id The event ID.
  * @param cb The callback function.
  * @param args Arguments for the callback function.
@@ -131,6 +197,62 @@ int syncs_undefine(struct syncs_connect *s, const char *id);
  */
 int syncs_subscribe_event(struct syncs_connect *s, uint32_t flags, const char *id, void (*cb)(void *, char *, void *, uint32_t), void *args);
 
+/**
+ * @brief Subscribes to an event with a callback which runs on the workers of executor.
+ *
+ * Callbacks of the same variable run in order one by one, callbacks of different
+ * variables run in parallel, so a slow one doesn't delay the receive thread and
+ * the others. The executor with SYNCS_CLIENT_EXECUTOR_WORKERS workers is started
+ * if syncs_set_executor() wasn't called. The value is copied for the callback.
+ *
+ * @param s The syncs_connect structure.
+ * @param flags Additional flags for the subscription.
+ * @param id The event ID.
+ * @param cb The callback function.
+ * @param args Arguments for the callback function.
+ * @return 0 on success, -ENOMEM.
+ */
+int syncs_subscribe_event_async(struct syncs_connect *s, uint32_t flags, const char *id, void (*cb)(void *, char *, void *, uint32_t), void *args);
+
+/**
+ * @brief Starts the executor of async subscriptions.
+ *
+ * Every variable has its home worker, idle workers steal variables which wait
+ * behind a busy one.
+ *
+ * @param s The syncs_connect structure.
+ * @param workers The number of worker threads, 0 for the default.
+ * @return 0 on success, -EINVAL for too many workers, -EBUSY if it runs already, -ENOMEM.
+ */
+int syncs_set_executor(struct syncs_connect *s, uint32_t workers);
+
+/**
+ * @brief Returns counters of the executor.
+ *
+ * @param s The syncs_connect structure.
+ * @param executed The number of callbacks which were called by workers.
+ * @param stolen The number of variables which workers took from queues of others.
+ */
+void syncs_get_executor_stats(struct syncs_connect *s, uint64_t *executed, uint64_t *stolen);
+
+/**
+ * @brief Subscribes to a stream, the callback is called for every element in order.
+ *
+ * Elements which were overwritten on the server before this client read them are
+ * reported by the gap callback with their count. Needs SYNCS_PROTOCOL_STREAM, otherwise
+ * the stream is received as an ordinary variable.
+ *
+ * @param s The syncs_connect structure.
+ * @param flags Additional flags for the subscription.
+ * @param id The stream ID.
+ * @param cb The callback function for elements.
+ * @param gap_cb The callback function for lost elements, may be NULL.
+ * @param args Arguments for the callback functions.
+ * @return 0 on success, -ENOMEM when there is no free event.
+ */
+int syncs_subscribe_stream(struct syncs_connect *s, uint32_t flags, const char *id, void (*cb)(void *, char *, void *, uint32_t),
+	void (*gap_cb)(void *, char *, uint64_t), void *args);
+
 /**
  * @brief Synchronously subscribes to an event.
  *
@@ -233,24 +355,70 @@ int syncs_read_str(struct syncs_connect *s, uint32_t flags, const char *id, char
 /**
  * @brief Waits for an event to occur within the specified timeout.
  *
+ * Events of sync subscriptions wait in the queue of connection in order
+ * of arrival, the oldest one is taken.
+ *
  * @param s The syncs_connect structure.
  * @param flags The pointer to store the event flags.
  * @param data The buffer to store the event data.
  * @param data_size The pointer to store the size of the event data.
  * @param timeout The timeout in seconds.
- * @return The event ID on success, NULL on timeout.
+ * @return The event ID of the subscription on success, valid while it is subscribed, NULL on timeout.
+ *         Events queued before an unsubscription are skipped, syncs_wait_events returns them.
  */
 const char *syncs_wait_event(struct syncs_connect *s, uint32_t *flags, void *data, uint32_t *data_size, int timeout);
 
+/**
+ * @brief Takes many queued events of sync subscriptions by one call.
+ *
+ * Waits only while the queue is empty. Data and data_size of every entry are
+ * set by caller to its buffer, data_size returns the size of value.
+ *
+ * @param s The syncs_connect structure.
+ * @param events The entries to fill.
+ * @param count The number of entries.
+ * @param timeout_sec The timeout in seconds.
+ * @return Number of taken events, 0 on timeout, -EINVAL for zero count, -ENOMEM when the queue can't be created.
+ */
+int syncs_wait_events(struct syncs_connect *s, struct syncs_queued_event *events, uint32_t count, unsigned int timeout_sec);
+
+/**
+ * @brief Sets the size and overflow policy of the queue of sync events.
+ *
+ * The queue is created by the first sync subscription, its size can't be changed later.
+ * SYNCS_QUEUE_DROP_OLDEST drops the oldest queued event for the new one,
+ * SYNCS_QUEUE_DROP_NEWEST drops the new one and SYNCS_QUEUE_CONFLATE (default)
+ * keeps the last value of every variable which didn't fit and gives it after the queued ones.
+ *
+ * @param s The syncs_connect structure.
+ * @param entries The number of entries rounded up to power of two, 0 for the default size.
+ * @param policy The overflow policy.
+ * @return 0 on success, -EINVAL for unknown policy, -EBUSY for a new size of the existing queue.
+ */
+int syncs_set_event_queue(struct syncs_connect *s, uint32_t entries, uint32_t policy);
+
+/**
+ * @brief Returns the number of events which were dropped or conflated by the full queue.
+ *
+ * @param s The syncs_connect structure.
+ * @return The overflow counter.
+ */
+uint64_t syncs_get_event_overflow(struct syncs_connect *s);
+
 /**
  * @brief Writes data associated with an event or variable.
  *
+ * Value of SYNCS_TYPE_VAR_HUGE variable up to SYNCS_HUGE_SIZE_MAXIMUM bytes
+ * is sent by chunks, the call returns when all of them are sent. Subscribers
+ * get the value only when it is complete.
+ *
  * @param s The syncs_connect structure.
  * @param flags Additional flags for the write operation.
  * @param id The event or variable ID.
  * @param data The data to write.
  * @param data_size The size of the data.
- * @return 0 on success, -1 on failure.
+ * @return 0 on success, -1 on failure, -EMSGSIZE when the value is too big,
+ * -ENOTSUP for huge variable when the server doesn't accept SYNCS_PROTOCOL_HUGE.
  */
 int syncs_write(struct syncs_connect *s, uint32_t flags, const char *id, void *data, uint32_t data_size);
 
@@ -319,6 +487,67 @@ int syncs_write_str(struct syncs_connect *s, uint32_t flags, const char *id, con
  */
 int syncs_write_event(struct syncs_connect *s, uint32_t flags, const char *id);
 
+/**
+ * @brief Corks writes of the tcp connection, they wait in the send buffer of connection.
+ *
+ * Waiting writes are sent by one call when the buffer is full, flush_us after
+ * the first of them or on syncs_flush(). Anything else which is sent to the server
+ * sends them first, so the order is kept. With SYNCS_CORK_SQUASH a write of the
+ * variable which waits already replaces the waiting value in its place.
+ * Writes of the lost connection are dropped.
+ *
+ * @param s The syncs_connect structure.
+ * @param options SYNCS_CORK_ON with SYNCS_CORK_SQUASH or 0 to send writes at once.
+ * @param flush_us Time the first write waits for, 0 waits for the full buffer or syncs_flush().
+ * @return 0 on success, -EINVAL for unknown options, -ENOMEM, error of sending the waiting writes.
+ */
+int syncs_set_cork(struct syncs_connect *s, uint32_t options, uint32_t flush_us);
+
+/**
+ * @brief Sends the corked writes at once.
+ *
+ * @param s The syncs_connect structure.
+ * @return 0 on success, -1 on failure.
+ */
+int syncs_flush(struct syncs_connect *s);
+
+/**
+ * @brief Starts a batch of writes which are sent to the server together.
+ *
+ * Records of a batch go to the server by one send and are applied in the order
+ * they were added, subscribers get the values of one batch in one send as well.
+ * On udp connection every record is written at once, a datagram keeps one record.
+ * The connection reuses the buffer of the previous batch, the batches which are
+ * begun while another one is open get their own buffers.
+ *
+ * @param s The syncs_connect structure.
+ * @return A pointer to the batch, NULL if it couldn't be allocated.
+ */
+struct syncs_write_batch *syncs_write_batch_begin(struct syncs_connect *s);
+
+/**
+ * @brief Adds a write to the batch, the arguments are those of syncs_write().
+ *
+ * Huge values can't be batched. A batch which outgrows its buffer sends the
+ * added records and goes on.
+ *
+ * @param b The batch.
+ * @param flags The variable type and additional flags.
+ * @param id The variable ID.
+ * @param data The data to write.
+ * @param data_size The size of the data, 0 for the size of type.
+ * @return 0 on success, -ENOTSUP for huge value, -EMSGSIZE if the data is too large.
+ */
+int syncs_write_batch_add(struct syncs_write_batch *b, uint32_t flags, const char *id, void *data, uint32_t data_size);
+
+/**
+ * @brief Sends the rest of the batch and releases it, the buffer is kept by the connection.
+ *
+ * @param b The batch.
+ * @return 0 on success, error of the first failed send otherwise.
+ */
+int syncs_write_batch_commit(struct syncs_write_batch *b);
+
 /**
  * @brief Requests the list of connected clients.
  *
@@ -109,6 +109,9 @@ static __attribute__((always_inline)) inline void syncs_fill_basic_header (struc
         p->magic = SYNCS_PACKET_MAGIC;
         p->magic_data = SYNCS_PACKET_MAGIC_DATA;
         p->type = type;
+        p->sync.data0 = 0;
+        p->sync.data1 = 0;
+        p->update_counter = 0;
 }
 
 static __attribute__((always_inline)) inline void syncs_fill_basic_header_request (struct syncs_header *p, uint32_t type)
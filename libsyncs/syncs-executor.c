@@ -0,0 +1,278 @@
+/**************************************************************
+ * Description: SyncScribe library to manage network and local events,
+ * variables and channels
+ * Copyright (c) 2022 Alexander Krapivniy (a.krapivniy@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "syncs-executor.h"
+
+#define MODULE_NAME "syncs-executor"
+#include <syncs-debug.h>
+
+/* unparks the home worker of the strand or any parked one, the cleared bit owns the wakeup */
+static void syncs_executor_unpark(struct syncs_executor *e, uint32_t home)
+{
+	struct syncs_executor_worker *w;
+	uint64_t parked, bit;
+
+	while ((parked = __atomic_load_n(&e->parked, __ATOMIC_SEQ_CST)) != 0) {
+		bit = (parked & (1ULL << home)) ? (1ULL << home) : (parked & -parked);
+		if (!(__atomic_fetch_and(&e->parked, ~bit, __ATOMIC_SEQ_CST) & bit))
+			continue;
+		w = &e->workers[__builtin_ctzll(bit)];
+		pthread_mutex_lock(&w->park_mutex);
+		w->wake = 1;
+		pthread_cond_signal(&w->park_cond);
+		pthread_mutex_unlock(&w->park_mutex);
+		return;
+	}
+}
+
+/* pending grows after the strand is queued and drops after it is taken, so it never overstates the queues */
+static void syncs_executor_push(struct syncs_executor_worker *w, struct syncs_executor_strand *strand)
+{
+	struct syncs_executor *e = w->executor;
+
+	strand->next = NULL;
+	pthread_mutex_lock(&w->mutex);
+	if (w->tail != NULL)
+		w->tail->next = strand;
+	else
+		__atomic_store_n(&w->head, strand, __ATOMIC_RELAXED);
+	w->tail = strand;
+	pthread_mutex_unlock(&w->mutex);
+
+	__atomic_add_fetch(&e->pending, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&e->parked, __ATOMIC_SEQ_CST))
+		syncs_executor_unpark(e, w->index);
+}
+
+static struct syncs_executor_strand *syncs_executor_pop(struct syncs_executor_worker *w)
+{
+	struct syncs_executor *e = w->executor;
+	struct syncs_executor_strand *strand;
+
+	// empty queue is skipped without its lock, a racing push is seen through pending
+	if (__atomic_load_n(&w->head, __ATOMIC_RELAXED) == NULL)
+		return NULL;
+	pthread_mutex_lock(&w->mutex);
+	strand = w->head;
+	if (strand != NULL) {
+		__atomic_store_n(&w->head, strand->next, __ATOMIC_RELAXED);
+		if (w->head == NULL)
+			w->tail = NULL;
+	}
+	pthread_mutex_unlock(&w->mutex);
+	if (strand != NULL)
+		__atomic_sub_fetch(&e->pending, 1, __ATOMIC_SEQ_CST);
+	return strand;
+}
+
+/* own queue goes first, then the oldest strand of the next workers */
+static struct syncs_executor_strand *syncs_executor_take(struct syncs_executor_worker *w)
+{
+	struct syncs_executor *e = w->executor;
+	struct syncs_executor_strand *strand;
+	uint32_t i;
+
+	if ((strand = syncs_executor_pop(w)) != NULL)
+		return strand;
+	for (i = 1; i < e->workers_count; i++)
+		if ((strand = syncs_executor_pop(&e->workers[(w->index + i) % e->workers_count])) != NULL) {
+			__atomic_add_fetch(&w->stolen, 1, __ATOMIC_RELAXED);
+			return strand;
+		}
+	return NULL;
+}
+
+static void syncs_executor_run(struct syncs_executor_worker *w, struct syncs_executor_strand *strand)
+{
+	struct syncs_executor_task *task;
+	int i;
+
+	for (i = 0; i < SYNCS_EXECUTOR_STRAND_BURST; i++) {
+		pthread_mutex_lock(&strand->mutex);
+		task = strand->head;
+		if (task == NULL) {
+			strand->scheduled = 0;
+			pthread_mutex_unlock(&strand->mutex);
+			return;
+		}
+		strand->head = task->next;
+		if (strand->head == NULL)
+			strand->tail = NULL;
+		pthread_mutex_unlock(&strand->mutex);
+
+		task->cb(task->args, task->id.c, task->data, task->size);
+		free(task);
+		__atomic_add_fetch(&w->executed, 1, __ATOMIC_RELAXED);
+	}
+	// busy key waits behind the others, it stays scheduled so nobody else queues it
+	syncs_executor_push(w, strand);
+}
+
+/*
+ * Worker marks itself parked before the last look at pending and a push counts the
+ * strand before it looks at the mask, so either the worker sees the strand or the
+ * push sees the worker.
+ */
+static void syncs_executor_park(struct syncs_executor_worker *w)
+{
+	struct syncs_executor *e = w->executor;
+	uint64_t bit = 1ULL << w->index;
+
+	pthread_mutex_lock(&w->park_mutex);
+	w->wake = 0;
+	pthread_mutex_unlock(&w->park_mutex);
+	__atomic_fetch_or(&e->parked, bit, __ATOMIC_SEQ_CST);
+	if ((__atomic_load_n(&e->pending, __ATOMIC_SEQ_CST) > 0) || __atomic_load_n(&e->onexit, __ATOMIC_SEQ_CST)) {
+		// a push which cleared the bit meanwhile signals anyway, its wakeup is taken below
+		if (__atomic_fetch_and(&e->parked, ~bit, __ATOMIC_SEQ_CST) & bit)
+			return;
+	}
+	pthread_mutex_lock(&w->park_mutex);
+	while (!w->wake && !__atomic_load_n(&e->onexit, __ATOMIC_ACQUIRE))
+		pthread_cond_wait(&w->park_cond, &w->park_mutex);
+	pthread_mutex_unlock(&w->park_mutex);
+}
+
+static void *syncs_executor_thread(void *arg)
+{
+	struct syncs_executor_worker *w = arg;
+	struct syncs_executor *e = w->executor;
+	struct syncs_executor_strand *strand;
+
+	while (!__atomic_load_n(&e->onexit, __ATOMIC_ACQUIRE)) {
+		strand = syncs_executor_take(w);
+		if (strand != NULL)
+			syncs_executor_run(w, strand);
+		else
+			syncs_executor_park(w);
+	}
+	syncsd_debug("worker %u exits, %lu callbacks, %lu stolen", w->index, w->executed, w->stolen);
+	return NULL;
+}
+
+struct syncs_executor *syncs_executor_create(uint32_t workers, uint32_t keys)
+{
+	struct syncs_executor *e;
+	uint32_t i;
+
+	if ((workers == 0) || (workers > SYNCS_EXECUTOR_WORKERS_MAXIMUM) || (keys == 0))
+		return NULL;
+	e = calloc(1, sizeof(struct syncs_executor) + workers * sizeof(struct syncs_executor_worker));
+	if (e == NULL)
+		goto error_alloc;
+	e->strands = calloc(keys, sizeof(struct syncs_executor_strand));
+	if (e->strands == NULL)
+		goto error_strands;
+	e->keys = keys;
+	for (i = 0; i < keys; i++)
+		pthread_mutex_init(&e->strands[i].mutex, NULL);
+	for (i = 0; i < workers; i++) {
+		e->workers[i].executor = e;
+		e->workers[i].index = i;
+		pthread_mutex_init(&e->workers[i].mutex, NULL);
+		pthread_mutex_init(&e->workers[i].park_mutex, NULL);
+		pthread_cond_init(&e->workers[i].park_cond, NULL);
+		if (pthread_create(&e->workers[i].thread, NULL, syncs_executor_thread, &e->workers[i]))
+			goto error_thread;
+		e->workers_count++;
+	}
+	syncsd_debug("executor of %u workers for %u keys", workers, keys);
+	return e;
+
+error_thread:
+	syncs_executor_destroy(e);
+	return NULL;
+error_strands:
+	free(e);
+error_alloc:
+	syncsd_error("couldn't create executor of %u workers", workers);
+	return NULL;
+}
+
+void syncs_executor_destroy(struct syncs_executor *e)
+{
+	struct syncs_executor_task *task;
+	uint32_t i;
+
+	__atomic_store_n(&e->onexit, 1, __ATOMIC_SEQ_CST);
+	for (i = 0; i < e->workers_count; i++) {
+		pthread_mutex_lock(&e->workers[i].park_mutex);
+		pthread_cond_signal(&e->workers[i].park_cond);
+		pthread_mutex_unlock(&e->workers[i].park_mutex);
+	}
+	for (i = 0; i < e->workers_count; i++)
+		pthread_join(e->workers[i].thread, NULL);
+
+	for (i = 0; i < e->keys; i++)
+		while ((task = e->strands[i].head) != NULL) {
+			e->strands[i].head = task->next;
+			free(task);
+		}
+	free(e->strands);
+	free(e);
+}
+
+int syncs_executor_post(struct syncs_executor *e, uint32_t key, void (*cb)(void *, char *, void *, uint32_t), void *args,
+	syncsid_t *id, void *data, uint32_t size)
+{
+	struct syncs_executor_strand *strand = &e->strands[key % e->keys];
+	struct syncs_executor_task *task;
+	int schedule;
+
+	task = malloc(sizeof(struct syncs_executor_task) + size);
+	if (task == NULL)
+		return -ENOMEM;
+	task->next = NULL;
+	task->cb = cb;
+	task->args = args;
+	task->id = *id;
+	task->size = size;
+	memcpy(task->data, data, size);
+
+	pthread_mutex_lock(&strand->mutex);
+	if (strand->tail != NULL)
+		strand->tail->next = task;
+	else
+		strand->head = task;
+	strand->tail = task;
+	schedule = !strand->scheduled;
+	strand->scheduled = 1;
+	pthread_mutex_unlock(&strand->mutex);
+
+	// the key has its home queue, idle workers steal the strand from it
+	if (schedule)
+		syncs_executor_push(&e->workers[key % e->workers_count], strand);
+	return 0;
+}
+
+void syncs_executor_get_stats(struct syncs_executor *e, uint64_t *executed, uint64_t *stolen)
+{
+	uint32_t i;
+
+	*executed = 0;
+	*stolen = 0;
+	for (i = 0; i < e->workers_count; i++) {
+		*executed += __atomic_load_n(&e->workers[i].executed, __ATOMIC_RELAXED);
+		*stolen += __atomic_load_n(&e->workers[i].stolen, __ATOMIC_RELAXED);
+	}
+}
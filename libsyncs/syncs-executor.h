@@ -0,0 +1,112 @@
+/**************************************************************
+ * Description: SyncScribe library to manage network and local events,
+ * variables and channels
+ * Copyright (c) 2022 Alexander Krapivniy (a.krapivniy@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************/
+
+#ifndef __SYNCS_EXECUTOR__
+#define __SYNCS_EXECUTOR__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <pthread.h>
+#include "syncs-types.h"
+
+#define SYNCS_EXECUTOR_WORKERS_MAXIMUM	64
+// strand gives its worker to others after so many callbacks in a row
+#define SYNCS_EXECUTOR_STRAND_BURST	64
+
+struct syncs_executor_task {
+	struct syncs_executor_task *next;
+	void (*cb)(void *, char *, void *, uint32_t);
+	void *args;
+	syncsid_t id;
+	uint32_t size;
+	uint8_t data[];
+};
+
+/*
+ * Tasks of one key wait in its strand. A strand is in one worker queue at most
+ * and runs on one worker at a time, so callbacks of the key keep their order
+ * while the strand itself moves between workers by stealing.
+ */
+struct syncs_executor_strand {
+	pthread_mutex_t mutex;
+	struct syncs_executor_task *head;
+	struct syncs_executor_task *tail;
+	struct syncs_executor_strand *next;
+	int scheduled;
+};
+
+struct syncs_executor_worker {
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	struct syncs_executor_strand *head;
+	struct syncs_executor_strand *tail;
+	struct syncs_executor *executor;
+	uint32_t index;
+	uint64_t executed;
+	uint64_t stolen;
+	// parked worker sleeps on its own condition, only the one who unparks it signals
+	pthread_mutex_t park_mutex;
+	pthread_cond_t park_cond;
+	int wake;
+};
+
+struct syncs_executor {
+	uint32_t keys;
+	uint32_t workers_count;
+	int onexit;
+	// strands which wait in queues of all workers and the mask of parked workers,
+	// a push wakes one parked worker, busy workers touch neither lock nor condition
+	int pending;
+	uint64_t parked;
+	struct syncs_executor_strand *strands;
+	struct syncs_executor_worker workers[];
+};
+
+/**
+ * @brief Starts the workers of executor for keys from 0 to keys - 1.
+ *
+ * @return The executor, NULL on failure.
+ */
+struct syncs_executor *syncs_executor_create(uint32_t workers, uint32_t keys);
+
+/**
+ * @brief Stops the workers, callbacks which wait aren't called.
+ */
+void syncs_executor_destroy(struct syncs_executor *e);
+
+/**
+ * @brief Queues a callback with a copy of data, callbacks of the same key run in order.
+ *
+ * @return 0 on success, -ENOMEM.
+ */
+int syncs_executor_post(struct syncs_executor *e, uint32_t key, void (*cb)(void *, char *, void *, uint32_t), void *args,
+	syncsid_t *id, void *data, uint32_t size);
+
+/**
+ * @brief Sums counters of the workers.
+ */
+void syncs_executor_get_stats(struct syncs_executor *e, uint64_t *executed, uint64_t *stolen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__SYNCS_EXECUTOR__
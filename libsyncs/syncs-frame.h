@@ -0,0 +1,222 @@
+/**************************************************************
+ * Description: SyncScribe library to manage network and local events,
+ * variables and channels
+ * Copyright (c) 2022 Alexander Krapivniy (a.krapivniy@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************/
+
+#ifndef __SYNCS_FRAME__
+#define __SYNCS_FRAME__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include "syncs-types.h"
+
+/*
+ * Decoded v3 frame. The header is rebuilt in the v2 layout, so the
+ * packet processing code stays the same for both versions: fields which
+ * were not sent are zero. Data points into the receive buffer.
+ */
+struct syncs_frame {
+	struct syncs_header header;
+	uint32_t handle;
+	uint32_t sequence;
+	uint8_t fields;
+	char *data;
+};
+
+#define SYNCS_FRAME_ID_WORDS	(sizeof(syncsid_t) / sizeof(uint64_t))
+
+/* ids are zero-filled after the name, short ones go in one or two words */
+static __attribute__((always_inline)) inline uint32_t syncs_frame_id_words(const syncsid_t *id)
+{
+	uint32_t words = SYNCS_FRAME_ID_WORDS;
+
+	while ((words > 1) && (id->i[words - 1] == 0))
+		words--;
+	return words;
+}
+
+/*
+ * Encodes the packet as v3 frame into the buffer of SYNCS_FRAME_SIZE_MAXIMUM bytes.
+ * Variable is addressed by handle when it is given, otherwise by id.
+ * Returns the frame size.
+ */
+static inline uint32_t syncs_frame_encode(void *buffer, struct syncs_header *header, const void *data, uint32_t sequence, const uint32_t *handle)
+{
+	struct syncs_frame_header *frame = buffer;
+	uint8_t *p = (uint8_t *) (frame + 1);
+	uint32_t data_size = SYNCS_PACKET_DATA_SIZE(header->data_size);
+	uint32_t i;
+
+	frame->magic = SYNCS_PACKET_MAGIC_V3;
+	frame->fields = 0;
+	frame->data_size = data_size;
+	frame->type = header->type;
+	frame->sequence = sequence;
+	if (handle != NULL) {
+		frame->handle = *handle;
+	} else {
+		frame->handle = syncs_frame_id_words(&header->id);
+		frame->fields |= SYNCS_FRAME_FIELD_ID;
+		for (i = 0; i < frame->handle; i++)
+			((uint64_t *) p)[i] = header->id.i[i];
+		p += frame->handle * sizeof(uint64_t);
+	}
+	if (header->sync.data0 || header->sync.data1) {
+		frame->fields |= SYNCS_FRAME_FIELD_SYNC;
+		memcpy(p, &header->sync, sizeof(struct syncdata));
+		p += sizeof(struct syncdata);
+	}
+	if (header->update_counter) {
+		frame->fields |= SYNCS_FRAME_FIELD_COUNTER;
+		*(uint64_t *) p = header->update_counter;
+		p += sizeof(uint64_t);
+	}
+	// fields keep p aligned, the last data word is zeroed first to pad the frame
+	if (data_size & (SYNCS_FRAME_ALIGN - 1))
+		*(uint64_t *) (p + SYNCS_FRAME_PAD(data_size) - sizeof(uint64_t)) = 0;
+	memcpy(p, data, data_size);
+	p += SYNCS_FRAME_PAD(data_size);
+
+	return p - (uint8_t *) buffer;
+}
+
+/*
+ * Encodes a chunk of huge variable into the buffer of SYNCS_HUGE_FRAME_SIZE_MAXIMUM bytes.
+ * The chunk header and the part of value are taken from different places.
+ * Returns the frame size.
+ */
+static inline uint32_t syncs_frame_encode_chunk(void *buffer, struct syncs_header *header, const struct syncs_huge_chunk *chunk,
+	const void *data, uint32_t size, uint32_t sequence, const uint32_t *handle)
+{
+	struct syncs_frame_header *frame = buffer;
+	uint8_t *p;
+
+	// chunk header keeps the alignment, so the value is appended right after it
+	header->data_size = sizeof(struct syncs_huge_chunk);
+	p = (uint8_t *) buffer + syncs_frame_encode(buffer, header, chunk, sequence, handle);
+	if (size & (SYNCS_FRAME_ALIGN - 1))
+		*(uint64_t *) (p + SYNCS_FRAME_PAD(size) - sizeof(uint64_t)) = 0;
+	memcpy(p, data, size);
+	frame->data_size += size;
+	p += SYNCS_FRAME_PAD(size);
+
+	return p - (uint8_t *) buffer;
+}
+
+/* only chunks of huge variables and stream batches carry more data than a variable */
+static inline uint32_t syncs_frame_data_maximum(uint32_t type)
+{
+	uint32_t message = type & SYNCS_TYPE_MSG_MASK;
+
+	switch (type & SYNCS_TYPE_VAR_MASK) {
+	case SYNCS_TYPE_VAR_HUGE:
+		if ((message == SYNCS_TYPE_WRITE) || (message == SYNCS_TYPE_EVENT))
+			return sizeof(struct syncs_huge_chunk) + SYNCS_HUGE_CHUNK_SIZE;
+		break;
+	case SYNCS_TYPE_VAR_STREAM:
+		if (message == SYNCS_TYPE_EVENT)
+			return SYNCS_STREAM_BATCH_SIZE_MAXIMUM;
+		break;
+	}
+	return SYNCS_VARIABLE_SIZE_MAXIMUM;
+}
+
+/*
+ * Returns the frame size, 0 when the buffer keeps only a part
+ * of the frame and -1 when it is not a valid frame.
+ */
+static inline int syncs_frame_decode(struct syncs_frame *frame, void *buffer, uint32_t size)
+{
+	struct syncs_frame_header *head = buffer;
+	struct syncs_header *header = &frame->header;
+	uint8_t *p = (uint8_t *) (head + 1);
+	const uint64_t *words;
+	uint32_t frame_size;
+
+	if (size < sizeof(struct syncs_frame_header))
+		return 0;
+	if ((head->magic != SYNCS_PACKET_MAGIC_V3) || (head->fields & ~SYNCS_FRAME_FIELD_MASK) ||
+		(head->data_size > syncs_frame_data_maximum(head->type)))
+		return -1;
+
+	frame_size = sizeof(struct syncs_frame_header) + head->data_size;
+	if (head->fields & SYNCS_FRAME_FIELD_ID) {
+		if ((head->handle == 0) || (head->handle > SYNCS_FRAME_ID_WORDS))
+			return -1;
+		frame_size += head->handle * sizeof(uint64_t);
+	}
+	if (head->fields & SYNCS_FRAME_FIELD_SYNC)
+		frame_size += sizeof(struct syncdata);
+	if (head->fields & SYNCS_FRAME_FIELD_COUNTER)
+		frame_size += sizeof(uint64_t);
+	frame_size = SYNCS_FRAME_PAD(frame_size);
+	if (size < frame_size)
+		return 0;
+
+	frame->fields = head->fields;
+	frame->sequence = head->sequence;
+	header->magic = SYNCS_PACKET_MAGIC;
+	header->magic_data = SYNCS_PACKET_MAGIC_DATA;
+	header->crc = 0;
+	header->type = head->type;
+	header->data_size = head->data_size;
+
+	// id is rebuilt by words, the ones which were not sent are zero
+	if (head->fields & SYNCS_FRAME_FIELD_ID) {
+		words = (const uint64_t *) p;
+		header->id.i[0] = words[0];
+		header->id.i[1] = (head->handle > 1) ? words[1] : 0;
+		header->id.i[2] = (head->handle > 2) ? words[2] : 0;
+		header->id.i[3] = (head->handle > 3) ? words[3] : 0;
+		p += head->handle * sizeof(uint64_t);
+		frame->handle = 0;
+	} else {
+		header->id.i[0] = 0;
+		header->id.i[1] = 0;
+		header->id.i[2] = 0;
+		header->id.i[3] = 0;
+		frame->handle = head->handle;
+	}
+	if (head->fields & SYNCS_FRAME_FIELD_SYNC) {
+		memcpy(&header->sync, p, sizeof(struct syncdata));
+		p += sizeof(struct syncdata);
+	} else {
+		header->sync.data0 = 0;
+		header->sync.data1 = 0;
+	}
+	if (head->fields & SYNCS_FRAME_FIELD_COUNTER) {
+		header->update_counter = *(uint64_t *) p;
+		p += sizeof(uint64_t);
+	} else
+		header->update_counter = 0;
+	frame->data = (char *) p;
+	return frame_size;
+}
+
+static __attribute__((always_inline)) inline void syncs_frame_set_sequence(void *buffer, uint32_t sequence)
+{
+	((struct syncs_frame_header *) buffer)->sequence = sequence;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__SYNCS_FRAME__
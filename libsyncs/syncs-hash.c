@@ -0,0 +1,155 @@
+/**************************************************************
+ * Description: SyncScribe library to manage network and local events,
+ * variables and channels
+ * Copyright (c) 2022 Alexander Krapivniy (a.krapivniy@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "syncs-hash.h"
+
+#define MODULE_NAME "syncs-hash"
+#include <syncs-debug.h>
+#undef syncsd_debug
+#define syncsd_debug(fmt,args...)
+
+#define SYNCS_HASH_MINIMUM 16
+
+static int syncs_hash_alloc(struct syncs_hash *h, uint32_t size)
+{
+	uint32_t real_size = SYNCS_HASH_MINIMUM;
+
+	while (real_size < size)
+		real_size <<= 1;
+
+	h->slots = calloc(real_size, sizeof(struct syncs_hash_slot));
+	if (h->slots == NULL) {
+		syncsd_error("couldn't allocate hash table for %u items", real_size);
+		return -1;
+	}
+	h->mask = real_size - 1;
+	h->count = 0;
+	h->used = 0;
+	return 0;
+}
+
+static void syncs_hash_place(struct syncs_hash *h, uint64_t key, void *item)
+{
+	uint32_t i = key & h->mask;
+
+	while ((h->slots[i].item != NULL) && (h->slots[i].item != SYNCS_HASH_DELETED))
+		i = (i + 1) & h->mask;
+
+	if (h->slots[i].item == NULL)
+		h->used++;
+	h->slots[i].key = key;
+	h->slots[i].item = item;
+	h->count++;
+}
+
+static int syncs_hash_resize(struct syncs_hash *h)
+{
+	struct syncs_hash_slot *slots = h->slots;
+	uint32_t size = h->mask + 1;
+	uint32_t i;
+
+	// a table full of tombstones is cleaned with the same size
+	if (syncs_hash_alloc(h, ((h->count + 1) * 2 > size) ? size * 2 : size))
+		goto error_alloc;
+
+	for (i = 0; i < size; i++)
+		if ((slots[i].item != NULL) && (slots[i].item != SYNCS_HASH_DELETED))
+			syncs_hash_place(h, slots[i].key, slots[i].item);
+	free(slots);
+	syncsd_debug("hash table resized from %u to %u", size, h->mask + 1);
+	return 0;
+
+error_alloc:
+	h->slots = slots;
+	h->mask = size - 1;
+	return -1;
+}
+
+static int syncs_hash_insert(struct syncs_hash *h, uint64_t key, void *item)
+{
+	if ((h->used + 1) * 4 > (h->mask + 1) * 3)
+		if (syncs_hash_resize(h))
+			return -1;
+	syncs_hash_place(h, key, item);
+	return 0;
+}
+
+static void syncs_hash_remove(struct syncs_hash *h, uint64_t key, void *item)
+{
+	uint32_t i = key & h->mask;
+
+	while (h->slots[i].item != NULL) {
+		if (h->slots[i].item == item) {
+			// next slot is empty, so the chain ends here and tombstone is not required
+			if (h->slots[(i + 1) & h->mask].item == NULL) {
+				h->slots[i].item = NULL;
+				h->used--;
+			} else
+				h->slots[i].item = SYNCS_HASH_DELETED;
+			h->count--;
+			return;
+		}
+		i = (i + 1) & h->mask;
+	}
+}
+
+int syncs_hash_init(struct syncs_hash *h, uint32_t size)
+{
+	return syncs_hash_alloc(h, size);
+}
+
+void syncs_hash_release(struct syncs_hash *h)
+{
+	free(h->slots);
+	h->slots = NULL;
+	h->mask = 0;
+	h->count = 0;
+	h->used = 0;
+}
+
+int syncs_hash_insert_id(struct syncs_hash *h, void *item)
+{
+	return syncs_hash_insert(h, syncs_idhash((syncsid_t *) item), item);
+}
+
+void syncs_hash_remove_id(struct syncs_hash *h, void *item)
+{
+	syncs_hash_remove(h, syncs_idhash((syncsid_t *) item), item);
+}
+
+int syncs_hash_insert_key(struct syncs_hash *h, uint64_t key, void *item)
+{
+	return syncs_hash_insert(h, syncs_hash_mix(key), item);
+}
+
+void syncs_hash_remove_key(struct syncs_hash *h, uint64_t key, void *item)
+{
+	syncs_hash_remove(h, syncs_hash_mix(key), item);
+}
+
+void syncs_hash_clear(struct syncs_hash *h)
+{
+	if (h->count || h->used)
+		memset(h->slots, 0, (h->mask + 1) * sizeof(struct syncs_hash_slot));
+	h->count = 0;
+	h->used = 0;
+}
@@ -0,0 +1,156 @@
+/**************************************************************
+ * Description: SyncScribe library to manage network and local events,
+ * variables and channels
+ * Copyright (c) 2022 Alexander Krapivniy (a.krapivniy@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************/
+
+#ifndef __SYNCS_HASH__
+#define __SYNCS_HASH__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "syncs-types.h"
+
+#define SYNCS_HASH_DELETED ((void *) -1)
+
+struct syncs_hash_slot {
+	uint64_t key;
+	void *item;
+};
+
+/*
+ * Open addressing table with linear probing. It keeps only pointers,
+ * the items are owned by the caller. Tables searched by id expect
+ * items which start with syncsid_t (syncs_event, syncs_client_event).
+ * Slot key is always a mixed hash, the mix is a bijection so exact
+ * 64-bit keys are compared through their hash as well.
+ * The table has no lock of its own: an insert may resize and free the
+ * slots, so finds and inserts of a shared table are serialized by the
+ * owner (the server takes its table lock around every access).
+ */
+struct syncs_hash {
+	struct syncs_hash_slot *slots;
+	uint32_t mask;
+	uint32_t count;
+	uint32_t used;
+};
+
+static __attribute__((always_inline)) inline uint64_t syncs_hash_mix(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+static __attribute__((always_inline)) inline uint64_t syncs_idhash(syncsid_t *id)
+{
+	uint64_t h = id->i[0];
+
+	h ^= (id->i[1] << 17) | (id->i[1] >> 47);
+	h ^= (id->i[2] << 31) | (id->i[2] >> 33);
+	h ^= (id->i[3] << 47) | (id->i[3] >> 17);
+	return syncs_hash_mix(h);
+}
+
+static __attribute__((always_inline)) inline void *syncs_hash_find_id(struct syncs_hash *h, syncsid_t *id)
+{
+	uint64_t key = syncs_idhash(id);
+	uint32_t i = key & h->mask;
+	struct syncs_hash_slot *slot;
+	syncsid_t *item_id;
+
+	while (1) {
+		slot = &h->slots[i];
+		if (slot->item == NULL)
+			return NULL;
+		if ((slot->key == key) && (slot->item != SYNCS_HASH_DELETED)) {
+			item_id = slot->item;
+			if ((item_id->i[0] == id->i[0]) && (item_id->i[1] == id->i[1]) &&
+				(item_id->i[2] == id->i[2]) && (item_id->i[3] == id->i[3]))
+				return slot->item;
+		}
+		i = (i + 1) & h->mask;
+	}
+}
+
+static __attribute__((always_inline)) inline void *syncs_hash_find_key(struct syncs_hash *h, uint64_t key)
+{
+	uint32_t i;
+	struct syncs_hash_slot *slot;
+
+	key = syncs_hash_mix(key);
+	i = key & h->mask;
+	while (1) {
+		slot = &h->slots[i];
+		if (slot->item == NULL)
+			return NULL;
+		if ((slot->key == key) && (slot->item != SYNCS_HASH_DELETED))
+			return slot->item;
+		i = (i + 1) & h->mask;
+	}
+}
+
+/**
+ * @brief Allocates the table, size is rounded up to power of two.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int syncs_hash_init(struct syncs_hash *h, uint32_t size);
+
+/**
+ * @brief Releases the table memory, the items are untouched.
+ */
+void syncs_hash_release(struct syncs_hash *h);
+
+/**
+ * @brief Adds an item indexed by its id (item has to start with syncsid_t).
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int syncs_hash_insert_id(struct syncs_hash *h, void *item);
+
+/**
+ * @brief Removes an item which was added by syncs_hash_insert_id.
+ */
+void syncs_hash_remove_id(struct syncs_hash *h, void *item);
+
+/**
+ * @brief Adds an item indexed by an exact 64-bit key.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int syncs_hash_insert_key(struct syncs_hash *h, uint64_t key, void *item);
+
+/**
+ * @brief Removes an item which was added by syncs_hash_insert_key.
+ */
+void syncs_hash_remove_key(struct syncs_hash *h, uint64_t key, void *item);
+
+/**
+ * @brief Forgets all items, the table keeps its size.
+ */
+void syncs_hash_clear(struct syncs_hash *h);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__SYNCS_HASH__
@@ -35,9 +35,8 @@
 #undef syncsd_debug
 #define syncsd_debug(fmt,args...)
 
-int syncs_tcpclient_open(const char *addr, int port)
+static int syncs_tcpclient_socket(struct sockaddr_in *serveraddr, const char *addr, int port)
 {
-	struct sockaddr_in serveraddr;
 	int socketfd;
 	int reuse = 1;
 	int nodelay = 1;
@@ -79,14 +78,24 @@ int syncs_tcpclient_open(const char *addr, int port)
 	if (setsockopt(socketfd, IPPROTO_IP, IP_TOS, (const char*) &ip_prio, sizeof(ip_prio)) < 0) {
 		syncsd_error("can't setting tcp socket:%s", strerror(errno));
 	}
-	memset(&serveraddr, 0, sizeof(struct sockaddr_in));
-	serveraddr.sin_family = AF_INET;
-	serveraddr.sin_port = htons(port);
+	memset(serveraddr, 0, sizeof(struct sockaddr_in));
+	serveraddr->sin_family = AF_INET;
+	serveraddr->sin_port = htons(port);
+	if ((addr != NULL) && (*addr != 0)) serveraddr->sin_addr.s_addr = inet_addr(addr);
+	else serveraddr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
 
-	syncsd_debug("connect to %s", addr);
-	if ((addr != NULL) && (*addr != 0)) serveraddr.sin_addr.s_addr = inet_addr(addr);
-	else serveraddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	return socketfd;
+}
+
+int syncs_tcpclient_open(const char *addr, int port)
+{
+	struct sockaddr_in serveraddr;
+	int socketfd;
+
+	if ((socketfd = syncs_tcpclient_socket(&serveraddr, addr, port)) < 0)
+		return -1;
 
+	syncsd_debug("connect to %s", addr);
 	if (connect(socketfd, (struct sockaddr *) &serveraddr, sizeof(struct sockaddr_in)) != 0) {
 		close(socketfd);
 		syncsd_error("can't connect to tcp socket:%s", strerror(errno));
@@ -96,6 +105,25 @@ int syncs_tcpclient_open(const char *addr, int port)
 	return socketfd;
 }
 
+int syncs_tcpclient_open_async(const char *addr, int port)
+{
+	struct sockaddr_in serveraddr;
+	int socketfd;
+
+	if ((socketfd = syncs_tcpclient_socket(&serveraddr, addr, port)) < 0)
+		return -1;
+	fcntl(socketfd, F_SETFL, fcntl(socketfd, F_GETFL, 0) | O_NONBLOCK);
+
+	syncsd_debug("start connect to %s", addr);
+	if ((connect(socketfd, (struct sockaddr *) &serveraddr, sizeof(struct sockaddr_in)) != 0) && (errno != EINPROGRESS)) {
+		close(socketfd);
+		syncsd_debug("can't connect to tcp socket:%s", strerror(errno));
+		return -2;
+	}
+
+	return socketfd;
+}
+
 void syncs_tcpclient_close(int socketfd)
 {
 	shutdown(socketfd, 2);
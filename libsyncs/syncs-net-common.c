@@ -31,6 +31,7 @@
 #include <fcntl.h>
 #include <net/route.h>
 #include <sys/ioctl.h>
+#include <poll.h>
 #include <ifaddrs.h>
 #include <net/if.h>
 
@@ -188,6 +189,28 @@ int syncs_blocking_send(int sock, void *buffer, uint32_t len, int flags)
 	return 0;
 }
 
+int syncs_stream_send(int sock, void *buffer, uint32_t len, int flags, int timeout_ms)
+{
+	struct pollfd pfd = { .fd = sock, .events = POLLOUT };
+	unsigned char *_buffer = (unsigned char *) buffer;
+	int ssent;
+
+	while (len > 0) {
+		ssent = send(sock, _buffer, len, flags);
+		if (ssent == -1) {
+			if (errno == EINTR)
+				continue;
+			// a frame is never left half sent while the peer reads
+			if ((errno == EAGAIN) && (poll(&pfd, 1, timeout_ms) > 0))
+				continue;
+			return -1;
+		}
+		_buffer += ssent;
+		len -= ssent;
+	}
+	return 0;
+}
+
 int syncs_udp_send(int sock, void *buffer, uint32_t len,  struct sockaddr_in *saddr, uint32_t saddr_size)
 {
 	sendto(sock, buffer, len, MSG_NOSIGNAL, (struct sockaddr *) saddr, saddr_size);
@@ -93,7 +93,7 @@ int syncs_tcpserver_open(const char *addr, int port)
 		return -2;
 	}
 
-	if (listen(socketfd, 5) != 0) {
+	if (listen(socketfd, SOMAXCONN) != 0) {
 		close(socketfd);
 		syncsd_error("can't listen tcp socket:%s", strerror(errno));
 		return -3;
@@ -74,6 +74,18 @@ int syncs_udpmulticast_open(const char *addr, int port);
  */
 int syncs_tcpclient_open(const char *addr, int port);
 
+/**
+ * @brief Opens a non-blocking TCP client socket and starts connecting.
+ *
+ * The socket becomes writable when the connection is done, SO_ERROR tells
+ * whether it succeeded.
+ *
+ * @param addr The server address.
+ * @param port The server port.
+ * @return The socket file descriptor on success, negative value on failure.
+ */
+int syncs_tcpclient_open_async(const char *addr, int port);
+
 /**
  * @brief Closes the specified TCP client socket.
  *
@@ -118,6 +130,18 @@ void syncs_set_nonblocking_socket(int socketfd, int rx_size, int tx_size);
  */
 int syncs_blocking_send(int sock, void *buffer, int len, int flags);
 
+/**
+ * @brief Sends data on a non-blocking stream socket, waits while the socket is full.
+ *
+ * @param sock The socket file descriptor.
+ * @param buffer The data buffer to send.
+ * @param len The length of the data buffer.
+ * @param flags The flags for the send operation.
+ * @param timeout_ms The longest wait for the socket to become writable.
+ * @return 0 on success, -1 on failure or timeout.
+ */
+int syncs_stream_send(int sock, void *buffer, uint32_t len, int flags, int timeout_ms);
+
 /**
  * @brief Sends data on a UDP socket.
  *
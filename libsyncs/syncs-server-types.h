@@ -23,19 +23,147 @@
 extern "C" {
 #endif
 
+#include <pthread.h>
+#include <sys/epoll.h>
 #include "syncs-types.h"
+#include "syncs-hash.h"
 
+#define SYNCS_SERVER_EVENT_CHUNK_SHIFT	6
+#define SYNCS_SERVER_EVENT_CHUNK	(1 << SYNCS_SERVER_EVENT_CHUNK_SHIFT)
+#define SYNCS_SERVER_EVENT_LIMIT	(1024 * 1024)
+// handle is the event index with a generation of the slot in upper bits, the 12 bits wrap,
+// so a client may write only by handles it was given for the full generation of the slot
+#define SYNCS_SERVER_HANDLE_INDEX_BITS	20
+#define SYNCS_SERVER_HANDLE_INDEX_MASK	((1 << SYNCS_SERVER_HANDLE_INDEX_BITS) - 1)
+#define SYNCS_SERVER_CLIENT_CHUNK_SHIFT	6
+#define SYNCS_SERVER_CLIENT_CHUNK	(1 << SYNCS_SERVER_CLIENT_CHUNK_SHIFT)
+#define SYNCS_SERVER_CLIENT_LIMIT	(64 * 1024)
+#define SYNCS_SERVER_EPOLL_BATCH	256
+// buffer of a split record is released after so many reads which left no tail
+#define SYNCS_SERVER_BUFFER_IDLE	64
+// chunks of huge variables and stream batches are sent while the socket keeps less unsent data
+#define SYNCS_SERVER_QUEUE_LIMIT	(64 * 1024)
+#define SYNCS_SERVER_STREAM_DEPTH	64
+// frames queued in user space for a client, new ones are dropped above the high watermark
+// until the client reads the queue down to the low one
+#define SYNCS_SERVER_OUTQ_HIGH		(4 * 1024 * 1024)
+#define SYNCS_SERVER_OUTQ_LOW		(1024 * 1024)
+#define SYNCS_SERVER_OUTQ_CHUNK		16
+// staged frames of client which are sent before the end of tick
+#define SYNCS_SERVER_BUNDLE_LIMIT	(64 * 1024)
+#define SYNCS_SERVER_OUTQ_IOV		64
+// zero-copy calls of a client which wait for the kernel, copying sends are used when it is full
+#define SYNCS_SERVER_ZC_PENDING		64
+// datagrams taken by one recvmmsg or sent by one sendmmsg
+#define SYNCS_SERVER_UDP_BATCH		32
+#define SYNCS_SERVER_UDP_DATAGRAM	SYNCS_FRAME_SIZE_MAXIMUM
+#define SYNCS_SERVER_UDP_IDLE_MS	(4 * SYNCS_UDP_KEEPALIVE_MS)
+// io_uring backend, a recv buffer with the tail of partial packet fits the client buffer
+#define SYNCS_SERVER_URING_ENTRIES	256
+#define SYNCS_SERVER_URING_BUFFERS	64
+#define SYNCS_SERVER_URING_BUFFER_SIZE	(SYNCS_CLIENT_BUFFER_SIZE / 2)
+#define SYNCS_SERVER_URING_SENDS	64
+#define SYNCS_SERVER_UDP_EXPIRY_MS	1000
+#define SYNCS_SERVER_REACTOR_MAXIMUM	16
+// encoded frames of the value kept by event, every one is built on the first send after a change
+#define SYNCS_EVENT_FRAME_V3_HANDLE	0
+#define SYNCS_EVENT_FRAME_V3_ID		1
+#define SYNCS_EVENT_FRAME_HANDLE	2
+#define SYNCS_EVENT_FRAME_PACKET	3
+#define SYNCS_EVENT_FRAME_READ_V3	4
+#define SYNCS_EVENT_FRAME_READ		5
+#define SYNCS_EVENT_FRAMES		6
+// slots of the mailbox of reactor, power of two
+#define SYNCS_SERVER_MAILBOX_SIZE	1024
 
 struct syncs_epoll_cb {
 	void *socket;
 	int (*cb)(void *, uint32_t);
 };
 
+struct syncs_event;
+struct syncs_channel;
+
+/* value of huge variable, it is shared by the event and all transfers which send it */
+struct syncs_blob {
+	uint32_t refs;
+	uint32_t size;
+	uint64_t update_counter;
+	uint8_t data[];
+};
+
+/* ring of the last elements of stream, the element of sequence n is kept in slot n % depth */
+struct syncs_stream {
+	uint64_t head;
+	uint32_t depth;
+	uint32_t slot_size;
+	uint16_t *sizes;
+	uint8_t *data;
+};
+
+/* serialized frame queued for clients, it is shared by all of them and never changed */
+struct syncs_outframe {
+	uint32_t refs;
+	uint32_t size;
+	// chunk of huge value isn't copied, it goes from the blob at ext_offset of the frame
+	struct syncs_blob *blob;
+	const uint8_t *ext;
+	uint32_t ext_offset;
+	uint32_t ext_size;
+	uint8_t data[];
+};
+
+/* entry of the client queue, v3 frame is sent with own header which keeps the sequence of client */
+struct syncs_outentry {
+	struct syncs_outframe *frame;
+	// event of conflating subscription, its newer value replaces the frame until it is started
+	struct syncs_event *event;
+	uint32_t offset;
+	uint32_t head_size;
+	struct syncs_frame_header head;
+};
+
+/* frame sent with MSG_ZEROCOPY is kept until the kernel reports the call done, the head is a copy */
+struct syncs_zcentry {
+	struct syncs_outframe *frame;
+	uint32_t call;
+	uint8_t done;
+	struct syncs_frame_header head;
+};
+
+/* huge value queued for a client, chunks are sent from offset */
+struct syncs_transfer {
+	syncsid_t id;
+	uint32_t handle;
+	uint32_t transfer;
+	uint32_t offset;
+	struct syncs_blob *blob;
+	struct syncs_transfer *next;
+};
+
+/* entry of event->consumers, slot is the position in client->subscriptions,
+   cursor is the sequence of the last stream element sent to the client */
+struct syncs_consumer {
+	struct syncs_client *client;
+	uint32_t slot;
+	uint64_t cursor;
+};
+
+/* entry of client->subscriptions, slot is the position in event->consumers,
+   queued is the number of the last frame of the event in the client queue */
+struct syncs_subscription {
+	struct syncs_event *event;
+	uint32_t slot;
+	uint32_t queued;
+	uint8_t conflate;
+};
+
 struct syncs_client {
 	syncsid_t id;
 	int socketfd;
 	struct syncs_epoll_cb epoll_data;
 	struct syncs_server *server;
+	struct syncs_reactor *reactor;
 	struct sockaddr_in addr;
 	int addr_size;
 	int event_subscribe;
@@ -44,12 +172,122 @@ struct syncs_client {
 	int tx_event_count;
         int tx_error;
 	int version;
-	uint8_t buffer[SYNCS_CLIENT_BUFFER_SIZE];
+	uint32_t protocol;
+	uint32_t tx_sequence;
+	uint8_t *buffer;
 	uint32_t buffer_recv;
+	uint32_t buffer_idle;
 	uint8_t key[SYNCS_CRYPT_KEY_SIZE];
+	// grown by subscribe with the exclusive table lock, fan-outs read it with the shared one
+	struct syncs_subscription *subscriptions;
+	uint32_t subscriptions_size;
+	struct syncs_channel *channels;
+	struct syncs_transfer *tx_head;
+	struct syncs_transfer *tx_tail;
+	struct syncs_client *pump_next;
+	int pumped;
+	uint32_t stream_lag;
+	struct syncs_blob *rx_blob;
+	uint32_t rx_transfer;
+	uint32_t rx_offset;
+	uint32_t rx_handle;
+	// handles given to the client, keyed by handle and generation of the slot
+	struct syncs_hash handles;
+	// frames which the socket didn't take, any thread queues and the reactor flushes on EPOLLOUT
+	pthread_mutex_t out_mutex;
+	struct syncs_outentry *out;
+	uint32_t out_size;
+	uint32_t out_first;
+	uint32_t out_count;
+	uint32_t out_bytes;
+	// frames ever queued, numbers the entries for conflation
+	uint32_t out_pushed;
+	uint32_t conflated;
+	uint8_t out_congested;
+	uint8_t out_watched;
+	// frames staged by the reactor during the tick are sent together at its end
+	uint8_t staged;
+	struct syncs_client *stage_next;
+	uint64_t tx_frames;
+	uint64_t tx_syscalls;
+	// frames of zero-copy calls which the kernel still reads, ring of SYNCS_SERVER_ZC_PENDING
+	struct syncs_zcentry *zc;
+	uint32_t zc_first;
+	uint32_t zc_count;
+	uint32_t zc_call;
+	uint8_t zc_enabled;
+	uint64_t zc_sends;
+	uint64_t zc_copied;
+	// monotonic time of the last datagram of udp session, sessions are listed from the oldest one
+	uint64_t udp_seen_ms;
+	struct syncs_client *udp_prev;
+	struct syncs_client *udp_next;
+	// stale completions of io_uring requests of the previous connection are ignored
+	uint32_t uring_gen;
+	uint32_t index;
+	struct syncs_client *next_free;
 };
 
 
+/* value written on one reactor, it is fanned out to the clients of another one */
+struct syncs_mail {
+	uint64_t sequence;
+	struct syncs_mail *next;
+	uint32_t handle;
+	uint32_t flags;
+	struct syncs_client *producer;
+	struct syncs_header header;
+	char data[SYNCS_VARIABLE_SIZE_MAXIMUM];
+};
+
+/*
+ * Lock-free ring, any thread posts and only the owner reactor takes. When the ring is full,
+ * mails go to the overflow list until the reactor empties both, so the order is kept.
+ */
+struct syncs_mailbox {
+	struct syncs_mail *mails;
+	uint64_t tail __attribute__((aligned(64)));
+	uint64_t head __attribute__((aligned(64)));
+	uint32_t overflowed;
+	pthread_mutex_t overflow_mutex;
+	struct syncs_mail *overflow_head;
+	struct syncs_mail *overflow_tail;
+};
+
+struct syncs_udp_batch;
+struct syncs_uring;
+struct syncs_uring_send;
+
+/* thread with own listener on the shared port, epoll set and clients */
+struct syncs_reactor {
+	struct syncs_server *server;
+	uint32_t index;
+	pthread_t thread;
+	int socketfd;
+	int epollfd;
+	int wakefd;
+	int timerfd;
+	uint32_t notified;
+	uint32_t timer_armed;
+	struct syncs_epoll_cb epoll_data;
+	struct syncs_epoll_cb epoll_wakedata;
+	struct syncs_epoll_cb epoll_timerdata;
+	struct syncs_client *staged_head;
+	// io_uring receives and accepts, the other ring sends staged frames at once, NULL with epoll
+	struct syncs_uring *uring;
+	struct syncs_uring *uring_tx;
+	struct syncs_uring_send *uring_sends;
+	uint64_t rx_syscalls;
+	// counters of clients which are closed already
+	uint64_t tx_frames;
+	uint64_t tx_syscalls;
+	uint64_t zc_sends;
+	uint64_t zc_copied;
+	struct syncs_mailbox mailbox;
+	struct epoll_event socket_events[SYNCS_SERVER_EPOLL_BATCH];
+	uint8_t buffer[SYNCS_CLIENT_BUFFER_SIZE];
+};
+
 struct syncs_event {
 	syncsid_t id;
 	char data[SYNCS_VARIABLE_SIZE_MAXIMUM];
@@ -58,11 +296,27 @@ struct syncs_event {
 	uint32_t count;
 	uint64_t update_counter;
 	uint32_t consumers_count;
+	uint32_t consumers_size;
 	uint32_t producers_count;
-	struct syncs_client *consumers[SYNCS_CLIENT_MAXIMUM];
+	// reallocated only with the exclusive table lock, writers fan out with the shared one
+	struct syncs_consumer *consumers;
 	struct syncs_client *producer;
+	struct syncs_blob *blob;
+	struct syncs_stream *stream;
+	struct syncs_outframe *frames[SYNCS_EVENT_FRAMES];
 	void (*cb)(void *, char *, void *, uint32_t);
 	void *args;
+	uint32_t index;
+	uint32_t handle;
+	uint32_t generation;
+	uint8_t lock;
+	// publish policy, write within it updates the value but isn't sent
+	uint8_t onchange;
+	uint8_t published;
+	double deadband;
+	double deadband_percent;
+	double published_value;
+	struct syncs_event *next_free;
 };
 
 struct syncs_channel {
@@ -72,21 +326,36 @@ struct syncs_channel {
 	uint32_t request_count;
 	uint32_t producers_count;
 	struct syncs_client *producer;
+	struct syncs_channel *producer_next;
+	struct syncs_channel **producer_prev;
 };
 
 struct syncs_server {
 	syncsid_t id;
 	char addr[20];
 	int port;
-	int socketfd;
-	int epollfd;
 	uint8_t key[SYNCS_CRYPT_KEY_SIZE];
-	struct syncs_epoll_cb epoll_data;
         struct syncs_epoll_cb epoll_udpdata;
-	struct epoll_event socket_events[SYNCS_CLIENT_MAXIMUM];
-	pthread_t thread;
-	struct syncs_event events[SYNCS_EVENT_MAXIMUM];
-	struct syncs_client clients[SYNCS_CLIENT_MAXIMUM];
+	// the first reactor also owns udp socket and sends queued transfers
+	struct syncs_reactor *reactors;
+	uint32_t reactor_count;
+	// reactors process writes in parallel, other messages change tables exclusively
+	pthread_rwlock_t lock;
+	uint32_t outq_high;
+	uint32_t outq_low;
+	uint32_t bundle_us;
+	uint32_t backend;
+	uint32_t zerocopy_bytes;
+	// chunk arrays are allocated for the limits, chunks are added under the table lock
+	struct syncs_event **event_chunks;
+	uint32_t event_chunk_count;
+	uint32_t event_capacity;
+	struct syncs_event *event_free;
+	struct syncs_hash event_index;
+	struct syncs_client **client_chunks;
+	uint32_t client_chunk_count;
+	uint32_t client_capacity;
+	struct syncs_client *client_free;
 	struct syncs_channel channels[SYNCS_CHANNEL_MAXIMUM];
 	uint32_t channel_count;
 	uint32_t event_count;
@@ -97,15 +366,61 @@ struct syncs_server {
 	int usocketfd;
 	int uepollfd;
 	struct syncs_epoll_cb uepoll_data;
-        uint8_t ubuffer[SYNCS_CLIENT_BUFFER_SIZE];
+	// datagrams of the first reactor are batched in both directions
+	struct syncs_udp_batch *udp_rx;
+	struct syncs_udp_batch *udp_tx;
+	uint64_t udp_rx_datagrams;
+	uint64_t udp_rx_syscalls;
+	uint64_t udp_tx_datagrams;
+	uint64_t udp_tx_syscalls;
+	// udp sessions are found by address and by id, the idle ones are expired by timer
+	struct syncs_hash uclient_addr_index;
+	struct syncs_hash uclient_id_index;
+	int udp_timerfd;
+	struct syncs_epoll_cb epoll_udptimerdata;
+	uint32_t udp_idle_ms;
+	uint64_t udp_now_ms;
+	uint64_t udp_expired;
+	// udp sessions by last activity, the timer looks only at the head
+	struct syncs_client *udp_oldest;
+	struct syncs_client *udp_newest;
+	uint64_t suppressed;
 	uint8_t crypt_buffer[SYNCS_VARIABLE_SIZE_MAXIMUM+16];
 	int uclient_count;
 
 	int ssdp_socketfd;
 	pthread_t ssdp_thread;
         int ssdp_beacon;
+
+	// huge values and lagging streams are queued by any thread and sent by the server thread
+	pthread_mutex_t pump_mutex;
+	struct syncs_client *pump_head;
+	uint8_t *huge_frame;
+	uint32_t huge_transfer;
 };
 
+static inline struct syncs_event *syncs_event_at(struct syncs_server *s, uint32_t i)
+{
+	return &s->event_chunks[i >> SYNCS_SERVER_EVENT_CHUNK_SHIFT][i & (SYNCS_SERVER_EVENT_CHUNK - 1)];
+}
+
+static inline struct syncs_event *syncs_event_by_handle(struct syncs_server *s, uint32_t handle)
+{
+	struct syncs_event *event;
+
+	if ((handle & SYNCS_SERVER_HANDLE_INDEX_MASK) >= s->event_capacity)
+		return NULL;
+	event = syncs_event_at(s, handle & SYNCS_SERVER_HANDLE_INDEX_MASK);
+	if ((event->handle != handle) || (event->id.i[0] == -1))
+		return NULL;
+	return event;
+}
+
+static inline struct syncs_client *syncs_client_at(struct syncs_server *s, uint32_t i)
+{
+	return &s->client_chunks[i >> SYNCS_SERVER_CLIENT_CHUNK_SHIFT][i & (SYNCS_SERVER_CLIENT_CHUNK - 1)];
+}
+
 #ifdef __cplusplus
 }
 #endif
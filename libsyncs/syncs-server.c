@@ -16,6 +16,7 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  ***************************************************************/
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -27,10 +28,20 @@
 #include <errno.h>
 #include <sys/socket.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
+#include <linux/errqueue.h>
 
 #include "syncs-net.h"
 #include "syncs-common.h"
 #include "syncs-crypt.h"
+#include "syncs-hash.h"
+#include "syncs-uring.h"
+#include "syncs-frame.h"
 #include "syncs-server-types.h"
 
 #define MODULE_NAME "syncs-server"
@@ -39,20 +50,168 @@
 #define syncsd_debug(fmt,args...)
 
 #define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+
+// reactor which runs in the thread, user threads have none
+static __thread struct syncs_reactor *syncs_reactor_current;
+
+static uint64_t syncs_monotonic_ms(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/* tables are shared by the reactors and user threads, both lock them even with one reactor */
+static inline void syncs_server_lock(struct syncs_server *s)
+{
+	pthread_rwlock_wrlock(&s->lock);
+}
+
+static inline void syncs_server_lock_shared(struct syncs_server *s)
+{
+	pthread_rwlock_rdlock(&s->lock);
+}
+
+static inline void syncs_server_unlock(struct syncs_server *s)
+{
+	pthread_rwlock_unlock(&s->lock);
+}
+
+/* the same event may be written by several reactors or user threads at once */
+static inline void syncs_event_lock(struct syncs_server *s, struct syncs_event *event)
+{
+	while (__atomic_test_and_set(&event->lock, __ATOMIC_ACQUIRE))
+		;
+}
+
+static inline void syncs_event_unlock(struct syncs_server *s, struct syncs_event *event)
+{
+	__atomic_clear(&event->lock, __ATOMIC_RELEASE);
+}
+
+static inline uint64_t syncs_next_update_counter(struct syncs_server *s)
+{
+	return __atomic_fetch_add(&s->update_counter, 1, __ATOMIC_RELAXED);
+}
+
+/* grows with the table lock, the chunk array is sized to the limit so it never moves */
+static int syncs_grow_clients(struct syncs_server *s)
+{
+	struct syncs_client *chunk;
+	int i;
+
+	if (s->client_capacity >= SYNCS_SERVER_CLIENT_LIMIT)
+		return -1;
+
+	chunk = calloc(SYNCS_SERVER_CLIENT_CHUNK, sizeof(struct syncs_client));
+	if (chunk == NULL)
+		return -1;
+
+	for (i = SYNCS_SERVER_CLIENT_CHUNK - 1; i >= 0; i--) {
+		chunk[i].socketfd = -1;
+		chunk[i].index = s->client_capacity + i;
+		pthread_mutex_init(&chunk[i].out_mutex, NULL);
+		chunk[i].next_free = s->client_free;
+		s->client_free = &chunk[i];
+	}
+	s->client_chunks[s->client_chunk_count++] = chunk;
+	__atomic_store_n(&s->client_capacity, s->client_capacity + SYNCS_SERVER_CLIENT_CHUNK, __ATOMIC_RELEASE);
+	syncsd_debug("client table grows to %u", s->client_capacity);
+	return 0;
+}
 
 struct syncs_client *syncs_get_free_client(struct syncs_server *s)
+{
+	struct syncs_client *c;
+
+	if ((s->client_free == NULL) && syncs_grow_clients(s)) {
+		syncsd_error("havn't space for new client");
+		return NULL;
+	}
+	c = s->client_free;
+	s->client_free = c->next_free;
+	c->next_free = NULL;
+	return c;
+}
+
+static void syncs_put_free_client(struct syncs_server *s, struct syncs_client *c)
+{
+	c->socketfd = -1;
+	c->buffer_recv = 0;
+	c->conflated = 0;
+	if (c->handles.slots != NULL)
+		syncs_hash_release(&c->handles);
+	if (c->buffer != NULL) {
+		free(c->buffer);
+		c->buffer = NULL;
+	}
+	c->next_free = s->client_free;
+	s->client_free = c;
+}
+
+static struct syncs_blob *syncs_blob_create(uint32_t size)
+{
+	struct syncs_blob *blob = malloc(sizeof(struct syncs_blob) + size);
+
+	if (blob != NULL) {
+		blob->refs = 1;
+		blob->size = size;
+		blob->update_counter = 0;
+	}
+	return blob;
+}
+
+static void syncs_blob_get(struct syncs_blob *blob)
+{
+	__atomic_add_fetch(&blob->refs, 1, __ATOMIC_RELAXED);
+}
+
+static void syncs_blob_put(struct syncs_blob *blob)
+{
+	if ((blob != NULL) && (__atomic_sub_fetch(&blob->refs, 1, __ATOMIC_ACQ_REL) == 0))
+		free(blob);
+}
+
+static struct syncs_outframe *syncs_outframe_alloc(uint32_t size)
+{
+	struct syncs_outframe *frame = malloc(sizeof(struct syncs_outframe) + size);
+
+	if (frame != NULL) {
+		frame->refs = 1;
+		frame->size = size;
+		frame->blob = NULL;
+		frame->ext = NULL;
+		frame->ext_offset = 0;
+		frame->ext_size = 0;
+	}
+	return frame;
+}
+
+static void syncs_outframe_put(struct syncs_outframe *frame)
+{
+	if (__atomic_sub_fetch(&frame->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+		syncs_blob_put(frame->blob);
+		free(frame);
+	}
+}
+
+/* value of event changes, frames of the old one are released by the last client which sends them */
+static void syncs_event_drop_frames(struct syncs_event *event)
 {
 	int i;
-	for (i = 0; i < SYNCS_CLIENT_MAXIMUM; i++)
-		if (s->clients[i].socketfd == -1)
-			return(&s->clients[i]);
-	syncsd_error("havn't space for new client");
-	return NULL;
+
+	for (i = 0; i < SYNCS_EVENT_FRAMES; i++)
+		if (event->frames[i] != NULL) {
+			syncs_outframe_put(event->frames[i]);
+			event->frames[i] = NULL;
+		}
 }
 
 void syncs_event_init(struct syncs_event *event, syncsid_t *id)
 {
-	int i;
+	syncs_event_drop_frames(event);
 	event->args = NULL;
 	event->cb = NULL;
 	event->count = 0;
@@ -63,16 +222,80 @@ void syncs_event_init(struct syncs_event *event, syncsid_t *id)
 	event->update_counter = 0;
 	event->consumers_count = 0;
 	event->producers_count = 0;
+	event->onchange = 0;
+	event->published = 0;
+	event->deadband = 0;
+	event->deadband_percent = 0;
+	// consumers vector is kept by the slot and reused by the next event
+	syncs_idcpy(&event->id, id);
+}
 
-	for (i = 0; i < SYNCS_CLIENT_MAXIMUM; i++) {
-		event->consumers[i] = NULL;
+static int syncs_event_numeric(uint32_t type)
+{
+	return (type == SYNCS_TYPE_VAR_INT32) || (type == SYNCS_TYPE_VAR_INT64) ||
+		(type == SYNCS_TYPE_VAR_FLOAT) || (type == SYNCS_TYPE_VAR_DOUBLE);
+}
+
+static double syncs_event_number(uint32_t type, const void *data)
+{
+	int32_t i32;
+	int64_t i64;
+	float f;
+	double d;
+
+	switch (type) {
+	case SYNCS_TYPE_VAR_INT32:
+		memcpy(&i32, data, sizeof(i32));
+		return i32;
+	case SYNCS_TYPE_VAR_INT64:
+		memcpy(&i64, data, sizeof(i64));
+		return i64;
+	case SYNCS_TYPE_VAR_FLOAT:
+		memcpy(&f, data, sizeof(f));
+		return f;
+	default:
+		memcpy(&d, data, sizeof(d));
+		return d;
 	}
-	syncs_idcpy(&event->id, id);
+}
+
+/*
+ * Value within the publish policy is only stored, numbers are compared with the
+ * last sent one, so slow drift is still sent once it leaves the deadband.
+ * Must be called with the event lock before the value is copied.
+ */
+static int syncs_event_suppress(struct syncs_event *event, const void *data, uint32_t data_size)
+{
+	double value, diff, band;
+
+	if (!event->onchange)
+		return 0;
+	if (!syncs_event_numeric(event->data_type) || (data_size < syncs_get_size_by_type(event->data_type))) {
+		if (event->published && (data_size == event->data_size) && !memcmp(event->data, data, data_size))
+			return 1;
+		event->published = 1;
+		return 0;
+	}
+	value = syncs_event_number(event->data_type, data);
+	if (event->published) {
+		diff = (value > event->published_value) ? value - event->published_value : event->published_value - value;
+		band = event->deadband_percent / 100 * ((event->published_value < 0) ? -event->published_value : event->published_value);
+		if (band < event->deadband)
+			band = event->deadband;
+		// NaN is never within the band
+		if (diff <= band)
+			return 1;
+	}
+	event->published = 1;
+	event->published_value = value;
+	return 0;
 }
 
 void syncs_channel_init(struct syncs_channel *channel, syncsid_t *id)
 {
 	channel->producer = NULL;
+	channel->producer_next = NULL;
+	channel->producer_prev = NULL;
 	channel->anons_count = 0;
 	channel->producers_count = 0;
 	channel->request_count = 0;
@@ -94,54 +317,74 @@ struct syncs_channel *syncs_create_channel(struct syncs_server *s, syncsid_t *id
 	return NULL;
 }
 
-struct syncs_event *syncs_create_event(struct syncs_server *s, syncsid_t *id)
+/* grows with the table lock, the chunk array is sized to the limit so it never moves */
+static int syncs_grow_events(struct syncs_server *s)
 {
+	struct syncs_event *chunk;
 	int i;
 
-	for (i = 0; i < SYNCS_EVENT_MAXIMUM; i++)
-		if (s->events[i].id.i[0] == -1) {
-			syncs_event_init(&s->events[i], id);
-			s->event_count++;
-			return &s->events[i];
-		}
-	syncsd_error("haven't space for create event");
-	return NULL;
+	if (s->event_capacity >= SYNCS_SERVER_EVENT_LIMIT)
+		return -1;
+
+	chunk = calloc(SYNCS_SERVER_EVENT_CHUNK, sizeof(struct syncs_event));
+	if (chunk == NULL)
+		return -1;
+
+	// chunks are never moved or released, so event pointers stay valid
+	for (i = SYNCS_SERVER_EVENT_CHUNK - 1; i >= 0; i--) {
+		chunk[i].id.i[0] = -1;
+		chunk[i].index = s->event_capacity + i;
+		chunk[i].handle = s->event_capacity + i;
+		chunk[i].next_free = s->event_free;
+		s->event_free = &chunk[i];
+	}
+	s->event_chunks[s->event_chunk_count++] = chunk;
+	__atomic_store_n(&s->event_capacity, s->event_capacity + SYNCS_SERVER_EVENT_CHUNK, __ATOMIC_RELEASE);
+	syncsd_debug("event table grows to %u", s->event_capacity);
+	return 0;
+}
+
+struct syncs_event *syncs_create_event(struct syncs_server *s, syncsid_t *id)
+{
+	struct syncs_event *event;
+
+	if ((s->event_free == NULL) && syncs_grow_events(s)) {
+		syncsd_error("haven't space for create event");
+		return NULL;
+	}
+
+	event = s->event_free;
+	syncs_event_init(event, id);
+	if (syncs_hash_insert_id(&s->event_index, event)) {
+		event->id.i[0] = -1;
+		syncsd_error("haven't space for index event");
+		return NULL;
+	}
+	s->event_free = event->next_free;
+	event->next_free = NULL;
+	s->event_count++;
+	return event;
 }
 
+/* the index is resized by inserts, callers hold the table lock */
 struct syncs_event *syncs_find_event(struct syncs_server *s, syncsid_t *id)
 {
-	int i;
-	for (i = 0; i < SYNCS_EVENT_MAXIMUM; i++)
-		if (syncs_idcmp(&s->events[i].id, id)) {
-			return &s->events[i];
-		}
-	return NULL;
+	return syncs_hash_find_id(&s->event_index, id);
+}
+
+static inline uint64_t syncs_uclient_key(struct sockaddr_in *addr)
+{
+	return ((uint64_t) addr->sin_addr.s_addr << 16) | addr->sin_port;
 }
 
 struct syncs_client *syncs_find_uclient_id(struct syncs_server *s, syncsid_t *id)
 {
-	int i;
-	for (i = 0; i < SYNCS_CLIENT_MAXIMUM; i++) {
-		if (s->clients[i].socketfd != UDP_SOCKET_STUB) continue;
-		if (syncs_idcmp(&s->clients[i].id, id)) {
-			return &s->clients[i];
-		}
-	}
-	return NULL;
+	return syncs_hash_find_id(&s->uclient_id_index, id);
 }
 
 struct syncs_client *syncs_find_uclient_addr(struct syncs_server *s, struct sockaddr_in *addr)
 {
-	int i;
-	for (i = 0; i < SYNCS_CLIENT_MAXIMUM; i++) {
-		if (s->clients[i].socketfd != UDP_SOCKET_STUB) continue;
-		if (s->clients[i].addr.sin_addr.s_addr != addr->sin_addr.s_addr)
-			continue;
-		if (s->clients[i].addr.sin_port != addr->sin_port)
-			continue;
-		return &s->clients[i];
-	}
-	return NULL;
+	return syncs_hash_find_key(&s->uclient_addr_index, syncs_uclient_key(addr));
 }
 
 struct syncs_channel *syncs_find_channel(struct syncs_server *s, syncsid_t *id)
@@ -154,183 +397,1672 @@ struct syncs_channel *syncs_find_channel(struct syncs_server *s, syncsid_t *id)
 	return NULL;
 }
 
+static int syncs_grow_vector(void **vector, uint32_t *vector_size, size_t item_size)
+{
+	void *items;
+	uint32_t size = (*vector_size) ? *vector_size * 2 : 4;
+
+	items = realloc(*vector, size * item_size);
+	if (items == NULL)
+		return -1;
+	*vector = items;
+	*vector_size = size;
+	return 0;
+}
+
+/* looks through the shorter of event consumers and client subscriptions */
+static int syncs_find_consumer(struct syncs_client *c, struct syncs_event *event)
+{
+	uint32_t i;
+
+	if ((uint32_t) c->event_subscribe < event->consumers_count) {
+		for (i = 0; i < (uint32_t) c->event_subscribe; i++)
+			if (c->subscriptions[i].event == event)
+				return c->subscriptions[i].slot;
+	} else {
+		for (i = 0; i < event->consumers_count; i++)
+			if (event->consumers[i].client == c)
+				return i;
+	}
+	return -1;
+}
+
+/*
+ * Both vectors are unordered, the last entry takes the hole and
+ * the back-index of moved entry is fixed in the opposite vector.
+ */
+static void syncs_remove_consumer(struct syncs_event *event, uint32_t i)
+{
+	struct syncs_client *c = event->consumers[i].client;
+	uint32_t j = event->consumers[i].slot;
+	struct syncs_consumer *consumer;
+	struct syncs_subscription *subscription;
+
+	if (i != --event->consumers_count) {
+		consumer = &event->consumers[i];
+		*consumer = event->consumers[event->consumers_count];
+		consumer->client->subscriptions[consumer->slot].slot = i;
+	}
+	if (j != (uint32_t) --c->event_subscribe) {
+		subscription = &c->subscriptions[j];
+		*subscription = c->subscriptions[c->event_subscribe];
+		subscription->event->consumers[subscription->slot].slot = j;
+	}
+}
+
+static struct syncs_stream *syncs_stream_create(uint32_t depth, uint32_t element_size)
+{
+	struct syncs_stream *stream;
+
+	if ((element_size == 0) || (element_size > SYNCS_VARIABLE_SIZE_MAXIMUM))
+		element_size = SYNCS_VARIABLE_SIZE_MAXIMUM;
+	stream = calloc(1, sizeof(struct syncs_stream));
+	if (stream == NULL)
+		return NULL;
+	stream->depth = (depth) ? depth : SYNCS_SERVER_STREAM_DEPTH;
+	stream->slot_size = SYNCS_FRAME_PAD(element_size);
+	stream->sizes = malloc(stream->depth * sizeof(uint16_t));
+	stream->data = malloc((size_t) stream->depth * stream->slot_size);
+	if ((stream->sizes == NULL) || (stream->data == NULL)) {
+		free(stream->sizes);
+		free(stream->data);
+		free(stream);
+		return NULL;
+	}
+	return stream;
+}
+
+static void syncs_stream_release(struct syncs_stream *stream)
+{
+	if (stream == NULL)
+		return;
+	free(stream->sizes);
+	free(stream->data);
+	free(stream);
+}
+
+/* event takes the reference of the new value */
+static void syncs_event_set_blob(struct syncs_server *s, struct syncs_event *event, struct syncs_blob *blob)
+{
+	struct syncs_blob *old;
+
+	pthread_mutex_lock(&s->pump_mutex);
+	old = event->blob;
+	event->blob = blob;
+	pthread_mutex_unlock(&s->pump_mutex);
+	syncs_blob_put(old);
+}
+
 void syncs_free_event(struct syncs_server *s, syncsid_t *id)
 {
 	struct syncs_event *event = syncs_find_event(s, id);
 
 	if (event != NULL) {
+		while (event->consumers_count)
+			syncs_remove_consumer(event, event->consumers_count - 1);
+		syncs_event_set_blob(s, event, NULL);
+		syncs_event_lock(s, event);
+		syncs_event_drop_frames(event);
+		syncs_event_unlock(s, event);
+		pthread_mutex_lock(&s->pump_mutex);
+		syncs_stream_release(event->stream);
+		event->stream = NULL;
+		pthread_mutex_unlock(&s->pump_mutex);
+		syncs_hash_remove_id(&s->event_index, event);
 		event->id.i[0] = -1;
+		// handles of the old event become stale
+		event->handle += 1 << SYNCS_SERVER_HANDLE_INDEX_BITS;
+		event->generation++;
+		event->next_free = s->event_free;
+		s->event_free = event;
 		s->event_count--;
 	}
 }
 
+static void syncs_set_channel_producer(struct syncs_channel *channel, struct syncs_client *c)
+{
+	if (channel->producer_prev != NULL) {
+		*channel->producer_prev = channel->producer_next;
+		if (channel->producer_next != NULL)
+			channel->producer_next->producer_prev = channel->producer_prev;
+		channel->producer_next = NULL;
+		channel->producer_prev = NULL;
+	}
+	channel->producer = c;
+	if (c != NULL) {
+		channel->producer_next = c->channels;
+		if (c->channels != NULL)
+			c->channels->producer_prev = &channel->producer_next;
+		channel->producer_prev = &c->channels;
+		c->channels = channel;
+	}
+}
+
+static void syncs_release_channel(struct syncs_server *s, struct syncs_channel *channel)
+{
+	syncs_set_channel_producer(channel, NULL);
+	channel->id.i[0] = -1;
+	s->channel_count--;
+}
+
 void syncs_free_channel(struct syncs_server *s, syncsid_t *id)
 {
 	struct syncs_channel *channel = syncs_find_channel(s, id);
 
-	if (channel != NULL) {
-		channel->id.i[0] = -1;
-		s->channel_count--;
-	}
+	if (channel != NULL)
+		syncs_release_channel(s, channel);
 }
 
-static int syncs_client_send(struct syncs_client *c, struct syncs_packet *packet)
+static void syncs_reactor_wake(struct syncs_reactor *r)
 {
-	void *buffer;
-	uint32_t size;
+	uint64_t value = 1;
 
-	//TODO: add packet encoder
-	buffer = packet;
-	size = SYNCS_PACKET_SIZE(packet);
+	// reactor runs the pump and takes mails after every epoll batch by itself
+	if (pthread_equal(pthread_self(), r->thread))
+		return;
+	if (write(r->wakefd, &value, sizeof(uint64_t)) < 0)
+		syncsd_debug("couldn't wake reactor %u: %s", r->index, strerror(errno));
+}
 
-	if (c->socketfd > -1) {
-		return(syncs_blocking_send(c->socketfd, buffer, size, MSG_NOSIGNAL));
-	} else if (c->socketfd == UDP_SOCKET_STUB) {
-		syncs_udp_send(c->server->usocketfd, buffer, size, &c->addr, c->addr_size);
-		return 0;
-	}
-	return -1;
+static int syncs_reactor_wake_handler(void *reactor, uint32_t epoll_event)
+{
+	struct syncs_reactor *r = reactor;
+	uint64_t value;
+
+	if (read(r->wakefd, &value, sizeof(uint64_t)) < 0)
+		syncsd_debug("couldn't read wake descriptor: %s", strerror(errno));
+	return 0;
 }
 
-int syncs_add_client_to_event(struct syncs_client *c, struct syncs_event *event, struct syncs_client *consumers[])
+/* queued transfers are sent by the first reactor */
+static void syncs_server_wake(struct syncs_server *s)
 {
-	int i;
+	syncs_reactor_wake(&s->reactors[0]);
+}
 
-	syncsd_debug("add client to event");
-	for (i = 0; i < SYNCS_CLIENT_MAXIMUM; i++) {
-		if (consumers[i] == c) {
-			syncsd_error("already subscribes, skip");
-			return 0;
-		}
+/* socket of client is watched for EPOLLOUT only while the queue keeps frames */
+static void syncs_client_watch_out(struct syncs_client *c, int out)
+{
+	struct epoll_event socket_event;
+	uint8_t watch;
+	int op;
+
+	socket_event.data.ptr = &c->epoll_data;
+	// io_uring receives by itself, epoll tells when the socket takes data again or has zero-copy reports
+	if (c->reactor->uring != NULL) {
+		watch = (out) ? 1 : ((c->zc_count) ? 2 : 0);
+		if (c->out_watched == watch)
+			return;
+		socket_event.events = (watch == 1) ? EPOLLOUT : 0;
+		op = (c->out_watched == 0) ? EPOLL_CTL_ADD : ((watch == 0) ? EPOLL_CTL_DEL : EPOLL_CTL_MOD);
+		c->out_watched = watch;
+		epoll_ctl(c->reactor->epollfd, op, c->socketfd, &socket_event);
+		return;
 	}
-	for (i = 0; i < SYNCS_CLIENT_MAXIMUM; i++) {
-		syncsd_debug("active client %p in %d", event->consumers[i], i);
-		if (consumers[i] == NULL) {
-			syncsd_debug("add client %p in %d", c, i);
-			consumers[i] = c;
-			event->consumers_count++;
-			c->event_subscribe++;
-			return 0;
-		}
+	if (c->out_watched == out)
+		return;
+	c->out_watched = out;
+	socket_event.events = EPOLLIN | EPOLLERR | ((out) ? EPOLLOUT : 0);
+	epoll_ctl(c->reactor->epollfd, EPOLL_CTL_MOD, c->socketfd, &socket_event);
+}
+
+/* must be called with out_mutex */
+static void syncs_client_drop_queue(struct syncs_client *c)
+{
+	while (c->out_count) {
+		syncs_outframe_put(c->out[c->out_first].frame);
+		c->out_first = (c->out_first + 1) & (c->out_size - 1);
+		c->out_count--;
 	}
-	return -1;
+	c->out_bytes = 0;
+	c->out_congested = 0;
 }
 
-void syncs_remove_client_from_event(struct syncs_client *c, struct syncs_event *event)
+/* must be called with out_mutex */
+static int syncs_client_grow_queue(struct syncs_client *c)
 {
-	int i;
+	uint32_t size = (c->out_size) ? c->out_size * 2 : SYNCS_SERVER_OUTQ_CHUNK;
+	struct syncs_outentry *out;
+	uint32_t i;
 
-	syncsd_debug("looking for client %p in event %s", c, event->id.c);
-	for (i = 0; i < SYNCS_CLIENT_MAXIMUM; i++) {
-		syncsd_debug("active client %p in %d", event->consumers[i], i);
-		if (event->consumers[i] == c) {
-			event->consumers[i] = NULL;
-			event->consumers_count--;
-			c->event_subscribe--;
-			return;
-		}
+	out = malloc(size * sizeof(struct syncs_outentry));
+	if (out == NULL)
+		return -1;
+	for (i = 0; i < c->out_count; i++)
+		out[i] = c->out[(c->out_first + i) & (c->out_size - 1)];
+	free(c->out);
+	c->out = out;
+	c->out_size = size;
+	c->out_first = 0;
+	return 0;
+}
+
+/* bytes of the frame from offset as iovec, chunk of blob is referenced in place */
+static uint32_t syncs_outframe_iov(struct syncs_outframe *frame, uint32_t offset, struct iovec *iov)
+{
+	const uint8_t *base[3] = { frame->data, frame->ext, frame->data + frame->ext_offset };
+	uint32_t start[3] = { 0, frame->ext_offset, frame->ext_offset + frame->ext_size };
+	uint32_t end[3] = { frame->ext_offset, frame->ext_offset + frame->ext_size, frame->size };
+	uint32_t i, count = 0;
+
+	if (frame->ext == NULL) {
+		iov[0].iov_base = frame->data + offset;
+		iov[0].iov_len = frame->size - offset;
+		return 1;
 	}
-	return;
+	for (i = 0; i < 3; i++) {
+		if (offset >= end[i])
+			continue;
+		iov[count].iov_base = (uint8_t *) base[i] + MAX(offset, start[i]) - start[i];
+		iov[count++].iov_len = end[i] - MAX(offset, start[i]);
+	}
+	return count;
 }
 
-void syncs_remove_client_from_events(struct syncs_client *c)
+/*
+ * Head of queue as iovec, frames are shared so only the personal head is taken from the entry.
+ * Zero-copy call takes as many frames as pending slots are free, heads are copied into the slots
+ * since the kernel reads them after the entries are reused.
+ */
+static uint32_t syncs_client_out_iov(struct syncs_client *c, struct msghdr *msg, struct iovec *iov, int zc)
 {
-	struct syncs_server *s = c->server;
-	int i;
-	for (i = 0; i < SYNCS_EVENT_MAXIMUM; i++) {
-		if (s->events[i].id.i[0] != -1) {
-			syncs_remove_client_from_event(c, &s->events[i]);
+	struct syncs_outentry *entry;
+	struct syncs_frame_header *head;
+	uint32_t i, offset, total = 0;
+
+	memset(msg, 0, sizeof(struct msghdr));
+	msg->msg_iov = iov;
+	for (i = 0; (i < c->out_count) && (msg->msg_iovlen + 4 <= SYNCS_SERVER_OUTQ_IOV); i++) {
+		if (zc && (c->zc_count + i >= SYNCS_SERVER_ZC_PENDING))
+			break;
+		entry = &c->out[(c->out_first + i) & (c->out_size - 1)];
+		offset = entry->offset;
+		if (offset < entry->head_size) {
+			head = &entry->head;
+			if (zc) {
+				head = &c->zc[(c->zc_first + c->zc_count + i) & (SYNCS_SERVER_ZC_PENDING - 1)].head;
+				memcpy(head, &entry->head, entry->head_size);
+			}
+			iov[msg->msg_iovlen].iov_base = (uint8_t *) head + offset;
+			iov[msg->msg_iovlen++].iov_len = entry->head_size - offset;
+			offset = entry->head_size;
 		}
+		msg->msg_iovlen += syncs_outframe_iov(entry->frame, offset, iov + msg->msg_iovlen);
+		total += entry->frame->size - entry->offset;
 	}
+	return total;
 }
 
-void syncs_remove_channels_of_client(struct syncs_client *c)
+static void syncs_client_out_sent(struct syncs_client *c, uint32_t sent)
 {
-	struct syncs_server *s = c->server;
-	int i;
-	for (i = 0; i < SYNCS_CHANNEL_MAXIMUM; i++) {
-		if (s->channels[i].id.i[0] != -1) {
-			if (s->channels[i].producer == c)
-				s->channels[i].id.i[0] = -1;
+	struct syncs_outentry *entry;
+	uint32_t left;
+
+	c->out_bytes -= sent;
+	while (sent > 0) {
+		entry = &c->out[c->out_first];
+		left = entry->frame->size - entry->offset;
+		if (sent < left) {
+			entry->offset += sent;
+			break;
 		}
+		sent -= left;
+		syncs_outframe_put(entry->frame);
+		c->out_first = (c->out_first + 1) & (c->out_size - 1);
+		c->out_count--;
 	}
 }
 
-int syncs_server_subscribe_event(struct syncs_server *s, uint32_t flags, const char *cid, void (*cb)(void *, char *, void *, uint32_t), void *args)
+static int syncs_client_out_done(struct syncs_client *c)
 {
-	syncsid_t id;
-	struct syncs_event *event;
+	if (c->out_congested && (c->out_bytes <= c->server->outq_low))
+		c->out_congested = 0;
+	syncs_client_watch_out(c, c->out_count != 0);
+	return (c->out_count == 0) && c->pumped;
+}
 
-	syncs_idstr(&id, cid);
-	event = syncs_find_event(s, &id);
+/* frame at the head of queue is large enough and the kernel can take one more zero-copy call */
+static int syncs_client_zerocopy(struct syncs_client *c)
+{
+	return c->zc_enabled && (c->zc_count < SYNCS_SERVER_ZC_PENDING) &&
+		(c->out[c->out_first].frame->size >= c->server->zerocopy_bytes);
+}
 
-	if (event == NULL) {
-		if (!(flags & SYNCS_TYPE_FORCE)) return -1;
-		event = syncs_create_event(s, &id);
-		if (event == NULL) return -2;
+/* frames touched by the sent bytes stay referenced until the report of the call, must be called with out_mutex */
+static void syncs_client_zc_hold(struct syncs_client *c, uint32_t sent)
+{
+	struct syncs_outentry *entry;
+	struct syncs_zcentry *slot;
+	uint32_t i, left;
+
+	for (i = 0; sent > 0; i++) {
+		entry = &c->out[(c->out_first + i) & (c->out_size - 1)];
+		slot = &c->zc[(c->zc_first + c->zc_count) & (SYNCS_SERVER_ZC_PENDING - 1)];
+		__atomic_add_fetch(&entry->frame->refs, 1, __ATOMIC_RELAXED);
+		slot->frame = entry->frame;
+		slot->call = c->zc_call;
+		slot->done = 0;
+		c->zc_count++;
+		left = entry->frame->size - entry->offset;
+		sent -= MIN(sent, left);
 	}
-
-	event->args = args;
-	event->cb = cb;
-
-	return 0;
+	// kernel numbers every zero-copy call of the socket from 0
+	c->zc_call++;
+	c->zc_sends++;
 }
 
-void syncs_server_unsubscribe_event(struct syncs_server *s, const char *cid)
+/* reports of the error queue give ranges of finished calls, frames are released in the order of calls */
+static void syncs_client_zc_reap(struct syncs_client *c)
 {
-	syncsid_t id;
-	struct syncs_event *event;
+	uint64_t control[16];
+	struct sock_extended_err *err;
+	struct syncs_zcentry *slot;
+	struct cmsghdr *cm;
+	struct msghdr msg;
+	uint32_t i, calls;
 
-	syncs_idstr(&id, cid);
-	event = syncs_find_event(s, &id);
-
-	if (event == NULL) return;
-
-	event->cb = NULL;
-	event->args = NULL;
+	while (1) {
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		if (recvmsg(c->socketfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+			break;
+		for (cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+			if ((cm->cmsg_level != SOL_IP) || (cm->cmsg_type != IP_RECVERR))
+				continue;
+			err = (struct sock_extended_err *) CMSG_DATA(cm);
+			if ((err->ee_errno != 0) || (err->ee_origin != SO_EE_ORIGIN_ZEROCOPY))
+				continue;
+			calls = err->ee_data - err->ee_info + 1;
+			if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+				c->zc_copied += calls;
+			for (i = 0; i < c->zc_count; i++) {
+				slot = &c->zc[(c->zc_first + i) & (SYNCS_SERVER_ZC_PENDING - 1)];
+				if (slot->call - err->ee_info < calls)
+					slot->done = 1;
+			}
+		}
+	}
+	while (c->zc_count && c->zc[c->zc_first].done) {
+		syncs_outframe_put(c->zc[c->zc_first].frame);
+		c->zc_first = (c->zc_first + 1) & (SYNCS_SERVER_ZC_PENDING - 1);
+		c->zc_count--;
+	}
 }
 
-void syncs_sync_calculate(int offset_s, int offset_ms, struct syncdata *sync)
+/* socket is closed, pages stay pinned by the kernel so the frames may go, must be called with out_mutex */
+static void syncs_client_zc_drop(struct syncs_client *c)
 {
-	struct timespec sync_time;
-
-	clock_gettime(CLOCK_REALTIME, &sync_time);
-	sync_time.tv_sec += offset_s;
-	sync_time.tv_nsec += offset_ms * 1000000L;
-	if (sync_time.tv_nsec > 1000000000L) {
-		sync_time.tv_nsec -= 1000000000L;
-		sync_time.tv_sec++;
+	while (c->zc_count) {
+		syncs_outframe_put(c->zc[c->zc_first].frame);
+		c->zc_first = (c->zc_first + 1) & (SYNCS_SERVER_ZC_PENDING - 1);
+		c->zc_count--;
 	}
-	sync->data0 = sync_time.tv_sec;
-	sync->data1 = sync_time.tv_nsec;
 }
 
-int syncs_send_event(struct syncs_server *s, struct syncs_event *event, int flags)
+/*
+ * Writes queued frames while the socket takes them, EPOLLOUT is watched when a part is left.
+ * Must be called with out_mutex, returns 1 when transfers of the client wait for the queue.
+ */
+static int syncs_client_flush_locked(struct syncs_client *c)
 {
-	struct syncs_packet packet;
- 	struct syncs_client *c;
+	struct iovec iov[SYNCS_SERVER_OUTQ_IOV];
+	struct msghdr msg;
+	uint32_t total;
+	ssize_t sent;
+	int zc;
+
+	if (c->zc_count)
+		syncs_client_zc_reap(c);
+	while (c->out_count) {
+		zc = syncs_client_zerocopy(c);
+		total = syncs_client_out_iov(c, &msg, iov, zc);
+		// writev with MSG_NOSIGNAL, peer which is gone mustn't kill the server
+		sent = sendmsg(c->socketfd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT | ((zc) ? MSG_ZEROCOPY : 0));
+		c->tx_syscalls++;
+		// kernel has no memory for the reports, the data is copied this time
+		if ((sent < 0) && zc && (errno == ENOBUFS)) {
+			zc = 0;
+			sent = sendmsg(c->socketfd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+			c->tx_syscalls++;
+		}
+		if ((sent > 0) && zc)
+			syncs_client_zc_hold(c, sent);
+		if (sent < 0) {
+			if ((errno == EAGAIN) || (errno == EINTR))
+				break;
+			syncsd_debug("couldn't flush client %s: %s", c->id.c, strerror(errno));
+			syncs_client_drop_queue(c);
+			break;
+		}
+		syncs_client_out_sent(c, sent);
+		// socket is full when it takes only a part
+		if ((uint32_t) sent < total)
+			break;
+	}
+	return syncs_client_out_done(c);
+}
+
+static void syncs_client_flush(struct syncs_client *c)
+{
+	int wake;
+
+	pthread_mutex_lock(&c->out_mutex);
+	wake = syncs_client_flush_locked(c);
+	pthread_mutex_unlock(&c->out_mutex);
+	// transfers of client are paused while its queue isn't empty
+	if (wake)
+		syncs_server_wake(c->server);
+}
+
+/* slots of mmsghdr point to their own buffer and address */
+struct syncs_udp_batch {
+	struct mmsghdr msgs[SYNCS_SERVER_UDP_BATCH];
+	struct iovec iov[SYNCS_SERVER_UDP_BATCH];
+	struct sockaddr_in addrs[SYNCS_SERVER_UDP_BATCH];
+	uint32_t count;
+	uint8_t buffers[SYNCS_SERVER_UDP_BATCH][SYNCS_SERVER_UDP_DATAGRAM];
+};
+
+static struct syncs_udp_batch *syncs_udp_batch_alloc(void)
+{
+	struct syncs_udp_batch *b;
+	uint32_t i;
+
+	b = calloc(1, sizeof(struct syncs_udp_batch));
+	if (b == NULL)
+		return NULL;
+	for (i = 0; i < SYNCS_SERVER_UDP_BATCH; i++) {
+		b->iov[i].iov_base = b->buffers[i];
+		b->iov[i].iov_len = SYNCS_SERVER_UDP_DATAGRAM;
+		b->msgs[i].msg_hdr.msg_name = &b->addrs[i];
+		b->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+		b->msgs[i].msg_hdr.msg_iov = &b->iov[i];
+		b->msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	return b;
+}
+
+/* datagrams are lost on errors the same way as with sendto */
+static void syncs_udp_flush(struct syncs_server *s)
+{
+	struct syncs_udp_batch *b = s->udp_tx;
+	uint32_t sent = 0;
+	int ret;
+
+	while (sent < b->count) {
+		ret = sendmmsg(s->usocketfd, b->msgs + sent, b->count - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+		s->udp_tx_syscalls++;
+		if (ret > 0) {
+			sent += ret;
+			continue;
+		}
+		if ((ret < 0) && (errno == EINTR))
+			continue;
+		syncsd_debug("couldn't send %u udp datagrams: %s", b->count - sent, strerror(errno));
+		// the head datagram is skipped, the rest may still go
+		sent++;
+	}
+	s->udp_tx_datagrams += b->count;
+	b->count = 0;
+}
+
+/* the first reactor stages datagrams during the tick, other threads send them at once */
+static void syncs_udp_queue(struct syncs_client *c, void *buffer, uint32_t size)
+{
+	struct syncs_server *s = c->server;
+	struct syncs_udp_batch *b = s->udp_tx;
+	uint32_t i;
+
+	if ((syncs_reactor_current != &s->reactors[0]) || (s->bundle_us == SYNCS_BUNDLE_NONE) ||
+		(size > SYNCS_SERVER_UDP_DATAGRAM)) {
+		syncs_udp_send(s->usocketfd, buffer, size, &c->addr, c->addr_size);
+		__atomic_fetch_add(&s->udp_tx_datagrams, 1, __ATOMIC_RELAXED);
+		__atomic_fetch_add(&s->udp_tx_syscalls, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	i = b->count++;
+	memcpy(b->buffers[i], buffer, size);
+	b->iov[i].iov_len = size;
+	b->addrs[i] = c->addr;
+	b->msgs[i].msg_hdr.msg_namelen = c->addr_size;
+	if (b->count == SYNCS_SERVER_UDP_BATCH)
+		syncs_udp_flush(s);
+}
+
+/* slot of one sendmsg which is in flight in the send ring */
+struct syncs_uring_send {
+	struct syncs_client *client;
+	struct msghdr msg;
+	struct iovec iov[SYNCS_SERVER_OUTQ_IOV];
+	uint32_t total;
+};
+
+static int syncs_client_sent_uring(struct syncs_client *c, struct syncs_uring_send *send, int res)
+{
+	if (res < 0) {
+		if ((res != -EAGAIN) && (res != -EINTR)) {
+			syncsd_debug("couldn't flush client %s: %s", c->id.c, strerror(-res));
+			syncs_client_drop_queue(c);
+		}
+		return syncs_client_out_done(c);
+	}
+	syncs_client_out_sent(c, res);
+	// queue longer than one sendmsg is sent by the usual way
+	if (((uint32_t) res == send->total) && c->out_count)
+		return syncs_client_flush_locked(c);
+	return syncs_client_out_done(c);
+}
+
+/* staged clients are sent by one io_uring_enter, their queues are locked until the sends complete */
+static void syncs_reactor_flush_uring(struct syncs_reactor *r)
+{
+	struct syncs_uring *u = r->uring_tx;
+	struct syncs_uring_send *send;
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	struct syncs_client *c;
+	uint32_t i, count, done;
+	int wake;
+
+	while (r->staged_head != NULL) {
+		count = 0;
+		while (((c = r->staged_head) != NULL) && (count < SYNCS_SERVER_URING_SENDS)) {
+			r->staged_head = c->stage_next;
+			c->stage_next = NULL;
+			c->staged = 0;
+			pthread_mutex_lock(&c->out_mutex);
+			// zero-copy sends and their reports go by the socket calls
+			sqe = (c->out_count && !syncs_client_zerocopy(c)) ? syncs_uring_get_sqe(u) : NULL;
+			if (sqe == NULL) {
+				wake = syncs_client_flush_locked(c);
+				pthread_mutex_unlock(&c->out_mutex);
+				if (wake)
+					syncs_server_wake(c->server);
+				continue;
+			}
+			send = &r->uring_sends[count];
+			send->client = c;
+			send->total = syncs_client_out_iov(c, &send->msg, send->iov, 0);
+			sqe->opcode = IORING_OP_SENDMSG;
+			sqe->fd = c->socketfd;
+			sqe->addr = (uint64_t) (uintptr_t) &send->msg;
+			sqe->len = 1;
+			sqe->msg_flags = MSG_NOSIGNAL | MSG_DONTWAIT;
+			sqe->user_data = count++;
+		}
+		for (done = 0; done < count; ) {
+			cqe = syncs_uring_peek(u);
+			if (cqe == NULL) {
+				r->tx_syscalls++;
+				if (syncs_uring_enter(u, count - done, -1) >= 0)
+					continue;
+				// nothing is in flight, the rest is sent by the usual way
+				syncsd_error("couldn't submit sends: %s", strerror(errno));
+				syncs_uring_discard(u);
+				for (i = 0; i < count; i++)
+					if (r->uring_sends[i].client != NULL)
+						syncs_client_sent_uring(r->uring_sends[i].client, &r->uring_sends[i], -EAGAIN);
+				break;
+			}
+			send = &r->uring_sends[cqe->user_data];
+			wake = syncs_client_sent_uring(send->client, send, cqe->res);
+			syncs_uring_seen(u);
+			done++;
+			c = send->client;
+			send->client = NULL;
+			pthread_mutex_unlock(&c->out_mutex);
+			if (wake)
+				syncs_server_wake(c->server);
+		}
+	}
+}
+
+/* sends everything which clients of the reactor got during the tick */
+static void syncs_reactor_flush(struct syncs_reactor *r)
+{
+	struct syncs_client *c;
+
+	if (r->uring_tx != NULL) {
+		syncs_reactor_flush_uring(r);
+		return;
+	}
+	while ((c = r->staged_head) != NULL) {
+		r->staged_head = c->stage_next;
+		c->stage_next = NULL;
+		c->staged = 0;
+		syncs_client_flush(c);
+	}
+}
+
+/* without the latency budget frames wait only for the end of the current tick */
+static void syncs_reactor_end_tick(struct syncs_reactor *r)
+{
+	struct itimerspec budget;
+
+	// datagrams don't wait for the latency budget, nothing is queued behind them
+	if ((r->index == 0) && r->server->udp_tx->count)
+		syncs_udp_flush(r->server);
+	if (r->staged_head == NULL)
+		return;
+	if (r->server->bundle_us == 0) {
+		syncs_reactor_flush(r);
+		return;
+	}
+	if (r->timer_armed)
+		return;
+	memset(&budget, 0, sizeof(budget));
+	budget.it_value.tv_sec = r->server->bundle_us / 1000000;
+	budget.it_value.tv_nsec = (r->server->bundle_us % 1000000) * 1000;
+	if (timerfd_settime(r->timerfd, 0, &budget, NULL)) {
+		syncsd_debug("couldn't arm bundle timer: %s", strerror(errno));
+		syncs_reactor_flush(r);
+		return;
+	}
+	r->timer_armed = 1;
+}
+
+static int syncs_reactor_timer_handler(void *reactor, uint32_t epoll_event)
+{
+	struct syncs_reactor *r = reactor;
+	uint64_t value;
+
+	if (read(r->timerfd, &value, sizeof(uint64_t)) < 0)
+		syncsd_debug("couldn't read bundle timer: %s", strerror(errno));
+	r->timer_armed = 0;
+	syncs_reactor_flush(r);
+	return 0;
+}
+
+/* entry of the queue by the number it got, NULL when it is sent already */
+static struct syncs_outentry *syncs_client_out_find(struct syncs_client *c, uint32_t number)
+{
+	uint32_t first = c->out_pushed - c->out_count;
+
+	if (number - first >= c->out_count)
+		return NULL;
+	return &c->out[(c->out_first + number - first) & (c->out_size - 1)];
+}
+
+/*
+ * Sends the frame at once when nothing is queued before it, the unsent rest is queued.
+ * Frames which the reactor of client sends itself are only staged, they go together
+ * at the end of tick. Shared frame is only referenced, private buffer is copied when it
+ * has to wait. v3 frame (head_size isn't 0) goes with a copy of its header which gets
+ * the sequence of client. Frame of conflating subscription replaces its previous one
+ * which isn't started yet and isn't dropped for congestion, the queue keeps at most one
+ * frame per such subscription.
+ */
+static int syncs_client_queue(struct syncs_client *c, struct syncs_outframe *frame, void *buffer, uint32_t size, uint32_t head_size,
+	struct syncs_subscription *sub)
+{
+	struct syncs_reactor *r = c->reactor;
+	struct syncs_frame_header head;
+	struct syncs_outentry *entry;
+	struct iovec iov[2];
+	struct msghdr msg;
+	int stage = (syncs_reactor_current == r) && (c->server->bundle_us != SYNCS_BUNDLE_NONE);
+	int zc = (frame != NULL) && c->zc_enabled && (frame->size >= c->server->zerocopy_bytes);
+	int conflate = (sub != NULL) && sub->conflate;
+	int sent = 0;
+	int wake = 0;
+	int ret = 0;
+
+	if (frame != NULL) {
+		buffer = frame->data;
+		size = frame->size;
+	}
+	pthread_mutex_lock(&c->out_mutex);
+	if (c->socketfd < 0) {
+		ret = -1;
+		goto out;
+	}
+	if (conflate && ((entry = syncs_client_out_find(c, sub->queued)) != NULL) &&
+		(entry->event == sub->event) && (entry->offset == 0)) {
+		// receiver sees the sequence of the replaced frame, nothing is lost for it
+		__atomic_add_fetch(&frame->refs, 1, __ATOMIC_RELAXED);
+		c->out_bytes += size - entry->frame->size;
+		syncs_outframe_put(entry->frame);
+		entry->frame = frame;
+		if (head_size) {
+			memcpy(&head, buffer, head_size);
+			head.sequence = entry->head.sequence;
+			memcpy(&entry->head, &head, head_size);
+		}
+		entry->head_size = head_size;
+		c->conflated++;
+		goto out;
+	}
+	if (head_size) {
+		memcpy(&head, buffer, head_size);
+		head.sequence = c->tx_sequence++;
+	}
+	// zero-copy frame goes through the queue, which keeps it until the kernel is done
+	if ((c->out_count == 0) && !stage && !zc) {
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		if (head_size) {
+			iov[0].iov_base = &head;
+			iov[0].iov_len = head_size;
+			msg.msg_iovlen = 1;
+		}
+		iov[msg.msg_iovlen].iov_base = (uint8_t *) buffer + head_size;
+		iov[msg.msg_iovlen++].iov_len = size - head_size;
+		sent = sendmsg(c->socketfd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+		c->tx_syscalls++;
+		if (sent < 0) {
+			if ((errno != EAGAIN) && (errno != EINTR)) {
+				ret = -1;
+				goto out;
+			}
+			sent = 0;
+		}
+		if ((uint32_t) sent == size) {
+			c->tx_frames++;
+			goto out;
+		}
+	}
+	// slow client loses whole frames, a started one is always completed
+	if ((sent == 0) && !conflate && (c->out_congested || (c->out_bytes + size > c->server->outq_high))) {
+		c->out_congested = 1;
+		ret = -1;
+		goto out;
+	}
+	if ((c->out_count == c->out_size) && syncs_client_grow_queue(c))
+		goto error_alloc;
+	if (frame == NULL) {
+		frame = syncs_outframe_alloc(size);
+		if (frame == NULL)
+			goto error_alloc;
+		memcpy(frame->data, buffer, size);
+	} else
+		__atomic_add_fetch(&frame->refs, 1, __ATOMIC_RELAXED);
+
+	entry = &c->out[(c->out_first + c->out_count) & (c->out_size - 1)];
+	entry->frame = frame;
+	entry->event = (conflate) ? sub->event : NULL;
+	if (conflate)
+		sub->queued = c->out_pushed;
+	c->out_pushed++;
+	entry->offset = sent;
+	entry->head_size = head_size;
+	if (head_size)
+		memcpy(&entry->head, &head, head_size);
+	c->out_count++;
+	c->out_bytes += size - sent;
+	c->tx_frames++;
+	if (!stage) {
+		if (zc)
+			wake = syncs_client_flush_locked(c);
+		else
+			syncs_client_watch_out(c, 1);
+		goto out;
+	}
+	if (!c->staged) {
+		c->staged = 1;
+		c->stage_next = r->staged_head;
+		r->staged_head = c;
+	}
+	// large data doesn't wait, there is nothing to bundle it with
+	if (c->out_bytes >= SYNCS_SERVER_BUNDLE_LIMIT)
+		wake = syncs_client_flush_locked(c);
+	goto out;
+
+error_alloc:
+	syncsd_error("couldn't queue frame for client %s", c->id.c);
+	// receiver can't find the next frame after a half sent one
+	if (sent)
+		shutdown(c->socketfd, SHUT_RDWR);
+	ret = -1;
+out:
+	pthread_mutex_unlock(&c->out_mutex);
+	if (wake)
+		syncs_server_wake(c->server);
+	return ret;
+}
+
+static int syncs_client_send_buffer(struct syncs_client *c, void *buffer, uint32_t size)
+{
+	if (c->socketfd > -1) {
+		return syncs_client_queue(c, NULL, buffer, size, 0, NULL);
+	} else if (c->socketfd == UDP_SOCKET_STUB) {
+		syncs_udp_queue(c, buffer, size);
+		return 0;
+	}
+	return -1;
+}
+
+/* frame may be shared by many clients, only the sequence is personal */
+static int syncs_client_send_frame(struct syncs_client *c, void *frame, uint32_t size)
+{
+	if (c->socketfd > -1)
+		return syncs_client_queue(c, NULL, frame, size, sizeof(struct syncs_frame_header), NULL);
+	syncs_frame_set_sequence(frame, c->tx_sequence++);
+	return syncs_client_send_buffer(c, frame, size);
+}
+
+static int syncs_client_send_outframe(struct syncs_client *c, struct syncs_outframe *frame, uint32_t head_size,
+	struct syncs_subscription *sub)
+{
+	uint64_t buffer[SYNCS_FRAME_SIZE_MAXIMUM / sizeof(uint64_t)];
+
+	if (c->socketfd > -1)
+		return syncs_client_queue(c, frame, NULL, 0, head_size, sub);
+	// datagram is personal, the shared frame isn't changed
+	memcpy(buffer, frame->data, frame->size);
+	if (head_size)
+		return syncs_client_send_frame(c, buffer, frame->size);
+	return syncs_client_send_buffer(c, buffer, frame->size);
+}
+
+static int syncs_client_send(struct syncs_client *c, struct syncs_packet *packet)
+{
+	uint64_t frame[SYNCS_FRAME_SIZE_MAXIMUM / sizeof(uint64_t)];
+
+	if (c->protocol & SYNCS_PROTOCOL_V3)
+		return syncs_client_send_frame(c, frame, syncs_frame_encode(frame, &packet->header, packet->buffer, 0, NULL));
+	return syncs_client_send_buffer(c, packet, SYNCS_PACKET_SIZE(packet));
+}
+
+static inline uint64_t syncs_handle_key(struct syncs_event *event)
+{
+	return ((uint64_t) event->generation << 32) | event->handle;
+}
+
+/* handle is remembered before it is sent, the client writes by it only after */
+static int syncs_client_send_handle(struct syncs_client *c, struct syncs_event *event)
+{
+	struct syncs_packet packet;
+	uint64_t key = syncs_handle_key(event);
+
+	if ((c->handles.slots == NULL) && syncs_hash_init(&c->handles, 0))
+		return -1;
+	if ((syncs_hash_find_key(&c->handles, key) == NULL) && syncs_hash_insert_key(&c->handles, key, event))
+		return -1;
+
+	syncs_fill_header(&packet.header, &event->id, SYNCS_TYPE_ACK | event->data_type);
+	packet.header.data_size = sizeof(uint32_t);
+	memcpy(packet.buffer, &event->handle, sizeof(uint32_t));
+	c->tx_event_count++;
+	return syncs_client_send(c, &packet);
+}
+
+/* client gets into the pump list, must be called with pump_mutex */
+static void syncs_pump_client(struct syncs_server *s, struct syncs_client *c)
+{
+	if (c->pumped)
+		return;
+	c->pumped = 1;
+	c->pump_next = s->pump_head;
+	s->pump_head = c;
+}
+
+/* client has queued frames or the socket keeps so much unsent data that only real-time events should be added */
+static int syncs_client_congested(struct syncs_client *c)
+{
+	int queued;
+
+	if (c->socketfd < 0)
+		return 0;
+	if (__atomic_load_n(&c->out_count, __ATOMIC_RELAXED))
+		return 1;
+	return !ioctl(c->socketfd, SIOCOUTQ, &queued) && (queued >= SYNCS_SERVER_QUEUE_LIMIT);
+}
+
+/* must be called with pump_mutex */
+static int syncs_queue_transfer(struct syncs_server *s, struct syncs_client *c, struct syncs_event *event, struct syncs_blob *blob)
+{
+	struct syncs_transfer *t;
+
+	// value which isn't started yet is replaced by the newer one
+	for (t = c->tx_head; t != NULL; t = t->next)
+		if ((t->offset == 0) && (t->handle == event->handle)) {
+			syncs_blob_get(blob);
+			syncs_blob_put(t->blob);
+			t->blob = blob;
+			return 0;
+		}
+
+	t = malloc(sizeof(struct syncs_transfer));
+	if (t == NULL)
+		return -1;
+	syncs_idcpy(&t->id, &event->id);
+	t->handle = event->handle;
+	t->transfer = s->huge_transfer++;
+	t->offset = 0;
+	syncs_blob_get(blob);
+	t->blob = blob;
+	t->next = NULL;
+	if (c->tx_head == NULL)
+		c->tx_head = t;
+	else
+		c->tx_tail->next = t;
+	c->tx_tail = t;
+	syncs_pump_client(s, c);
+	return 0;
+}
+
+/* chunk which goes with zero-copy is referenced in the blob, only the header and padding are built */
+static struct syncs_outframe *syncs_outframe_chunk(struct syncs_header *header, const struct syncs_huge_chunk *chunk,
+	struct syncs_blob *blob, uint32_t size, const uint32_t *handle)
+{
+	struct syncs_outframe *frame;
+	uint32_t prefix, pad = SYNCS_FRAME_PAD(size) - size;
+
+	frame = syncs_outframe_alloc(SYNCS_HUGE_FRAME_SIZE_MAXIMUM - SYNCS_HUGE_CHUNK_SIZE + SYNCS_FRAME_ALIGN);
+	if (frame == NULL)
+		return NULL;
+	header->data_size = sizeof(struct syncs_huge_chunk);
+	prefix = syncs_frame_encode(frame->data, header, chunk, 0, handle);
+	((struct syncs_frame_header *) frame->data)->data_size += size;
+	memset(frame->data + prefix, 0, pad);
+	syncs_blob_get(blob);
+	frame->blob = blob;
+	frame->ext = blob->data + chunk->offset;
+	frame->ext_offset = prefix;
+	frame->ext_size = size;
+	frame->size = prefix + size + pad;
+	return frame;
+}
+
+/* sends the next chunk of the first transfer, must be called with pump_mutex */
+static void syncs_send_chunk(struct syncs_server *s, struct syncs_client *c)
+{
+	struct syncs_transfer *t = c->tx_head;
+	struct syncs_huge_chunk chunk;
+	struct syncs_header header;
+	uint32_t size = MIN(t->blob->size - t->offset, SYNCS_HUGE_CHUNK_SIZE);
+	struct syncs_outframe *frame;
+	uint32_t frame_size;
+	int ret;
+
+	syncs_fill_header(&header, &t->id, SYNCS_TYPE_EVENT | SYNCS_TYPE_VAR_HUGE);
+	header.update_counter = t->blob->update_counter;
+	chunk.transfer = t->transfer;
+	chunk.size = t->blob->size;
+	chunk.offset = t->offset;
+	chunk.reserved = 0;
+	if (c->zc_enabled && (size >= s->zerocopy_bytes)) {
+		frame = syncs_outframe_chunk(&header, &chunk, t->blob, size, (c->protocol & SYNCS_PROTOCOL_HANDLE) ? &t->handle : NULL);
+		ret = (frame != NULL) ? syncs_client_send_outframe(c, frame, sizeof(struct syncs_frame_header), NULL) : -1;
+		if (frame != NULL)
+			syncs_outframe_put(frame);
+	} else {
+		frame_size = syncs_frame_encode_chunk(s->huge_frame, &header, &chunk, t->blob->data + t->offset, size, 0,
+			(c->protocol & SYNCS_PROTOCOL_HANDLE) ? &t->handle : NULL);
+		ret = syncs_client_send_frame(c, s->huge_frame, frame_size);
+	}
+	if (ret) {
+		// receiver drops the broken transfer when a chunk of the next one comes
+		c->tx_error++;
+		size = t->blob->size - t->offset;
+	}
+	t->offset += size;
+	if (t->offset < t->blob->size)
+		return;
+
+	c->tx_event_count++;
+	c->tx_head = t->next;
+	syncs_blob_put(t->blob);
+	free(t);
+}
+
+/* must be called with pump_mutex */
+static void syncs_stream_append(struct syncs_stream *stream, void *data, uint32_t size)
+{
+	uint32_t slot;
+
+	stream->head++;
+	slot = stream->head % stream->depth;
+	size = MIN(size, stream->slot_size);
+	memcpy(stream->data + (size_t) slot * stream->slot_size, data, size);
+	stream->sizes[slot] = size;
+}
+
+/*
+ * Sends elements after the cursor of consumer in one frame, elements which are
+ * overwritten already are skipped and the receiver sees the jump of sequence.
+ * Must be called with pump_mutex.
+ */
+static int syncs_stream_send_batch(struct syncs_client *c, struct syncs_event *event, struct syncs_consumer *consumer)
+{
+	struct syncs_stream *stream = event->stream;
+	uint64_t batch[SYNCS_STREAM_BATCH_SIZE_MAXIMUM / sizeof(uint64_t)];
+	uint64_t frame[SYNCS_FRAME_SIZE_MAXIMUM / sizeof(uint64_t)];
+	struct syncs_stream_batch *head = (struct syncs_stream_batch *) batch;
+	struct syncs_stream_element *element;
+	struct syncs_header header;
+	uint32_t size = sizeof(struct syncs_stream_batch);
+	uint32_t slot;
+
+	if (stream->head - consumer->cursor > stream->depth) {
+		syncsd_debug("client %s lost %lu elements of %s", c->id.c, stream->head - stream->depth - consumer->cursor, event->id.c);
+		consumer->cursor = stream->head - stream->depth;
+	}
+	head->sequence = consumer->cursor + 1;
+	head->count = 0;
+	head->reserved = 0;
+	while (consumer->cursor < stream->head) {
+		slot = (consumer->cursor + 1) % stream->depth;
+		if (size + sizeof(struct syncs_stream_element) + SYNCS_FRAME_PAD(stream->sizes[slot]) > SYNCS_STREAM_BATCH_SIZE_MAXIMUM)
+			break;
+		element = (struct syncs_stream_element *) ((uint8_t *) batch + size);
+		element->size = stream->sizes[slot];
+		element->reserved = 0;
+		size += sizeof(struct syncs_stream_element);
+		if (element->size & (SYNCS_FRAME_ALIGN - 1))
+			*(uint64_t *) ((uint8_t *) batch + size + SYNCS_FRAME_PAD(element->size) - sizeof(uint64_t)) = 0;
+		memcpy((uint8_t *) batch + size, stream->data + (size_t) slot * stream->slot_size, element->size);
+		size += SYNCS_FRAME_PAD(element->size);
+		head->count++;
+		consumer->cursor++;
+	}
+
+	syncs_fill_header(&header, &event->id, SYNCS_TYPE_EVENT | SYNCS_TYPE_VAR_STREAM);
+	header.update_counter = event->update_counter;
+	header.data_size = size;
+	c->tx_event_count++;
+	return syncs_client_send_frame(c, frame, syncs_frame_encode(frame, &header, batch, 0,
+		(c->protocol & SYNCS_PROTOCOL_HANDLE) ? &event->handle : NULL));
+}
+
+/* one batch of every lagging stream of client, must be called with pump_mutex */
+static void syncs_stream_catch_up(struct syncs_server *s, struct syncs_client *c)
+{
+	struct syncs_subscription *subscription;
+	struct syncs_consumer *consumer;
+	uint32_t lag = 0;
 	int i;
 
-	syncs_fill_header(&packet.header, &event->id, SYNCS_TYPE_EVENT | event->data_type);
-	memcpy(packet.buffer, event->data, event->data_size);
-	packet.header.data_size = event->data_size;
+	for (i = 0; i < c->event_subscribe; i++) {
+		subscription = &c->subscriptions[i];
+		if (subscription->event->stream == NULL)
+			continue;
+		consumer = &subscription->event->consumers[subscription->slot];
+		if (consumer->cursor == subscription->event->stream->head)
+			continue;
+		if (syncs_stream_send_batch(c, subscription->event, consumer))
+			c->tx_error++;
+		if (consumer->cursor != subscription->event->stream->head)
+			lag++;
+	}
+	c->stream_lag = lag;
+}
 
-	if (flags & SYNCS_TYPE_SYNC) {
-		packet.header.type |= SYNCS_TYPE_SYNC;
-		syncs_sync_calculate(0, s->sync_offset, &packet.header.sync);
+/*
+ * Sends one chunk and one batch of every lagging stream to every client in the pump list.
+ * Small events are sent between rounds, so they wait at most for the data which is
+ * already in the socket. Returns timeout for epoll_wait.
+ */
+static int syncs_pump_transfers(struct syncs_server *s)
+{
+	struct syncs_client **link, *c;
+	int sent = 0, timeout;
+
+	syncs_server_lock_shared(s);
+	pthread_mutex_lock(&s->pump_mutex);
+	link = &s->pump_head;
+	while ((c = *link) != NULL) {
+		if (!syncs_client_congested(c)) {
+			if (c->stream_lag)
+				syncs_stream_catch_up(s, c);
+			if (c->tx_head != NULL)
+				syncs_send_chunk(s, c);
+			sent++;
+		}
+		if ((c->tx_head == NULL) && !c->stream_lag) {
+			*link = c->pump_next;
+			c->pumped = 0;
+		} else
+			link = &c->pump_next;
 	}
+	// clients which are full are polled until their sockets are drained
+	if (s->pump_head == NULL)
+		timeout = -1;
+	else timeout = (sent) ? 0 : 1;
+	pthread_mutex_unlock(&s->pump_mutex);
+	syncs_server_unlock(s);
+	return timeout;
+}
 
-	syncsd_debug("send event %s", &event->id.c[0]);
-	for (i = 0; i < SYNCS_CLIENT_MAXIMUM; i++) {
-		c = event->consumers[i];
-		if (c == NULL) continue;
+static void syncs_drop_transfers(struct syncs_client *c)
+{
+	struct syncs_server *s = c->server;
+	struct syncs_client **link;
+	struct syncs_transfer *t;
+
+	pthread_mutex_lock(&s->pump_mutex);
+	if (c->pumped)
+		for (link = &s->pump_head; *link != NULL; link = &(*link)->pump_next)
+			if (*link == c) {
+				*link = c->pump_next;
+				break;
+			}
+	while ((t = c->tx_head) != NULL) {
+		c->tx_head = t->next;
+		syncs_blob_put(t->blob);
+		free(t);
+	}
+	c->tx_tail = NULL;
+	c->pump_next = NULL;
+	c->pumped = 0;
+	c->stream_lag = 0;
+	pthread_mutex_unlock(&s->pump_mutex);
+
+	syncs_blob_put(c->rx_blob);
+	c->rx_blob = NULL;
+}
+
+/*
+ * Written value is appended to the stream. Clients which are in time get the element
+ * at once, the others are caught up by the server thread with batches.
+ */
+static int syncs_send_stream(struct syncs_server *s, struct syncs_event *event, int flags)
+{
+	struct syncs_consumer *consumer;
+	struct syncs_client *c;
+	struct syncs_packet packet;
+	uint32_t i;
+	int lag = 0;
+	int ret;
+
+	pthread_mutex_lock(&s->pump_mutex);
+	if ((event->stream == NULL) && ((event->stream = syncs_stream_create(0, 0)) == NULL)) {
+		pthread_mutex_unlock(&s->pump_mutex);
+		syncsd_error("couldn't allocate stream %s", event->id.c);
+		return -1;
+	}
+	syncs_stream_append(event->stream, event->data, event->data_size);
+	packet.header.magic = 0;
+
+	for (i = 0; i < event->consumers_count; i++) {
+		consumer = &event->consumers[i];
+		c = consumer->client;
+		if (c == event->producer && !(flags & SYNCS_TYPE_ECHO)) {
+			consumer->cursor = event->stream->head;
+			continue;
+		}
+		if (!(c->protocol & SYNCS_PROTOCOL_STREAM)) {
+			// old clients get every element as an event of variable
+			if (packet.header.magic == 0) {
+				syncs_fill_header(&packet.header, &event->id, SYNCS_TYPE_EVENT | SYNCS_TYPE_VAR_STREAM);
+				memcpy(packet.buffer, event->data, event->data_size);
+				packet.header.data_size = event->data_size;
+				packet.header.update_counter = event->update_counter;
+			}
+			c->tx_event_count++;
+			ret = syncs_client_send(c, &packet);
+		} else if ((consumer->cursor + 1 == event->stream->head) && !syncs_client_congested(c))
+			ret = syncs_stream_send_batch(c, event, consumer);
+		else {
+			c->stream_lag++;
+			syncs_pump_client(s, c);
+			lag++;
+			continue;
+		}
+		if (ret)
+			c->tx_error++;
+	}
+	pthread_mutex_unlock(&s->pump_mutex);
+	if (lag)
+		syncs_server_wake(s);
+	return 0;
+}
+
+/* huge values are queued, the server thread sends them by chunks */
+static int syncs_send_huge(struct syncs_server *s, struct syncs_event *event, int flags)
+{
+	struct syncs_client *c;
+	uint32_t i;
+
+	pthread_mutex_lock(&s->pump_mutex);
+	for (i = 0; (event->blob != NULL) && (i < event->consumers_count); i++) {
+		c = event->consumers[i].client;
 		if (c == event->producer && !(flags & SYNCS_TYPE_ECHO)) continue;
+		if (!(c->protocol & SYNCS_PROTOCOL_HUGE)) {
+			syncsd_debug("client %s doesn't receive huge variables", c->id.c);
+			continue;
+		}
+		if (syncs_queue_transfer(s, c, event, event->blob))
+			c->tx_error++;
+	}
+	pthread_mutex_unlock(&s->pump_mutex);
+	syncs_server_wake(s);
+	return 0;
+}
+
+/*
+ * Both vectors may move when they grow. Subscribe runs with the exclusive table
+ * lock and every fan-out (writes, mails, pump) with the shared one, so no sender
+ * walks them meanwhile; the per-event lock covers only the value.
+ */
+int syncs_add_client_to_event(struct syncs_client *c, struct syncs_event *event)
+{
+	syncsd_debug("add client to event");
+	if (syncs_find_consumer(c, event) >= 0) {
+		syncsd_error("already subscribes, skip");
+		return 0;
+	}
+	if ((event->consumers_count == event->consumers_size) &&
+		syncs_grow_vector((void **) &event->consumers, &event->consumers_size, sizeof(struct syncs_consumer))) {
+		syncsd_error("couldn't grow consumers of %s", event->id.c);
+		return -1;
+	}
+	if (((uint32_t) c->event_subscribe == c->subscriptions_size) &&
+		syncs_grow_vector((void **) &c->subscriptions, &c->subscriptions_size, sizeof(struct syncs_subscription))) {
+		syncsd_error("couldn't grow subscriptions of client");
+		return -1;
+	}
+	syncsd_debug("add client %p in %d", c, event->consumers_count);
+	event->consumers[event->consumers_count].client = c;
+	event->consumers[event->consumers_count].slot = c->event_subscribe;
+	// subscriber of stream gets elements which are written after it
+	event->consumers[event->consumers_count].cursor = (event->stream != NULL) ? event->stream->head : 0;
+	c->subscriptions[c->event_subscribe].event = event;
+	c->subscriptions[c->event_subscribe].slot = event->consumers_count;
+	c->subscriptions[c->event_subscribe].queued = 0;
+	c->subscriptions[c->event_subscribe].conflate = 0;
+	event->consumers_count++;
+	c->event_subscribe++;
+	return 0;
+}
+
+void syncs_remove_client_from_event(struct syncs_client *c, struct syncs_event *event)
+{
+	int i;
+
+	syncsd_debug("looking for client %p in event %s", c, event->id.c);
+	i = syncs_find_consumer(c, event);
+	if (i >= 0)
+		syncs_remove_consumer(event, i);
+}
+
+void syncs_remove_client_from_events(struct syncs_client *c)
+{
+	struct syncs_subscription *subscription;
+
+	while (c->event_subscribe) {
+		subscription = &c->subscriptions[c->event_subscribe - 1];
+		syncs_remove_consumer(subscription->event, subscription->slot);
+	}
+}
+
+void syncs_remove_channels_of_client(struct syncs_client *c)
+{
+	while (c->channels != NULL)
+		syncs_release_channel(c->server, c->channels);
+}
+
+int syncs_server_subscribe_event(struct syncs_server *s, uint32_t flags, const char *cid, void (*cb)(void *, char *, void *, uint32_t), void *args)
+{
+	syncsid_t id;
+	struct syncs_event *event;
+
+	syncs_idstr(&id, cid);
+	syncs_server_lock(s);
+	event = syncs_find_event(s, &id);
+
+	if (event == NULL) {
+		if (!(flags & SYNCS_TYPE_FORCE) || ((event = syncs_create_event(s, &id)) == NULL)) {
+			syncs_server_unlock(s);
+			return (flags & SYNCS_TYPE_FORCE) ? -2 : -1;
+		}
+	}
+
+	event->args = args;
+	event->cb = cb;
+	syncs_server_unlock(s);
+
+	return 0;
+}
+
+void syncs_server_unsubscribe_event(struct syncs_server *s, const char *cid)
+{
+	syncsid_t id;
+	struct syncs_event *event;
+
+	syncs_idstr(&id, cid);
+	syncs_server_lock(s);
+	event = syncs_find_event(s, &id);
+	if (event != NULL) {
+		event->cb = NULL;
+		event->args = NULL;
+	}
+	syncs_server_unlock(s);
+}
+
+void syncs_sync_calculate(int offset_s, int offset_ms, struct syncdata *sync)
+{
+	struct timespec sync_time;
+
+	clock_gettime(CLOCK_REALTIME, &sync_time);
+	sync_time.tv_sec += offset_s;
+	sync_time.tv_nsec += offset_ms * 1000000L;
+	if (sync_time.tv_nsec > 1000000000L) {
+		sync_time.tv_nsec -= 1000000000L;
+		sync_time.tv_sec++;
+	}
+	sync->data0 = sync_time.tv_sec;
+	sync->data1 = sync_time.tv_nsec;
+}
+
+/* read reply of the current value, must be called with the event lock */
+static void syncs_event_read_packet(struct syncs_event *event, struct syncs_packet *packet)
+{
+	syncs_fill_header(&packet->header, &event->id, SYNCS_TYPE_READ | (event->data_type & SYNCS_TYPE_VAR_MASK));
+	memcpy(packet->buffer, event->data, event->data_size);
+	packet->header.data_size = event->data_size;
+}
+
+static uint32_t syncs_event_frame_head(uint32_t format)
+{
+	if ((format == SYNCS_EVENT_FRAME_V3_HANDLE) || (format == SYNCS_EVENT_FRAME_V3_ID) || (format == SYNCS_EVENT_FRAME_READ_V3))
+		return sizeof(struct syncs_frame_header);
+	return 0;
+}
+
+static struct syncs_outframe *syncs_outframe_encode(struct syncs_event *event, struct syncs_packet *packet, uint32_t format)
+{
+	struct syncs_outframe *frame;
+	struct syncs_handle_packet *handle_packet;
+	uint32_t data_size = SYNCS_PACKET_DATA_SIZE(packet->header.data_size);
+
+	// v3 frame is never longer than the header with all fields and the padded data
+	frame = syncs_outframe_alloc(sizeof(struct syncs_frame_header) + sizeof(syncsid_t) +
+		sizeof(struct syncdata) + sizeof(uint64_t) + SYNCS_FRAME_PAD(data_size));
+	if (frame == NULL)
+		return NULL;
+	switch (format) {
+	case SYNCS_EVENT_FRAME_V3_HANDLE:
+		frame->size = syncs_frame_encode(frame->data, &packet->header, packet->buffer, 0, &event->handle);
+		break;
+	case SYNCS_EVENT_FRAME_V3_ID:
+	case SYNCS_EVENT_FRAME_READ_V3:
+		frame->size = syncs_frame_encode(frame->data, &packet->header, packet->buffer, 0, NULL);
+		break;
+	case SYNCS_EVENT_FRAME_HANDLE:
+		handle_packet = (struct syncs_handle_packet *) frame->data;
+		handle_packet->header.magic = SYNCS_PACKET_MAGIC_HANDLE;
+		handle_packet->header.magic_data = SYNCS_PACKET_MAGIC_DATA;
+		handle_packet->header.type = packet->header.type;
+		handle_packet->header.handle = event->handle;
+		handle_packet->header.update_counter = packet->header.update_counter;
+		handle_packet->header.data_size = packet->header.data_size;
+		memcpy(handle_packet->buffer, packet->buffer, data_size);
+		frame->size = SYNCS_HANDLE_PACKET_SIZE(handle_packet);
+		break;
+	default:
+		frame->size = SYNCS_PACKET_SIZE(packet);
+		memcpy(frame->data, packet, frame->size);
+	}
+	return frame;
+}
+
+/*
+ * Returns a reference to the frame of value in the format. Frames of the current value are
+ * kept by the event, the packet written before the last change or the packet with the sync
+ * time is encoded for this send only. Packet of read reply is taken from the event here.
+ */
+static struct syncs_outframe *syncs_event_frame(struct syncs_server *s, struct syncs_event *event, uint32_t format, struct syncs_packet *packet)
+{
+	struct syncs_outframe *frame;
+	uint64_t update_counter;
+	int read = (format == SYNCS_EVENT_FRAME_READ_V3) || (format == SYNCS_EVENT_FRAME_READ);
+	int cache = read || !(packet->header.type & SYNCS_TYPE_SYNC);
+
+	syncs_event_lock(s, event);
+	frame = event->frames[format];
+	if (cache && (frame != NULL) && (read || (event->update_counter == packet->header.update_counter))) {
+		__atomic_add_fetch(&frame->refs, 1, __ATOMIC_RELAXED);
+		syncs_event_unlock(s, event);
+		return frame;
+	}
+	if (read)
+		syncs_event_read_packet(event, packet);
+	update_counter = (read) ? event->update_counter : packet->header.update_counter;
+	syncs_event_unlock(s, event);
+
+	frame = syncs_outframe_encode(event, packet, format);
+	if ((frame == NULL) || !cache)
+		return frame;
+	syncs_event_lock(s, event);
+	if ((event->frames[format] == NULL) && (event->update_counter == update_counter)) {
+		frame->refs++;
+		event->frames[format] = frame;
+	}
+	syncs_event_unlock(s, event);
+	return frame;
+}
+
+/*
+ * Sends the packet to consumers of the event which run on the reactor. Consumers of other
+ * reactors are collected in the remote mask, they are skipped when it is NULL.
+ */
+static void syncs_fanout(struct syncs_server *s, struct syncs_event *event, struct syncs_packet *packet,
+	struct syncs_client *producer, int flags, struct syncs_reactor *reactor, uint32_t *remote)
+{
+	// every wire format is taken once for all clients which use it
+	struct syncs_outframe *frames[SYNCS_EVENT_FRAME_PACKET + 1] = { NULL, NULL, NULL, NULL };
+ 	struct syncs_client *c;
+	uint32_t format;
+	uint32_t i;
+	int ret;
+
+	syncsd_debug("send event %s", &event->id.c[0]);
+	for (i = 0; i < event->consumers_count; i++) {
+		c = event->consumers[i].client;
+		if (c == producer && !(flags & SYNCS_TYPE_ECHO)) continue;
+		if (c->reactor != reactor) {
+			if (remote != NULL)
+				*remote |= 1 << c->reactor->index;
+			continue;
+		}
 		c->tx_event_count++;
 		syncsd_debug("send event for %s", &event->id.c[0]);
-		if (syncs_client_send(c, &packet)) {
+		if ((c->protocol & (SYNCS_PROTOCOL_V3 | SYNCS_PROTOCOL_HANDLE)) == (SYNCS_PROTOCOL_V3 | SYNCS_PROTOCOL_HANDLE))
+			format = SYNCS_EVENT_FRAME_V3_HANDLE;
+		else if (c->protocol & SYNCS_PROTOCOL_V3)
+			format = SYNCS_EVENT_FRAME_V3_ID;
+		else if ((c->protocol & SYNCS_PROTOCOL_HANDLE) && !(flags & SYNCS_TYPE_SYNC))
+			format = SYNCS_EVENT_FRAME_HANDLE;
+		else
+			format = SYNCS_EVENT_FRAME_PACKET;
+		if (frames[format] == NULL)
+			frames[format] = syncs_event_frame(s, event, format, packet);
+		if (frames[format] != NULL)
+			ret = syncs_client_send_outframe(c, frames[format], syncs_event_frame_head(format),
+				&c->subscriptions[event->consumers[i].slot]);
+		else
+			ret = -1;
+		if (ret)
 			c->tx_error++;
+	}
+	for (i = 0; i <= SYNCS_EVENT_FRAME_PACKET; i++)
+		if (frames[i] != NULL)
+			syncs_outframe_put(frames[i]);
+}
+
+static int syncs_mailbox_init(struct syncs_mailbox *mailbox)
+{
+	uint64_t i;
+
+	mailbox->mails = malloc(SYNCS_SERVER_MAILBOX_SIZE * sizeof(struct syncs_mail));
+	if (mailbox->mails == NULL)
+		return -1;
+	for (i = 0; i < SYNCS_SERVER_MAILBOX_SIZE; i++)
+		mailbox->mails[i].sequence = i;
+	mailbox->head = 0;
+	mailbox->tail = 0;
+	mailbox->overflowed = 0;
+	mailbox->overflow_head = NULL;
+	mailbox->overflow_tail = NULL;
+	pthread_mutex_init(&mailbox->overflow_mutex, NULL);
+	return 0;
+}
+
+static void syncs_mail_fill(struct syncs_mail *mail, struct syncs_event *event, struct syncs_packet *packet,
+	struct syncs_client *producer, int flags)
+{
+	mail->handle = event->handle;
+	mail->flags = flags;
+	mail->producer = producer;
+	memcpy(&mail->header, packet, SYNCS_PACKET_SIZE(packet));
+}
+
+/* slot is free for the post number n when its sequence is n and keeps a mail when it is n + 1 */
+static int syncs_mailbox_push(struct syncs_mailbox *mailbox, struct syncs_event *event, struct syncs_packet *packet,
+	struct syncs_client *producer, int flags)
+{
+	struct syncs_mail *mail;
+	uint64_t tail, sequence;
+
+	tail = __atomic_load_n(&mailbox->tail, __ATOMIC_RELAXED);
+	while (1) {
+		mail = &mailbox->mails[tail & (SYNCS_SERVER_MAILBOX_SIZE - 1)];
+		sequence = __atomic_load_n(&mail->sequence, __ATOMIC_ACQUIRE);
+		if (sequence == tail) {
+			if (__atomic_compare_exchange_n(&mailbox->tail, &tail, tail + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (sequence < tail)
+			return -1;
+		else
+			tail = __atomic_load_n(&mailbox->tail, __ATOMIC_RELAXED);
+	}
+	syncs_mail_fill(mail, event, packet, producer, flags);
+	__atomic_store_n(&mail->sequence, tail + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+static void syncs_mailbox_post(struct syncs_reactor *r, struct syncs_event *event, struct syncs_packet *packet,
+	struct syncs_client *producer, int flags)
+{
+	struct syncs_mailbox *mailbox = &r->mailbox;
+	struct syncs_mail *mail;
+
+	if (__atomic_load_n(&mailbox->overflowed, __ATOMIC_ACQUIRE) || syncs_mailbox_push(mailbox, event, packet, producer, flags)) {
+		// reactor doesn't keep up, mails wait in the list
+		mail = malloc(sizeof(struct syncs_mail));
+		if (mail == NULL) {
+			syncsd_error("couldn't allocate mail for reactor %u", r->index);
+			return;
 		}
+		syncs_mail_fill(mail, event, packet, producer, flags);
+		mail->next = NULL;
+		pthread_mutex_lock(&mailbox->overflow_mutex);
+		if (mailbox->overflow_tail != NULL)
+			mailbox->overflow_tail->next = mail;
+		else
+			mailbox->overflow_head = mail;
+		mailbox->overflow_tail = mail;
+		__atomic_store_n(&mailbox->overflowed, 1, __ATOMIC_RELEASE);
+		pthread_mutex_unlock(&mailbox->overflow_mutex);
+	}
+
+	// one wake is enough until the reactor takes mails
+	if (!__atomic_exchange_n(&r->notified, 1, __ATOMIC_ACQ_REL))
+		syncs_reactor_wake(r);
+}
+
+static void syncs_reactor_open_mail(struct syncs_reactor *r, struct syncs_mail *mail)
+{
+	struct syncs_event *event;
+
+	// event could be undefined after the mail was posted, its handle doesn't match then
+	event = syncs_event_by_handle(r->server, mail->handle);
+	if (event != NULL)
+		syncs_fanout(r->server, event, (struct syncs_packet *) &mail->header, mail->producer, mail->flags, r, NULL);
+}
+
+/* fans out mails of other reactors, must be called with the shared lock */
+static void syncs_reactor_take_mails(struct syncs_reactor *r)
+{
+	struct syncs_mailbox *mailbox = &r->mailbox;
+	struct syncs_mail *mail, *list;
+
+	__atomic_exchange_n(&r->notified, 0, __ATOMIC_ACQ_REL);
+	while (1) {
+		mail = &mailbox->mails[mailbox->head & (SYNCS_SERVER_MAILBOX_SIZE - 1)];
+		if (__atomic_load_n(&mail->sequence, __ATOMIC_ACQUIRE) != mailbox->head + 1)
+			break;
+		syncs_reactor_open_mail(r, mail);
+		__atomic_store_n(&mail->sequence, mailbox->head + SYNCS_SERVER_MAILBOX_SIZE, __ATOMIC_RELEASE);
+		mailbox->head++;
 	}
+	if (!__atomic_load_n(&mailbox->overflowed, __ATOMIC_ACQUIRE))
+		return;
+
+	// overflow keeps later mails, they are taken only after the whole ring
+	pthread_mutex_lock(&mailbox->overflow_mutex);
+	if (__atomic_load_n(&mailbox->tail, __ATOMIC_ACQUIRE) != mailbox->head) {
+		pthread_mutex_unlock(&mailbox->overflow_mutex);
+		return;
+	}
+	list = mailbox->overflow_head;
+	mailbox->overflow_head = NULL;
+	mailbox->overflow_tail = NULL;
+	__atomic_store_n(&mailbox->overflowed, 0, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&mailbox->overflow_mutex);
+
+	while ((mail = list) != NULL) {
+		list = mail->next;
+		syncs_reactor_open_mail(r, mail);
+		free(mail);
+	}
+}
+
+/* clients of the current reactor get the packet at once, other reactors get it by mail */
+static void syncs_deliver(struct syncs_server *s, struct syncs_event *event, struct syncs_packet *packet,
+	struct syncs_client *producer, int flags)
+{
+	struct syncs_reactor *reactor = syncs_reactor_current;
+	uint32_t remote = 0;
+	uint32_t i;
+
+	if (s->reactor_count == 1) {
+		syncs_fanout(s, event, packet, producer, flags, &s->reactors[0], NULL);
+		return;
+	}
+	if ((reactor != NULL) && (reactor->server != s))
+		reactor = NULL;
+	syncs_fanout(s, event, packet, producer, flags, reactor, &remote);
+	for (i = 0; remote; i++, remote >>= 1)
+		if (remote & 1)
+			syncs_mailbox_post(&s->reactors[i], event, packet, producer, flags);
+}
+
+/* value and producer are taken together, must be called with the event lock */
+static struct syncs_client *syncs_event_packet(struct syncs_event *event, struct syncs_packet *packet)
+{
+	syncs_fill_header(&packet->header, &event->id, SYNCS_TYPE_EVENT | event->data_type);
+	memcpy(packet->buffer, event->data, event->data_size);
+	packet->header.data_size = event->data_size;
+	packet->header.update_counter = event->update_counter;
+	return event->producer;
+}
+
+static void syncs_send_packet(struct syncs_server *s, struct syncs_event *event, struct syncs_packet *packet, struct syncs_client *producer, int flags)
+{
+	if (flags & SYNCS_TYPE_SYNC) {
+		packet->header.type |= SYNCS_TYPE_SYNC;
+		syncs_sync_calculate(0, s->sync_offset, &packet->header.sync);
+	}
+	syncs_deliver(s, event, packet, producer, flags);
+}
+
+int syncs_send_event(struct syncs_server *s, struct syncs_event *event, int flags)
+{
+	struct syncs_packet packet;
+	struct syncs_client *producer;
+
+	if (event->data_type == SYNCS_TYPE_VAR_HUGE)
+		return syncs_send_huge(s, event, flags);
+	if (event->data_type == SYNCS_TYPE_VAR_STREAM)
+		return syncs_send_stream(s, event, flags);
+
+	syncs_event_lock(s, event);
+	producer = syncs_event_packet(event, &packet);
+	syncs_event_unlock(s, event);
+	syncs_send_packet(s, event, &packet, producer, flags);
 	return 0;
 }
 
@@ -338,6 +2070,19 @@ int syncs_resend_event(struct syncs_client *c, struct syncs_event * event)
 {
 	struct syncs_packet packet;
 
+	if (event->data_type == SYNCS_TYPE_VAR_HUGE) {
+		if (!(c->protocol & SYNCS_PROTOCOL_HUGE))
+			return 0;
+		pthread_mutex_lock(&c->server->pump_mutex);
+		if ((event->blob != NULL) && syncs_queue_transfer(c->server, c, event, event->blob))
+			c->tx_error++;
+		pthread_mutex_unlock(&c->server->pump_mutex);
+		syncs_server_wake(c->server);
+		return 0;
+	}
+	if ((event->data_type == SYNCS_TYPE_VAR_STREAM) && (c->protocol & SYNCS_PROTOCOL_STREAM))
+		return 0;
+
 	syncs_fill_header(&packet.header, &event->id, SYNCS_TYPE_EVENT | SYNCS_STATUS_LOST);
 	memcpy(packet.buffer, event->data, event->data_size);
 	packet.header.data_size = event->data_size;
@@ -354,6 +2099,8 @@ int syncs_send_server_status(struct syncs_client *c, int code)
 
 	syncs_fill_header_request_str(&packet.header, c->server->id.c, SYNCS_TYPE_SERVER_STATUS);
 	packet.header.update_counter = code;
+	packet.header.sync.data0 = c->protocol;
+	packet.header.sync.data1 = SYNCS_PROTOCOL_SIGNATURE;
 
 	syncs_client_send(c, &packet);
 	c->tx_event_count++;
@@ -367,43 +2114,113 @@ int syncs_send_udp_server_status(struct syncs_server *s, struct sockaddr_in *add
 
 	syncs_fill_header_request_str(&packet.header, s->id.c, SYNCS_TYPE_SERVER_STATUS);
 	packet.header.update_counter = code;
+	packet.header.sync.data0 = 0;
+	packet.header.sync.data1 = 0;
 
 	sendto(s->usocketfd, &packet, size, MSG_NOSIGNAL, (struct sockaddr *) addr, sizeof(struct sockaddr_in));
 	return 0;
 }
 
-int syncs_server_write(struct syncs_server *s, int flags, const char *cid, void *data, uint32_t data_size)
+static int syncs_server_write_huge(struct syncs_server *s, struct syncs_event *event, int flags, void *data, uint32_t data_size)
 {
-	syncsid_t id;
-	struct syncs_event *event;
-
-	syncs_idstr(&id, cid);
+	struct syncs_blob *blob;
 
-	syncsd_debug("writing event");
+	if (event->data_type == SYNCS_TYPE_VAR_NOT_DEFINED)
+		event->data_type = SYNCS_TYPE_VAR_HUGE;
+	if (event->data_type != SYNCS_TYPE_VAR_HUGE)
+		return -3;
+	if (data_size > SYNCS_HUGE_SIZE_MAXIMUM) {
+		syncsd_error("size of variable %s more than maximum %d", event->id.c, SYNCS_HUGE_SIZE_MAXIMUM);
+		return -5;
+	}
+	blob = syncs_blob_create(data_size);
+	if (blob == NULL)
+		return -2;
+	memcpy(blob->data, data, data_size);
+	blob->update_counter = syncs_next_update_counter(s);
+	syncs_event_set_blob(s, event, blob);
+	event->update_counter = blob->update_counter;
 
-	event = syncs_find_event(s, &id);
-	if (event == NULL) {
-		syncsd_debug("event not found");
-		if (!(flags & SYNCS_TYPE_FORCE)) return -1;
-		syncsd_debug("create event");
-		event = syncs_create_event(s, &id);
-		if (event == NULL) return -2;
+	if (event->producer != NULL) {
+		event->producer = NULL;
+		event->producers_count++;
 	}
+	syncs_send_event(s, event, flags);
+	return 0;
+}
 
+static int syncs_server_write_event(struct syncs_server *s, struct syncs_event *event, int flags, void *data, uint32_t data_size)
+{
+	struct syncs_packet packet;
+	struct syncs_client *producer;
+	int suppress;
+
+	if ((flags & SYNCS_TYPE_VAR_MASK) == SYNCS_TYPE_VAR_HUGE)
+		return syncs_server_write_huge(s, event, flags, data, data_size);
 	if (!data_size)
 		data_size = syncs_get_size_by_type(flags);
+	if (data_size > SYNCS_VARIABLE_SIZE_MAXIMUM) {
+		syncsd_error("size of variable %s more than maximum %d", event->id.c, SYNCS_VARIABLE_SIZE_MAXIMUM);
+		return -5;
+	}
+	syncs_event_lock(s, event);
+	suppress = syncs_event_suppress(event, data, data_size);
 	memcpy(event->data, data, data_size);
 	event->data_size = data_size;
+	event->update_counter = syncs_next_update_counter(s);
+	syncs_event_drop_frames(event);
 
 	if (event->producer != NULL) {
 		event->producer = NULL;
 		event->producers_count++;
 	}
+	producer = syncs_event_packet(event, &packet);
+	syncs_event_unlock(s, event);
+	if (suppress) {
+		__atomic_fetch_add(&s->suppressed, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
 	syncsd_debug("send event");
-	syncs_send_event(s, event, flags);
+	if (event->data_type == SYNCS_TYPE_VAR_STREAM)
+		syncs_send_event(s, event, flags);
+	else
+		syncs_send_packet(s, event, &packet, producer, flags);
 	return 0;
 }
 
+int syncs_server_write(struct syncs_server *s, int flags, const char *cid, void *data, uint32_t data_size)
+{
+	syncsid_t id;
+	struct syncs_event *event;
+	int ret;
+
+	syncs_idstr(&id, cid);
+
+	syncsd_debug("writing event");
+
+	syncs_server_lock_shared(s);
+	event = syncs_find_event(s, &id);
+	if (event != NULL) {
+		ret = syncs_server_write_event(s, event, flags, data, data_size);
+		syncs_server_unlock(s);
+		return ret;
+	}
+	syncs_server_unlock(s);
+
+	syncsd_debug("event not found");
+	if (!(flags & SYNCS_TYPE_FORCE)) return -1;
+	// new event changes the table, it is created exclusively
+	syncs_server_lock(s);
+	event = syncs_find_event(s, &id);
+	if (event == NULL) {
+		syncsd_debug("create event");
+		event = syncs_create_event(s, &id);
+	}
+	ret = (event != NULL) ? syncs_server_write_event(s, event, flags, data, data_size) : -2;
+	syncs_server_unlock(s);
+	return ret;
+}
+
 int syncs_server_write_int32(struct syncs_server *s, uint32_t flags, const char *id, int32_t data)
 {
 	return syncs_server_write(s, flags | SYNCS_TYPE_VAR_INT32, id, &data, 0);
@@ -436,14 +2253,33 @@ int syncs_server_read(struct syncs_server *s, uint32_t flags, const char *cid, v
 	struct syncs_event *event;
 
 	syncs_idstr(&id, cid);
+	syncs_server_lock_shared(s);
 	event = syncs_find_event(s, &id);
 
-	if (event == NULL)
+	if (event == NULL) {
+		syncs_server_unlock(s);
 		return -1;
+	}
 
+	if (event->data_type == SYNCS_TYPE_VAR_HUGE) {
+		pthread_mutex_lock(&s->pump_mutex);
+		if (event->blob == NULL)
+			*data_size = 0;
+		else if (*data_size > event->blob->size)
+			*data_size = event->blob->size;
+		if (*data_size)
+			memcpy(data, event->blob->data, *data_size);
+		pthread_mutex_unlock(&s->pump_mutex);
+		syncs_server_unlock(s);
+		return 0;
+	}
+
+	syncs_event_lock(s, event);
 	if (*data_size > event->data_size)
 		*data_size = event->data_size;
 	memcpy(data, event->data, *data_size);
+	syncs_event_unlock(s, event);
+	syncs_server_unlock(s);
 
 	return 0;
 }
@@ -481,34 +2317,120 @@ void syncs_server_cb_event(struct syncs_server *s, syncsid_t * id)
 {
 	void (*cb)(void *, char *, void *data, uint32_t size);
 	void *args;
-	struct syncs_event *event = syncs_find_event(s, id);
+	struct syncs_event *event;
 
-	if (event == NULL) return;
+	syncs_server_lock_shared(s);
+	event = syncs_find_event(s, id);
+	if (event == NULL) {
+		syncs_server_unlock(s);
+		return;
+	}
 
 	cb = event->cb;
 	args = event->args;
 	if (cb != NULL) {
 		cb(args, id->c, event->data, event->data_size);
 	}
+	syncs_server_unlock(s);
 }
 
 void syncs_close_client_socket(struct syncs_client * c)
 {
+	struct syncs_client **link;
 	int socketfd = c->socketfd;
 
-	epoll_ctl(c->server->epollfd, EPOLL_CTL_DEL, socketfd, NULL);
+	epoll_ctl(c->reactor->epollfd, EPOLL_CTL_DEL, socketfd, NULL);
+	// recv in flight holds the socket, shutdown ends it and the generation makes its completion stale
+	if (c->reactor->uring != NULL) {
+		shutdown(socketfd, SHUT_RDWR);
+		__atomic_add_fetch(&c->uring_gen, 1, __ATOMIC_RELAXED);
+	}
+
+	// threads which fan out see the closed socket and don't queue anymore
+	pthread_mutex_lock(&c->out_mutex);
+	syncs_client_drop_queue(c);
+	syncs_client_zc_drop(c);
+	c->socketfd = -1;
+	c->out_watched = 0;
+	pthread_mutex_unlock(&c->out_mutex);
+	if (c->staged) {
+		for (link = &c->reactor->staged_head; *link != c; link = &(*link)->stage_next)
+			;
+		*link = c->stage_next;
+		c->stage_next = NULL;
+		c->staged = 0;
+	}
+	c->reactor->tx_frames += c->tx_frames;
+	c->reactor->tx_syscalls += c->tx_syscalls;
+	c->reactor->zc_sends += c->zc_sends;
+	c->reactor->zc_copied += c->zc_copied;
 
+	syncs_drop_transfers(c);
 	syncs_remove_client_from_events(c);
 	syncs_remove_channels_of_client(c);
 
-	c->socketfd = -1;
+	syncs_put_free_client(c->server, c);
+	c->server->client_count--;
 	close(socketfd);
 	syncsd_debug("client disconnected %d", socketfd);
 }
 
+static void syncs_udp_unlink(struct syncs_server *s, struct syncs_client *c)
+{
+	if (c->udp_prev != NULL)
+		c->udp_prev->udp_next = c->udp_next;
+	else
+		s->udp_oldest = c->udp_next;
+	if (c->udp_next != NULL)
+		c->udp_next->udp_prev = c->udp_prev;
+	else
+		s->udp_newest = c->udp_prev;
+	c->udp_prev = NULL;
+	c->udp_next = NULL;
+}
+
+static void syncs_udp_append(struct syncs_server *s, struct syncs_client *c)
+{
+	c->udp_prev = s->udp_newest;
+	c->udp_next = NULL;
+	if (s->udp_newest != NULL)
+		s->udp_newest->udp_next = c;
+	else
+		s->udp_oldest = c;
+	s->udp_newest = c;
+}
+
+/* udp_now_ms only grows, so moving the session to the end keeps the list ordered by activity */
+static void syncs_udp_touch(struct syncs_server *s, struct syncs_client *c)
+{
+	c->udp_seen_ms = s->udp_now_ms;
+	if (s->udp_newest == c)
+		return;
+	syncs_udp_unlink(s, c);
+	syncs_udp_append(s, c);
+}
+
+/* session has no socket, it is forgotten together with its subscriptions */
+static void syncs_close_uclient(struct syncs_client *c)
+{
+	struct syncs_server *s = c->server;
+
+	syncs_udp_unlink(s, c);
+	syncs_hash_remove_key(&s->uclient_addr_index, syncs_uclient_key(&c->addr), c);
+	syncs_hash_remove_id(&s->uclient_id_index, c);
+	syncs_drop_transfers(c);
+	syncs_remove_client_from_events(c);
+	syncs_remove_channels_of_client(c);
+	syncs_put_free_client(s, c);
+	s->client_count--;
+	s->uclient_count--;
+	syncsd_debug("udp client %s disconnected", c->id.c);
+}
+
 int syncs_client_subscribe(struct syncs_client *c, syncsid_t *id, uint32_t flags, uint64_t update_counter)
 {
 	struct syncs_event *event;
+	int i;
 
 	syncsd_debug("client subscribe");
 	event = syncs_find_event(c->server, id);
@@ -523,8 +2445,15 @@ int syncs_client_subscribe(struct syncs_client *c, syncsid_t *id, uint32_t flags
 	syncsd_debug("found event: type [0x%08x:0x%08x] ", flags&SYNCS_TYPE_VAR_MASK, event->data_type);
 
 	if (((event->data_type & SYNCS_TYPE_VAR_MASK) == SYNCS_TYPE_VAR_ANY) || ((flags & SYNCS_TYPE_VAR_MASK) == SYNCS_TYPE_VAR_ANY) || ((flags & SYNCS_TYPE_VAR_MASK) == event->data_type)) {
-		syncs_add_client_to_event(c, event, event->consumers);
+		if (syncs_add_client_to_event(c, event))
+			return -4;
 	} else return -3;
+	// repeated subscription changes the option, elements of stream are never conflated
+	i = syncs_find_consumer(c, event);
+	c->subscriptions[event->consumers[i].slot].conflate = (flags & SYNCS_TYPE_CONFLATE) && (event->stream == NULL);
+
+	if (c->protocol & SYNCS_PROTOCOL_HANDLE)
+		syncs_client_send_handle(c, event);
 
 	if (update_counter < event->update_counter)
 		syncs_resend_event(c, event);
@@ -556,75 +2485,201 @@ int syncs_add_event(struct syncs_server *s, syncsid_t *id, uint32_t flags, void
 	} else
 		if (!(flags & SYNCS_TYPE_FORCE)) return -2;
 
+	syncs_event_lock(s, event);
 	event->data_type = flags & SYNCS_TYPE_VAR_MASK;
 	if ((size > 1) && (size < SYNCS_VARIABLE_SIZE_MAXIMUM))
 		event->data_size = size;
 	else event->data_size = syncs_get_size_by_type(flags);
 	if (data != NULL)
 		memcpy(event->data, data, event->data_size);
+	// policy stays when a client redefines the variable, the defined value is the sent one
+	if ((flags & SYNCS_TYPE_ONCHANGE) && (event->data_type != SYNCS_TYPE_VAR_STREAM) && (event->data_type != SYNCS_TYPE_VAR_HUGE))
+		event->onchange = 1;
+	event->published = 0;
+	if (event->onchange && (data != NULL))
+		syncs_event_suppress(event, event->data, event->data_size);
+	syncs_event_drop_frames(event);
+	syncs_event_unlock(s, event);
+
+	return 0;
+}
+
+int syncs_server_define_stream(struct syncs_server *s, const char *cid, uint32_t depth, uint32_t element_size)
+{
+	struct syncs_stream *stream;
+	struct syncs_event *event;
+	syncsid_t id;
+	int ret;
 
+	syncs_idstr(&id, cid);
+	stream = syncs_stream_create(depth, element_size);
+	if (stream == NULL)
+		return -1;
+	syncs_server_lock(s);
+	ret = syncs_add_event(s, &id, SYNCS_TYPE_VAR_STREAM, NULL, 0);
+	if (ret) {
+		syncs_server_unlock(s);
+		syncs_stream_release(stream);
+		return ret;
+	}
+	event = syncs_find_event(s, &id);
+	pthread_mutex_lock(&s->pump_mutex);
+	syncs_stream_release(event->stream);
+	event->stream = stream;
+	pthread_mutex_unlock(&s->pump_mutex);
+	syncs_server_unlock(s);
 	return 0;
 }
 
 int syncs_server_define(struct syncs_server *s, const char *cid, uint32_t flags, void *data, uint32_t size)
 {
 	syncsid_t id;
+	int ret;
 
 	syncs_idstr(&id, cid);
 	if (size > SYNCS_VARIABLE_SIZE_MAXIMUM) {
 		syncsd_error("size of variable %s more than maximum %d", cid, SYNCS_VARIABLE_SIZE_MAXIMUM);
 		return -5;
 	}
-	return(syncs_add_event(s, &id, flags, data, size));
+	syncs_server_lock(s);
+	ret = syncs_add_event(s, &id, flags, data, size);
+	syncs_server_unlock(s);
+	return ret;
+}
+
+int syncs_server_set_deadband(struct syncs_server *s, const char *cid, double absolute, double percent)
+{
+	struct syncs_event *event;
+	syncsid_t id;
+	int ret = 0;
+
+	syncs_idstr(&id, cid);
+	if ((absolute < 0) || (percent < 0))
+		return -3;
+	syncs_server_lock_shared(s);
+	event = syncs_find_event(s, &id);
+	if (event == NULL) {
+		syncs_server_unlock(s);
+		return -1;
+	}
+	syncs_event_lock(s, event);
+	if (syncs_event_numeric(event->data_type)) {
+		event->onchange = 1;
+		event->deadband = absolute;
+		event->deadband_percent = percent;
+	} else {
+		syncsd_error("deadband of %s needs a numeric type", cid);
+		ret = -3;
+	}
+	syncs_event_unlock(s, event);
+	syncs_server_unlock(s);
+	return ret;
 }
 
 int syncs_client_read(struct syncs_client *c, syncsid_t * id)
 {
 	struct syncs_event *event;
+	struct syncs_outframe *frame;
 	struct syncs_packet packet;
+	uint32_t format;
 
 	syncsd_debug("client wants to read event %s", (char *) id);
 
-	syncs_fill_header(&packet.header, id, SYNCS_TYPE_READ);
-
 	event = syncs_find_event(c->server, id);
 	if (event != NULL) {
 		syncsd_debug("found event %s for read", (char *) id);
-		memcpy(packet.buffer, event->data, event->data_size);
-		packet.header.data_size = event->data_size;
-		packet.header.type |= (event->data_type & SYNCS_TYPE_VAR_MASK);
-	} else {
-		syncsd_debug("no event %s for read", (char *) id);
-		packet.header.type |= SYNCS_TYPE_VAR_NOT_DEFINED;
-		packet.header.data_size = 0;
+		// readers which poll the same value share the frame
+		format = (c->protocol & SYNCS_PROTOCOL_V3) ? SYNCS_EVENT_FRAME_READ_V3 : SYNCS_EVENT_FRAME_READ;
+		frame = syncs_event_frame(c->server, event, format, &packet);
+		if (frame == NULL)
+			return -1;
+		if (syncs_client_send_outframe(c, frame, syncs_event_frame_head(format), NULL))
+			c->tx_error++;
+		syncs_outframe_put(frame);
+		c->tx_event_count++;
+		return 0;
 	}
+	syncsd_debug("no event %s for read", (char *) id);
+	syncs_fill_header(&packet.header, id, SYNCS_TYPE_READ | SYNCS_TYPE_VAR_NOT_DEFINED);
+	packet.header.data_size = 0;
 	syncs_client_send(c, &packet);
 	c->tx_event_count++;
 	return 0;
 }
 
-int syncs_client_write(struct syncs_client *c, syncsid_t *id, uint32_t flags, char *data, uint32_t data_size)
+/* chunks are collected per client, the value is published like a write when it is complete */
+static int syncs_client_write_chunk(struct syncs_client *c, struct syncs_event *event, uint32_t flags, char *data, uint32_t data_size)
 {
-	struct syncs_event *event;
-	void (*cb)(void *, char *, void *, uint32_t);
-	void *args;
 	struct syncs_server *s = c->server;
+	struct syncs_huge_chunk chunk;
+	struct syncs_blob *blob;
+	uint32_t size;
 
-	syncsd_debug("write");
-	event = syncs_find_event(s, id);
-	if (event == NULL) {
-		syncsd_debug("NULL");
-		if (!(flags & SYNCS_TYPE_FORCE)) return -1;
-		event = syncs_create_event(c->server, id);
-		if (event == NULL) return -2;
-		event->data_type = flags & SYNCS_TYPE_VAR_MASK;
+	if (!(c->protocol & SYNCS_PROTOCOL_HUGE) || (data_size < sizeof(struct syncs_huge_chunk)))
+		return -1;
+	memcpy(&chunk, data, sizeof(struct syncs_huge_chunk));
+	size = data_size - sizeof(struct syncs_huge_chunk);
+	if ((chunk.size > SYNCS_HUGE_SIZE_MAXIMUM) || (chunk.offset > chunk.size) || (size > chunk.size - chunk.offset))
+		return -1;
+
+	if (chunk.offset == 0) {
+		syncs_blob_put(c->rx_blob);
+		c->rx_blob = syncs_blob_create(chunk.size);
+		if (c->rx_blob == NULL) {
+			syncsd_error("couldn't allocate %u bytes for %s", chunk.size, event->id.c);
+			return -2;
+		}
+		c->rx_transfer = chunk.transfer;
+		c->rx_handle = event->handle;
+		c->rx_offset = 0;
+	} else if ((c->rx_blob == NULL) || (chunk.transfer != c->rx_transfer) || (chunk.offset != c->rx_offset) ||
+		(chunk.size != c->rx_blob->size) || (event->handle != c->rx_handle)) {
+		syncsd_debug("lost chunk of %s", event->id.c);
+		return -1;
+	}
+	memcpy(c->rx_blob->data + chunk.offset, data + sizeof(struct syncs_huge_chunk), size);
+	c->rx_offset += size;
+	if (c->rx_offset < c->rx_blob->size)
+		return 0;
+
+	blob = c->rx_blob;
+	c->rx_blob = NULL;
+	if (event->producer != c) {
+		event->producer = c;
+		event->producers_count++;
 	}
+	event->count++;
+	c->event_write++;
+
+	blob->update_counter = syncs_next_update_counter(s);
+	syncs_blob_get(blob);
+	syncs_event_set_blob(s, event, blob);
+	event->update_counter = blob->update_counter;
+
+	if (event->cb != NULL)
+		event->cb(event->args, event->id.c, blob->data, blob->size);
+	syncs_send_event(s, event, flags & (SYNCS_TYPE_VAR_MASK | SYNCS_TYPE_ECHO));
+	syncs_blob_put(blob);
+	return 0;
+}
+
+static int syncs_client_write_event(struct syncs_client *c, struct syncs_event *event, uint32_t flags, char *data, uint32_t data_size)
+{
+	void (*cb)(void *, char *, void *, uint32_t);
+	void *args;
+	struct syncs_server *s = c->server;
+	struct syncs_packet packet;
+	struct syncs_client *producer;
+	int suppress;
 
 	if ((flags & SYNCS_TYPE_VAR_MASK) != event->data_type) {
 		syncsd_debug("error type");
 		return -3;
 	}
+	if (event->data_type == SYNCS_TYPE_VAR_HUGE)
+		return syncs_client_write_chunk(c, event, flags, data, data_size);
 
+	syncs_event_lock(s, event);
 	if (event->producer != c) {
 		event->producer = c;
 		event->producers_count++;
@@ -632,28 +2687,74 @@ int syncs_client_write(struct syncs_client *c, syncsid_t *id, uint32_t flags, ch
 	event->count++;
 	c->event_write++;
 
+	suppress = syncs_event_suppress(event, data, data_size);
 	memcpy(event->data, data, data_size);
 	event->data_size = data_size;
-	event->update_counter = s->update_counter;
-	s->update_counter++;
+	event->update_counter = syncs_next_update_counter(s);
+	syncs_event_drop_frames(event);
+	// value is sent as it was written, another reactor could write the event meanwhile
+	producer = syncs_event_packet(event, &packet);
+	syncs_event_unlock(s, event);
+	if (suppress) {
+		__atomic_fetch_add(&s->suppressed, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
 	syncsd_debug("new data = %d:%d", *(int *) event->data, event->data_size);
 
 	cb = event->cb;
 	args = event->args;
 	if (cb != NULL) {
-		cb(args, id->c, event->data, event->data_size);
+		cb(args, event->id.c, event->data, event->data_size);
 	}
 
-	syncs_send_event(s, event, flags & (SYNCS_TYPE_VAR_MASK | SYNCS_TYPE_SYNC | SYNCS_TYPE_ECHO));
+	flags &= SYNCS_TYPE_VAR_MASK | SYNCS_TYPE_SYNC | SYNCS_TYPE_ECHO;
+	if (event->data_type == SYNCS_TYPE_VAR_STREAM)
+		syncs_send_event(s, event, flags);
+	else
+		syncs_send_packet(s, event, &packet, producer, flags);
 	return 0;
 }
 
+int syncs_client_write(struct syncs_client *c, syncsid_t *id, uint32_t flags, char *data, uint32_t data_size)
+{
+	struct syncs_event *event;
+
+	syncsd_debug("write");
+	event = syncs_find_event(c->server, id);
+	if (event == NULL) {
+		syncsd_debug("NULL");
+		if (!(flags & SYNCS_TYPE_FORCE)) return -1;
+		event = syncs_create_event(c->server, id);
+		if (event == NULL) return -2;
+		event->data_type = flags & SYNCS_TYPE_VAR_MASK;
+	}
+	return syncs_client_write_event(c, event, flags, data, data_size);
+}
+
+int syncs_client_write_handle(struct syncs_client *c, uint32_t handle, uint32_t type, char *data, uint32_t data_size)
+{
+	struct syncs_event *event;
+
+	if ((type & SYNCS_TYPE_MSG_MASK) != SYNCS_TYPE_WRITE)
+		return -1;
+	event = syncs_event_by_handle(c->server, handle);
+	// generation in the handle wraps, the handle of a slot reused many times must be given anew
+	if ((event == NULL) || (c->handles.slots == NULL) || (syncs_hash_find_key(&c->handles, syncs_handle_key(event)) != event)) {
+		syncsd_debug("unknown handle 0x%08x", handle);
+		return -1;
+	}
+	c->rx_event_count++;
+	return syncs_client_write_event(c, event, type, data, data_size);
+}
+
 int syncs_server_undefine(struct syncs_server *s, const char *cid)
 {
 	syncsid_t id;
 
 	syncs_idstr(&id, cid);
+	syncs_server_lock(s);
 	syncs_free_event(s, &id);
+	syncs_server_unlock(s);
 	return 0;
 }
 
@@ -664,28 +2765,29 @@ void syncs_client_send_clientlist(struct syncs_client *c, uint8_t sequance)
 	uint8_t max_clients_in_packet = SYNCS_VARIABLE_SIZE_MAXIMUM / sizeof(struct syncs_client_info);
 	struct syncs_client_info *client_info = (struct syncs_client_info *) packet.buffer;
 	uint8_t client_count = 0;
-	int i;
+	uint32_t i, j;
 	struct syncs_client *client;
 
 
-	packet.header.magic = SYNCS_PACKET_MAGIC;
-	packet.header.magic_data = SYNCS_PACKET_MAGIC_DATA;
-	packet.header.type = SYNCS_TYPE_CLIENT_LIST;
+	syncs_fill_basic_header(&packet.header, SYNCS_TYPE_CLIENT_LIST);
 
 	packet.header.id.c[0] = 0;
 	packet.header.id.c[1] = (s->client_count / max_clients_in_packet) + 1;
 	packet.header.id.c[3] = sequance;
 	packet.header.id.c[4] = 0;
 
-	for (i = 0; i < SYNCS_CLIENT_MAXIMUM; i++)
-		if (s->clients[i].socketfd != -1) {
-			client = &s->clients[i];
+	for (i = 0; i < s->client_capacity; i++)
+		if ((client = syncs_client_at(s, i))->socketfd != -1) {
 			client_info[client_count].id = client->id;
 			client_info[client_count].event_subscribe = client->event_subscribe;
 			client_info[client_count].event_write = client->event_write;
 			client_info[client_count].rx_event_count = client->rx_event_count;
 			client_info[client_count].tx_event_count = client->tx_event_count;
 			client_info[client_count].ip = client->addr.sin_addr.s_addr;
+			client_info[client_count].event_conflate = 0;
+			for (j = 0; j < (uint32_t) client->event_subscribe; j++)
+				client_info[client_count].event_conflate += client->subscriptions[j].conflate;
+			client_info[client_count].conflated = client->conflated;
 			client_count++;
 			if (client_count >= max_clients_in_packet) {
 				packet.header.id.c[2] = client_count;
@@ -717,13 +2819,11 @@ void syncs_client_send_eventlist(struct syncs_client *c, uint8_t sequance)
 	uint8_t max_events_in_packet = SYNCS_VARIABLE_SIZE_MAXIMUM / sizeof(struct syncs_event_info);
 	struct syncs_event_info *event_info = (struct syncs_event_info *) packet.buffer;
 	uint8_t event_count = 0;
-	int i;
+	uint32_t i;
 	struct syncs_event *event;
 
 
-	packet.header.magic = SYNCS_PACKET_MAGIC;
-	packet.header.magic_data = SYNCS_PACKET_MAGIC_DATA;
-	packet.header.type = SYNCS_TYPE_EVENT_LIST;
+	syncs_fill_basic_header(&packet.header, SYNCS_TYPE_EVENT_LIST);
 
 	packet.header.id.c[0] = 0;
 	packet.header.id.c[1] = (s->event_count / max_events_in_packet) + 1;
@@ -731,9 +2831,8 @@ void syncs_client_send_eventlist(struct syncs_client *c, uint8_t sequance)
 	packet.header.id.c[4] = 0;
 	syncsd_debug("send event list max events in package %d, packages %d, seq %d", max_events_in_packet, packet.header.id.c[1], packet.header.id.c[3]);
 
-	for (i = 0; i < SYNCS_EVENT_MAXIMUM; i++)
-		if (s->events[i].id.i[0] != -1) {
-			event = &s->events[i];
+	for (i = 0; i < s->event_capacity; i++)
+		if ((event = syncs_event_at(s, i))->id.i[0] != -1) {
 			event_info[event_count].id = event->id;
 			event_info[event_count].consumers_count = event->consumers_count;
 			event_info[event_count].count = event->count;
@@ -776,9 +2875,7 @@ void syncs_client_send_channellist(struct syncs_client *c, uint8_t sequance)
 	int i;
 	struct syncs_channel *channel;
 
-	packet.header.magic = SYNCS_PACKET_MAGIC;
-	packet.header.magic_data = SYNCS_PACKET_MAGIC_DATA;
-	packet.header.type = SYNCS_TYPE_CHANNEL_LIST;
+	syncs_fill_basic_header(&packet.header, SYNCS_TYPE_CHANNEL_LIST);
 
 	packet.header.id.c[0] = 0;
 	packet.header.id.c[1] = (s->channel_count / max_channels_in_packet) + 1;
@@ -838,7 +2935,7 @@ int syncs_add_channel(struct syncs_client *c, syncsid_t *id, int flags, struct s
 	channel->ticket.ip = c->addr.sin_addr.s_addr;
 
 	if (c != channel->producer) {
-		channel->producer = c;
+		syncs_set_channel_producer(channel, c);
 		channel->producers_count++;
 	}
 	return 0;
@@ -879,15 +2976,8 @@ int syncs_client_channel(struct syncs_client *c, struct syncs_header *packet_hea
 	return 0;
 }
 
-int syncs_client_process_packet(struct syncs_client *c, struct syncs_packet *packet)
+int syncs_client_process_packet(struct syncs_client *c, struct syncs_header *packet_header, char *data)
 {
-	struct syncs_header *packet_header;
-	char *data;
-
-	//TODO: add packet decoder
-	packet_header = &packet->header;
-	data = packet->buffer;
-
 	syncsd_debug("receive %u", packet_header->type);
 	switch (packet_header->type & SYNCS_TYPE_MSG_MASK) {
 	case SYNCS_TYPE_SUBSCRIBE:
@@ -897,7 +2987,13 @@ int syncs_client_process_packet(struct syncs_client *c, struct syncs_packet *pac
 		syncs_client_unsubscribe(c, &packet_header->id);
 		break;
 	case SYNCS_TYPE_DEFINE:
-		syncs_add_event(c->server, &packet_header->id, packet_header->type, NULL, packet_header->data_size);
+		// publish policy belongs to the server, a client can't turn it on
+		syncs_add_event(c->server, &packet_header->id, packet_header->type & ~SYNCS_TYPE_OPTIONS_MASK, NULL, packet_header->data_size);
+		if (c->protocol & SYNCS_PROTOCOL_HANDLE) {
+			struct syncs_event *event = syncs_find_event(c->server, &packet_header->id);
+			if (event != NULL)
+				syncs_client_send_handle(c, event);
+		}
 		break;
 	case SYNCS_TYPE_UNDEFINE:
 		syncs_free_event(c->server, &packet_header->id);
@@ -917,11 +3013,23 @@ int syncs_client_process_packet(struct syncs_client *c, struct syncs_packet *pac
 	case SYNCS_TYPE_CLIENT_ID:
 		if (packet_header->sync.data0 != SYNCS_VERSION_MAJOR) {
 			syncs_send_server_status(c, SYNCS_ERROR_NOTSUPPORT);
-			syncs_close_client_socket(c);
-		} else
-			syncs_send_server_status(c, SYNCS_ERROR_NOTFOUND);
+			if (c->socketfd == UDP_SOCKET_STUB)
+				syncs_close_uclient(c);
+			else
+				syncs_close_client_socket(c);
+			break;
+		}
 		memcpy(&c->id, &packet_header->id, sizeof(syncsid_t));
 		c->version = ((packet_header->sync.data0 & 0xff) << 8) | (packet_header->sync.data1 & 0xff);
+		if ((packet_header->update_counter >> 32) == SYNCS_PROTOCOL_SIGNATURE)
+			c->protocol = packet_header->update_counter & SYNCS_PROTOCOL_MASK;
+		else c->protocol = 0;
+		// chunks of huge variables rely on ordered delivery, batches are v3 frames only
+		if (!(c->protocol & SYNCS_PROTOCOL_V3))
+			c->protocol &= ~(SYNCS_PROTOCOL_HUGE | SYNCS_PROTOCOL_STREAM);
+		if (c->socketfd == UDP_SOCKET_STUB)
+			c->protocol &= ~SYNCS_PROTOCOL_HUGE;
+		syncs_send_server_status(c, SYNCS_ERROR_NOTFOUND);
 		break;
 	case SYNCS_TYPE_CHANNEL:
 		syncs_client_channel(c, packet_header, data);
@@ -929,9 +3037,144 @@ int syncs_client_process_packet(struct syncs_client *c, struct syncs_packet *pac
 	case SYNCS_TYPE_CHANNEL_LIST:
 		syncs_client_send_channellist(c, (int) packet_header->id.c[0]);
 		break;
+	case SYNCS_TYPE_EMPTY:
+		// keepalive of udp session, it is already marked as seen
+		break;
 	default: return -1;
 	}
-	c->rx_event_count++;
+	c->rx_event_count++;
+	return 0;
+}
+
+/* writes are processed by reactors in parallel, other messages change tables exclusively */
+static int syncs_client_dispatch(struct syncs_client *c, struct syncs_header *header, char *data)
+{
+	struct syncs_server *s = c->server;
+	struct syncs_event *event;
+	int ret;
+
+	if ((header->type & SYNCS_TYPE_MSG_MASK) == SYNCS_TYPE_WRITE) {
+		syncs_server_lock_shared(s);
+		event = syncs_find_event(s, &header->id);
+		if (event != NULL) {
+			syncs_client_write_event(c, event, header->type, data, header->data_size);
+			c->rx_event_count++;
+			syncs_server_unlock(s);
+			return 0;
+		}
+		syncs_server_unlock(s);
+	}
+	syncs_server_lock(s);
+	ret = syncs_client_process_packet(c, header, data);
+	syncs_server_unlock(s);
+	return ret;
+}
+
+static int syncs_client_dispatch_handle(struct syncs_client *c, uint32_t handle, uint32_t type, char *data, uint32_t data_size)
+{
+	int ret;
+
+	syncs_server_lock_shared(c->server);
+	ret = syncs_client_write_handle(c, handle, type, data, data_size);
+	syncs_server_unlock(c->server);
+	return ret;
+}
+
+static void syncs_client_disconnect(struct syncs_client *c)
+{
+	struct syncs_server *s = c->server;
+
+	syncs_server_lock(s);
+	syncs_close_client_socket(c);
+	syncs_server_unlock(s);
+}
+
+/* dispatches whole packets of the buffer and keeps the tail of partial one, -1 when the client is closed */
+static int syncs_client_parse(struct syncs_client *c, uint8_t *buffer, int buffer_recv)
+{
+	int socketfd = c->socketfd;
+	struct syncs_header *packet_header;
+	struct syncs_handle_header *handle_header;
+	struct syncs_frame frame;
+	int buffer_head = 0;
+	int ret;
+
+	while ((buffer_recv - buffer_head) >= sizeof(struct syncs_frame_header)) {
+		packet_header = (struct syncs_header *) (buffer + buffer_head);
+
+		if (packet_header->magic == SYNCS_PACKET_MAGIC_V3) {
+			ret = syncs_frame_decode(&frame, packet_header, buffer_recv - buffer_head);
+			if (ret == 0) break;
+			if (ret < 0) {
+				buffer_head++;
+				continue;
+			}
+			if (frame.fields & SYNCS_FRAME_FIELD_ID)
+				syncs_client_dispatch(c, &frame.header, frame.data);
+			else
+				syncs_client_dispatch_handle(c, frame.handle, frame.header.type, frame.data, frame.header.data_size);
+			if (c->socketfd != socketfd)
+				return -1;
+			buffer_head += ret;
+			continue;
+		}
+		if (packet_header->magic == SYNCS_PACKET_MAGIC_HANDLE) {
+			if ((buffer_recv - buffer_head) < sizeof(struct syncs_handle_header)) break;
+			handle_header = (struct syncs_handle_header *) packet_header;
+			if (handle_header->magic_data != SYNCS_PACKET_MAGIC_DATA) {
+				buffer_head++;
+				continue;
+			}
+			handle_header->data_size &= SYNCS_VARIABLE_SIZE_MAXIMUM;
+			if ((buffer_recv - buffer_head) < (sizeof(struct syncs_handle_header) + handle_header->data_size)) break;
+
+			syncs_client_dispatch_handle(c, handle_header->handle, handle_header->type,
+				(char *) (handle_header + 1), handle_header->data_size);
+			if (c->socketfd != socketfd)
+				return -1;
+			buffer_head += sizeof(struct syncs_handle_header) + handle_header->data_size;
+			continue;
+		}
+		if (packet_header->magic != SYNCS_PACKET_MAGIC) {
+			buffer_head++;
+			continue;
+		}
+		if ((buffer_recv - buffer_head) < sizeof(struct syncs_header)) break;
+		if (packet_header->magic_data != SYNCS_PACKET_MAGIC_DATA) {
+			buffer_head++;
+			continue;
+		}
+		packet_header->data_size &= SYNCS_VARIABLE_SIZE_MAXIMUM;
+		if ((buffer_recv - buffer_head) < (sizeof(struct syncs_header) +packet_header->data_size)) break;
+
+		syncs_client_dispatch(c, packet_header, (char *) (packet_header + 1));
+		if (c->socketfd != socketfd)
+			return -1;
+		buffer_head += sizeof(struct syncs_header) +packet_header->data_size;
+	}
+
+	if (buffer_head < buffer_recv) {
+		if (c->buffer == NULL) {
+			c->buffer = malloc(SYNCS_CLIENT_BUFFER_SIZE);
+			if (c->buffer == NULL) {
+				syncsd_error("couldn't allocate buffer for client");
+				syncs_client_disconnect(c);
+				return -1;
+			}
+		}
+		if ((buffer_head) || (buffer != c->buffer))
+			memmove(c->buffer, buffer + buffer_head, buffer_recv - buffer_head);
+		c->buffer_recv = buffer_recv - buffer_head;
+		c->buffer_idle = 0;
+	} else {
+		// buffer is kept for the next split record, it goes only after many reads without one
+		c->buffer_recv = 0;
+		if ((c->buffer != NULL) && (++c->buffer_idle >= SYNCS_SERVER_BUFFER_IDLE)) {
+			free(c->buffer);
+			c->buffer = NULL;
+		}
+	}
+
 	return 0;
 }
 
@@ -939,53 +3182,61 @@ int syncs_client_handler(void *client, uint32_t epoll_event)
 {
 	int read_size;
 	struct syncs_client *c = client;
-	int socketfd = c->socketfd;
-	struct syncs_header *packet_header;
-	int buffer_head = 0;
 	int buffer_recv = c->buffer_recv;
-	uint8_t *buffer = c->buffer;
+	uint8_t *buffer;
+
+	if ((epoll_event & EPOLLOUT) || ((epoll_event & EPOLLERR) && __atomic_load_n(&c->zc_count, __ATOMIC_RELAXED))) {
+		syncs_client_flush(c);
+		// io_uring reads the socket by itself, epoll only watches the queue
+		if ((c->reactor->uring != NULL) || !(epoll_event & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+			return 0;
+	}
+	if (c->reactor->uring != NULL)
+		return 0;
 
-	read_size = recv(socketfd, buffer + buffer_recv, SYNCS_CLIENT_BUFFER_SIZE - buffer_recv, 0);
+	// idle clients don't keep a buffer, only a tail of partial packet is stored per client
+	buffer = (buffer_recv) ? c->buffer : c->reactor->buffer;
+
+	read_size = recv(c->socketfd, buffer + buffer_recv, SYNCS_CLIENT_BUFFER_SIZE - buffer_recv, 0);
+	c->reactor->rx_syscalls++;
 	syncsd_debug("read from client %d %d bytes", c->socketfd, read_size);
-	if (read_size < (int) sizeof(struct syncs_header)) {
+	if (read_size <= 0) {
 		if (read_size == -1) {
 			if ((errno == EAGAIN) || (errno == EINTR))
 				return 0;
-			syncs_close_client_socket(c);
+			syncs_client_disconnect(c);
 		}
 		if (read_size == 0) {
-			syncs_close_client_socket(c);
+			syncs_client_disconnect(c);
 		}
 		return 0;
 	}
 
-	buffer_recv += read_size;
+	syncs_client_parse(c, buffer, buffer_recv + read_size);
+	return 0;
+}
 
-	while ((buffer_recv - buffer_head) >= sizeof(struct syncs_header)) {
-		packet_header = (struct syncs_header *) (buffer + buffer_head);
+/* data of io_uring buffer, which is given back at once, is parsed in place or after the stored tail */
+static void syncs_client_receive(struct syncs_client *c, uint8_t *data, int size)
+{
+	int chunk;
 
-		if (packet_header->magic != SYNCS_PACKET_MAGIC) {
-			buffer_head++;
-			continue;
-		}
-		if (packet_header->magic_data != SYNCS_PACKET_MAGIC_DATA) {
-			buffer_head++;
-			continue;
+	while ((size > 0) && c->buffer_recv) {
+		chunk = MIN(size, SYNCS_CLIENT_BUFFER_SIZE - c->buffer_recv);
+		// tail which fills the whole buffer is never a packet
+		if (chunk == 0) {
+			syncs_client_disconnect(c);
+			return;
 		}
-		packet_header->data_size &= SYNCS_VARIABLE_SIZE_MAXIMUM;
-		if ((buffer_recv - buffer_head) < (sizeof(struct syncs_header) +packet_header->data_size)) break;
-
-		syncs_client_process_packet(c, (struct syncs_packet *)packet_header);
-		buffer_head += sizeof(struct syncs_header) +packet_header->data_size;
+		memcpy(c->buffer + c->buffer_recv, data, chunk);
+		if (syncs_client_parse(c, c->buffer, c->buffer_recv + chunk))
+			return;
+		data += chunk;
+		size -= chunk;
 	}
-
-	if (buffer_head < buffer_recv) {
-		if (buffer_head)
-			memmove(buffer, buffer + buffer_head, buffer_recv - buffer_head);
-		c->buffer_recv = buffer_recv - buffer_head;
-	} else c->buffer_recv = 0;
-
-	return 0;
+	// the tail is parsed out and its buffer is released, the rest is parsed in place
+	if (size > 0)
+		syncs_client_parse(c, data, size);
 }
 
 struct syncs_client * syncs_add_uclient(struct syncs_server *s, struct sockaddr_in * addr)
@@ -1001,7 +3252,16 @@ struct syncs_client * syncs_add_uclient(struct syncs_server *s, struct sockaddr_
 	c->addr_size = sizeof(struct sockaddr_in);
 	memcpy(&c->addr, addr, c->addr_size);
 	c->server = s;
+	c->reactor = &s->reactors[0];
+	if (syncs_hash_insert_key(&s->uclient_addr_index, syncs_uclient_key(addr), c)) {
+		syncs_put_free_client(s, c);
+		return NULL;
+	}
 	c->socketfd = UDP_SOCKET_STUB;
+	c->protocol = 0;
+	c->tx_sequence = 0;
+	c->udp_seen_ms = s->udp_now_ms;
+	syncs_udp_append(s, c);
 
 	c->event_subscribe = 0;
 	c->rx_event_count = 0;
@@ -1015,49 +3275,91 @@ struct syncs_client * syncs_add_uclient(struct syncs_server *s, struct sockaddr_
 	return c;
 }
 
+/* client restarted with another port, its session moves to the new address */
+static int syncs_move_uclient(struct syncs_client *c, struct sockaddr_in *addr)
+{
+	struct syncs_server *s = c->server;
+
+	syncs_hash_remove_key(&s->uclient_addr_index, syncs_uclient_key(&c->addr), c);
+	memcpy(&c->addr, addr, sizeof(struct sockaddr_in));
+	return syncs_hash_insert_key(&s->uclient_addr_index, syncs_uclient_key(addr), c);
+}
+
 int syncs_uclient_process_packet(struct syncs_server *s, struct sockaddr_in *addr, struct syncs_header *packet_header, char *data)
 {
 	struct syncs_client *c = NULL;
+	uint32_t type = packet_header->type & SYNCS_TYPE_MSG_MASK;
 
 	if ((c = syncs_find_uclient_addr(s, addr)) == NULL) {
-		if ((packet_header->type & SYNCS_TYPE_MSG_MASK) == SYNCS_TYPE_CLIENT_ID) {
+		if (type == SYNCS_TYPE_CLIENT_ID) {
 			if ((c = syncs_find_uclient_id(s, &packet_header->id)) == NULL) {
 				if ((c = syncs_add_uclient(s, addr)) == NULL) {
 					return -1;
 				}
-			} else
-				memcpy(&c->addr, addr, sizeof(struct sockaddr_in));
+			} else if (syncs_move_uclient(c, addr)) {
+				syncs_close_uclient(c);
+				return -1;
+			}
 		} else {
-			syncs_send_udp_server_status(s, addr, 2);
+			syncs_send_udp_server_status(s, addr, SYNCS_ERROR_UNKNOWNCLIENT);
 			return -1;
 		}
 	}
-	syncs_client_process_packet(c, (struct syncs_packet *)packet_header);
+	syncs_udp_touch(s, c);
+	// id index follows the id which the client gives
+	if (type == SYNCS_TYPE_CLIENT_ID)
+		syncs_hash_remove_id(&s->uclient_id_index, c);
+	syncs_client_process_packet(c, packet_header, data);
+	if ((type == SYNCS_TYPE_CLIENT_ID) && (c->socketfd == UDP_SOCKET_STUB) &&
+		syncs_hash_insert_id(&s->uclient_id_index, c))
+		syncs_close_uclient(c);
 	return 0;
 }
 
-int syncs_udp_handler(void *server, uint32_t epoll_event)
+static int syncs_udp_write_handle(struct syncs_server *s, struct sockaddr_in *addr, uint32_t handle, uint32_t type, char *data, uint32_t data_size)
+{
+	struct syncs_client *c;
+
+	if ((c = syncs_find_uclient_addr(s, addr)) == NULL) {
+		syncs_send_udp_server_status(s, addr, SYNCS_ERROR_UNKNOWNCLIENT);
+		return -1;
+	}
+	syncs_udp_touch(s, c);
+	return syncs_client_write_handle(c, handle, type, data, data_size);
+}
+
+static int syncs_udp_handle_packet(struct syncs_server *s, struct sockaddr_in *addr, struct syncs_handle_packet *packet, int size)
+{
+	if (packet->header.magic_data != SYNCS_PACKET_MAGIC_DATA)
+		return 0;
+	packet->header.data_size &= SYNCS_VARIABLE_SIZE_MAXIMUM;
+	if (size < (int) (sizeof(struct syncs_handle_header) + packet->header.data_size))
+		return 0;
+	return syncs_udp_write_handle(s, addr, packet->header.handle, packet->header.type, packet->buffer, packet->header.data_size);
+}
+
+static int syncs_udp_frame(struct syncs_server *s, struct sockaddr_in *addr, void *buffer, int size)
+{
+	struct syncs_frame frame;
+
+	if (syncs_frame_decode(&frame, buffer, size) <= 0)
+		return 0;
+	if (frame.fields & SYNCS_FRAME_FIELD_ID)
+		return syncs_uclient_process_packet(s, addr, &frame.header, frame.data);
+	return syncs_udp_write_handle(s, addr, frame.handle, frame.header.type, frame.data, frame.header.data_size);
+}
+
+static int syncs_udp_datagram(struct syncs_server *s, struct sockaddr_in *addr, uint8_t *buffer, int read_size)
 {
-	struct syncs_server *s = server;
 	struct syncs_header *packet_header;
-	uint8_t *buffer = s->ubuffer;
-	int read_size;
-	struct sockaddr_in addr;
-	socklen_t addr_len = sizeof(struct sockaddr_in);
 	int ret;
 
-	read_size = recvfrom(s->usocketfd, buffer, SYNCS_CLIENT_BUFFER_SIZE, 0, (struct sockaddr *) &addr, &addr_len);
-	syncsd_debug("read from %i udp %d bytes", s->usocketfd, read_size);
+	if ((read_size >= (int) sizeof(struct syncs_frame_header)) && (buffer[0] == SYNCS_PACKET_MAGIC_V3))
+		return syncs_udp_frame(s, addr, buffer, read_size);
+	if ((read_size >= (int) sizeof(struct syncs_handle_header)) && (buffer[0] == SYNCS_PACKET_MAGIC_HANDLE))
+		return syncs_udp_handle_packet(s, addr, (struct syncs_handle_packet *) buffer, read_size);
 	if (read_size < (int) sizeof(struct syncs_header)) {
-		syncsd_error("read from udp %d bytes errno %i", read_size, errno);
-		if (read_size == -1) {
-			if ((errno == ENETDOWN || errno == EPROTO || errno == ENOPROTOOPT || errno == EHOSTDOWN ||
-				errno == ENONET || errno == EHOSTUNREACH || errno == EOPNOTSUPP || errno == ENETUNREACH)) {
-				return 0;
-			};
-		}
-		if (read_size == 0) {
-		}
+		syncsd_error("read from udp %d bytes", read_size);
 		return 0;
 	}
 
@@ -1069,36 +3371,115 @@ int syncs_udp_handler(void *server, uint32_t epoll_event)
 		return 0;
 	}
 	packet_header->data_size &= SYNCS_VARIABLE_SIZE_MAXIMUM;
-	ret = syncs_uclient_process_packet(s, &addr, packet_header, (char *) packet_header + sizeof(struct syncs_header));
+	ret = syncs_uclient_process_packet(s, addr, packet_header, (char *) packet_header + sizeof(struct syncs_header));
 	syncsd_debug("syncs_uclient_process_packet return %i", ret);
 	return ret;
 }
 
-int syncs_add_client(void *server, uint32_t epoll_event)
+/* takes everything which is already queued on the socket by one call */
+static int syncs_udp_receive(struct syncs_server *s)
+{
+	struct syncs_udp_batch *b = s->udp_rx;
+	int count, i;
+
+	for (i = 0; i < SYNCS_SERVER_UDP_BATCH; i++)
+		b->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+	count = recvmmsg(s->usocketfd, b->msgs, SYNCS_SERVER_UDP_BATCH, MSG_DONTWAIT, NULL);
+	s->udp_rx_syscalls++;
+	syncsd_debug("read from %i udp %d datagrams", s->usocketfd, count);
+	if (count <= 0) {
+		if ((errno == EAGAIN || errno == EINTR || errno == ENETDOWN || errno == EPROTO || errno == ENOPROTOOPT || errno == EHOSTDOWN ||
+			errno == ENONET || errno == EHOSTUNREACH || errno == EOPNOTSUPP || errno == ENETUNREACH))
+			return 0;
+		syncsd_error("read from udp errno %i", errno);
+		return 0;
+	}
+	s->udp_rx_datagrams += count;
+	s->udp_now_ms = syncs_monotonic_ms();
+	for (i = 0; i < count; i++) {
+		// truncated datagram can't be a valid frame
+		if (b->msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+			continue;
+		syncs_udp_datagram(s, &b->addrs[i], b->buffers[i], b->msgs[i].msg_len);
+	}
+	return 0;
+}
+
+/* udp clients are looked up in the client table, so datagrams are processed exclusively */
+int syncs_udp_handler(void *server, uint32_t epoll_event)
+{
+	struct syncs_server *s = server;
+	int ret;
+
+	syncs_server_lock(s);
+	ret = syncs_udp_receive(s);
+	syncs_server_unlock(s);
+	return ret;
+}
+
+/* sessions which sent nothing for the idle time are forgotten, live clients send keepalives */
+static int syncs_udp_timer_handler(void *server, uint32_t epoll_event)
 {
 	struct syncs_server *s = server;
 	struct syncs_client *c;
+	uint64_t value, now;
+
+	if (read(s->udp_timerfd, &value, sizeof(uint64_t)) < 0)
+		syncsd_debug("couldn't read expiry timer: %s", strerror(errno));
+	now = syncs_monotonic_ms();
+	syncs_server_lock(s);
+	// sessions are ordered by activity, the first live one ends the expiry
+	while (((c = s->udp_oldest) != NULL) && (now - c->udp_seen_ms >= s->udp_idle_ms)) {
+		syncsd_debug("udp client %s expired", c->id.c);
+		syncs_close_uclient(c);
+		s->udp_expired++;
+	}
+	syncs_server_unlock(s);
+	return 0;
+}
+
+/* zero-copy is used when the kernel allows it for the socket, reports number its calls from 0 */
+static void syncs_client_zc_init(struct syncs_client *c)
+{
+	int one = 1;
+
+	c->zc_enabled = 0;
+	c->zc_first = 0;
+	c->zc_count = 0;
+	c->zc_call = 0;
+	c->zc_sends = 0;
+	c->zc_copied = 0;
+	if (c->server->zerocopy_bytes == 0)
+		return;
+	if ((c->zc == NULL) && ((c->zc = malloc(SYNCS_SERVER_ZC_PENDING * sizeof(struct syncs_zcentry))) == NULL))
+		return;
+	if (setsockopt(c->socketfd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one))) {
+		syncsd_debug("couldn't enable zero-copy for client: %s", strerror(errno));
+		return;
+	}
+	c->zc_enabled = 1;
+}
+
+/* accepted socket gets a free slot, it is watched by epoll or received by io_uring */
+static struct syncs_client *syncs_client_attach(struct syncs_reactor *r, int socketfd, struct sockaddr_in *addr)
+{
+	struct syncs_server *s = r->server;
+	struct syncs_client *c;
 	struct epoll_event socket_event;
 
 	syncsd_debug("new client extended");
 	c = syncs_get_free_client(s);
 	if (c == NULL) {
 		syncsd_error("couldn't find slot for client");
-		return 0;
+		close(socketfd);
+		return NULL;
 	}
 
 	c->addr_size = sizeof(struct sockaddr_in);
+	memcpy(&c->addr, addr, sizeof(struct sockaddr_in));
 	c->server = s;
-
-	c->socketfd = accept(s->socketfd, (struct sockaddr *) &c->addr, (socklen_t*) & c->addr_size);
-	if (c->socketfd == -1) {
-		if ((errno == ENETDOWN || errno == EPROTO || errno == ENOPROTOOPT || errno == EHOSTDOWN ||
-			errno == ENONET || errno == EHOSTUNREACH || errno == EOPNOTSUPP || errno == ENETUNREACH)) {
-			return 0;
-		};
-		syncsd_error("error on wait client: %s", strerror(errno));
-		return -1;
-	}
+	c->reactor = r;
+	c->socketfd = socketfd;
 	syncs_set_nonblocking_socket(c->socketfd, 1024 * 1024, 1024 * 1024);
 	syncs_set_keepalive(c->socketfd, 600, 3);
 
@@ -1108,79 +3489,367 @@ int syncs_add_client(void *server, uint32_t epoll_event)
 	c->rx_event_count = 0;
 	c->tx_event_count = 0;
 	c->event_write = 0;
-
-	socket_event.data.ptr = &c->epoll_data;
-	socket_event.events = EPOLLIN | EPOLLERR;
-	epoll_ctl(s->epollfd, EPOLL_CTL_ADD, c->socketfd, &socket_event);
+	c->tx_error = 0;
+	c->protocol = 0;
+	c->tx_sequence = 0;
+	c->tx_frames = 0;
+	c->tx_syscalls = 0;
+	c->buffer_recv = 0;
+	c->buffer_idle = 0;
+	syncs_client_zc_init(c);
+
+	if (r->uring == NULL) {
+		socket_event.data.ptr = &c->epoll_data;
+		socket_event.events = EPOLLIN | EPOLLERR;
+		epoll_ctl(r->epollfd, EPOLL_CTL_ADD, c->socketfd, &socket_event);
+	}
 	s->client_count++;
 
 	syncsd_debug("client connected %d", c->socketfd);
+	return c;
+}
+
+static int syncs_accept_client(struct syncs_reactor *r)
+{
+	struct sockaddr_in addr;
+	socklen_t addr_size = sizeof(struct sockaddr_in);
+	int socketfd;
+
+	socketfd = accept(r->socketfd, (struct sockaddr *) &addr, &addr_size);
+	r->rx_syscalls++;
+	if (socketfd == -1) {
+		if ((errno == EAGAIN || errno == EINTR || errno == ENETDOWN || errno == EPROTO || errno == ENOPROTOOPT || errno == EHOSTDOWN ||
+			errno == ENONET || errno == EHOSTUNREACH || errno == EOPNOTSUPP || errno == ENETUNREACH)) {
+			return 0;
+		};
+		syncsd_error("error on wait client: %s", strerror(errno));
+		return -1;
+	}
+	syncs_client_attach(r, socketfd, &addr);
 	return 0;
 }
 
-void syncs_recv_clients(struct syncs_server * s)
+/* every reactor accepts on its own listener, the kernel spreads connections between them */
+int syncs_add_client(void *reactor, uint32_t epoll_event)
+{
+	struct syncs_reactor *r = reactor;
+	int ret;
+
+	syncs_server_lock(r->server);
+	ret = syncs_accept_client(r);
+	syncs_server_unlock(r->server);
+	return ret;
+}
+
+/* wake, timers and udp stay in epoll, the listener is added only when sockets are read by epoll */
+static void syncs_reactor_watch(struct syncs_reactor *r)
 {
-	int epollfd = s->epollfd;
+	struct syncs_server *s = r->server;
 	struct epoll_event socket_event;
-	struct epoll_event *socket_events = s->socket_events;
-	int event_size;
+	int epollfd = r->epollfd;
+
+	if (r->uring == NULL) {
+		socket_event.data.ptr = &r->epoll_data;
+		socket_event.events = EPOLLIN | EPOLLERR;
+		epoll_ctl(epollfd, EPOLL_CTL_ADD, r->socketfd, &socket_event);
+	}
+	if (r->index == 0) {
+		socket_event.data.ptr = &s->epoll_udpdata;
+		socket_event.events = EPOLLIN | EPOLLERR;
+		epoll_ctl(epollfd, EPOLL_CTL_ADD, s->usocketfd, &socket_event);
+		socket_event.data.ptr = &s->epoll_udptimerdata;
+		socket_event.events = EPOLLIN;
+		epoll_ctl(epollfd, EPOLL_CTL_ADD, s->udp_timerfd, &socket_event);
+	}
+	socket_event.data.ptr = &r->epoll_wakedata;
+	socket_event.events = EPOLLIN;
+	epoll_ctl(epollfd, EPOLL_CTL_ADD, r->wakefd, &socket_event);
+	if (r->timerfd >= 0) {
+		socket_event.data.ptr = &r->epoll_timerdata;
+		socket_event.events = EPOLLIN;
+		epoll_ctl(epollfd, EPOLL_CTL_ADD, r->timerfd, &socket_event);
+	}
+}
+
+static int syncs_reactor_dispatch(struct syncs_reactor *r, int timeout)
+{
+	struct epoll_event *socket_events = r->socket_events;
 	struct syncs_epoll_cb *epoll_data;
+	int event_size;
 	int i;
 
-	socket_event.data.ptr = &s->epoll_data;
-	socket_event.events = EPOLLIN | EPOLLERR;
-	epoll_ctl(epollfd, EPOLL_CTL_ADD, s->socketfd, &socket_event);
-	socket_event.data.ptr = &s->epoll_udpdata;
-	socket_event.events = EPOLLIN | EPOLLERR;
-	epoll_ctl(epollfd, EPOLL_CTL_ADD, s->usocketfd, &socket_event);
+	event_size = epoll_wait(r->epollfd, socket_events, SYNCS_SERVER_EPOLL_BATCH, timeout);
+	r->rx_syscalls++;
+	for (i = 0; i < event_size; i++) {
+		syncsd_debug("event %d from %d", i, event_size);
+		epoll_data = (struct syncs_epoll_cb *) socket_events[i].data.ptr;
+		epoll_data->cb(epoll_data->socket, socket_events[i].events);
+	}
+	return event_size;
+}
+
+static void syncs_reactor_tick(struct syncs_reactor *r, int *timeout)
+{
+	struct syncs_server *s = r->server;
+
+	if (s->reactor_count > 1) {
+		syncs_server_lock_shared(s);
+		syncs_reactor_take_mails(r);
+		syncs_server_unlock(s);
+	}
+	if (r->index == 0)
+		*timeout = syncs_pump_transfers(s);
+	syncs_reactor_end_tick(r);
+}
+
+void syncs_recv_clients(struct syncs_reactor *r)
+{
+	int timeout = -1;
+
+	syncs_reactor_watch(r);
+	while (1) {
+		syncs_reactor_dispatch(r, timeout);
+		syncs_reactor_tick(r, &timeout);
+	}
+}
+
+/* user_data of receiving ring keeps the kind of request, generation and slot of the client */
+#define SYNCS_URING_ACCEPT	1ULL
+#define SYNCS_URING_RECV	2ULL
+#define SYNCS_URING_POLL	3ULL
+#define SYNCS_URING_DATA(tag, gen, index)	(((uint64_t) (tag) << 56) | ((uint64_t) ((gen) & 0xffffff) << 32) | (index))
+
+static const uint8_t syncs_uring_ops[] = {
+	IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SENDMSG, IORING_OP_POLL_ADD,
+	// multishot recv and accept have no probe, the opcode of the same kernel stands for them
+	IORING_OP_SENDMSG_ZC,
+};
+
+static void syncs_uring_arm_accept(struct syncs_reactor *r)
+{
+	struct io_uring_sqe *sqe = syncs_uring_get_sqe(r->uring);
+
+	if (sqe == NULL)
+		return;
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = r->socketfd;
+	sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+	sqe->user_data = SYNCS_URING_DATA(SYNCS_URING_ACCEPT, 0, 0);
+}
+
+static void syncs_uring_arm_recv(struct syncs_reactor *r, struct syncs_client *c)
+{
+	struct io_uring_sqe *sqe = syncs_uring_get_sqe(r->uring);
+
+	if (sqe == NULL) {
+		syncsd_error("couldn't receive from client %s", c->id.c);
+		syncs_client_disconnect(c);
+		return;
+	}
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = c->socketfd;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = r->uring->buffer_group;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->user_data = SYNCS_URING_DATA(SYNCS_URING_RECV, c->uring_gen, c->index);
+}
+
+static void syncs_uring_arm_poll(struct syncs_reactor *r)
+{
+	struct io_uring_sqe *sqe = syncs_uring_get_sqe(r->uring);
+
+	if (sqe == NULL)
+		return;
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = r->epollfd;
+	sqe->poll32_events = POLLIN;
+	sqe->len = IORING_POLL_ADD_MULTI;
+	sqe->user_data = SYNCS_URING_DATA(SYNCS_URING_POLL, 0, 0);
+}
+
+static void syncs_uring_accepted(struct syncs_reactor *r, struct io_uring_cqe *cqe)
+{
+	struct syncs_client *c;
+	struct sockaddr_in addr;
+	socklen_t addr_size = sizeof(struct sockaddr_in);
+
+	if (!(cqe->flags & IORING_CQE_F_MORE))
+		syncs_uring_arm_accept(r);
+	if (cqe->res < 0) {
+		if (cqe->res != -EAGAIN)
+			syncsd_debug("error on wait client: %s", strerror(-cqe->res));
+		return;
+	}
+	memset(&addr, 0, sizeof(addr));
+	getpeername(cqe->res, (struct sockaddr *) &addr, &addr_size);
+	syncs_server_lock(r->server);
+	c = syncs_client_attach(r, cqe->res, &addr);
+	if (c != NULL)
+		syncs_uring_arm_recv(r, c);
+	syncs_server_unlock(r->server);
+}
+
+/* buffer goes back to the ring right after parsing, completions of a closed connection are dropped */
+static void syncs_uring_received(struct syncs_reactor *r, struct io_uring_cqe *cqe)
+{
+	struct syncs_uring *u = r->uring;
+	struct syncs_client *c = syncs_client_at(r->server, cqe->user_data & 0xffffffff);
+	uint32_t gen = (cqe->user_data >> 32) & 0xffffff;
+	uint32_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+	int socketfd = c->socketfd;
+	int stale = ((__atomic_load_n(&c->uring_gen, __ATOMIC_RELAXED) & 0xffffff) != gen) || (socketfd < 0);
+
+	if (cqe->res > 0) {
+		if (!stale)
+			syncs_client_receive(c, syncs_uring_buffer(u, bid), cqe->res);
+		syncs_uring_buffer_put(u, bid);
+		if (stale || (c->socketfd != socketfd) || (cqe->flags & IORING_CQE_F_MORE))
+			return;
+		syncs_uring_arm_recv(r, c);
+		return;
+	}
+	if (stale)
+		return;
+	// kernel ran out of buffers, they are back as the completions are handled
+	if (cqe->res == -ENOBUFS) {
+		syncs_uring_arm_recv(r, c);
+		return;
+	}
+	if ((cqe->res != 0) && (cqe->res != -ECONNRESET))
+		syncsd_debug("couldn't receive from client %s: %s", c->id.c, strerror(-cqe->res));
+	syncs_client_disconnect(c);
+}
+
+/*
+ * Sockets are read by multishot recv into provided buffers and accepted by multishot accept,
+ * other descriptors stay in epoll which is polled by the ring, so one enter waits for everything.
+ */
+static void syncs_recv_clients_uring(struct syncs_reactor *r)
+{
+	struct syncs_uring *u = r->uring;
+	struct io_uring_cqe *cqe;
+	int timeout = -1;
+	int ret;
 
+	syncs_reactor_watch(r);
+	syncs_uring_arm_accept(r);
+	syncs_uring_arm_poll(r);
 	while (1) {
-		event_size = epoll_wait(epollfd, socket_events, SYNCS_CLIENT_MAXIMUM, -1);
-		for (i = 0; i < event_size; i++) {
-			syncsd_debug("event %d from %d", i, event_size);
-			epoll_data = (struct syncs_epoll_cb *) socket_events[i].data.ptr;
-			epoll_data->cb(epoll_data->socket, socket_events[i].events);
+		ret = syncs_uring_enter(u, 1, timeout);
+		r->rx_syscalls++;
+		if (ret < 0) {
+			syncsd_error("couldn't wait on io_uring: %s", strerror(-ret));
+			return;
+		}
+		while ((cqe = syncs_uring_peek(u)) != NULL) {
+			switch (cqe->user_data >> 56) {
+			case SYNCS_URING_RECV:
+				syncs_uring_received(r, cqe);
+				break;
+			case SYNCS_URING_ACCEPT:
+				syncs_uring_accepted(r, cqe);
+				break;
+			case SYNCS_URING_POLL:
+				if (!(cqe->flags & IORING_CQE_F_MORE))
+					syncs_uring_arm_poll(r);
+				syncs_reactor_dispatch(r, 0);
+				break;
+			}
+			syncs_uring_seen(u);
 		}
+		syncs_reactor_tick(r, &timeout);
 	}
 }
 
-void *syncs_server_thread(void *server)
+/* rings are created by the reactor thread, which is their only issuer */
+static int syncs_reactor_uring_init(struct syncs_reactor *r)
 {
-	struct syncs_server *s = server;
+	r->uring = calloc(1, sizeof(struct syncs_uring));
+	r->uring_tx = calloc(1, sizeof(struct syncs_uring));
+	r->uring_sends = calloc(SYNCS_SERVER_URING_SENDS, sizeof(struct syncs_uring_send));
+	if ((r->uring == NULL) || (r->uring_tx == NULL) || (r->uring_sends == NULL))
+		goto error_alloc;
+	if (syncs_uring_init(r->uring, SYNCS_SERVER_URING_ENTRIES, syncs_uring_ops, sizeof(syncs_uring_ops)))
+		goto error_alloc;
+	if (syncs_uring_buffers_init(r->uring, SYNCS_SERVER_URING_BUFFERS, SYNCS_SERVER_URING_BUFFER_SIZE, 0))
+		goto error_tx;
+	if (syncs_uring_init(r->uring_tx, SYNCS_SERVER_URING_SENDS, syncs_uring_ops, sizeof(syncs_uring_ops)))
+		goto error_tx;
+	return 0;
+
+error_tx:
+	syncs_uring_release(r->uring);
+error_alloc:
+	free(r->uring);
+	free(r->uring_tx);
+	free(r->uring_sends);
+	r->uring = NULL;
+	r->uring_tx = NULL;
+	r->uring_sends = NULL;
+	return -1;
+}
+
+static void syncs_reactor_uring_release(struct syncs_reactor *r)
+{
+	if (r->uring == NULL)
+		return;
+	syncs_uring_release(r->uring);
+	syncs_uring_release(r->uring_tx);
+	free(r->uring);
+	free(r->uring_tx);
+	free(r->uring_sends);
+	r->uring = NULL;
+	r->uring_tx = NULL;
+	r->uring_sends = NULL;
+}
 
-	syncsd_debug("run server thread");
+void *syncs_server_thread(void *reactor)
+{
+	struct syncs_reactor *r = reactor;
+	struct syncs_server *s = r->server;
+
+	syncsd_debug("run server thread %u", r->index);
+	syncs_reactor_current = r;
 	while (1) {
 		syncsd_debug("open server socket");
-		s->socketfd = syncs_tcpserver_open(s->addr, s->port);
-		if (s->socketfd < 0) {
+		r->socketfd = syncs_tcpserver_open(s->addr, s->port);
+		if (r->socketfd < 0) {
 			syncsd_error("couldn't open tcp socket");
 			goto error_tcp;
 		}
-		syncs_set_nonblocking_socket(s->socketfd, 1024 * 1024, 1024 * 1024);
-
-		s->usocketfd = syncs_udpserver_open(s->addr, s->port);
-		if (s->usocketfd < 0) {
-			syncsd_error("couldn't open udp socket");
-			goto error_udp;
+		syncs_set_nonblocking_socket(r->socketfd, 1024 * 1024, 1024 * 1024);
+
+		// udp clients are served by the first reactor
+		if (r->index == 0) {
+			s->usocketfd = syncs_udpserver_open(s->addr, s->port);
+			if (s->usocketfd < 0) {
+				syncsd_error("couldn't open udp socket");
+				goto error_udp;
+			}
+			syncs_set_nonblocking_socket(s->usocketfd, 1024 * 1024, 1024 * 1024);
 		}
-		syncs_set_nonblocking_socket(s->usocketfd, 1024 * 1024, 1024 * 1024);
 
-		s->epollfd = epoll_create(SYNCS_CLIENT_MAXIMUM + 2); // actually arg is ignore
-		if (s->epollfd < 0) {
+		r->epollfd = epoll_create(SYNCS_SERVER_EPOLL_BATCH); // actually arg is ignore
+		if (r->epollfd < 0) {
 			syncsd_error("couldn't create epoll descriptor");
 			goto error_epoll;
 		}
-		syncs_recv_clients(s);
-		close(s->epollfd);
+		if ((s->backend == SYNCS_BACKEND_URING) && (r->uring == NULL) && syncs_reactor_uring_init(r))
+			syncsd_error("couldn't create io_uring, epoll is used");
+		if (r->uring != NULL) {
+			syncs_recv_clients_uring(r);
+			syncs_reactor_uring_release(r);
+		} else syncs_recv_clients(r);
+		close(r->epollfd);
 error_epoll:
-		close(s->socketfd);
+		if (r->index == 0)
+			close(s->usocketfd);
 error_udp:
-		close(s->usocketfd);
+		close(r->socketfd);
 error_tcp:
 		usleep(300000);
 	}
 
-	free(server);
 	return NULL;
 }
 
@@ -1189,25 +3858,161 @@ void syncs_server_set_sync_offset(struct syncs_server *s, int ms)
 	s->sync_offset = ms;
 }
 
-static void syncs_server_structure_init(struct syncs_server * s)
+static int syncs_server_structure_init(struct syncs_server * s)
 {
-	int i;
-
-	for (i = 0; i < SYNCS_EVENT_MAXIMUM; i++) {
-		s->events[i].id.i[0] = -1;
-	}
+	uint32_t i;
+
+	if (syncs_hash_init(&s->event_index, SYNCS_EVENT_MAXIMUM * 2))
+		goto error_event_index;
+	if (syncs_hash_init(&s->uclient_addr_index, SYNCS_CLIENT_MAXIMUM * 2))
+		goto error_addr_index;
+	if (syncs_hash_init(&s->uclient_id_index, SYNCS_CLIENT_MAXIMUM * 2))
+		goto error_id_index;
+	s->event_chunks = calloc(SYNCS_SERVER_EVENT_LIMIT >> SYNCS_SERVER_EVENT_CHUNK_SHIFT, sizeof(struct syncs_event *));
+	s->client_chunks = calloc(SYNCS_SERVER_CLIENT_LIMIT >> SYNCS_SERVER_CLIENT_CHUNK_SHIFT, sizeof(struct syncs_client *));
+	if ((s->event_chunks == NULL) || (s->client_chunks == NULL))
+		goto error_chunks;
+	if (syncs_grow_events(s))
+		goto error_chunks;
+	if (syncs_grow_clients(s))
+		goto error_grow;
+	s->huge_frame = malloc(SYNCS_HUGE_FRAME_SIZE_MAXIMUM);
+	if (s->huge_frame == NULL)
+		goto error_grow;
 	for (i = 0; i < SYNCS_CHANNEL_MAXIMUM; i++) {
 		s->channels[i].id.i[0] = -1;
 	}
-	for (i = 0; i < SYNCS_CLIENT_MAXIMUM; i++) {
-		s->clients[i].socketfd = -1;
-	}
 	s->sync_offset = SYNCS_DEFAULT_SYNC_OFFSET_MS;
+
+	pthread_mutex_init(&s->pump_mutex, NULL);
+	pthread_rwlock_init(&s->lock, NULL);
+	return 0;
+
+error_grow:
+	for (i = 0; i < s->event_chunk_count; i++)
+		free(s->event_chunks[i]);
+	for (i = 0; i < s->client_chunk_count; i++)
+		free(s->client_chunks[i]);
+error_chunks:
+	free(s->event_chunks);
+	free(s->client_chunks);
+	syncs_hash_release(&s->uclient_id_index);
+error_id_index:
+	syncs_hash_release(&s->uclient_addr_index);
+error_addr_index:
+	syncs_hash_release(&s->event_index);
+error_event_index:
+	return -1;
 }
 
-struct syncs_server * syncs_server_create(const char *addr, int port, const char *cid)
+/* only for a server which threads were never started */
+static void syncs_server_structure_release(struct syncs_server *s)
+{
+	uint32_t i;
+
+	free(s->huge_frame);
+	for (i = 0; i < s->event_chunk_count; i++)
+		free(s->event_chunks[i]);
+	for (i = 0; i < s->client_chunk_count; i++)
+		free(s->client_chunks[i]);
+	free(s->event_chunks);
+	free(s->client_chunks);
+	syncs_hash_release(&s->uclient_id_index);
+	syncs_hash_release(&s->uclient_addr_index);
+	syncs_hash_release(&s->event_index);
+	pthread_rwlock_destroy(&s->lock);
+	pthread_mutex_destroy(&s->pump_mutex);
+}
+
+/* reactors are calloc'ed, so descriptors which weren't made yet are closed as -1 */
+static void syncs_server_reactors_release(struct syncs_server *s, uint32_t count)
+{
+	struct syncs_reactor *r;
+	uint32_t i;
+
+	for (i = 0; i < count; i++) {
+		r = &s->reactors[i];
+		if (r->wakefd >= 0)
+			close(r->wakefd);
+		if (r->timerfd >= 0)
+			close(r->timerfd);
+		free(r->mailbox.mails);
+	}
+	free(s->reactors);
+	s->reactors = NULL;
+}
+
+static int syncs_server_reactors_init(struct syncs_server *s, uint32_t count)
+{
+	struct syncs_reactor *r;
+	uint32_t i;
+
+	s->reactors = calloc(count, sizeof(struct syncs_reactor));
+	if (s->reactors == NULL)
+		return -1;
+	for (i = 0; i < count; i++) {
+		r = &s->reactors[i];
+		r->server = s;
+		r->index = i;
+		r->socketfd = -1;
+		r->epollfd = -1;
+		r->timerfd = -1;
+		r->epoll_data.socket = r;
+		r->epoll_data.cb = &syncs_add_client;
+		r->epoll_wakedata.socket = r;
+		r->epoll_wakedata.cb = &syncs_reactor_wake_handler;
+		r->wakefd = eventfd(0, EFD_NONBLOCK);
+		if (r->wakefd < 0)
+			goto error_reactor;
+		r->epoll_timerdata.socket = r;
+		r->epoll_timerdata.cb = &syncs_reactor_timer_handler;
+		if ((s->bundle_us != 0) && (s->bundle_us != SYNCS_BUNDLE_NONE)) {
+			r->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+			if (r->timerfd < 0)
+				goto error_reactor;
+		}
+		// single reactor sends to all clients by itself
+		if ((count > 1) && syncs_mailbox_init(&r->mailbox))
+			goto error_reactor;
+	}
+	s->reactor_count = count;
+	return 0;
+
+error_reactor:
+	syncs_server_reactors_release(s, i + 1);
+	return -1;
+}
+
+/* expiry runs a few times within the idle time, so sessions live at most a fraction longer */
+static int syncs_udp_timer_init(struct syncs_server *s)
+{
+	struct itimerspec period;
+	uint32_t ms = MAX(MIN(s->udp_idle_ms / 4, SYNCS_SERVER_UDP_EXPIRY_MS), 1);
+
+	s->epoll_udptimerdata.socket = s;
+	s->epoll_udptimerdata.cb = &syncs_udp_timer_handler;
+	s->udp_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+	if (s->udp_timerfd < 0)
+		return -1;
+	period.it_value.tv_sec = ms / 1000;
+	period.it_value.tv_nsec = (ms % 1000) * 1000000;
+	period.it_interval = period.it_value;
+	if (timerfd_settime(s->udp_timerfd, 0, &period, NULL)) {
+		close(s->udp_timerfd);
+		s->udp_timerfd = -1;
+		return -1;
+	}
+	return 0;
+}
+
+struct syncs_server * syncs_server_create_ex(const char *addr, int port, const char *cid, const struct syncs_server_options *options)
 {
 	struct syncs_server *s;
+	uint32_t reactors = 1;
+	uint32_t i;
+
+	if ((options != NULL) && (options->reactors > 1))
+		reactors = MIN(options->reactors, SYNCS_SERVER_REACTOR_MAXIMUM);
 
 	s = calloc(1, sizeof(struct syncs_server));
 	if (s == NULL) {
@@ -1215,65 +4020,152 @@ struct syncs_server * syncs_server_create(const char *addr, int port, const char
 		goto error_server_alloc;
 	}
 
-	syncs_server_structure_init(s);
+	if (syncs_server_structure_init(s)) {
+		syncsd_error("couldn't allocate event table");
+		goto error_structure_init;
+	}
+	if (options != NULL) {
+		s->bundle_us = options->bundle_us;
+		s->backend = options->backend;
+		s->zerocopy_bytes = options->zerocopy_bytes;
+	}
+	if (syncs_server_reactors_init(s, reactors)) {
+		syncsd_error("couldn't create reactors");
+		goto error_reactors_init;
+	}
 	if (addr != NULL)
 		strncpy(s->addr, addr, 20);
 	s->port = port;
 	if (cid != NULL)
 		syncs_idstr(&s->id, cid);
-	s->epoll_data.socket = s;
-	s->epoll_data.cb = &syncs_add_client;
+	// queue takes at least one chunk of huge variable
+	s->outq_high = ((options != NULL) && options->queue_high) ? options->queue_high : SYNCS_SERVER_OUTQ_HIGH;
+	s->outq_high = MAX(s->outq_high, SYNCS_HUGE_FRAME_SIZE_MAXIMUM);
+	s->outq_low = ((options != NULL) && options->queue_low) ? options->queue_low : SYNCS_SERVER_OUTQ_LOW;
+	s->outq_low = MIN(s->outq_low, s->outq_high / 2);
 	s->epoll_udpdata.socket = s;
 	s->epoll_udpdata.cb = &syncs_udp_handler;
+	s->udp_rx = syncs_udp_batch_alloc();
+	s->udp_tx = syncs_udp_batch_alloc();
+	if ((s->udp_rx == NULL) || (s->udp_tx == NULL)) {
+		syncsd_error("couldn't allocate udp batches");
+		goto error_udp_alloc;
+	}
+	s->udp_idle_ms = ((options != NULL) && options->udp_idle_ms) ? options->udp_idle_ms : SYNCS_SERVER_UDP_IDLE_MS;
+	s->udp_now_ms = syncs_monotonic_ms();
+	if (syncs_udp_timer_init(s)) {
+		syncsd_error("couldn't create udp expiry timer");
+		goto error_udp_alloc;
+	}
 
-	pthread_create(&s->thread, NULL, &syncs_server_thread, (void*) s);
+	for (i = 0; i < reactors; i++)
+		pthread_create(&s->reactors[i].thread, NULL, &syncs_server_thread, (void*) &s->reactors[i]);
 	return s;
 
+error_udp_alloc:
+	free(s->udp_rx);
+	free(s->udp_tx);
+	syncs_server_reactors_release(s, reactors);
+error_reactors_init:
+	syncs_server_structure_release(s);
+error_structure_init:
+	free(s);
 error_server_alloc:
 	return NULL;
 }
 
+struct syncs_server * syncs_server_create(const char *addr, int port, const char *cid)
+{
+	return syncs_server_create_ex(addr, port, cid, NULL);
+}
+
 void syncs_server_stop(struct syncs_server * s)
 {
 	/* SyncScribe will live forever */
 }
 
+int syncs_server_get_stats(struct syncs_server *s, struct syncs_server_stats *stats)
+{
+	struct syncs_client *c;
+	struct timespec cpu;
+	clockid_t clock;
+	uint32_t i;
+
+	memset(stats, 0, sizeof(struct syncs_server_stats));
+	stats->backend = SYNCS_BACKEND_URING;
+	syncs_server_lock_shared(s);
+	for (i = 0; i < s->reactor_count; i++) {
+		stats->tx_frames += s->reactors[i].tx_frames;
+		stats->tx_syscalls += s->reactors[i].tx_syscalls;
+		stats->rx_syscalls += s->reactors[i].rx_syscalls;
+		stats->zerocopy_sends += s->reactors[i].zc_sends;
+		stats->zerocopy_copied += s->reactors[i].zc_copied;
+		if (!pthread_getcpuclockid(s->reactors[i].thread, &clock) && !clock_gettime(clock, &cpu))
+			stats->reactor_cpu_us += (uint64_t) cpu.tv_sec * 1000000 + cpu.tv_nsec / 1000;
+		// backend which was asked for falls back to epoll on the kernel without io_uring
+		if (s->reactors[i].uring == NULL)
+			stats->backend = SYNCS_BACKEND_EPOLL;
+	}
+	stats->udp_rx_datagrams = s->udp_rx_datagrams;
+	stats->udp_rx_syscalls = s->udp_rx_syscalls;
+	stats->udp_tx_datagrams = s->udp_tx_datagrams;
+	stats->udp_tx_syscalls = s->udp_tx_syscalls;
+	stats->udp_expired = s->udp_expired;
+	stats->suppressed = s->suppressed;
+	stats->udp_clients = s->uclient_count;
+	for (i = 0; i < s->client_capacity; i++) {
+		c = syncs_client_at(s, i);
+		if (c->socketfd < 0)
+			continue;
+		stats->tx_frames += c->tx_frames;
+		stats->tx_syscalls += c->tx_syscalls;
+		stats->zerocopy_sends += c->zc_sends;
+		stats->zerocopy_copied += c->zc_copied;
+		stats->clients++;
+	}
+	syncs_server_unlock(s);
+	return 0;
+}
+
 void syncs_server_print_event(struct syncs_server * s, FILE *stream)
 {
-	int i;
+	uint32_t i;
+	struct syncs_event *event;
+	struct syncs_client *client;
 	char str[15];
 	struct in_addr addr;
 
 	(void) addr;
+	syncs_server_lock_shared(s);
 	fprintf(stream, "Event statistics\n");
 	fprintf(stream, "|%30s|%15s|%7s|%7s|%7s", "id", "value", "count", "prod.", "cons.\n");
-	for (i = 0; i < SYNCS_EVENT_MAXIMUM; i++)
-		if (s->events[i].id.i[0] != -1) {
-			switch (s->events[i].data_type) {
+	for (i = 0; i < s->event_capacity; i++)
+		if ((event = syncs_event_at(s, i))->id.i[0] != -1) {
+			switch (event->data_type) {
 			case SYNCS_TYPE_VAR_INT32:
-				if ((*(int *) s->events[i].data < 255) && isprint(*(int *) s->events[i].data)) snprintf(str, 15, "%d/%c", *(int *) s->events[i].data, *(char *) s->events[i].data);
-				else snprintf(str, 15, "%d", *(int *) s->events[i].data);
+				if ((*(int *) event->data < 255) && isprint(*(int *) event->data)) snprintf(str, 15, "%d/%c", *(int *) event->data, *(char *) event->data);
+				else snprintf(str, 15, "%d", *(int *) event->data);
 				break;
-			case SYNCS_TYPE_VAR_INT64: snprintf(str, 15, "%ld", *(long *) s->events[i].data);
+			case SYNCS_TYPE_VAR_INT64: snprintf(str, 15, "%ld", *(long *) event->data);
 				break;
-			case SYNCS_TYPE_VAR_FLOAT: snprintf(str, 15, "%f", *(float *) s->events[i].data);
+			case SYNCS_TYPE_VAR_FLOAT: snprintf(str, 15, "%f", *(float *) event->data);
 				break;
-			case SYNCS_TYPE_VAR_DOUBLE: snprintf(str, 15, "%lf", *(double *) s->events[i].data);
+			case SYNCS_TYPE_VAR_DOUBLE: snprintf(str, 15, "%lf", *(double *) event->data);
 				break;
-			case SYNCS_TYPE_VAR_STRING: snprintf(str, 15, "%s", (char *) s->events[i].data);
+			case SYNCS_TYPE_VAR_STRING: snprintf(str, 15, "%s", (char *) event->data);
 				break;
 			default: snprintf(str, 10, "not support");
 				break;
 			}
-			fprintf(stream, "|%30s|%15s|%7d|%7d|%7d\n", (char *) &s->events[i].id, str, s->events[i].count, s->events[i].producers_count, s->events[i].consumers_count);
+			fprintf(stream, "|%30s|%15s|%7d|%7d|%7d\n", (char *) &event->id, str, event->count, event->producers_count, event->consumers_count);
 		}
 
 	fprintf(stream, "Client statistics\n");
 	fprintf(stream, "|%20s|%7s|%7s|%7s|%7s|%7s|%7s\n", "id", "rx pkt", "tx pkt", "subscr", "write", "ip", "proto");
-	for (i = 0; i < SYNCS_CLIENT_MAXIMUM; i++)
-		if (s->clients[i].socketfd != -1) {
-			fprintf(stream, "|%20s|%7d|%7d|%7d|%7d|%7s|%7s\n", (char *) &s->clients[i].id, s->clients[i].rx_event_count, s->clients[i].tx_event_count, s->clients[i].event_subscribe, s->clients[i].event_write,
-				inet_ntoa(s->clients[i].addr.sin_addr), (s->clients[i].socketfd == UDP_SOCKET_STUB) ? "udp" : "tcp");
+	for (i = 0; i < s->client_capacity; i++)
+		if ((client = syncs_client_at(s, i))->socketfd != -1) {
+			fprintf(stream, "|%20s|%7d|%7d|%7d|%7d|%7s|%7s\n", (char *) &client->id, client->rx_event_count, client->tx_event_count, client->event_subscribe, client->event_write,
+				inet_ntoa(client->addr.sin_addr), (client->socketfd == UDP_SOCKET_STUB) ? "udp" : "tcp");
 		}
 
 	fprintf(stream, "Channel statistics\n");
@@ -1284,7 +4176,7 @@ void syncs_server_print_event(struct syncs_server * s, FILE *stream)
 			fprintf(stream, "|%20s|%11s|%7d|%7d|%7d|%7d\n", (char *) &s->channels[i].id, inet_ntoa(addr), s->channels[i].ticket.port,
 				s->channels[i].request_count, s->channels[i].producers_count, s->channels[i].anons_count);
 		}
-
+	syncs_server_unlock(s);
 }
 
 int syncs_server_ssdp_response(struct syncs_server *s, char *buffer, uint32_t size)
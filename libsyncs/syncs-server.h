@@ -36,9 +36,29 @@ extern "C" {
  */
 struct syncs_server *syncs_server_create(const char *addr, int port, const char *id);
 
+/**
+ * @brief Creates a server instance with options.
+ *
+ * Several reactors share the port with SO_REUSEPORT and process writes in parallel,
+ * events for clients of another reactor are passed through its mailbox. Callbacks of
+ * server events run in reactor threads then and must not define or undefine variables.
+ * Frames to the clients of reactor are sent together at the end of its epoll iteration
+ * or when bundle_us is over.
+ *
+ * @param addr The server address.
+ * @param port The server port.
+ * @param id The server ID.
+ * @param options The server options, NULL for the defaults.
+ * @return A pointer to the created syncs_server structure.
+ */
+struct syncs_server *syncs_server_create_ex(const char *addr, int port, const char *id, const struct syncs_server_options *options);
+
 /**
  * @brief Defines a new event or variable on the server.
  *
+ * With SYNCS_TYPE_ONCHANGE in type a write of the same bytes as the current
+ * value isn't sent to subscribers, see syncs_server_set_deadband().
+ *
  * @param s The syncs_server structure.
  * @param id The event or variable ID.
  * @param type The type of the event or variable.
@@ -48,6 +68,36 @@ struct syncs_server *syncs_server_create(const char *addr, int port, const char
  */
 int syncs_server_define(struct syncs_server *s, const char *id, int type, void *data, uint32_t size);
 
+/**
+ * @brief Sets the deadband of a numeric variable, the variable gets the SYNCS_TYPE_ONCHANGE policy.
+ *
+ * Write which differs from the last sent value by no more than the deadband
+ * updates the value, count and update counter, but isn't sent to subscribers
+ * and doesn't call the server callback. The band is the larger of the absolute
+ * one and the percent of the last sent value.
+ *
+ * @param s The syncs_server structure.
+ * @param id The variable ID.
+ * @param absolute The absolute deadband, 0 sends every change.
+ * @param percent The deadband in percent of the last sent value, 0 for none.
+ * @return 0 on success, -1 if the variable doesn't exist, -3 if it isn't int, long, float or double.
+ */
+int syncs_server_set_deadband(struct syncs_server *s, const char *id, double absolute, double percent);
+
+/**
+ * @brief Defines a stream variable, every written value is appended to the ring.
+ *
+ * Subscribers get all elements in order, batched when they fall behind. A subscriber
+ * which lags more than depth elements loses the oldest of them and is notified by the gap.
+ *
+ * @param s The syncs_server structure.
+ * @param id The stream ID.
+ * @param depth The number of elements kept in the ring, 0 for the default.
+ * @param element_size The maximum size of element, 0 for the variable maximum.
+ * @return 0 on success, -1 on failure, -2 if the stream already exists.
+ */
+int syncs_server_define_stream(struct syncs_server *s, const char *id, uint32_t depth, uint32_t element_size);
+
 /**
  * @brief Undefines an existing event or variable on the server.
  *
@@ -148,6 +198,9 @@ int syncs_server_read_str(struct syncs_server *s, uint32_t flags, const char *id
 /**
  * @brief Writes data associated with an event or variable to the server.
  *
+ * Value of SYNCS_TYPE_VAR_HUGE variable is kept by reference and queued for
+ * subscribers, the server thread sends it by chunks between other events.
+ *
  * @param s The syncs_server structure.
  * @param flags Additional flags for the write operation.
  * @param id The event or variable ID.
@@ -235,6 +288,15 @@ void syncs_server_set_sync_offset(struct syncs_server *s, int ms);
  */
 void syncs_server_print_event(struct syncs_server *s, FILE *stream);
 
+/**
+ * @brief Collects counters of frames and send calls to tcp clients.
+ *
+ * @param s The syncs_server structure.
+ * @param stats The structure to store the counters.
+ * @return 0 on success, -1 on failure.
+ */
+int syncs_server_get_stats(struct syncs_server *s, struct syncs_server_stats *stats);
+
 /**
  * @brief Creates an SSDP instance for the server.
  *
@@ -47,6 +47,8 @@ typedef union syncs_id syncsid_t;
 
 #define SYNCS_PACKET_MAGIC	('S')
 #define SYNCS_PACKET_MAGIC_DATA ('D')
+#define SYNCS_PACKET_MAGIC_HANDLE ('H')
+#define SYNCS_PACKET_MAGIC_V3	('V')
 #define UDP_SOCKET_STUB		(-2)
 #define SYNCS_VERSION_MAJOR	2
 #define SYNCS_VERSION_MINOR	1
@@ -76,6 +78,81 @@ struct syncs_packet {
 	char buffer[SYNCS_EVENT_DATA_SIZE_MAXIMUM];
 } __attribute__((packed));
 
+// Compact header of WRITE and EVENT packets for a variable with a known handle.
+// It is used only when SYNCS_PROTOCOL_HANDLE is negotiated, sync events keep the full header.
+struct syncs_handle_header {
+	uint8_t magic;
+	uint8_t magic_data;
+	uint16_t data_size;
+	uint32_t type;
+	uint32_t handle;
+	uint64_t update_counter;
+} __attribute__((packed));
+
+struct syncs_handle_packet {
+	struct syncs_handle_header header;
+	char buffer[SYNCS_EVENT_DATA_SIZE_MAXIMUM];
+} __attribute__((packed));
+
+// Protocol v3 frame header, all fields are naturally aligned.
+// Optional fields follow the header in the order of SYNCS_FRAME_FIELD_* bits,
+// then data. The frame is padded with zeros to SYNCS_FRAME_ALIGN bytes,
+// so the next header in a stream stays aligned as well.
+// Without SYNCS_FRAME_FIELD_ID the variable is addressed by handle. With it the
+// handle field keeps the number of 8-byte words of id which are sent, the zero
+// words at the end of id are left out.
+struct syncs_frame_header {
+	uint8_t magic;
+	uint8_t fields;
+	uint16_t data_size;
+	uint32_t type;
+	uint32_t sequence;
+	uint32_t handle;
+};
+
+#define SYNCS_FRAME_FIELD_ID	  0x01 // 1 to 4 words of syncsid_t
+#define SYNCS_FRAME_FIELD_SYNC	  0x02 // struct syncdata
+#define SYNCS_FRAME_FIELD_COUNTER 0x04 // uint64_t update counter
+#define SYNCS_FRAME_FIELD_MASK	  0x07
+
+#define SYNCS_FRAME_ALIGN	  8
+#define SYNCS_FRAME_PAD(size)	  (((size) + SYNCS_FRAME_ALIGN - 1) & ~(SYNCS_FRAME_ALIGN - 1))
+#define SYNCS_FRAME_SIZE_MAXIMUM  SYNCS_FRAME_PAD(sizeof(struct syncs_frame_header) + sizeof(syncsid_t) + \
+					sizeof(struct syncdata) + sizeof(uint64_t) + SYNCS_EVENT_DATA_SIZE_MAXIMUM)
+
+// Huge variable (SYNCS_TYPE_VAR_HUGE) is sent as a sequence of v3 WRITE or EVENT frames,
+// data of every frame is the chunk header followed by up to SYNCS_HUGE_CHUNK_SIZE bytes
+// of the value. Chunks of one transfer go in order, the receiver delivers the value only
+// when all of them are collected. A chunk with zero offset starts a new transfer.
+struct syncs_huge_chunk {
+	uint32_t transfer;
+	uint32_t size;
+	uint32_t offset;
+	uint32_t reserved;
+};
+
+#define SYNCS_HUGE_SIZE_MAXIMUM	  (64 * 1024 * 1024)
+#define SYNCS_HUGE_CHUNK_SIZE	  (16 * 1024)
+#define SYNCS_HUGE_FRAME_SIZE_MAXIMUM SYNCS_FRAME_PAD(sizeof(struct syncs_frame_header) + sizeof(syncsid_t) + \
+					sizeof(struct syncdata) + sizeof(uint64_t) + sizeof(struct syncs_huge_chunk) + SYNCS_HUGE_CHUNK_SIZE)
+
+// Elements of stream (SYNCS_TYPE_VAR_STREAM) are sent in v3 EVENT frames as batches:
+// the batch header then count elements, every element is its header and data padded
+// to SYNCS_FRAME_ALIGN. Sequence numbers of elements go one by one from 1, a jump
+// of the sequence means the receiver fell behind and lost the elements between.
+struct syncs_stream_batch {
+	uint64_t sequence; // sequence of the first element
+	uint32_t count;
+	uint32_t reserved;
+};
+
+struct syncs_stream_element {
+	uint32_t size;
+	uint32_t reserved;
+};
+
+#define SYNCS_STREAM_BATCH_SIZE_MAXIMUM (SYNCS_EVENT_DATA_SIZE_MAXIMUM & ~(SYNCS_FRAME_ALIGN - 1))
+
 struct syncs_client_id {
 	uint32_t version;
 	syncsid_t groupid;
@@ -99,6 +176,8 @@ struct syncs_client_info {
 	uint32_t rx_event_count;
 	uint32_t tx_event_count;
 	in_addr_t ip;
+	uint32_t event_conflate;	// subscriptions which keep only the latest value queued
+	uint32_t conflated;	// queued values replaced by newer ones
 } __attribute__((packed));
 
 struct syncs_channel_info {
@@ -115,6 +194,54 @@ struct syncs_channel_ticket {
 	uint32_t flags;
 } __attribute__((packed));
 
+// options of syncs_server_create_ex, zeroed structure gives the defaults
+struct syncs_server_options {
+	uint32_t reactors;	// threads with own listener and clients, 0 or 1 runs a single thread
+	uint32_t queue_high;	// bytes queued for a slow client before its events are dropped
+	uint32_t queue_low;	// bytes of queue when the client gets events again
+	uint32_t bundle_us;	// microseconds which frames wait to be sent together, 0 for the end of tick
+	uint32_t udp_idle_ms;	// udp session which sent nothing for this time is forgotten, 0 for default
+	uint32_t backend;	// SYNCS_BACKEND_EPOLL or SYNCS_BACKEND_URING, epoll is used without io_uring support
+	uint32_t zerocopy_bytes;	// frames and chunks of this size and larger go with MSG_ZEROCOPY, 0 disables
+};
+
+#define SYNCS_BACKEND_EPOLL	0
+#define SYNCS_BACKEND_URING	1
+
+// bundle_us which sends every frame at once
+#define SYNCS_BUNDLE_NONE	0xffffffff
+// udp client reminds the server about its session, the server forgets it after several misses
+#define SYNCS_UDP_KEEPALIVE_MS	15000
+
+// counters of syncs_server_get_stats, frames and send calls of tcp clients
+struct syncs_server_stats {
+	uint64_t tx_frames;
+	uint64_t tx_syscalls;
+	uint64_t udp_rx_datagrams;
+	uint64_t udp_rx_syscalls;
+	uint64_t udp_tx_datagrams;
+	uint64_t udp_tx_syscalls;
+	uint64_t udp_expired;
+	uint64_t rx_syscalls;
+	uint64_t reactor_cpu_us;
+	uint64_t zerocopy_sends;	// calls with MSG_ZEROCOPY
+	uint64_t zerocopy_copied;	// calls which the kernel copied anyway, loopback always does
+	uint64_t suppressed;	// writes kept by the publish policy of variable
+	uint32_t clients;
+	uint32_t udp_clients;
+	uint32_t backend;
+};
+
+// event taken by syncs_wait_events, data and data_size are the buffer of caller,
+// sequence counts every event of the queue, so a jump shows the dropped ones
+struct syncs_queued_event {
+	char id[sizeof(syncsid_t)];
+	uint32_t flags;
+	uint32_t data_size;
+	uint64_t sequence;
+	void *data;
+};
+
 #define SYNCS_PACKET_SIZE_MASK (0x0fff)
 #define SYNCS_PACKET_SIZE_PADDING(data_size) ((data_size)>>12)
 #define SYNCS_PACKET_DATA_SIZE(data_size) ((data_size)&SYNCS_PACKET_SIZE_MASK)
@@ -125,11 +252,43 @@ struct syncs_channel_ticket {
 #define SYNCS_CRYPT_HEADER_SIZE	 (sizeof(struct syncs_header) - 1 - 2 - 1)
 #define SYNCS_CRC_HEADER_SIZE	 (sizeof(struct syncs_header) - 1 - 4)
 
+#define SYNCS_HANDLE_PACKET_SIZE(packet) (sizeof(struct syncs_handle_header) + (SYNCS_PACKET_DATA_SIZE(((packet)->header.data_size))))
+
+// Protocol options, client requests them in low word of update_counter of CLIENT_ID
+// (high word is the signature), server returns the accepted ones in sync.data0
+// of SERVER_STATUS with the signature in sync.data1.
+// When handles are accepted, DEFINE and SUBSCRIBE are answered with ACK
+// which carries the 32-bit handle of the variable as data.
+// With V3 both sides send v3 frames once the option is known to them,
+// receivers always accept all packet formats.
+// HUGE allows chunked transfers of huge variables, it is accepted only together
+// with V3 on TCP connections. STREAM makes stream elements come in batches,
+// it is accepted only together with V3.
+#define SYNCS_PROTOCOL_HANDLE	    0x00000001
+#define SYNCS_PROTOCOL_V3	    0x00000002
+#define SYNCS_PROTOCOL_HUGE	    0x00000004
+#define SYNCS_PROTOCOL_STREAM	    0x00000008
+#define SYNCS_PROTOCOL_MASK	    0x0000000f
+// options are valid only with the signature, old peers leave these fields uninitialized
+#define SYNCS_PROTOCOL_SIGNATURE    0x50524f54
+
 #define SYNCS_CLIENT_MODE_TCP	    0x00000001
 #define SYNCS_CLIENT_MODE_UDP	    0x00000002
 #define SYNCS_CLIENT_MODE_ICMP	    0x00000004
 #define SYNCS_CLIENT_MODE_BROADCAST 0x00000008
 
+// Options of syncs_set_cork, writes of a corked tcp connection wait to be sent together.
+// SQUASH keeps only the last value of variable which waits.
+#define SYNCS_CORK_ON		    0x00000001
+#define SYNCS_CORK_SQUASH	    0x00000002
+#define SYNCS_CORK_MASK		    0x00000003
+
+// Overflow policies of syncs_set_event_queue, the queue keeps events of sync subscriptions.
+// CONFLATE keeps the last value of variable which didn't fit and delivers it after the queued ones.
+#define SYNCS_QUEUE_DROP_OLDEST	    0x00000000
+#define SYNCS_QUEUE_DROP_NEWEST	    0x00000001
+#define SYNCS_QUEUE_CONFLATE	    0x00000002
+
 // EVENT TYPE FLAG BIT MAP
 // 0..3 - event message type
 // 4..7 - event message bit attributes
@@ -162,6 +321,12 @@ struct syncs_channel_ticket {
 #define SYNCS_TYPE_FORCE      (0x0080)
 #define SYNCS_TYPE_FLAGS_MASK (0x00f0)
 
+// options of SUBSCRIBE, queued value which isn't sent yet is replaced by the newer one
+#define SYNCS_TYPE_CONFLATE   (0x1000)
+// options of DEFINE on the server, write which doesn't change the value isn't sent
+#define SYNCS_TYPE_ONCHANGE   (0x2000)
+#define SYNCS_TYPE_OPTIONS_MASK (0xf000)
+
 #define SYNCS_TYPE_VAR_NOT_DEFINED (0x0000)
 #define SYNCS_TYPE_VAR_EMPTY	   (0x0100)
 #define SYNCS_TYPE_VAR_INT32	   (0x0200)
@@ -0,0 +1,265 @@
+/**************************************************************
+ * Description: SyncScribe library to manage network and local events,
+ * variables and channels
+ * Copyright (c) 2022 Alexander Krapivniy (a.krapivniy@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "syncs-uring.h"
+
+#define MODULE_NAME "syncs-uring"
+#include <syncs-debug.h>
+#undef syncsd_debug
+#define syncsd_debug(fmt,args...)
+
+#define SYNCS_URING_CQ_FACTOR	8
+
+static int syncs_uring_setup(uint32_t entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int syncs_uring_register(int fd, uint32_t opcode, void *arg, uint32_t nr_args)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/* probe tells which opcodes the kernel knows, flags of them can't be probed */
+static int syncs_uring_probe(struct syncs_uring *u, const uint8_t *ops, uint32_t ops_count)
+{
+	struct io_uring_probe *probe;
+	size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+	uint32_t i;
+	int ret = 0;
+
+	probe = calloc(1, size);
+	if (probe == NULL)
+		return -1;
+	if (syncs_uring_register(u->fd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+		free(probe);
+		return -1;
+	}
+	for (i = 0; i < ops_count; i++)
+		if ((ops[i] > probe->last_op) || !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED)) {
+			syncsd_debug("io_uring doesn't support op %u", ops[i]);
+			ret = -1;
+		}
+	free(probe);
+	return ret;
+}
+
+static int syncs_uring_map(struct syncs_uring *u, struct io_uring_params *p)
+{
+	u->sq_ring_size = p->sq_off.array + p->sq_entries * sizeof(uint32_t);
+	u->cq_ring_size = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+	if (u->features & IORING_FEAT_SINGLE_MMAP) {
+		if (u->cq_ring_size > u->sq_ring_size)
+			u->sq_ring_size = u->cq_ring_size;
+		u->cq_ring_size = u->sq_ring_size;
+	}
+	u->sq_ring = mmap(NULL, u->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+	if (u->sq_ring == MAP_FAILED)
+		goto error_sq;
+	if (u->features & IORING_FEAT_SINGLE_MMAP)
+		u->cq_ring = u->sq_ring;
+	else {
+		u->cq_ring = mmap(NULL, u->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+		if (u->cq_ring == MAP_FAILED)
+			goto error_cq;
+	}
+	u->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+	u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+	if (u->sqes == MAP_FAILED)
+		goto error_sqes;
+
+	u->sq_head = (uint32_t *) ((uint8_t *) u->sq_ring + p->sq_off.head);
+	u->sq_tail = (uint32_t *) ((uint8_t *) u->sq_ring + p->sq_off.tail);
+	u->sq_mask = *(uint32_t *) ((uint8_t *) u->sq_ring + p->sq_off.ring_mask);
+	u->sq_array = (uint32_t *) ((uint8_t *) u->sq_ring + p->sq_off.array);
+	u->sq_entries = p->sq_entries;
+	u->cq_head = (uint32_t *) ((uint8_t *) u->cq_ring + p->cq_off.head);
+	u->cq_tail = (uint32_t *) ((uint8_t *) u->cq_ring + p->cq_off.tail);
+	u->cq_mask = *(uint32_t *) ((uint8_t *) u->cq_ring + p->cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe *) ((uint8_t *) u->cq_ring + p->cq_off.cqes);
+	return 0;
+
+error_sqes:
+	if (u->cq_ring != u->sq_ring)
+		munmap(u->cq_ring, u->cq_ring_size);
+error_cq:
+	munmap(u->sq_ring, u->sq_ring_size);
+error_sq:
+	return -1;
+}
+
+int syncs_uring_init(struct syncs_uring *u, uint32_t entries, const uint8_t *ops, uint32_t ops_count)
+{
+	struct io_uring_params p;
+
+	memset(u, 0, sizeof(struct syncs_uring));
+	memset(&p, 0, sizeof(p));
+	p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN | IORING_SETUP_SINGLE_ISSUER;
+	p.cq_entries = entries * SYNCS_URING_CQ_FACTOR;
+	u->fd = syncs_uring_setup(entries, &p);
+	if ((u->fd < 0) && (errno == EINVAL)) {
+		// older kernel doesn't know the hints
+		memset(&p, 0, sizeof(p));
+		p.flags = IORING_SETUP_CQSIZE;
+		p.cq_entries = entries * SYNCS_URING_CQ_FACTOR;
+		u->fd = syncs_uring_setup(entries, &p);
+	}
+	if (u->fd < 0) {
+		syncsd_debug("couldn't create io_uring: %s", strerror(errno));
+		return -1;
+	}
+	u->features = p.features;
+	// completions mustn't be lost and waiting needs a timeout
+	if (!(u->features & IORING_FEAT_NODROP) || !(u->features & IORING_FEAT_EXT_ARG)) {
+		syncsd_debug("io_uring lacks features 0x%x", u->features);
+		goto error_features;
+	}
+	if (syncs_uring_probe(u, ops, ops_count))
+		goto error_features;
+	if (syncs_uring_map(u, &p))
+		goto error_features;
+	return 0;
+
+error_features:
+	close(u->fd);
+	u->fd = -1;
+	return -1;
+}
+
+int syncs_uring_buffers_init(struct syncs_uring *u, uint32_t count, uint32_t size, uint16_t group)
+{
+	struct io_uring_buf_reg reg;
+	uint32_t i;
+
+	u->buf_ring_size = count * sizeof(struct io_uring_buf);
+	u->buf_ring = mmap(NULL, u->buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (u->buf_ring == MAP_FAILED)
+		goto error_ring;
+	u->buffers = malloc((size_t) count * size);
+	if (u->buffers == NULL)
+		goto error_buffers;
+
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uint64_t) (uintptr_t) u->buf_ring;
+	reg.ring_entries = count;
+	reg.bgid = group;
+	if (syncs_uring_register(u->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+		syncsd_debug("couldn't register buffer ring: %s", strerror(errno));
+		goto error_register;
+	}
+	u->buffer_count = count;
+	u->buffer_size = size;
+	u->buffer_group = group;
+	u->buffer_tail = 0;
+	for (i = 0; i < count; i++)
+		syncs_uring_buffer_put(u, i);
+	return 0;
+
+error_register:
+	free(u->buffers);
+	u->buffers = NULL;
+error_buffers:
+	munmap(u->buf_ring, u->buf_ring_size);
+error_ring:
+	u->buf_ring = NULL;
+	return -1;
+}
+
+void syncs_uring_release(struct syncs_uring *u)
+{
+	if (u->fd < 0)
+		return;
+	if (u->buf_ring != NULL) {
+		munmap(u->buf_ring, u->buf_ring_size);
+		free(u->buffers);
+	}
+	munmap(u->sqes, u->sqes_size);
+	if (u->cq_ring != u->sq_ring)
+		munmap(u->cq_ring, u->cq_ring_size);
+	munmap(u->sq_ring, u->sq_ring_size);
+	close(u->fd);
+	u->fd = -1;
+}
+
+struct io_uring_sqe *syncs_uring_get_sqe(struct syncs_uring *u)
+{
+	struct io_uring_sqe *sqe;
+	uint32_t tail = *u->sq_tail;
+
+	if (tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >= u->sq_entries) {
+		if (syncs_uring_enter(u, 0, 0) <= 0)
+			return NULL;
+		tail = *u->sq_tail;
+		if (tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >= u->sq_entries)
+			return NULL;
+	}
+	sqe = &u->sqes[tail & u->sq_mask];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	u->sq_array[tail & u->sq_mask] = tail & u->sq_mask;
+	__atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	u->sq_pending++;
+	return sqe;
+}
+
+int syncs_uring_enter(struct syncs_uring *u, uint32_t wait, int timeout_ms)
+{
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	uint32_t flags = 0;
+	void *argp = NULL;
+	size_t argsz = 0;
+	int ret;
+
+	if (wait) {
+		flags = IORING_ENTER_GETEVENTS;
+		if (timeout_ms >= 0) {
+			ts.tv_sec = timeout_ms / 1000;
+			ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+			memset(&arg, 0, sizeof(arg));
+			arg.ts = (uint64_t) (uintptr_t) &ts;
+			flags |= IORING_ENTER_EXT_ARG;
+			argp = &arg;
+			argsz = sizeof(arg);
+		}
+	}
+	ret = syscall(__NR_io_uring_enter, u->fd, u->sq_pending, wait, flags, argp, argsz);
+	u->enters++;
+	if (ret < 0) {
+		// timeout and signal only end waiting, entries are taken anyway
+		if ((errno == ETIME) || (errno == EINTR))
+			return 0;
+		return -errno;
+	}
+	u->sq_pending -= ret;
+	return ret;
+}
+
+void syncs_uring_discard(struct syncs_uring *u)
+{
+	__atomic_store_n(u->sq_tail, *u->sq_tail - u->sq_pending, __ATOMIC_RELEASE);
+	u->sq_pending = 0;
+}
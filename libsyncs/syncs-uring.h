@@ -0,0 +1,149 @@
+/**************************************************************
+ * Description: SyncScribe library to manage network and local events,
+ * variables and channels
+ * Copyright (c) 2022 Alexander Krapivniy (a.krapivniy@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************/
+
+#ifndef __SYNCS_URING__
+#define __SYNCS_URING__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+/*
+ * Minimal io_uring ring driven by raw syscalls, the library doesn't
+ * depend on liburing. Ring is used by one thread only, so the shared
+ * indexes need only acquire and release ordering against the kernel.
+ * Provided buffers are a single group which recv takes from.
+ */
+struct syncs_uring {
+	int fd;
+	uint32_t features;
+	// submission queue
+	uint32_t *sq_head;
+	uint32_t *sq_tail;
+	uint32_t *sq_array;
+	uint32_t sq_mask;
+	uint32_t sq_entries;
+	uint32_t sq_pending;
+	struct io_uring_sqe *sqes;
+	// completion queue
+	uint32_t *cq_head;
+	uint32_t *cq_tail;
+	uint32_t cq_mask;
+	struct io_uring_cqe *cqes;
+	// mappings which are released with the ring
+	void *sq_ring;
+	size_t sq_ring_size;
+	void *cq_ring;
+	size_t cq_ring_size;
+	size_t sqes_size;
+	// provided buffers
+	struct io_uring_buf_ring *buf_ring;
+	size_t buf_ring_size;
+	uint8_t *buffers;
+	uint32_t buffer_count;
+	uint32_t buffer_size;
+	uint16_t buffer_group;
+	uint16_t buffer_tail;
+	uint64_t enters;
+};
+
+static __attribute__((always_inline)) inline struct io_uring_cqe *syncs_uring_peek(struct syncs_uring *u)
+{
+	uint32_t head = *u->cq_head;
+
+	if (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE))
+		return NULL;
+	return &u->cqes[head & u->cq_mask];
+}
+
+static __attribute__((always_inline)) inline void syncs_uring_seen(struct syncs_uring *u)
+{
+	__atomic_store_n(u->cq_head, *u->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+static __attribute__((always_inline)) inline uint8_t *syncs_uring_buffer(struct syncs_uring *u, uint32_t bid)
+{
+	return u->buffers + (size_t) bid * u->buffer_size;
+}
+
+/* buffer is given back to the kernel as soon as its data is consumed */
+static __attribute__((always_inline)) inline void syncs_uring_buffer_put(struct syncs_uring *u, uint32_t bid)
+{
+	struct io_uring_buf *buf = &u->buf_ring->bufs[u->buffer_tail & (u->buffer_count - 1)];
+
+	buf->addr = (uint64_t) (uintptr_t) syncs_uring_buffer(u, bid);
+	buf->len = u->buffer_size;
+	buf->bid = bid;
+	u->buffer_tail++;
+	__atomic_store_n(&u->buf_ring->tail, u->buffer_tail, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Creates the ring, COOP_TASKRUN and SINGLE_ISSUER are used when
+ * the kernel knows them, so it has to be called by the thread which uses it.
+ *
+ * @param ops Opcodes which the caller relies on, the ring isn't created
+ * when one of them is missing.
+ *
+ * @return 0 on success, -1 on failure or missing support.
+ */
+int syncs_uring_init(struct syncs_uring *u, uint32_t entries, const uint8_t *ops, uint32_t ops_count);
+
+/**
+ * @brief Registers a group of provided buffers, count is a power of two.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int syncs_uring_buffers_init(struct syncs_uring *u, uint32_t count, uint32_t size, uint16_t group);
+
+/**
+ * @brief Unmaps the ring and its buffers.
+ */
+void syncs_uring_release(struct syncs_uring *u);
+
+/**
+ * @brief Takes a free submission entry, the queue is submitted when it is full.
+ *
+ * @return zeroed entry or NULL when the kernel doesn't take the queue.
+ */
+struct io_uring_sqe *syncs_uring_get_sqe(struct syncs_uring *u);
+
+/**
+ * @brief Submits the pending entries and waits for completions.
+ *
+ * @param wait Number of completions to wait for, 0 only submits.
+ * @param timeout_ms Limit of waiting, -1 waits without limit.
+ *
+ * @return number of submitted entries or negative errno.
+ */
+int syncs_uring_enter(struct syncs_uring *u, uint32_t wait, int timeout_ms);
+
+/**
+ * @brief Drops the entries which the kernel didn't take, memory they point to may be reused.
+ */
+void syncs_uring_discard(struct syncs_uring *u);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__SYNCS_URING__
@@ -76,6 +76,8 @@ class LibsyncsClientInfo(ctypes.Structure):
         ("rx_event_count", c_uint32),
         ("tx_event_count", c_uint32),
         ("ip", c_uint32),
+        ("event_conflate", c_uint32),
+        ("conflated", c_uint32),
     ]
 
 libsyncs.syncs_connect.restype = c_void_p
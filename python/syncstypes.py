@@ -21,6 +21,9 @@ SYNCS_TYPE_ECHO = (0x0020)
 SYNCS_TYPE_CRYPT = (0x0040)
 SYNCS_TYPE_FORCE = (0x0080)
 SYNCS_TYPE_FLAGS_MASK = (0x00f0)
+SYNCS_TYPE_CONFLATE = (0x1000)
+SYNCS_TYPE_ONCHANGE = (0x2000)
+SYNCS_TYPE_OPTIONS_MASK = (0xf000)
 SYNCS_TYPE_VAR_NOT_DEFINED = (0x0000)
 SYNCS_TYPE_VAR_EMPTY = (0x0100)
 SYNCS_TYPE_VAR_INT32 = (0x0200)
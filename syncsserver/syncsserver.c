@@ -84,6 +84,9 @@ struct syncs_server *syncs_json_server_init(char *filename)
 		struct json_object *type = NULL;
 		struct json_object *value = NULL;
 		struct json_object *size = NULL;
+		struct json_object *publish = NULL;
+		struct json_object *deadband = NULL;
+		struct json_object *deadband_percent = NULL;
 		int size_int = 0;
 		int flags = 0;
 
@@ -118,30 +121,45 @@ struct syncs_server *syncs_json_server_init(char *filename)
 		else
 			flags = SYNCS_TYPE_VAR_NOT_DEFINED;
 
-		switch (flags) {
+		// "publish": "change" sends only changed values, deadband implies it
+		json_object_object_get_ex(variable, "deadband", &deadband);
+		json_object_object_get_ex(variable, "deadband_percent", &deadband_percent);
+		if ((json_object_object_get_ex(variable, "publish", &publish) && !strcmp(json_object_get_string(publish), "change")) ||
+			(deadband != NULL) || (deadband_percent != NULL))
+			flags |= SYNCS_TYPE_ONCHANGE;
+
+		switch (flags & SYNCS_TYPE_VAR_MASK) {
 		case SYNCS_TYPE_VAR_INT32:
 		case SYNCS_TYPE_VAR_INT64:
 			if (value != NULL) {
 				int value_int = json_object_get_int(value);
 				syncsd_info("register %d variable %s type int size %d value %d ", i, name_string, 4, value_int);
 				syncs_server_define(server, name_string, flags, &value_int, 8);
-				continue;
+				break;
 			}
-			break;
+			continue;
 		case SYNCS_TYPE_VAR_STRING:
 			if (value != NULL) {
 				const char *value_string = json_object_get_string(value);
 				int size_string = strlen(value_string);
 				syncsd_info("register %d variable %s type string size %d value %s", i, name_string, size_string, value_string);
 				syncs_server_define(server, name_string, flags, (void *)value_string, size_string);
-				continue;
+				break;
 			}
-			break;
+			continue;
 		default:
 			syncsd_info("register %d variable %s size %d value undefine", i, name_string, size_int);
 			syncs_server_define(server, name_string, flags, NULL, size_int);
 			break;
 		}
+		if ((deadband != NULL) || (deadband_percent != NULL)) {
+			double absolute = (deadband != NULL) ? json_object_get_double(deadband) : 0;
+			double percent = (deadband_percent != NULL) ? json_object_get_double(deadband_percent) : 0;
+
+			syncsd_info("variable %s deadband %g percent %g", name_string, absolute, percent);
+			if (syncs_server_set_deadband(server, name_string, absolute, percent))
+				syncsd_error("couldn't set deadband of %s", name_string);
+		}
 	}
 
 	json_object_put(parsed_json);
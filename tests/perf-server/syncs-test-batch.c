@@ -0,0 +1,150 @@
+/**************************************************************
+ * Description: Utility and test tools to support SyncScribe library
+ * Copyright (c) 2022 Alexander Krapivniy (a.krapivniy@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <syncs-server.h>
+#include <syncs-client.h>
+
+#define MODULE_NAME "syncs-test-batch"
+#include <syncs-debug.h>
+#include <test_tools.h>
+
+#define BATCH_PORT		4487
+#define BATCH_VARIABLES		32
+#define BATCH_CYCLES		2000
+#define BATCH_SUBSCRIBERS	2
+
+static volatile uint32_t write_count;
+static volatile uint32_t event_count;
+
+static void batch_write_cb(void *args, char *id, void *data, uint32_t size)
+{
+	__atomic_fetch_add(&write_count, 1, __ATOMIC_RELAXED);
+}
+
+static void batch_event_cb(void *args, char *id, void *data, uint32_t size)
+{
+	__atomic_fetch_add(&event_count, 1, __ATOMIC_RELAXED);
+}
+
+static struct syncs_connect *batch_connect(int port, const char *name)
+{
+	struct syncs_connect *connect;
+
+	connect = syncs_connect_simple("127.0.0.1", port, name);
+	if ((connect == NULL) || syncs_connect_wait(connect, 3))
+		die("connect");
+	return connect;
+}
+
+/* a cycle of control loop updates every variable once */
+static void batch_cycle(struct syncs_connect *writer, int batched, int cycle)
+{
+	struct syncs_write_batch *b = NULL;
+	char id[32];
+	float value;
+	int i;
+
+	if (batched && ((b = syncs_write_batch_begin(writer)) == NULL))
+		die("batch");
+	for (i = 0; i < BATCH_VARIABLES; i++) {
+		snprintf(id, sizeof(id), "bench/value%d", i);
+		value = cycle + i;
+		if (batched)
+			syncs_write_batch_add(b, SYNCS_TYPE_VAR_FLOAT, id, &value, 0);
+		else
+			syncs_write_float(writer, 0, id, value);
+	}
+	if (batched && syncs_write_batch_commit(b))
+		die("commit");
+}
+
+static void batch_run(int batched, int port)
+{
+	struct syncs_connect *subscribers[BATCH_SUBSCRIBERS];
+	struct syncs_connect *writer;
+	struct syncs_server_stats before, after;
+	struct timespec start, end, sent;
+	struct syncs_server *s;
+	char id[32];
+	uint64_t us, send_us;
+	uint32_t total = BATCH_VARIABLES * BATCH_CYCLES;
+	int i, j, ms;
+
+	s = syncs_server_create("127.0.0.1", port, "bench");
+	if (s == NULL)
+		die("server create");
+	for (i = 0; i < BATCH_VARIABLES; i++) {
+		snprintf(id, sizeof(id), "bench/value%d", i);
+		syncs_server_define(s, id, SYNCS_TYPE_VAR_FLOAT, NULL, 0);
+		syncs_server_subscribe_event(s, SYNCS_TYPE_VAR_FLOAT, id, batch_write_cb, NULL);
+	}
+	sleep(1);
+
+	for (i = 0; i < BATCH_SUBSCRIBERS; i++) {
+		snprintf(id, sizeof(id), "subscriber%d", i);
+		subscribers[i] = batch_connect(port, id);
+		for (j = 0; j < BATCH_VARIABLES; j++) {
+			snprintf(id, sizeof(id), "bench/value%d", j);
+			syncs_subscribe_event(subscribers[i], SYNCS_TYPE_VAR_FLOAT, id, batch_event_cb, NULL);
+		}
+	}
+	writer = batch_connect(port, "writer");
+	// handles of the variables make the records short
+	for (i = 0; i < BATCH_VARIABLES; i++) {
+		snprintf(id, sizeof(id), "bench/value%d", i);
+		syncs_define(writer, id, SYNCS_TYPE_VAR_FLOAT | SYNCS_TYPE_FORCE);
+	}
+	usleep(300000);
+
+	write_count = 0;
+	event_count = 0;
+	syncs_server_get_stats(s, &before);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < BATCH_CYCLES; i++) {
+		batch_cycle(writer, batched, i);
+		if ((i % 16) == 15)
+			usleep(100);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &sent);
+	for (ms = 0; ((write_count < total) || (event_count < total * BATCH_SUBSCRIBERS)) && (ms < 30000); ms++)
+		usleep(1000);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (write_count < total)
+		die("writes lost");
+	syncs_server_get_stats(s, &after);
+	us = tt_clockusdiff(start, end) + 1;
+	send_us = tt_clockusdiff(start, sent) + 1;
+
+	printf("%-10s %7.0f ns/variable to send, %9.0f writes/sec, %6lu reads, %6lu sends of %6u events\n",
+		batched ? "batch" : "individual", (double) send_us * 1000 / total, (double) total * 1000000 / us,
+		after.rx_syscalls - before.rx_syscalls, after.tx_syscalls - before.tx_syscalls, event_count);
+	// clients stay until exit, like the server of the run
+}
+
+int main()
+{
+	printf("#----- %d variables per cycle, %d cycles, %d subscribers -----\n", BATCH_VARIABLES, BATCH_CYCLES, BATCH_SUBSCRIBERS);
+	batch_run(0, BATCH_PORT);
+	batch_run(1, BATCH_PORT + 1);
+	return 0;
+}
@@ -0,0 +1,237 @@
+/**************************************************************
+ * Description: Utility and test tools to support SyncScribe library
+ * Copyright (c) 2022 Alexander Krapivniy (a.krapivniy@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <syncs-server.h>
+
+#define MODULE_NAME "syncs-test-bundle"
+#include <syncs-debug.h>
+#include <test_tools.h>
+
+#define BUNDLE_PORT		4472
+#define BUNDLE_WRITERS		4
+#define BUNDLE_SUBSCRIBERS	4
+#define BUNDLE_WRITES		50000
+#define BUNDLE_BURST		32
+
+static const uint32_t bundle_budgets[] = { SYNCS_BUNDLE_NONE, 0, 200 };
+
+struct bundle_client {
+	pthread_t thread;
+	int fd;
+	uint32_t handle;
+	volatile int stop;
+};
+
+static volatile uint32_t write_count;
+
+static void bundle_write_cb(void *args, char *id, void *data, uint32_t size)
+{
+	__atomic_fetch_add(&write_count, 1, __ATOMIC_RELAXED);
+}
+
+static void bundle_header(struct syncs_header *h, const char *id, uint32_t type)
+{
+	memset(h, 0, sizeof(struct syncs_header));
+	h->magic = SYNCS_PACKET_MAGIC;
+	h->magic_data = SYNCS_PACKET_MAGIC_DATA;
+	h->type = type;
+	snprintf(h->id.c, sizeof(syncsid_t), "%s", id);
+}
+
+static void bundle_recv(int fd, void *buffer, int size)
+{
+	int ret;
+
+	while (size > 0) {
+		ret = recv(fd, buffer, size, 0);
+		if (ret <= 0)
+			die("recv");
+		buffer = (uint8_t *) buffer + ret;
+		size -= ret;
+	}
+}
+
+static int bundle_connect(int port, const char *name)
+{
+	struct sockaddr_in addr;
+	struct syncs_header h;
+	int fd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if ((fd < 0) || connect(fd, (struct sockaddr *) &addr, sizeof(addr)))
+		die("connect");
+	bundle_header(&h, name, SYNCS_TYPE_CLIENT_ID);
+	h.sync.data0 = SYNCS_VERSION_MAJOR;
+	h.sync.data1 = SYNCS_VERSION_MINOR;
+	h.update_counter = ((uint64_t) SYNCS_PROTOCOL_SIGNATURE << 32) | SYNCS_PROTOCOL_HANDLE;
+	if (send(fd, &h, sizeof(h), 0) != sizeof(h))
+		die("send");
+	bundle_recv(fd, &h, sizeof(h));
+	return fd;
+}
+
+static uint32_t bundle_request(int fd, const char *id, uint32_t type)
+{
+	struct syncs_packet packet;
+
+	bundle_header(&packet.header, id, type | SYNCS_TYPE_VAR_INT32);
+	packet.header.update_counter = UINT64_MAX;
+	if (send(fd, &packet, sizeof(struct syncs_header), 0) != sizeof(struct syncs_header))
+		die("send");
+	bundle_recv(fd, &packet, sizeof(struct syncs_header) + sizeof(uint32_t));
+	if ((packet.header.type & SYNCS_TYPE_MSG_MASK) != SYNCS_TYPE_ACK)
+		die("ack");
+	return *(uint32_t *) packet.buffer;
+}
+
+/* writer sends bursts of values, the server sees a burst in one read */
+static void *bundle_writer_thread(void *args)
+{
+	struct bundle_client *w = args;
+	uint8_t buffer[BUNDLE_BURST * (sizeof(struct syncs_handle_header) + sizeof(int32_t))];
+	struct syncs_handle_header *header;
+	int size = sizeof(struct syncs_handle_header) + sizeof(int32_t);
+	int i;
+
+	for (i = 0; i < BUNDLE_BURST; i++) {
+		header = (struct syncs_handle_header *) (buffer + i * size);
+		header->magic = SYNCS_PACKET_MAGIC_HANDLE;
+		header->magic_data = SYNCS_PACKET_MAGIC_DATA;
+		header->data_size = sizeof(int32_t);
+		header->type = SYNCS_TYPE_WRITE | SYNCS_TYPE_VAR_INT32;
+		header->handle = w->handle;
+		header->update_counter = 0;
+		*(int32_t *) (header + 1) = i;
+	}
+	for (i = 0; i < BUNDLE_WRITES; i += BUNDLE_BURST) {
+		if (send(w->fd, buffer, sizeof(buffer), 0) != sizeof(buffer))
+			die("send");
+		usleep(100);
+	}
+	return NULL;
+}
+
+static void *bundle_subscriber_thread(void *args)
+{
+	struct bundle_client *sub = args;
+	uint8_t buffer[64 * 1024];
+
+	while (!sub->stop)
+		if (recv(sub->fd, buffer, sizeof(buffer), 0) <= 0)
+			break;
+	return NULL;
+}
+
+static void bundle_run(uint32_t budget, int port)
+{
+	struct syncs_server_options options = { .reactors = 1, .bundle_us = budget };
+	struct bundle_client writers[BUNDLE_WRITERS];
+	struct bundle_client subscribers[BUNDLE_SUBSCRIBERS];
+	struct syncs_server_stats before, after;
+	struct timespec start, end;
+	struct syncs_server *s;
+	char id[32];
+	uint64_t us, frames, syscalls;
+	uint32_t total = BUNDLE_WRITERS * BUNDLE_WRITES;
+	int i, j, ms;
+
+	s = syncs_server_create_ex("127.0.0.1", port, "bench", &options);
+	if (s == NULL)
+		die("server create");
+	for (i = 0; i < BUNDLE_WRITERS; i++) {
+		snprintf(id, sizeof(id), "bench/value%d", i);
+		syncs_server_define(s, id, SYNCS_TYPE_VAR_INT32, NULL, 0);
+		syncs_server_subscribe_event(s, SYNCS_TYPE_VAR_INT32, id, bundle_write_cb, NULL);
+	}
+	sleep(1);
+
+	for (i = 0; i < BUNDLE_SUBSCRIBERS; i++) {
+		snprintf(id, sizeof(id), "subscriber%d", i);
+		subscribers[i].fd = bundle_connect(port, id);
+		for (j = 0; j < BUNDLE_WRITERS; j++) {
+			snprintf(id, sizeof(id), "bench/value%d", j);
+			bundle_request(subscribers[i].fd, id, SYNCS_TYPE_SUBSCRIBE);
+		}
+		subscribers[i].stop = 0;
+		pthread_create(&subscribers[i].thread, NULL, bundle_subscriber_thread, &subscribers[i]);
+	}
+	for (i = 0; i < BUNDLE_WRITERS; i++) {
+		snprintf(id, sizeof(id), "writer%d", i);
+		writers[i].fd = bundle_connect(port, id);
+		snprintf(id, sizeof(id), "bench/value%d", i);
+		writers[i].handle = bundle_request(writers[i].fd, id, SYNCS_TYPE_DEFINE | SYNCS_TYPE_FORCE);
+	}
+	usleep(100000);
+
+	write_count = 0;
+	syncs_server_get_stats(s, &before);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < BUNDLE_WRITERS; i++)
+		pthread_create(&writers[i].thread, NULL, bundle_writer_thread, &writers[i]);
+	for (ms = 0; (write_count < total) && (ms < 60000); ms++)
+		usleep(1000);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (write_count < total)
+		die("writes lost");
+	us = tt_clockusdiff(start, end) + 1;
+	usleep(300000);
+	syncs_server_get_stats(s, &after);
+	frames = after.tx_frames - before.tx_frames;
+	syscalls = after.tx_syscalls - before.tx_syscalls;
+
+	for (i = 0; i < BUNDLE_WRITERS; i++) {
+		pthread_join(writers[i].thread, NULL);
+		close(writers[i].fd);
+	}
+	for (i = 0; i < BUNDLE_SUBSCRIBERS; i++) {
+		subscribers[i].stop = 1;
+		shutdown(subscribers[i].fd, SHUT_RDWR);
+		pthread_join(subscribers[i].thread, NULL);
+		close(subscribers[i].fd);
+	}
+	if (budget == SYNCS_BUNDLE_NONE)
+		printf("no bundling ");
+	else
+		printf("budget %4u us", budget);
+	printf(" %9.0f writes/sec, %8lu frames in %8lu sends, %6.3f sends/frame\n",
+		(double) total * 1000000 / us, frames, syscalls, frames ? (double) syscalls / frames : 0);
+}
+
+int main()
+{
+	uint32_t i;
+
+	printf("#----- %d writers in bursts of %d, %d subscribers -----\n", BUNDLE_WRITERS, BUNDLE_BURST, BUNDLE_SUBSCRIBERS);
+	for (i = 0; i < sizeof(bundle_budgets) / sizeof(bundle_budgets[0]); i++)
+		bundle_run(bundle_budgets[i], BUNDLE_PORT + i);
+	return 0;
+}
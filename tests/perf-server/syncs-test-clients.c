@@ -0,0 +1,217 @@
+/**************************************************************
+ * Description: Utility and test tools to support SyncScribe library
+ * Copyright (c) 2022 Alexander Krapivniy (a.krapivniy@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <syncs-server.h>
+#include <syncs-server-types.h>
+
+#define MODULE_NAME "syncs-test-clients"
+#include <syncs-debug.h>
+#include <test_tools.h>
+
+#define CLIENTS_PORT		4455
+#define CLIENTS_WRITES		20
+#define CLIENTS_TIMEOUT_MS	60000
+
+static volatile uint32_t write_count;
+
+static void clients_write_cb(void *args, char *id, void *data, uint32_t size)
+{
+	write_count++;
+}
+
+static long clients_rss_kb(void)
+{
+	char line[128];
+	long rss = 0;
+	FILE *f = fopen("/proc/self/status", "r");
+
+	if (f == NULL)
+		return 0;
+	while (fgets(line, sizeof(line), f) != NULL)
+		if (sscanf(line, "VmRSS: %ld", &rss) == 1)
+			break;
+	fclose(f);
+	return rss;
+}
+
+static void clients_header(struct syncs_header *h, const char *id, uint32_t type, uint16_t data_size)
+{
+	memset(h, 0, sizeof(struct syncs_header));
+	h->magic = SYNCS_PACKET_MAGIC;
+	h->magic_data = SYNCS_PACKET_MAGIC_DATA;
+	h->type = type;
+	h->data_size = data_size;
+	snprintf(h->id.c, sizeof(syncsid_t), "%s", id);
+}
+
+/* forked side: it owns all client sockets, so server fds are not limited by them */
+static void clients_connect(int count, int control)
+{
+	struct sockaddr_in addr;
+	struct syncs_packet packet;
+	char name[32];
+	int32_t value;
+	int *fds;
+	char cmd;
+	int i, j;
+
+	fds = calloc(count, sizeof(int));
+	if (fds == NULL)
+		die("alloc");
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(CLIENTS_PORT);
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+	for (i = 0; i < count; i++) {
+		fds[i] = socket(AF_INET, SOCK_STREAM, 0);
+		if (fds[i] < 0)
+			die("socket");
+		if (connect(fds[i], (struct sockaddr *) &addr, sizeof(addr)))
+			die("connect");
+		snprintf(name, sizeof(name), "bench/%d", i);
+		clients_header(&packet.header, name, SYNCS_TYPE_CLIENT_ID, 0);
+		packet.header.sync.data0 = SYNCS_VERSION_MAJOR;
+		if (send(fds[i], &packet, sizeof(struct syncs_header), 0) != sizeof(struct syncs_header))
+			die("send");
+	}
+	if (write(control, "c", 1) != 1)
+		die("control");
+
+	// wait for active phase
+	if (read(control, &cmd, 1) != 1)
+		die("control");
+
+	clients_header(&packet.header, "bench/value", SYNCS_TYPE_WRITE | SYNCS_TYPE_VAR_INT32, sizeof(int32_t));
+	for (j = 0; j < CLIENTS_WRITES; j++)
+		for (i = 0; i < count; i++) {
+			value = j;
+			memcpy(packet.buffer, &value, sizeof(int32_t));
+			if (send(fds[i], &packet, sizeof(struct syncs_header) + sizeof(int32_t), 0) < 0)
+				die("send");
+		}
+
+	if (read(control, &cmd, 1) != 1)
+		die("control");
+	for (i = 0; i < count; i++)
+		close(fds[i]);
+	free(fds);
+	exit(0);
+}
+
+static int clients_wait(struct syncs_server *s, uint32_t clients, uint32_t writes)
+{
+	int ms;
+
+	for (ms = 0; ms < CLIENTS_TIMEOUT_MS; ms++) {
+		if ((s->client_count == clients) && (write_count >= writes))
+			return 0;
+		usleep(1000);
+	}
+	return -1;
+}
+
+static void clients_run(struct syncs_server *s, int count)
+{
+	struct timespec start, end;
+	uint64_t connect_us, write_us;
+	long rss;
+	int control[2];
+	pid_t pid;
+	char cmd = 'g';
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, control))
+		die("socketpair");
+
+	rss = clients_rss_kb();
+	write_count = 0;
+	fflush(stdout);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pid = fork();
+	if (pid < 0)
+		die("fork");
+	if (pid == 0) {
+		close(control[0]);
+		clients_connect(count, control[1]);
+	}
+	close(control[1]);
+
+	if ((read(control[0], &cmd, 1) != 1) || clients_wait(s, count, 0)) {
+		printf("%6d clients: connect failed, %u connected\n", count, s->client_count);
+		kill(pid, SIGKILL);
+		goto out;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	connect_us = tt_clockusdiff(start, end) + 1;
+	rss = clients_rss_kb() - rss;
+
+	printf("%6d idle clients: connect %8.0f clients/sec, server memory %6ld kB (%ld bytes/client), capacity %u\n",
+		count, (double) count * 1000000 / connect_us, rss, rss * 1024 / count, s->client_capacity);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if ((write(control[0], &cmd, 1) != 1) || clients_wait(s, count, count * CLIENTS_WRITES)) {
+		printf("%6d clients: writes lost, %u received\n", count, write_count);
+		kill(pid, SIGKILL);
+		goto out;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	write_us = tt_clockusdiff(start, end) + 1;
+	printf("%6d active clients: %8.0f writes/sec\n", count, (double) count * CLIENTS_WRITES * 1000000 / write_us);
+
+	if (write(control[0], &cmd, 1) != 1)
+		die("control");
+out:
+	waitpid(pid, NULL, 0);
+	close(control[0]);
+	clients_wait(s, 0, 0);
+}
+
+int main()
+{
+	struct syncs_server *s;
+	struct rlimit limit;
+
+	getrlimit(RLIMIT_NOFILE, &limit);
+	limit.rlim_cur = limit.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &limit);
+
+	s = syncs_server_create("127.0.0.1", CLIENTS_PORT, "bench");
+	if (s == NULL)
+		die("server create");
+	syncs_server_define(s, "bench/value", SYNCS_TYPE_VAR_INT32, NULL, 0);
+	syncs_server_subscribe_event(s, SYNCS_TYPE_VAR_INT32, "bench/value", clients_write_cb, NULL);
+	sleep(1);
+
+	printf("#----- Server with many connected clients -----\n");
+	clients_run(s, 1000);
+	clients_run(s, 10000);
+	return 0;
+}
@@ -0,0 +1,174 @@
+/**************************************************************
+ * Description: Utility and test tools to support SyncScribe library
+ * Copyright (c) 2022 Alexander Krapivniy (a.krapivniy@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <syncs-server.h>
+
+#define MODULE_NAME "syncs-test-conflate"
+#include <syncs-debug.h>
+#include <test_tools.h>
+
+#define CONFLATE_PORT		4481
+#define CONFLATE_VARIABLES	16
+#define CONFLATE_WRITES		20000
+
+static void conflate_header(struct syncs_header *h, const char *id, uint32_t type)
+{
+	memset(h, 0, sizeof(struct syncs_header));
+	h->magic = SYNCS_PACKET_MAGIC;
+	h->magic_data = SYNCS_PACKET_MAGIC_DATA;
+	h->type = type;
+	snprintf(h->id.c, sizeof(syncsid_t), "%s", id);
+}
+
+static void conflate_recv(int fd, void *buffer, int size)
+{
+	int ret;
+
+	while (size > 0) {
+		ret = recv(fd, buffer, size, 0);
+		if (ret <= 0)
+			die("recv");
+		buffer = (uint8_t *) buffer + ret;
+		size -= ret;
+	}
+}
+
+/* subscriber has a small receive buffer, so the server queues what it doesn't take */
+static int conflate_connect(int port, const char *name)
+{
+	struct sockaddr_in addr;
+	struct syncs_header h;
+	int size = 4096;
+	int fd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		die("socket");
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)))
+		die("connect");
+	conflate_header(&h, name, SYNCS_TYPE_CLIENT_ID);
+	h.sync.data0 = SYNCS_VERSION_MAJOR;
+	h.sync.data1 = SYNCS_VERSION_MINOR;
+	h.update_counter = ((uint64_t) SYNCS_PROTOCOL_SIGNATURE << 32) | SYNCS_PROTOCOL_HANDLE;
+	if (send(fd, &h, sizeof(h), 0) != sizeof(h))
+		die("send");
+	conflate_recv(fd, &h, sizeof(h));
+	return fd;
+}
+
+static uint32_t conflate_subscribe(int fd, const char *id, uint32_t options)
+{
+	struct syncs_packet packet;
+
+	conflate_header(&packet.header, id, SYNCS_TYPE_SUBSCRIBE | SYNCS_TYPE_VAR_INT32 | options);
+	packet.header.update_counter = UINT64_MAX;
+	if (send(fd, &packet, sizeof(struct syncs_header), 0) != sizeof(struct syncs_header))
+		die("send");
+	conflate_recv(fd, &packet, sizeof(struct syncs_header) + sizeof(uint32_t));
+	if ((packet.header.type & SYNCS_TYPE_MSG_MASK) != SYNCS_TYPE_ACK)
+		die("ack");
+	return *(uint32_t *) packet.buffer;
+}
+
+static void conflate_run(uint32_t options, int port)
+{
+	struct syncs_server_options server_options = { .reactors = 1 };
+	uint32_t handles[CONFLATE_VARIABLES];
+	int32_t last[CONFLATE_VARIABLES];
+	struct syncs_handle_header *header;
+	struct syncs_server *s;
+	struct pollfd pfd;
+	uint8_t buffer[64 * 1024];
+	uint32_t head = 0, tail = 0, frames = 0, fresh = 0;
+	char id[32];
+	int fd, i, j, ret;
+
+	s = syncs_server_create_ex("127.0.0.1", port, "bench", &server_options);
+	if (s == NULL)
+		die("server create");
+	for (i = 0; i < CONFLATE_VARIABLES; i++) {
+		snprintf(id, sizeof(id), "bench/value%d", i);
+		syncs_server_define(s, id, SYNCS_TYPE_VAR_INT32, NULL, 0);
+	}
+	sleep(1);
+	fd = conflate_connect(port, "subscriber");
+	for (i = 0; i < CONFLATE_VARIABLES; i++) {
+		snprintf(id, sizeof(id), "bench/value%d", i);
+		handles[i] = conflate_subscribe(fd, id, options);
+		last[i] = -1;
+	}
+
+	// subscriber doesn't read while the values are written
+	for (j = 0; j < CONFLATE_WRITES; j++)
+		for (i = 0; i < CONFLATE_VARIABLES; i++) {
+			snprintf(id, sizeof(id), "bench/value%d", i);
+			syncs_server_write_int32(s, 0, id, j);
+		}
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	while (poll(&pfd, 1, 300) > 0) {
+		ret = recv(fd, buffer + tail, sizeof(buffer) - tail, 0);
+		if (ret <= 0)
+			die("recv");
+		tail += ret;
+		while (tail - head >= sizeof(struct syncs_handle_header)) {
+			header = (struct syncs_handle_header *) (buffer + head);
+			if (header->magic != SYNCS_PACKET_MAGIC_HANDLE)
+				die("frame");
+			if (tail - head < sizeof(struct syncs_handle_header) + header->data_size)
+				break;
+			for (i = 0; i < CONFLATE_VARIABLES; i++)
+				if (handles[i] == header->handle)
+					last[i] = *(int32_t *) (header + 1);
+			head += sizeof(struct syncs_handle_header) + header->data_size;
+			frames++;
+		}
+		memmove(buffer, buffer + head, tail - head);
+		tail -= head;
+		head = 0;
+	}
+	close(fd);
+	for (i = 0; i < CONFLATE_VARIABLES; i++)
+		fresh += (last[i] == CONFLATE_WRITES - 1);
+	printf("%-10s %8u values written, %8u delivered, %2u of %u variables got the latest value\n",
+		options ? "conflation" : "queue", CONFLATE_WRITES * CONFLATE_VARIABLES, frames, fresh, CONFLATE_VARIABLES);
+}
+
+int main()
+{
+	printf("#----- Stalled subscriber of %d variables -----\n", CONFLATE_VARIABLES);
+	conflate_run(0, CONFLATE_PORT);
+	conflate_run(SYNCS_TYPE_CONFLATE, CONFLATE_PORT + 1);
+	return 0;
+}
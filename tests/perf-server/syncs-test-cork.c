@@ -0,0 +1,118 @@
+/**************************************************************
+ * Description: Utility and test tools to support SyncScribe library
+ * Copyright (c) 2022 Alexander Krapivniy (a.krapivniy@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <syncs-server.h>
+#include <syncs-client.h>
+
+#define MODULE_NAME "syncs-test-cork"
+#include <syncs-debug.h>
+#include <test_tools.h>
+
+#define CORK_PORT		4489
+#define CORK_VARIABLES		16
+#define CORK_WRITES		100000
+
+struct cork_mode {
+	const char *name;
+	uint32_t options;
+	uint32_t flush_us;
+};
+
+static const struct cork_mode cork_modes[] = {
+	{ "not corked", 0, 0 },
+	{ "cork 500us", SYNCS_CORK_ON, 500 },
+	{ "squash 500us", SYNCS_CORK_ON | SYNCS_CORK_SQUASH, 500 },
+};
+
+static volatile uint32_t write_count;
+static volatile uint32_t done_count;
+
+/* the last value of every variable is negative, the run ends when the server has all of them */
+static void cork_write_cb(void *args, char *id, void *data, uint32_t size)
+{
+	__atomic_fetch_add(&write_count, 1, __ATOMIC_RELAXED);
+	if (*(int32_t *) data < 0)
+		__atomic_fetch_add(&done_count, 1, __ATOMIC_RELAXED);
+}
+
+static void cork_run(const struct cork_mode *mode, int port)
+{
+	struct syncs_connect *writer;
+	struct syncs_server_stats before, after;
+	struct timespec start, end, sent;
+	struct syncs_server *s;
+	char ids[CORK_VARIABLES][32];
+	uint64_t us, send_us;
+	int i, ms;
+
+	s = syncs_server_create("127.0.0.1", port, "bench");
+	if (s == NULL)
+		die("server create");
+	for (i = 0; i < CORK_VARIABLES; i++) {
+		snprintf(ids[i], sizeof(ids[i]), "bench/value%d", i);
+		syncs_server_define(s, ids[i], SYNCS_TYPE_VAR_INT32, NULL, 0);
+		syncs_server_subscribe_event(s, SYNCS_TYPE_VAR_INT32, ids[i], cork_write_cb, NULL);
+	}
+	sleep(1);
+
+	writer = syncs_connect_simple("127.0.0.1", port, "writer");
+	if ((writer == NULL) || syncs_connect_wait(writer, 3))
+		die("connect");
+	for (i = 0; i < CORK_VARIABLES; i++)
+		syncs_define(writer, ids[i], SYNCS_TYPE_VAR_INT32 | SYNCS_TYPE_FORCE);
+	usleep(300000);
+	if (syncs_set_cork(writer, mode->options, mode->flush_us))
+		die("cork");
+
+	write_count = 0;
+	done_count = 0;
+	syncs_server_get_stats(s, &before);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < CORK_WRITES; i++)
+		syncs_write_int32(writer, 0, ids[i % CORK_VARIABLES], (i < CORK_WRITES - CORK_VARIABLES) ? i : -1);
+	syncs_flush(writer);
+	clock_gettime(CLOCK_MONOTONIC, &sent);
+	for (ms = 0; (done_count < CORK_VARIABLES) && (ms < 30000); ms++)
+		usleep(100);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (done_count < CORK_VARIABLES)
+		die("last values lost");
+	syncs_server_get_stats(s, &after);
+	us = tt_clockusdiff(start, end) + 1;
+	send_us = tt_clockusdiff(start, sent) + 1;
+
+	printf("%-13s %5.0f ns/write to send, %9.0f writes/sec to the server, %6lu reads, %6u writes applied\n",
+		mode->name, (double) send_us * 1000 / CORK_WRITES, (double) CORK_WRITES * 1000000 / us,
+		after.rx_syscalls - before.rx_syscalls, write_count);
+	// the writer stays until exit, like the server of the run
+}
+
+int main()
+{
+	uint32_t i;
+
+	printf("#----- 1 writer, %d writes in a loop over %d variables -----\n", CORK_WRITES, CORK_VARIABLES);
+	for (i = 0; i < sizeof(cork_modes) / sizeof(cork_modes[0]); i++)
+		cork_run(&cork_modes[i], CORK_PORT + i);
+	return 0;
+}
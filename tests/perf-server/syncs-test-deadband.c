@@ -0,0 +1,134 @@
+/**************************************************************
+ * Description: Utility and test tools to support SyncScribe library
+ * Copyright (c) 2022 Alexander Krapivniy (a.krapivniy@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <syncs-server.h>
+#include <syncs-client.h>
+
+#define MODULE_NAME "syncs-test-deadband"
+#include <syncs-debug.h>
+#include <test_tools.h>
+
+#define DEADBAND_PORT		4483
+#define DEADBAND_SUBSCRIBERS	4
+#define DEADBAND_WRITES		20000
+#define DEADBAND_STEP		50
+
+struct deadband_policy {
+	const char *name;
+	uint32_t flags;
+	double absolute;
+	double percent;
+};
+
+static const struct deadband_policy deadband_policies[] = {
+	{ "every write", 0, 0, 0 },
+	{ "on change", SYNCS_TYPE_ONCHANGE, 0, 0 },
+	{ "deadband 0.1", SYNCS_TYPE_ONCHANGE, 0.1, 0 },
+	{ "deadband 1%", SYNCS_TYPE_ONCHANGE, 0, 1 },
+};
+
+static volatile uint32_t event_count;
+static volatile float event_last;
+
+static void deadband_event_cb(void *args, char *id, void *data, uint32_t size)
+{
+	event_last = *(float *) data;
+	__atomic_fetch_add(&event_count, 1, __ATOMIC_RELAXED);
+}
+
+/* producer repeats a slowly stepping value with a small jitter now and then */
+static float deadband_value(int i)
+{
+	float value = 10 + i / DEADBAND_STEP;
+
+	if ((i % 5) == 0)
+		value += 0.01 * (i % 3);
+	return value;
+}
+
+static void deadband_run(const struct deadband_policy *policy, int port)
+{
+	struct syncs_connect *subscribers[DEADBAND_SUBSCRIBERS];
+	struct syncs_connect *writer;
+	struct syncs_server_stats before, after;
+	struct timespec start, end;
+	struct syncs_server *s;
+	char name[32];
+	uint64_t us, frames;
+	float last = 0;
+	int i, ms;
+
+	s = syncs_server_create("127.0.0.1", port, "bench");
+	if (s == NULL)
+		die("server create");
+	syncs_server_define(s, "bench/value", SYNCS_TYPE_VAR_FLOAT | policy->flags, NULL, 0);
+	if ((policy->absolute || policy->percent) && syncs_server_set_deadband(s, "bench/value", policy->absolute, policy->percent))
+		die("deadband");
+	sleep(1);
+
+	for (i = 0; i < DEADBAND_SUBSCRIBERS; i++) {
+		snprintf(name, sizeof(name), "subscriber%d", i);
+		subscribers[i] = syncs_connect_simple("127.0.0.1", port, name);
+		if ((subscribers[i] == NULL) || syncs_connect_wait(subscribers[i], 3))
+			die("connect");
+		syncs_subscribe_event(subscribers[i], SYNCS_TYPE_VAR_FLOAT, "bench/value", deadband_event_cb, NULL);
+	}
+	writer = syncs_connect_simple("127.0.0.1", port, "writer");
+	if ((writer == NULL) || syncs_connect_wait(writer, 3))
+		die("connect");
+	usleep(300000);
+
+	event_count = 0;
+	syncs_server_get_stats(s, &before);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < DEADBAND_WRITES; i++) {
+		syncs_write_float(writer, 0, "bench/value", deadband_value(i));
+		if ((i % 64) == 63)
+			usleep(200);
+	}
+	// the last value leaves the band, so the subscribers must end with it
+	last = deadband_value(DEADBAND_WRITES - 1) + DEADBAND_STEP;
+	syncs_write_float(writer, 0, "bench/value", last);
+	for (ms = 0; (event_last != last) && (ms < 10000); ms++)
+		usleep(1000);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	usleep(300000);
+	syncs_server_get_stats(s, &after);
+	us = tt_clockusdiff(start, end) + 1;
+	frames = after.tx_frames - before.tx_frames;
+
+	printf("%-13s %8.0f writes/sec, %6u events, %8lu frames out, %6lu suppressed, last %s\n", policy->name,
+		(double) (DEADBAND_WRITES + 1) * 1000000 / us, event_count, frames,
+		after.suppressed - before.suppressed, (event_last == last) ? "ok" : "lost");
+	// clients stay until exit, like the server of the run
+}
+
+int main()
+{
+	uint32_t i;
+
+	printf("#----- 1 writer, %d writes of a stepping float, %d subscribers -----\n", DEADBAND_WRITES, DEADBAND_SUBSCRIBERS);
+	for (i = 0; i < sizeof(deadband_policies) / sizeof(deadband_policies[0]); i++)
+		deadband_run(&deadband_policies[i], DEADBAND_PORT + i);
+	return 0;
+}
@@ -0,0 +1,156 @@
+/**************************************************************
+ * Description: Utility and test tools to support SyncScribe library
+ * Copyright (c) 2022 Alexander Krapivniy (a.krapivniy@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <syncs-server.h>
+#include <syncs-client.h>
+
+#define MODULE_NAME "syncs-test-executor"
+#include <syncs-debug.h>
+#include <test_tools.h>
+
+#define EXECUTOR_PORT		4500
+#define EXECUTOR_VARIABLES	8
+#define EXECUTOR_SLOW		2
+#define EXECUTOR_SLOW_US	500
+#define EXECUTOR_ROUNDS		2000
+#define EXECUTOR_WORKERS	4
+
+struct executor_variable {
+	int slow;
+	int64_t last;
+	uint32_t count;
+	uint32_t bad;
+};
+
+static struct executor_variable variables[EXECUTOR_VARIABLES];
+static uint64_t fast_latency[EXECUTOR_ROUNDS * EXECUTOR_VARIABLES];
+static volatile uint32_t fast_count;
+static volatile uint32_t total_count;
+
+static uint64_t executor_now_us(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/* value is the time of write, so the callback knows how long the event waited */
+static void executor_event_cb(void *args, char *id, void *data, uint32_t size)
+{
+	struct executor_variable *v = args;
+	int64_t value = *(int64_t *) data;
+
+	if (value <= v->last)
+		v->bad++;
+	v->last = value;
+	v->count++;
+	if (v->slow)
+		usleep(EXECUTOR_SLOW_US);
+	else
+		fast_latency[__atomic_fetch_add(&fast_count, 1, __ATOMIC_RELAXED)] = executor_now_us() - value;
+	__atomic_fetch_add(&total_count, 1, __ATOMIC_RELEASE);
+}
+
+static int executor_compare(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+	return (x > y) - (x < y);
+}
+
+static void executor_run(int async, int port)
+{
+	struct syncs_connect *client;
+	struct syncs_server *s;
+	struct timespec start, end;
+	char ids[EXECUTOR_VARIABLES][32];
+	uint32_t total = EXECUTOR_ROUNDS * EXECUTOR_VARIABLES, bad = 0, fast;
+	uint64_t us, executed, stolen;
+	int i, j, ms;
+
+	s = syncs_server_create("127.0.0.1", port, "bench");
+	if (s == NULL)
+		die("server create");
+	for (i = 0; i < EXECUTOR_VARIABLES; i++) {
+		snprintf(ids[i], sizeof(ids[i]), "bench/value%d", i);
+		syncs_server_define(s, ids[i], SYNCS_TYPE_VAR_INT64, NULL, 0);
+	}
+	sleep(1);
+
+	client = syncs_connect_simple("127.0.0.1", port, "client");
+	if ((client == NULL) || syncs_connect_wait(client, 3))
+		die("connect");
+	if (async && syncs_set_executor(client, EXECUTOR_WORKERS))
+		die("executor");
+	for (i = 0; i < EXECUTOR_VARIABLES; i++) {
+		memset(&variables[i], 0, sizeof(variables[i]));
+		variables[i].slow = (i < EXECUTOR_SLOW);
+		if (async)
+			syncs_subscribe_event_async(client, SYNCS_TYPE_VAR_INT64, ids[i], executor_event_cb, &variables[i]);
+		else
+			syncs_subscribe_event(client, SYNCS_TYPE_VAR_INT64, ids[i], executor_event_cb, &variables[i]);
+	}
+	// initial values of subscriptions
+	for (ms = 0; (total_count < EXECUTOR_VARIABLES) && (ms < 3000); ms++)
+		usleep(1000);
+	usleep(300000);
+	for (i = 0; i < EXECUTOR_VARIABLES; i++) {
+		variables[i].count = 0;
+		variables[i].last = 0;
+	}
+	fast_count = 0;
+	total_count = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < EXECUTOR_ROUNDS; i++) {
+		for (j = 0; j < EXECUTOR_VARIABLES; j++)
+			syncs_server_write_int64(s, 0, ids[j], executor_now_us());
+		usleep(100);
+	}
+	for (ms = 0; (__atomic_load_n(&total_count, __ATOMIC_ACQUIRE) < total) && (ms < 60000); ms++)
+		usleep(1000);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (total_count < total)
+		die("events lost");
+	us = tt_clockusdiff(start, end) + 1;
+	for (i = 0; i < EXECUTOR_VARIABLES; i++)
+		bad += variables[i].bad;
+	fast = fast_count;
+	qsort(fast_latency, fast, sizeof(uint64_t), executor_compare);
+	syncs_get_executor_stats(client, &executed, &stolen);
+
+	printf("%-6s %8.0f events/sec, fast callbacks wait p50 %6lu us p99 %6lu us, %u out of order, %lu stolen\n",
+		async ? "async" : "inline", (double) total * 1000000 / us, fast_latency[fast / 2], fast_latency[fast * 99 / 100],
+		bad, stolen);
+	// the client stays until exit, like the server of the run
+}
+
+int main()
+{
+	printf("#----- %d variables, %d of them with %d us callbacks, %d rounds, %d workers -----\n",
+		EXECUTOR_VARIABLES, EXECUTOR_SLOW, EXECUTOR_SLOW_US, EXECUTOR_ROUNDS, EXECUTOR_WORKERS);
+	executor_run(0, EXECUTOR_PORT);
+	executor_run(1, EXECUTOR_PORT + 1);
+	return 0;
+}
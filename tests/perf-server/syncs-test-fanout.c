@@ -0,0 +1,126 @@
+/**************************************************************
+ * Description: Utility and test tools to support SyncScribe library
+ * Copyright (c) 2022 Alexander Krapivniy (a.krapivniy@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#define MODULE_NAME "syncs-test-fanout"
+#include <syncs-debug.h>
+#include <test_tools.h>
+
+#define FANOUT_SLOTS	64
+#define FANOUT_EVENTS	1000000
+
+struct fanout_client {
+	uint32_t tx_event_count;
+	uint32_t pad[15];
+};
+
+/* the walk that server did before: every slot of fixed array is visited */
+static uint32_t fanout_slots(struct fanout_client **consumers, struct fanout_client *producer)
+{
+	struct fanout_client *c;
+	uint32_t sent = 0;
+	int i;
+
+	for (i = 0; i < FANOUT_SLOTS; i++) {
+		c = consumers[i];
+		if (c == NULL) continue;
+		if (c == producer) continue;
+		c->tx_event_count++;
+		sent++;
+	}
+	return sent;
+}
+
+static uint32_t fanout_dense(struct fanout_client **consumers, uint32_t count, struct fanout_client *producer)
+{
+	struct fanout_client *c;
+	uint32_t sent = 0;
+	uint32_t i;
+
+	for (i = 0; i < count; i++) {
+		c = consumers[i];
+		if (c == producer) continue;
+		c->tx_event_count++;
+		sent++;
+	}
+	return sent;
+}
+
+static void fanout_run(int count)
+{
+	struct fanout_client *clients;
+	struct fanout_client *slots[FANOUT_SLOTS] = { NULL };
+	struct fanout_client **dense;
+	struct timespec start, end;
+	uint64_t slots_us, dense_us;
+	uint32_t sent = 0;
+	int i;
+
+	clients = calloc(count, sizeof(struct fanout_client));
+	dense = calloc(count, sizeof(struct fanout_client *));
+	if ((clients == NULL) || (dense == NULL))
+		die("alloc");
+
+	// subscribers are scattered over the slots like after some reconnects
+	for (i = 0; i < count; i++) {
+		dense[i] = &clients[i];
+		if (count <= FANOUT_SLOTS)
+			slots[(i * 37) % FANOUT_SLOTS] = &clients[i];
+	}
+
+	if (count <= FANOUT_SLOTS) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < FANOUT_EVENTS; i++)
+			sent += fanout_slots(slots, NULL);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		slots_us = tt_clockusdiff(start, end) + 1;
+	} else
+		slots_us = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < FANOUT_EVENTS; i++)
+		sent += fanout_dense(dense, count, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	dense_us = tt_clockusdiff(start, end) + 1;
+
+	if (slots_us)
+		printf("%5d subscribers: slots %7.1f ns/event, dense %7.1f ns/event, x%.1f (%u)\n", count,
+			(double) slots_us * 1000 / FANOUT_EVENTS, (double) dense_us * 1000 / FANOUT_EVENTS,
+			(double) slots_us / dense_us, sent & 1);
+	else
+		printf("%5d subscribers: slots       - ns/event, dense %7.1f ns/event (%u)\n", count,
+			(double) dense_us * 1000 / FANOUT_EVENTS, sent & 1);
+
+	free(dense);
+	free(clients);
+}
+
+int main()
+{
+	printf("#----- Event fan-out: fixed consumer slots against dense vector -----\n");
+	fanout_run(1);
+	fanout_run(2);
+	fanout_run(8);
+	fanout_run(32);
+	fanout_run(64);
+	fanout_run(1024);
+	return 0;
+}
@@ -0,0 +1,259 @@
+/**************************************************************
+ * Description: Utility and test tools to support SyncScribe library
+ * Copyright (c) 2022 Alexander Krapivniy (a.krapivniy@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <syncs-server.h>
+#include <syncs-frame.h>
+
+#define MODULE_NAME "syncs-test-frame"
+#include <syncs-debug.h>
+#include <test_tools.h>
+
+#define FRAME_PORT	4457
+#define FRAME_STREAM	256
+#define FRAME_ROUNDS	20000
+#define FRAME_EVENTS	20000
+
+struct frame_case {
+	const char *name;
+	uint32_t type;
+	uint32_t data_size;
+	uint64_t update_counter;
+	int by_handle;
+};
+
+static struct frame_case frame_cases[] = {
+	{ "write int32 by id",       SYNCS_TYPE_WRITE | SYNCS_TYPE_VAR_INT32,   4, 0, 0 },
+	{ "event int32 by id",       SYNCS_TYPE_EVENT | SYNCS_TYPE_VAR_INT32,   4, 12345, 0 },
+	{ "write int32 by handle",   SYNCS_TYPE_WRITE | SYNCS_TYPE_VAR_INT32,   4, 0, 1 },
+	{ "event int32 by handle",   SYNCS_TYPE_EVENT | SYNCS_TYPE_VAR_INT32,   4, 12345, 1 },
+	{ "event string[13] by id",  SYNCS_TYPE_EVENT | SYNCS_TYPE_VAR_STRING, 13, 12345, 0 },
+	{ "subscribe request",       SYNCS_TYPE_SUBSCRIBE | SYNCS_TYPE_VAR_INT32, 0, 0, 0 },
+};
+
+/* v2 frames are written back to back like the senders do */
+static uint32_t frame_encode_v2(uint8_t *stream, struct frame_case *fc, const char *data)
+{
+	struct syncs_packet *packet;
+	uint32_t size = 0;
+	int i;
+
+	for (i = 0; i < FRAME_STREAM; i++) {
+		packet = (struct syncs_packet *) (stream + size);
+		packet->header.magic = SYNCS_PACKET_MAGIC;
+		packet->header.magic_data = SYNCS_PACKET_MAGIC_DATA;
+		packet->header.type = fc->type;
+		memcpy(&packet->header.id, "bench/value", 12);
+		memset(&packet->header.id.c[12], 0, sizeof(syncsid_t) - 12);
+		packet->header.sync.data0 = 0;
+		packet->header.sync.data1 = 0;
+		packet->header.update_counter = fc->update_counter ? fc->update_counter + i : 0;
+		packet->header.data_size = fc->data_size;
+		memcpy(packet->buffer, data, fc->data_size);
+		size += SYNCS_PACKET_SIZE(packet);
+	}
+	return size;
+}
+
+static uint64_t frame_decode_v2(uint8_t *stream, uint32_t size)
+{
+	struct syncs_header *header;
+	uint32_t head = 0;
+	uint64_t sum = 0;
+
+	while (head < size) {
+		header = (struct syncs_header *) (stream + head);
+		if ((header->magic != SYNCS_PACKET_MAGIC) || (header->magic_data != SYNCS_PACKET_MAGIC_DATA))
+			die("v2 decode");
+		header->data_size &= SYNCS_VARIABLE_SIZE_MAXIMUM;
+		sum += header->type + header->update_counter + header->id.i[0] + *(uint8_t *) (header + 1);
+		head += sizeof(struct syncs_header) + header->data_size;
+	}
+	return sum;
+}
+
+static uint32_t frame_encode_v3(uint8_t *stream, struct frame_case *fc, const char *data)
+{
+	struct syncs_header header;
+	uint32_t handle = 0x00100003;
+	uint32_t size = 0;
+	int i;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(&header.id, "bench/value", 12);
+	header.type = fc->type;
+	header.data_size = fc->data_size;
+	for (i = 0; i < FRAME_STREAM; i++) {
+		header.update_counter = fc->update_counter ? fc->update_counter + i : 0;
+		size += syncs_frame_encode(stream + size, &header, data, i, fc->by_handle ? &handle : NULL);
+	}
+	return size;
+}
+
+static uint64_t frame_decode_v3(uint8_t *stream, uint32_t size)
+{
+	struct syncs_frame frame;
+	uint32_t head = 0;
+	uint64_t sum = 0;
+	int ret;
+
+	while (head < size) {
+		ret = syncs_frame_decode(&frame, stream + head, size - head);
+		if (ret <= 0)
+			die("v3 decode");
+		sum += frame.header.type + frame.header.update_counter + frame.header.id.i[0] + frame.handle + *(uint8_t *) frame.data;
+		head += ret;
+	}
+	return sum;
+}
+
+static void frame_codec_run(struct frame_case *fc)
+{
+	static uint64_t stream_v2[FRAME_STREAM * sizeof(struct syncs_packet) / sizeof(uint64_t) + 1];
+	static uint64_t stream_v3[FRAME_STREAM * SYNCS_FRAME_SIZE_MAXIMUM / sizeof(uint64_t)];
+	static const char data[16] = "0123456789abcde";
+	struct timespec start, end;
+	uint64_t enc_v2, dec_v2, enc_v3, dec_v3;
+	uint32_t size_v2 = 0, size_v3 = 0;
+	uint64_t sum = 0;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < FRAME_ROUNDS; i++)
+		size_v2 = frame_encode_v2((uint8_t *) stream_v2, fc, data);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	enc_v2 = tt_clockusdiff(start, end) + 1;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < FRAME_ROUNDS; i++)
+		sum += frame_decode_v2((uint8_t *) stream_v2, size_v2);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	dec_v2 = tt_clockusdiff(start, end) + 1;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < FRAME_ROUNDS; i++)
+		size_v3 = frame_encode_v3((uint8_t *) stream_v3, fc, data);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	enc_v3 = tt_clockusdiff(start, end) + 1;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < FRAME_ROUNDS; i++)
+		sum += frame_decode_v3((uint8_t *) stream_v3, size_v3);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	dec_v3 = tt_clockusdiff(start, end) + 1;
+
+	// v2 has no handles, those cases are compared against the full header
+	printf("%-24s v2 %3u bytes enc %5.1f dec %5.1f ns | v3 %3u bytes enc %5.1f dec %5.1f ns (%u)\n", fc->name,
+		size_v2 / FRAME_STREAM, (double) enc_v2 * 1000 / FRAME_ROUNDS / FRAME_STREAM, (double) dec_v2 * 1000 / FRAME_ROUNDS / FRAME_STREAM,
+		size_v3 / FRAME_STREAM, (double) enc_v3 * 1000 / FRAME_ROUNDS / FRAME_STREAM, (double) dec_v3 * 1000 / FRAME_ROUNDS / FRAME_STREAM,
+		(uint32_t) sum & 1);
+}
+
+static void frame_header(struct syncs_header *h, const char *id, uint32_t type)
+{
+	memset(h, 0, sizeof(struct syncs_header));
+	h->magic = SYNCS_PACKET_MAGIC;
+	h->magic_data = SYNCS_PACKET_MAGIC_DATA;
+	h->type = type;
+	snprintf(h->id.c, sizeof(syncsid_t), "%s", id);
+}
+
+/* counts everything received until the socket is quiet */
+static uint64_t frame_drain(int fd)
+{
+	uint8_t buffer[16 * 1024];
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	uint64_t total = 0;
+	int ret;
+
+	while (poll(&pfd, 1, 300) > 0) {
+		ret = recv(fd, buffer, sizeof(buffer), 0);
+		if (ret <= 0)
+			break;
+		total += ret;
+	}
+	return total;
+}
+
+static int frame_subscriber(const char *name, uint32_t protocol)
+{
+	struct sockaddr_in addr;
+	struct syncs_header h;
+	int fd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(FRAME_PORT);
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if ((fd < 0) || connect(fd, (struct sockaddr *) &addr, sizeof(addr)))
+		die("connect");
+	frame_header(&h, name, SYNCS_TYPE_CLIENT_ID);
+	h.sync.data0 = SYNCS_VERSION_MAJOR;
+	h.sync.data1 = SYNCS_VERSION_MINOR;
+	h.update_counter = ((uint64_t) SYNCS_PROTOCOL_SIGNATURE << 32) | protocol;
+	if (send(fd, &h, sizeof(h), 0) != sizeof(h))
+		die("send");
+
+	frame_header(&h, "bench/value", SYNCS_TYPE_SUBSCRIBE | SYNCS_TYPE_VAR_INT32);
+	h.update_counter = UINT64_MAX;
+	if (send(fd, &h, sizeof(h), 0) != sizeof(h))
+		die("send");
+	return fd;
+}
+
+int main()
+{
+	static const uint32_t protocols[] = { 0, SYNCS_PROTOCOL_HANDLE, SYNCS_PROTOCOL_V3, SYNCS_PROTOCOL_V3 | SYNCS_PROTOCOL_HANDLE };
+	static const char *names[] = { "v2", "v2 handle", "v3", "v3 handle" };
+	struct syncs_server *s;
+	int fds[4];
+	uint32_t i;
+
+	printf("#----- Frame encode/decode, v2 packed header against v3 aligned header -----\n");
+	for (i = 0; i < sizeof(frame_cases) / sizeof(frame_cases[0]); i++)
+		frame_codec_run(&frame_cases[i]);
+
+	s = syncs_server_create("127.0.0.1", FRAME_PORT, "bench");
+	if (s == NULL)
+		die("server create");
+	syncs_server_define(s, "bench/value", SYNCS_TYPE_VAR_INT32, NULL, 0);
+	sleep(1);
+
+	printf("#----- Bytes on the wire for int32 events -----\n");
+	for (i = 0; i < 4; i++)
+		fds[i] = frame_subscriber(names[i], protocols[i]);
+	usleep(100000);
+	for (i = 0; i < 4; i++)
+		frame_drain(fds[i]);
+
+	for (i = 0; i < FRAME_EVENTS; i++)
+		syncs_server_write_int32(s, 0, "bench/value", i);
+	for (i = 0; i < 4; i++) {
+		printf("%-10s %5.1f bytes/event\n", names[i], (double) frame_drain(fds[i]) / FRAME_EVENTS);
+		close(fds[i]);
+	}
+	return 0;
+}
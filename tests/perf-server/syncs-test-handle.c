@@ -0,0 +1,230 @@
+/**************************************************************
+ * Description: Utility and test tools to support SyncScribe library
+ * Copyright (c) 2022 Alexander Krapivniy (a.krapivniy@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <syncs-server.h>
+
+#define MODULE_NAME "syncs-test-handle"
+#include <syncs-debug.h>
+#include <test_tools.h>
+
+#define HANDLE_PORT	4456
+#define HANDLE_WRITES	200000
+#define HANDLE_EVENTS	20000
+#define HANDLE_BATCH	64
+
+static volatile uint32_t write_count;
+
+static void handle_write_cb(void *args, char *id, void *data, uint32_t size)
+{
+	write_count++;
+}
+
+static void handle_header(struct syncs_header *h, const char *id, uint32_t type, uint16_t data_size)
+{
+	memset(h, 0, sizeof(struct syncs_header));
+	h->magic = SYNCS_PACKET_MAGIC;
+	h->magic_data = SYNCS_PACKET_MAGIC_DATA;
+	h->type = type;
+	h->data_size = data_size;
+	snprintf(h->id.c, sizeof(syncsid_t), "%s", id);
+}
+
+static void handle_recv(int fd, void *buffer, int size)
+{
+	int ret;
+
+	while (size > 0) {
+		ret = recv(fd, buffer, size, 0);
+		if (ret <= 0)
+			die("recv");
+		buffer = (uint8_t *) buffer + ret;
+		size -= ret;
+	}
+}
+
+/* connects raw socket, returns accepted protocol options */
+static int handle_connect(const char *name, uint32_t protocol, uint32_t *accepted)
+{
+	struct sockaddr_in addr;
+	struct syncs_header h;
+	int fd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(HANDLE_PORT);
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if ((fd < 0) || connect(fd, (struct sockaddr *) &addr, sizeof(addr)))
+		die("connect");
+	handle_header(&h, name, SYNCS_TYPE_CLIENT_ID, 0);
+	h.sync.data0 = SYNCS_VERSION_MAJOR;
+	h.sync.data1 = SYNCS_VERSION_MINOR;
+	if (protocol)
+		h.update_counter = ((uint64_t) SYNCS_PROTOCOL_SIGNATURE << 32) | protocol;
+	if (send(fd, &h, sizeof(h), 0) != sizeof(h))
+		die("send");
+	handle_recv(fd, &h, sizeof(h));
+	if ((h.type & SYNCS_TYPE_MSG_MASK) != SYNCS_TYPE_SERVER_STATUS)
+		die("status");
+	*accepted = (h.sync.data1 == SYNCS_PROTOCOL_SIGNATURE) ? h.sync.data0 : 0;
+	return fd;
+}
+
+static uint32_t handle_request(int fd, const char *id, uint32_t type)
+{
+	struct syncs_packet packet;
+
+	handle_header(&packet.header, id, type | SYNCS_TYPE_VAR_INT32, 0);
+	// newest counter, so server doesn't resend the current value
+	packet.header.update_counter = UINT64_MAX;
+	if (send(fd, &packet, sizeof(struct syncs_header), 0) != sizeof(struct syncs_header))
+		die("send");
+	handle_recv(fd, &packet, sizeof(struct syncs_header) + sizeof(uint32_t));
+	if ((packet.header.type & SYNCS_TYPE_MSG_MASK) != SYNCS_TYPE_ACK)
+		die("ack");
+	return *(uint32_t *) packet.buffer;
+}
+
+static void handle_wait(uint32_t count)
+{
+	int ms;
+
+	for (ms = 0; (write_count < count) && (ms < 10000); ms++)
+		usleep(100);
+	if (write_count < count)
+		die("writes lost");
+}
+
+static void handle_write_run(int fd, uint32_t handle)
+{
+	uint8_t buffer[HANDLE_BATCH * (sizeof(struct syncs_header) + sizeof(int32_t))];
+	struct syncs_packet *packet;
+	struct syncs_handle_header *handle_packet;
+	struct timespec start, end;
+	uint64_t full_us, handle_us;
+	int full_size = sizeof(struct syncs_header) + sizeof(int32_t);
+	int handle_size = sizeof(struct syncs_handle_header) + sizeof(int32_t);
+	int i, j;
+
+	for (j = 0; j < HANDLE_BATCH; j++) {
+		packet = (struct syncs_packet *) (buffer + j * full_size);
+		handle_header(&packet->header, "bench/value", SYNCS_TYPE_WRITE | SYNCS_TYPE_VAR_INT32, sizeof(int32_t));
+		*(int32_t *) packet->buffer = j;
+	}
+	write_count = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < HANDLE_WRITES; i += HANDLE_BATCH)
+		if (send(fd, buffer, HANDLE_BATCH * full_size, 0) != HANDLE_BATCH * full_size)
+			die("send");
+	handle_wait(HANDLE_WRITES);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	full_us = tt_clockusdiff(start, end) + 1;
+
+	for (j = 0; j < HANDLE_BATCH; j++) {
+		handle_packet = (struct syncs_handle_header *) (buffer + j * handle_size);
+		handle_packet->magic = SYNCS_PACKET_MAGIC_HANDLE;
+		handle_packet->magic_data = SYNCS_PACKET_MAGIC_DATA;
+		handle_packet->data_size = sizeof(int32_t);
+		handle_packet->type = SYNCS_TYPE_WRITE | SYNCS_TYPE_VAR_INT32;
+		handle_packet->handle = handle;
+		handle_packet->update_counter = 0;
+		*(int32_t *) (handle_packet + 1) = j;
+	}
+	write_count = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < HANDLE_WRITES; i += HANDLE_BATCH)
+		if (send(fd, buffer, HANDLE_BATCH * handle_size, 0) != HANDLE_BATCH * handle_size)
+			die("send");
+	handle_wait(HANDLE_WRITES);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	handle_us = tt_clockusdiff(start, end) + 1;
+
+	printf("write int32: id header %3d bytes %9.0f writes/sec, handle header %3d bytes %9.0f writes/sec\n",
+		full_size, (double) HANDLE_WRITES * 1000000 / full_us, handle_size, (double) HANDLE_WRITES * 1000000 / handle_us);
+}
+
+/* counts everything received until the socket is quiet */
+static uint64_t handle_drain(int fd)
+{
+	uint8_t buffer[16 * 1024];
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	uint64_t total = 0;
+	int ret;
+
+	while (poll(&pfd, 1, 300) > 0) {
+		ret = recv(fd, buffer, sizeof(buffer), 0);
+		if (ret <= 0)
+			break;
+		total += ret;
+	}
+	return total;
+}
+
+int main()
+{
+	struct syncs_server *s;
+	struct syncs_header h;
+	int writer, legacy, compact;
+	uint32_t accepted, handle;
+	uint64_t legacy_bytes, compact_bytes;
+	int i;
+
+	s = syncs_server_create("127.0.0.1", HANDLE_PORT, "bench");
+	if (s == NULL)
+		die("server create");
+	syncs_server_subscribe_event(s, SYNCS_TYPE_VAR_INT32 | SYNCS_TYPE_FORCE, "bench/value", handle_write_cb, NULL);
+	sleep(1);
+
+	printf("#----- Numeric handles against full id header -----\n");
+	writer = handle_connect("writer", SYNCS_PROTOCOL_HANDLE, &accepted);
+	if (!(accepted & SYNCS_PROTOCOL_HANDLE))
+		die("handles are not accepted");
+	handle = handle_request(writer, "bench/value", SYNCS_TYPE_DEFINE | SYNCS_TYPE_FORCE);
+	handle_write_run(writer, handle);
+
+	legacy = handle_connect("legacy", 0, &accepted);
+	compact = handle_connect("compact", SYNCS_PROTOCOL_HANDLE, &accepted);
+	handle_header(&h, "bench/value", SYNCS_TYPE_SUBSCRIBE | SYNCS_TYPE_VAR_INT32, 0);
+	h.update_counter = UINT64_MAX;
+	if (send(legacy, &h, sizeof(h), 0) != sizeof(h))
+		die("send");
+	handle_request(compact, "bench/value", SYNCS_TYPE_SUBSCRIBE);
+	usleep(100000);
+
+	for (i = 0; i < HANDLE_EVENTS; i++)
+		syncs_server_write_int32(s, 0, "bench/value", i);
+	legacy_bytes = handle_drain(legacy);
+	compact_bytes = handle_drain(compact);
+	printf("event int32: id header %5.1f bytes/event, handle header %5.1f bytes/event\n",
+		(double) legacy_bytes / HANDLE_EVENTS, (double) compact_bytes / HANDLE_EVENTS);
+
+	close(writer);
+	close(legacy);
+	close(compact);
+	return 0;
+}
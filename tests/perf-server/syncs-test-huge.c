@@ -0,0 +1,174 @@
+/**************************************************************
+ * Description: Utility and test tools to support SyncScribe library
+ * Copyright (c) 2022 Alexander Krapivniy (a.krapivniy@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <syncs-server.h>
+#include <syncs-client.h>
+
+#define MODULE_NAME "syncs-test-huge"
+#include <syncs-debug.h>
+#include <test_tools.h>
+
+#define HUGE_PORT	4458
+#define HUGE_CLIENTS	4
+#define HUGE_TICKS	200
+#define HUGE_TICK_US	1000
+
+static const uint32_t huge_sizes[] = { 64 * 1024, 1024 * 1024, 4 * 1024 * 1024, 16 * 1024 * 1024 };
+
+struct huge_subscriber {
+	struct syncs_connect *connect;
+	volatile uint32_t values;
+	volatile uint32_t ticks;
+	uint64_t latency_sum;
+	uint64_t latency_max;
+};
+
+static struct huge_subscriber subscribers[HUGE_CLIENTS];
+static uint8_t *huge_value;
+
+static uint64_t huge_now_ns(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void huge_value_cb(void *args, char *id, void *data, uint32_t size)
+{
+	struct huge_subscriber *sub = args;
+
+	if (memcmp(data, huge_value, size))
+		die("value is damaged");
+	sub->values++;
+}
+
+static void huge_tick_cb(void *args, char *id, void *data, uint32_t size)
+{
+	struct huge_subscriber *sub = args;
+	uint64_t latency = huge_now_ns() - *(uint64_t *) data;
+
+	sub->latency_sum += latency;
+	if (latency > sub->latency_max)
+		sub->latency_max = latency;
+	sub->ticks++;
+}
+
+static void huge_wait(volatile uint32_t *counter, uint32_t count)
+{
+	int ms;
+
+	for (ms = 0; (*counter < count) && (ms < 30000); ms++)
+		usleep(1000);
+	if (*counter < count)
+		die("values lost");
+}
+
+/* small events are written every tick, optionally while the huge value is sent */
+static void huge_tick_run(struct syncs_server *s, uint32_t size)
+{
+	uint64_t latency_sum = 0, latency_max = 0, now;
+	uint32_t i;
+
+	for (i = 0; i < HUGE_CLIENTS; i++) {
+		subscribers[i].ticks = 0;
+		subscribers[i].latency_sum = 0;
+		subscribers[i].latency_max = 0;
+	}
+	if (size)
+		syncs_server_write(s, SYNCS_TYPE_VAR_HUGE, "bench/huge", huge_value, size);
+	for (i = 0; i < HUGE_TICKS; i++) {
+		now = huge_now_ns();
+		syncs_server_write_int64(s, 0, "bench/tick", now);
+		usleep(HUGE_TICK_US);
+	}
+	for (i = 0; i < HUGE_CLIENTS; i++) {
+		huge_wait(&subscribers[i].ticks, HUGE_TICKS);
+		latency_sum += subscribers[i].latency_sum;
+		if (subscribers[i].latency_max > latency_max)
+			latency_max = subscribers[i].latency_max;
+	}
+	printf("%-22s tick latency avg %7.1f us max %8.1f us\n", size ? "during huge transfer" : "idle",
+		(double) latency_sum / 1000 / HUGE_TICKS / HUGE_CLIENTS, (double) latency_max / 1000);
+}
+
+int main()
+{
+	struct timespec start, end;
+	struct syncs_server *s;
+	struct syncs_connect *writer;
+	uint64_t us;
+	uint32_t i, j, values;
+
+	huge_value = malloc(huge_sizes[3]);
+	if (huge_value == NULL)
+		die("malloc");
+	for (i = 0; i < huge_sizes[3]; i++)
+		huge_value[i] = i * 7 + (i >> 16);
+
+	s = syncs_server_create("127.0.0.1", HUGE_PORT, "bench");
+	if (s == NULL)
+		die("server create");
+	syncs_server_define(s, "bench/huge", SYNCS_TYPE_VAR_HUGE, NULL, 0);
+	syncs_server_define(s, "bench/tick", SYNCS_TYPE_VAR_INT64, NULL, 0);
+	sleep(1);
+
+	for (i = 0; i < HUGE_CLIENTS; i++) {
+		subscribers[i].connect = syncs_connect_simple("127.0.0.1", HUGE_PORT, "subscriber");
+		syncs_set_protocol(subscribers[i].connect, SYNCS_PROTOCOL_V3 | SYNCS_PROTOCOL_HANDLE | SYNCS_PROTOCOL_HUGE);
+		if (syncs_connect_wait(subscribers[i].connect, 3))
+			die("connect");
+		syncs_subscribe_event(subscribers[i].connect, SYNCS_TYPE_VAR_HUGE, "bench/huge", huge_value_cb, &subscribers[i]);
+		syncs_subscribe_event(subscribers[i].connect, SYNCS_TYPE_VAR_INT64, "bench/tick", huge_tick_cb, &subscribers[i]);
+	}
+	writer = syncs_connect_simple("127.0.0.1", HUGE_PORT, "writer");
+	syncs_set_protocol(writer, SYNCS_PROTOCOL_V3 | SYNCS_PROTOCOL_HUGE);
+	if (syncs_connect_wait(writer, 3))
+		die("connect");
+	usleep(200000);
+
+	printf("#----- Huge variable fan-out to %d subscribers -----\n", HUGE_CLIENTS);
+	for (i = 0; i < sizeof(huge_sizes) / sizeof(huge_sizes[0]); i++) {
+		values = subscribers[0].values;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (syncs_write(writer, SYNCS_TYPE_VAR_HUGE, "bench/huge", huge_value, huge_sizes[i]))
+			die("write");
+		for (j = 0; j < HUGE_CLIENTS; j++)
+			huge_wait(&subscribers[j].values, values + 1);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		us = tt_clockusdiff(start, end) + 1;
+		printf("%8u bytes %8.1f ms %8.1f MB/s delivered\n", huge_sizes[i], (double) us / 1000,
+			(double) huge_sizes[i] * HUGE_CLIENTS / us);
+	}
+
+	printf("#----- Small events behind a huge value of %u bytes -----\n", huge_sizes[3]);
+	huge_tick_run(s, 0);
+	huge_tick_run(s, huge_sizes[3]);
+	for (j = 0; j < HUGE_CLIENTS; j++)
+		huge_wait(&subscribers[j].values, sizeof(huge_sizes) / sizeof(huge_sizes[0]) + 1);
+
+	syncs_disconnect(writer);
+	for (i = 0; i < HUGE_CLIENTS; i++)
+		syncs_disconnect(subscribers[i].connect);
+	return 0;
+}
@@ -0,0 +1,108 @@
+/**************************************************************
+ * Description: Utility and test tools to support SyncScribe library
+ * Copyright (c) 2022 Alexander Krapivniy (a.krapivniy@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <syncs-types.h>
+#include <syncs-hash.h>
+
+#define MODULE_NAME "syncs-test-lookup"
+#include <syncs-debug.h>
+#include <test_tools.h>
+
+#define LOOKUP_COUNT 2000000
+
+struct lookup_item {
+	syncsid_t id;
+	uint32_t value;
+};
+
+static void lookup_make_id(syncsid_t *id, int n)
+{
+	id->i[0] = 0; id->i[1] = 0; id->i[2] = 0; id->i[3] = 0;
+	snprintf(id->c, sizeof(syncsid_t), "plant/variable/%d", n);
+}
+
+/* the same walk that server did before the index */
+static struct lookup_item *lookup_scan(struct lookup_item *items, int count, syncsid_t *id)
+{
+	int i;
+	for (i = 0; i < count; i++)
+		if ((items[i].id.i[0] == id->i[0]) && (items[i].id.i[1] == id->i[1]) &&
+			(items[i].id.i[2] == id->i[2]) && (items[i].id.i[3] == id->i[3]))
+			return &items[i];
+	return NULL;
+}
+
+static void lookup_run(int count)
+{
+	struct lookup_item *items;
+	syncsid_t *keys;
+	struct syncs_hash index;
+	struct timespec start, end;
+	uint64_t scan_us, hash_us;
+	uint32_t found = 0;
+	int scan_lookups;
+	int i;
+
+	items = calloc(count, sizeof(struct lookup_item));
+	keys = calloc(1024, sizeof(syncsid_t));
+	if ((items == NULL) || (keys == NULL) || syncs_hash_init(&index, count * 2))
+		die("alloc");
+
+	for (i = 0; i < count; i++) {
+		lookup_make_id(&items[i].id, i);
+		items[i].value = i;
+		syncs_hash_insert_id(&index, &items[i]);
+	}
+	for (i = 0; i < 1024; i++)
+		lookup_make_id(&keys[i], rand() % count);
+
+	// the scan is slow on big tables, so it gets a smaller number of lookups
+	scan_lookups = LOOKUP_COUNT / ((count / 256) + 1);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < scan_lookups; i++)
+		found += lookup_scan(items, count, &keys[i & 1023])->value;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	scan_us = tt_clockusdiff(start, end) + 1;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < LOOKUP_COUNT; i++)
+		found += ((struct lookup_item *) syncs_hash_find_id(&index, &keys[i & 1023]))->value;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	hash_us = tt_clockusdiff(start, end) + 1;
+
+	printf("%6d variables: scan %12.0f lookup/sec, hash %12.0f lookup/sec, x%.1f (%u)\n", count,
+		(double) scan_lookups * 1000000 / scan_us, (double) LOOKUP_COUNT * 1000000 / hash_us,
+		((double) LOOKUP_COUNT / hash_us) / ((double) scan_lookups / scan_us), found & 1);
+
+	syncs_hash_release(&index);
+	free(keys);
+	free(items);
+}
+
+int main()
+{
+	printf("#----- Event lookup: linear scan against hash index -----\n");
+	lookup_run(16);
+	lookup_run(256);
+	lookup_run(10000);
+	return 0;
+}
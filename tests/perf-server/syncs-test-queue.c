@@ -0,0 +1,125 @@
+/**************************************************************
+ * Description: Utility and test tools to support SyncScribe library
+ * Copyright (c) 2022 Alexander Krapivniy (a.krapivniy@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <syncs-server.h>
+#include <syncs-client.h>
+
+#define MODULE_NAME "syncs-test-queue"
+#include <syncs-debug.h>
+#include <test_tools.h>
+
+#define QUEUE_PORT		4498
+#define QUEUE_VARIABLES		8
+#define QUEUE_WRITES		100000
+#define QUEUE_BATCH		64
+
+struct queue_writer {
+	struct syncs_server *server;
+	char ids[QUEUE_VARIABLES][32];
+};
+
+static void *queue_write_thread(void *arg)
+{
+	struct queue_writer *w = arg;
+	int i;
+
+	for (i = 0; i < QUEUE_WRITES; i++) {
+		syncs_server_write_int32(w->server, 0, w->ids[i % QUEUE_VARIABLES], i);
+		if ((i % 64) == 63)
+			usleep(50);
+	}
+	return NULL;
+}
+
+/* every value of a variable is larger than the previous one, a smaller one means reordering */
+static void queue_run(uint32_t batch, int port)
+{
+	struct syncs_queued_event events[QUEUE_BATCH];
+	int32_t values[QUEUE_BATCH], last[QUEUE_VARIABLES];
+	struct queue_writer w;
+	struct syncs_connect *client;
+	struct timespec start, end;
+	pthread_t thread;
+	uint32_t got = 0, calls = 0, bad = 0;
+	uint64_t us, overflow;
+	int i, n, index;
+
+	w.server = syncs_server_create("127.0.0.1", port, "bench");
+	if (w.server == NULL)
+		die("server create");
+	for (i = 0; i < QUEUE_VARIABLES; i++) {
+		snprintf(w.ids[i], sizeof(w.ids[i]), "bench/value%d", i);
+		syncs_server_define(w.server, w.ids[i], SYNCS_TYPE_VAR_INT32, NULL, 0);
+	}
+	sleep(1);
+
+	client = syncs_connect_simple("127.0.0.1", port, "client");
+	if ((client == NULL) || syncs_connect_wait(client, 3))
+		die("connect");
+	if (syncs_set_event_queue(client, 1024, SYNCS_QUEUE_DROP_NEWEST))
+		die("queue");
+	for (i = 0; i < QUEUE_VARIABLES; i++)
+		syncs_subscribe_event_sync(client, SYNCS_TYPE_VAR_INT32, w.ids[i]);
+	usleep(300000);
+	// initial values of subscriptions
+	for (i = 0; i < QUEUE_BATCH; i++)
+		events[i].data = &values[i];
+	do {
+		for (i = 0; i < QUEUE_BATCH; i++)
+			events[i].data_size = sizeof(int32_t);
+	} while (syncs_wait_events(client, events, QUEUE_BATCH, 1) > 0);
+	overflow = syncs_get_event_overflow(client);
+	for (i = 0; i < QUEUE_VARIABLES; i++)
+		last[i] = -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pthread_create(&thread, NULL, queue_write_thread, &w);
+	while ((n = syncs_wait_events(client, events, batch, 1)) > 0) {
+		calls++;
+		for (i = 0; i < n; i++) {
+			index = atoi(events[i].id + strlen("bench/value"));
+			if (values[i] <= last[index])
+				bad++;
+			last[index] = values[i];
+			events[i].data_size = sizeof(int32_t);
+		}
+		got += n;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+	}
+	pthread_join(thread, NULL);
+	us = tt_clockusdiff(start, end) + 1;
+	overflow = syncs_get_event_overflow(client) - overflow;
+
+	printf("batch %2u %9.0f events/sec, %6u events, %6u calls, %5lu overflow, %u out of order\n",
+		batch, (double) got * 1000000 / us, got, calls, overflow, bad);
+	// the client stays until exit, like the server of the run
+}
+
+int main()
+{
+	printf("#----- %d writes of the server over %d variables, sync subscriptions -----\n", QUEUE_WRITES, QUEUE_VARIABLES);
+	queue_run(1, QUEUE_PORT);
+	queue_run(QUEUE_BATCH, QUEUE_PORT + 1);
+	return 0;
+}
@@ -0,0 +1,237 @@
+/**************************************************************
+ * Description: Utility and test tools to support SyncScribe library
+ * Copyright (c) 2022 Alexander Krapivniy (a.krapivniy@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <syncs-server.h>
+
+#define MODULE_NAME "syncs-test-reactors"
+#include <syncs-debug.h>
+#include <test_tools.h>
+
+#define REACTORS_PORT		4460
+#define REACTORS_WRITERS	16
+#define REACTORS_SUBSCRIBERS	4
+#define REACTORS_WRITES		50000
+#define REACTORS_BATCH		64
+
+static const uint32_t reactor_counts[] = { 1, 2, 4, 8 };
+
+struct reactors_writer {
+	pthread_t thread;
+	int fd;
+	uint32_t handle;
+};
+
+struct reactors_subscriber {
+	pthread_t thread;
+	int fd;
+	volatile int stop;
+	uint64_t bytes;
+};
+
+static volatile uint32_t write_count;
+
+static void reactors_write_cb(void *args, char *id, void *data, uint32_t size)
+{
+	__atomic_fetch_add(&write_count, 1, __ATOMIC_RELAXED);
+}
+
+static void reactors_header(struct syncs_header *h, const char *id, uint32_t type)
+{
+	memset(h, 0, sizeof(struct syncs_header));
+	h->magic = SYNCS_PACKET_MAGIC;
+	h->magic_data = SYNCS_PACKET_MAGIC_DATA;
+	h->type = type;
+	snprintf(h->id.c, sizeof(syncsid_t), "%s", id);
+}
+
+static void reactors_recv(int fd, void *buffer, int size)
+{
+	int ret;
+
+	while (size > 0) {
+		ret = recv(fd, buffer, size, 0);
+		if (ret <= 0)
+			die("recv");
+		buffer = (uint8_t *) buffer + ret;
+		size -= ret;
+	}
+}
+
+static int reactors_connect(int port, const char *name)
+{
+	struct sockaddr_in addr;
+	struct syncs_header h;
+	int fd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if ((fd < 0) || connect(fd, (struct sockaddr *) &addr, sizeof(addr)))
+		die("connect");
+	reactors_header(&h, name, SYNCS_TYPE_CLIENT_ID);
+	h.sync.data0 = SYNCS_VERSION_MAJOR;
+	h.sync.data1 = SYNCS_VERSION_MINOR;
+	h.update_counter = ((uint64_t) SYNCS_PROTOCOL_SIGNATURE << 32) | SYNCS_PROTOCOL_HANDLE;
+	if (send(fd, &h, sizeof(h), 0) != sizeof(h))
+		die("send");
+	reactors_recv(fd, &h, sizeof(h));
+	return fd;
+}
+
+static uint32_t reactors_request(int fd, const char *id, uint32_t type)
+{
+	struct syncs_packet packet;
+
+	reactors_header(&packet.header, id, type | SYNCS_TYPE_VAR_INT32);
+	packet.header.update_counter = UINT64_MAX;
+	if (send(fd, &packet, sizeof(struct syncs_header), 0) != sizeof(struct syncs_header))
+		die("send");
+	reactors_recv(fd, &packet, sizeof(struct syncs_header) + sizeof(uint32_t));
+	if ((packet.header.type & SYNCS_TYPE_MSG_MASK) != SYNCS_TYPE_ACK)
+		die("ack");
+	return *(uint32_t *) packet.buffer;
+}
+
+static void *reactors_writer_thread(void *args)
+{
+	struct reactors_writer *w = args;
+	uint8_t buffer[REACTORS_BATCH * (sizeof(struct syncs_handle_header) + sizeof(int32_t))];
+	struct syncs_handle_header *header;
+	int size = sizeof(struct syncs_handle_header) + sizeof(int32_t);
+	int i;
+
+	for (i = 0; i < REACTORS_BATCH; i++) {
+		header = (struct syncs_handle_header *) (buffer + i * size);
+		header->magic = SYNCS_PACKET_MAGIC_HANDLE;
+		header->magic_data = SYNCS_PACKET_MAGIC_DATA;
+		header->data_size = sizeof(int32_t);
+		header->type = SYNCS_TYPE_WRITE | SYNCS_TYPE_VAR_INT32;
+		header->handle = w->handle;
+		header->update_counter = 0;
+		*(int32_t *) (header + 1) = i;
+	}
+	for (i = 0; i < REACTORS_WRITES; i += REACTORS_BATCH)
+		if (send(w->fd, buffer, sizeof(buffer), 0) != sizeof(buffer))
+			die("send");
+	return NULL;
+}
+
+static void *reactors_subscriber_thread(void *args)
+{
+	struct reactors_subscriber *sub = args;
+	uint8_t buffer[64 * 1024];
+	int ret;
+
+	while (!sub->stop) {
+		ret = recv(sub->fd, buffer, sizeof(buffer), 0);
+		if (ret <= 0)
+			break;
+		sub->bytes += ret;
+	}
+	return NULL;
+}
+
+static void reactors_run(uint32_t reactors, int port)
+{
+	struct syncs_server_options options = { .reactors = reactors };
+	struct reactors_writer writers[REACTORS_WRITERS];
+	struct reactors_subscriber subscribers[REACTORS_SUBSCRIBERS];
+	struct timespec start, end;
+	struct syncs_server *s;
+	char id[32];
+	uint64_t us, bytes = 0;
+	uint32_t total = REACTORS_WRITERS * REACTORS_WRITES;
+	int i, j, ms;
+
+	s = syncs_server_create_ex("127.0.0.1", port, "bench", &options);
+	if (s == NULL)
+		die("server create");
+	for (i = 0; i < REACTORS_WRITERS; i++) {
+		snprintf(id, sizeof(id), "bench/value%d", i);
+		syncs_server_define(s, id, SYNCS_TYPE_VAR_INT32, NULL, 0);
+		syncs_server_subscribe_event(s, SYNCS_TYPE_VAR_INT32, id, reactors_write_cb, NULL);
+	}
+	sleep(1);
+
+	for (i = 0; i < REACTORS_SUBSCRIBERS; i++) {
+		snprintf(id, sizeof(id), "subscriber%d", i);
+		subscribers[i].fd = reactors_connect(port, id);
+		for (j = 0; j < REACTORS_WRITERS; j++) {
+			snprintf(id, sizeof(id), "bench/value%d", j);
+			reactors_request(subscribers[i].fd, id, SYNCS_TYPE_SUBSCRIBE);
+		}
+		subscribers[i].stop = 0;
+		subscribers[i].bytes = 0;
+		pthread_create(&subscribers[i].thread, NULL, reactors_subscriber_thread, &subscribers[i]);
+	}
+	for (i = 0; i < REACTORS_WRITERS; i++) {
+		snprintf(id, sizeof(id), "writer%d", i);
+		writers[i].fd = reactors_connect(port, id);
+		snprintf(id, sizeof(id), "bench/value%d", i);
+		writers[i].handle = reactors_request(writers[i].fd, id, SYNCS_TYPE_DEFINE | SYNCS_TYPE_FORCE);
+	}
+	usleep(100000);
+
+	write_count = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < REACTORS_WRITERS; i++)
+		pthread_create(&writers[i].thread, NULL, reactors_writer_thread, &writers[i]);
+	for (ms = 0; (write_count < total) && (ms < 60000); ms++)
+		usleep(1000);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (write_count < total)
+		die("writes lost");
+	us = tt_clockusdiff(start, end) + 1;
+
+	for (i = 0; i < REACTORS_WRITERS; i++) {
+		pthread_join(writers[i].thread, NULL);
+		close(writers[i].fd);
+	}
+	sleep(2);
+	for (i = 0; i < REACTORS_SUBSCRIBERS; i++) {
+		subscribers[i].stop = 1;
+		shutdown(subscribers[i].fd, SHUT_RDWR);
+		pthread_join(subscribers[i].thread, NULL);
+		close(subscribers[i].fd);
+		bytes += subscribers[i].bytes;
+	}
+	printf("%2u reactors %9.0f writes/sec, %6.1f MB fanned out to %d subscribers\n", reactors,
+		(double) total * 1000000 / us, (double) bytes / 1000000, REACTORS_SUBSCRIBERS);
+}
+
+int main()
+{
+	uint32_t i;
+
+	printf("#----- %d writers, %d writes each, %ld cpus -----\n", REACTORS_WRITERS, REACTORS_WRITES, sysconf(_SC_NPROCESSORS_ONLN));
+	for (i = 0; i < sizeof(reactor_counts) / sizeof(reactor_counts[0]); i++)
+		reactors_run(reactor_counts[i], REACTORS_PORT + i);
+	return 0;
+}
@@ -0,0 +1,190 @@
+/**************************************************************
+ * Description: Utility and test tools to support SyncScribe library
+ * Copyright (c) 2022 Alexander Krapivniy (a.krapivniy@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <syncs-server.h>
+#include <syncs-frame.h>
+
+#define MODULE_NAME "syncs-test-read"
+#include <syncs-debug.h>
+#include <test_tools.h>
+
+#define READ_PORT	4471
+#define READ_DASHBOARDS	8
+#define READ_VARIABLES	32
+#define READ_ROUNDS	2000
+
+struct read_dashboard {
+	pthread_t thread;
+	int fd;
+	uint64_t reads;
+};
+
+static struct syncs_server *server;
+static volatile int writer_stop;
+
+static void read_header(struct syncs_header *h, const char *id, uint32_t type)
+{
+	memset(h, 0, sizeof(struct syncs_header));
+	h->magic = SYNCS_PACKET_MAGIC;
+	h->magic_data = SYNCS_PACKET_MAGIC_DATA;
+	h->type = type;
+	snprintf(h->id.c, sizeof(syncsid_t), "%s", id);
+}
+
+static int read_connect(const char *name)
+{
+	struct sockaddr_in addr;
+	struct syncs_header h;
+	int fd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(READ_PORT);
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if ((fd < 0) || connect(fd, (struct sockaddr *) &addr, sizeof(addr)))
+		die("connect");
+	read_header(&h, name, SYNCS_TYPE_CLIENT_ID);
+	h.sync.data0 = SYNCS_VERSION_MAJOR;
+	h.sync.data1 = SYNCS_VERSION_MINOR;
+	h.update_counter = ((uint64_t) SYNCS_PROTOCOL_SIGNATURE << 32) | SYNCS_PROTOCOL_V3;
+	if (send(fd, &h, sizeof(h), 0) != sizeof(h))
+		die("send");
+	return fd;
+}
+
+/* dashboard polls all variables at once and waits for every reply */
+static void *read_dashboard_thread(void *args)
+{
+	struct read_dashboard *d = args;
+	struct syncs_header requests[READ_VARIABLES];
+	static __thread uint8_t buffer[64 * 1024];
+	struct syncs_frame frame;
+	uint32_t size = 0, head, replies;
+	char id[32];
+	int i, ret;
+
+	for (i = 0; i < READ_VARIABLES; i++) {
+		snprintf(id, sizeof(id), "dash/value%d", i);
+		read_header(&requests[i], id, SYNCS_TYPE_READ);
+	}
+	for (i = 0; i < READ_ROUNDS; i++) {
+		if (send(d->fd, requests, sizeof(requests), 0) != sizeof(requests))
+			die("send");
+		replies = 0;
+		while (replies < READ_VARIABLES) {
+			ret = recv(d->fd, buffer + size, sizeof(buffer) - size, 0);
+			if (ret <= 0)
+				die("recv");
+			size += ret;
+			head = 0;
+			while ((ret = syncs_frame_decode(&frame, buffer + head, size - head)) > 0) {
+				head += ret;
+				if ((frame.header.type & SYNCS_TYPE_MSG_MASK) == SYNCS_TYPE_READ)
+					replies++;
+			}
+			if (ret < 0)
+				die("frame decode");
+			memmove(buffer, buffer + head, size - head);
+			size -= head;
+		}
+		d->reads += replies;
+	}
+	return NULL;
+}
+
+static void *read_writer_thread(void *args)
+{
+	char id[32];
+	int64_t value = 0;
+
+	while (!writer_stop) {
+		snprintf(id, sizeof(id), "dash/value%ld", value % READ_VARIABLES);
+		syncs_server_write_int64(server, 0, id, value++);
+		usleep(10);
+	}
+	return NULL;
+}
+
+static void read_run(int writing)
+{
+	struct read_dashboard dashboards[READ_DASHBOARDS];
+	struct timespec start, end;
+	pthread_t writer;
+	uint64_t us, reads = 0;
+	char name[32];
+	int i;
+
+	for (i = 0; i < READ_DASHBOARDS; i++) {
+		snprintf(name, sizeof(name), "dashboard%d", i);
+		dashboards[i].fd = read_connect(name);
+		dashboards[i].reads = 0;
+	}
+	usleep(100000);
+	writer_stop = 0;
+	if (writing)
+		pthread_create(&writer, NULL, read_writer_thread, NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < READ_DASHBOARDS; i++)
+		pthread_create(&dashboards[i].thread, NULL, read_dashboard_thread, &dashboards[i]);
+	for (i = 0; i < READ_DASHBOARDS; i++) {
+		pthread_join(dashboards[i].thread, NULL);
+		reads += dashboards[i].reads;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	us = tt_clockusdiff(start, end) + 1;
+
+	writer_stop = 1;
+	if (writing)
+		pthread_join(writer, NULL);
+	for (i = 0; i < READ_DASHBOARDS; i++)
+		close(dashboards[i].fd);
+	printf("%-16s %8lu reads %9.0f reads/sec\n", writing ? "values changing" : "values steady", reads,
+		(double) reads * 1000000 / us);
+}
+
+int main()
+{
+	char id[32];
+	int i;
+
+	server = syncs_server_create("127.0.0.1", READ_PORT, "bench");
+	if (server == NULL)
+		die("server create");
+	for (i = 0; i < READ_VARIABLES; i++) {
+		snprintf(id, sizeof(id), "dash/value%d", i);
+		syncs_server_define(server, id, SYNCS_TYPE_VAR_INT64, NULL, 0);
+	}
+	sleep(1);
+
+	printf("#----- %d dashboards polling %d variables -----\n", READ_DASHBOARDS, READ_VARIABLES);
+	read_run(0);
+	read_run(1);
+	return 0;
+}
@@ -0,0 +1,229 @@
+/**************************************************************
+ * Description: Utility and test tools to support SyncScribe library
+ * Copyright (c) 2022 Alexander Krapivniy (a.krapivniy@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <syncs-server.h>
+#include <syncs-client.h>
+#include <syncs-frame.h>
+
+#define MODULE_NAME "syncs-test-slow"
+#include <syncs-debug.h>
+#include <test_tools.h>
+
+#define SLOW_PORT	4470
+#define SLOW_STALLED	4
+#define SLOW_WRITES	200000
+#define SLOW_QUEUE_HIGH	(256 * 1024)
+#define SLOW_QUEUE_LOW	(64 * 1024)
+// slow subscriber reads so much at once and pauses, it keeps up with a small part of writes
+#define SLOW_READ_SIZE	1024
+#define SLOW_READ_PAUSE_US	500
+
+struct slow_counters {
+	pthread_t thread;
+	int fd;
+	uint64_t frames;
+	uint64_t events;
+	uint64_t gaps;
+	uint64_t broken;
+	uint32_t sequence;
+	int64_t value;
+};
+
+static volatile int slow_writes_done;
+
+static volatile uint64_t fast_events;
+static int64_t fast_next;
+static uint32_t fast_disorder;
+
+static void slow_header(struct syncs_header *h, const char *id, uint32_t type)
+{
+	memset(h, 0, sizeof(struct syncs_header));
+	h->magic = SYNCS_PACKET_MAGIC;
+	h->magic_data = SYNCS_PACKET_MAGIC_DATA;
+	h->type = type;
+	snprintf(h->id.c, sizeof(syncsid_t), "%s", id);
+}
+
+/* raw subscriber with a tiny receive buffer, it reads by small parts with pauses */
+static int slow_subscriber(const char *name)
+{
+	struct sockaddr_in addr;
+	struct syncs_header h;
+	int fd, size = 4096;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(SLOW_PORT);
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		die("socket");
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)))
+		die("connect");
+	slow_header(&h, name, SYNCS_TYPE_CLIENT_ID);
+	h.sync.data0 = SYNCS_VERSION_MAJOR;
+	h.sync.data1 = SYNCS_VERSION_MINOR;
+	h.update_counter = ((uint64_t) SYNCS_PROTOCOL_SIGNATURE << 32) | SYNCS_PROTOCOL_V3 | SYNCS_PROTOCOL_HANDLE;
+	if (send(fd, &h, sizeof(h), 0) != sizeof(h))
+		die("send");
+
+	slow_header(&h, "bench/value", SYNCS_TYPE_SUBSCRIBE | SYNCS_TYPE_VAR_INT64);
+	h.update_counter = UINT64_MAX;
+	if (send(fd, &h, sizeof(h), 0) != sizeof(h))
+		die("send");
+	return fd;
+}
+
+/*
+ * Decodes frames while the writes go on and drains the rest when they are done. Frames are
+ * whole even if some of them are dropped, a dropped one is seen as a gap of sequence or,
+ * at the end of stream, as a missing last value.
+ */
+static void *slow_reader(void *arg)
+{
+	static __thread uint8_t buffer[256 * 1024];
+	struct slow_counters *sc = arg;
+	struct pollfd pfd = { .fd = sc->fd, .events = POLLIN };
+	struct syncs_frame frame;
+	uint32_t size = 0, head;
+	int ret;
+
+	while (poll(&pfd, 1, 300) > 0 || !slow_writes_done) {
+		if (!(pfd.revents & POLLIN))
+			continue;
+		ret = recv(sc->fd, buffer + size, (slow_writes_done) ? sizeof(buffer) - size : SLOW_READ_SIZE, 0);
+		if (ret <= 0)
+			break;
+		size += ret;
+		head = 0;
+		while ((ret = syncs_frame_decode(&frame, buffer + head, size - head)) > 0) {
+			head += ret;
+			if (sc->frames && (frame.sequence != sc->sequence + 1))
+				sc->gaps++;
+			sc->sequence = frame.sequence;
+			sc->frames++;
+			if ((frame.header.type & SYNCS_TYPE_MSG_MASK) == SYNCS_TYPE_EVENT) {
+				memcpy(&sc->value, frame.data, sizeof(int64_t));
+				sc->events++;
+			}
+		}
+		if (ret < 0) {
+			// the rest of stream can't be parsed anymore
+			sc->broken++;
+			break;
+		}
+		memmove(buffer, buffer + head, size - head);
+		size -= head;
+		if (!slow_writes_done)
+			usleep(SLOW_READ_PAUSE_US);
+	}
+	// nothing follows the drops at the end of writes, the last value shows them instead
+	if (sc->value != SLOW_WRITES - 1)
+		sc->gaps++;
+	return NULL;
+}
+
+static void slow_value_cb(void *args, char *id, void *data, uint32_t size)
+{
+	int64_t value = *(int64_t *) data;
+
+	if (value != fast_next)
+		fast_disorder++;
+	fast_next = value + 1;
+	fast_events++;
+}
+
+int main()
+{
+	struct syncs_server_options options = { .reactors = 1, .queue_high = SLOW_QUEUE_HIGH, .queue_low = SLOW_QUEUE_LOW };
+	struct timespec start, end, call_start, call_end;
+	struct slow_counters sc[SLOW_STALLED];
+	struct syncs_server *s;
+	struct syncs_connect *fast;
+	uint64_t us, call_us, call_max = 0;
+	char name[32];
+	int i, ms;
+
+	s = syncs_server_create_ex("127.0.0.1", SLOW_PORT, "bench", &options);
+	if (s == NULL)
+		die("server create");
+	syncs_server_define(s, "bench/value", SYNCS_TYPE_VAR_INT64, NULL, 0);
+	sleep(1);
+
+	for (i = 0; i < SLOW_STALLED; i++) {
+		snprintf(name, sizeof(name), "slow%d", i);
+		memset(&sc[i], 0, sizeof(struct slow_counters));
+		sc[i].fd = slow_subscriber(name);
+	}
+	fast = syncs_connect_simple("127.0.0.1", SLOW_PORT, "fast");
+	syncs_set_protocol(fast, SYNCS_PROTOCOL_V3 | SYNCS_PROTOCOL_HANDLE);
+	if (syncs_connect_wait(fast, 3))
+		die("connect");
+	syncs_subscribe_event(fast, SYNCS_TYPE_VAR_INT64, "bench/value", slow_value_cb, NULL);
+	usleep(200000);
+
+	printf("#----- %d writes, %d slow subscribers, queue watermarks %d/%d KB -----\n",
+		SLOW_WRITES, SLOW_STALLED, SLOW_QUEUE_HIGH / 1024, SLOW_QUEUE_LOW / 1024);
+	fast_events = 0;
+	for (i = 0; i < SLOW_STALLED; i++)
+		if (pthread_create(&sc[i].thread, NULL, slow_reader, &sc[i]))
+			die("pthread_create");
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < SLOW_WRITES; i++) {
+		clock_gettime(CLOCK_MONOTONIC, &call_start);
+		syncs_server_write_int64(s, 0, "bench/value", i);
+		clock_gettime(CLOCK_MONOTONIC, &call_end);
+		call_us = tt_clockusdiff(call_start, call_end);
+		if (call_us > call_max)
+			call_max = call_us;
+	}
+	for (ms = 0; (fast_events < SLOW_WRITES) && (ms < 10000); ms++)
+		usleep(1000);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	slow_writes_done = 1;
+	us = tt_clockusdiff(start, end) + 1;
+	printf("fast     subscriber %6lu events %9.0f events/sec, out of order %u, write call max %lu us\n",
+		fast_events, (double) fast_events * 1000000 / us, fast_disorder, call_max);
+
+	for (i = 0; i < SLOW_STALLED; i++) {
+		pthread_join(sc[i].thread, NULL);
+		printf("slow     subscriber %6lu events %6lu dropped in %lu gaps, %lu broken streams\n",
+			sc[i].events, SLOW_WRITES - sc[i].events, sc[i].gaps, sc[i].broken);
+		// a drop comes with a jump of sequence or a missing last value, the receiver always sees its loss
+		if ((sc[i].events < SLOW_WRITES) && (sc[i].gaps == 0))
+			die("drops without gaps");
+		if (sc[i].broken)
+			die("broken stream");
+		close(sc[i].fd);
+	}
+
+	syncs_disconnect(fast);
+	return 0;
+}
@@ -0,0 +1,223 @@
+/**************************************************************
+ * Description: Utility and test tools to support SyncScribe library
+ * Copyright (c) 2022 Alexander Krapivniy (a.krapivniy@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <syncs-server.h>
+#include <syncs-client.h>
+#include <syncs-frame.h>
+
+#define MODULE_NAME "syncs-test-stream"
+#include <syncs-debug.h>
+#include <test_tools.h>
+
+#define STREAM_PORT	4459
+#define STREAM_DEPTH	256
+#define STREAM_ELEMENT	32
+#define STREAM_BURST	4096
+#define STREAM_WRITES	200000
+
+struct stream_counters {
+	uint64_t elements;
+	uint64_t batches;
+	uint64_t gaps;
+	uint64_t lost;
+	uint64_t bytes;
+	uint64_t sequence;
+};
+
+static volatile uint64_t client_elements;
+static volatile uint64_t client_lost;
+static uint32_t client_next;
+static uint32_t client_disorder;
+
+static void stream_header(struct syncs_header *h, const char *id, uint32_t type)
+{
+	memset(h, 0, sizeof(struct syncs_header));
+	h->magic = SYNCS_PACKET_MAGIC;
+	h->magic_data = SYNCS_PACKET_MAGIC_DATA;
+	h->type = type;
+	snprintf(h->id.c, sizeof(syncsid_t), "%s", id);
+}
+
+/* raw subscriber with a tiny receive buffer, so the server sees it congested at once */
+static int stream_subscriber(const char *name)
+{
+	struct sockaddr_in addr;
+	struct syncs_header h;
+	int fd, size = 4096;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(STREAM_PORT);
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		die("socket");
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)))
+		die("connect");
+	stream_header(&h, name, SYNCS_TYPE_CLIENT_ID);
+	h.sync.data0 = SYNCS_VERSION_MAJOR;
+	h.sync.data1 = SYNCS_VERSION_MINOR;
+	h.update_counter = ((uint64_t) SYNCS_PROTOCOL_SIGNATURE << 32) | SYNCS_PROTOCOL_V3 | SYNCS_PROTOCOL_STREAM;
+	if (send(fd, &h, sizeof(h), 0) != sizeof(h))
+		die("send");
+
+	stream_header(&h, "bench/stream", SYNCS_TYPE_SUBSCRIBE | SYNCS_TYPE_VAR_STREAM);
+	h.update_counter = UINT64_MAX;
+	if (send(fd, &h, sizeof(h), 0) != sizeof(h))
+		die("send");
+	return fd;
+}
+
+/* decodes v3 frames until the socket is quiet, counts elements of the stream batches */
+static void stream_drain(int fd, struct stream_counters *sc)
+{
+	static uint8_t buffer[256 * 1024];
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	struct syncs_stream_batch batch;
+	struct syncs_frame frame;
+	uint32_t size = 0, head;
+	int ret;
+
+	while (poll(&pfd, 1, 300) > 0) {
+		ret = recv(fd, buffer + size, sizeof(buffer) - size, 0);
+		if (ret <= 0)
+			break;
+		sc->bytes += ret;
+		size += ret;
+		head = 0;
+		while ((ret = syncs_frame_decode(&frame, buffer + head, size - head)) > 0) {
+			head += ret;
+			if (frame.header.type != (SYNCS_TYPE_EVENT | SYNCS_TYPE_VAR_STREAM))
+				continue;
+			memcpy(&batch, frame.data, sizeof(batch));
+			if (sc->sequence && (batch.sequence > sc->sequence + 1)) {
+				sc->gaps++;
+				sc->lost += batch.sequence - sc->sequence - 1;
+			}
+			sc->sequence = batch.sequence + batch.count - 1;
+			sc->elements += batch.count;
+			sc->batches++;
+		}
+		if (ret < 0)
+			die("frame decode");
+		memmove(buffer, buffer + head, size - head);
+		size -= head;
+	}
+}
+
+static void stream_value_cb(void *args, char *id, void *data, uint32_t size)
+{
+	if (*(uint32_t *) data != client_next)
+		client_disorder++;
+	client_next = *(uint32_t *) data + 1;
+	client_elements++;
+}
+
+static void stream_gap_cb(void *args, char *id, uint64_t lost)
+{
+	client_lost += lost;
+	// sequence of the next element is unknown, it is just accepted
+	client_disorder--;
+}
+
+static void stream_raw_run(struct syncs_server *s, int stalled)
+{
+	uint8_t element[STREAM_ELEMENT];
+	struct stream_counters sc;
+	uint32_t i;
+	int fd;
+
+	memset(&sc, 0, sizeof(sc));
+	memset(element, 0, sizeof(element));
+	fd = stream_subscriber(stalled ? "stalled" : "reading");
+	usleep(100000);
+	stream_drain(fd, &sc);
+	memset(&sc, 0, sizeof(sc));
+
+	for (i = 0; i < STREAM_BURST; i++) {
+		*(uint32_t *) element = i;
+		syncs_server_write(s, SYNCS_TYPE_VAR_STREAM, "bench/stream", element, sizeof(element));
+		if (!stalled && !(i & 63))
+			stream_drain(fd, &sc);
+	}
+	if (stalled)
+		usleep(300000);
+	stream_drain(fd, &sc);
+	printf("%-8s subscriber %5lu elements in %5lu frames, %5.1f bytes/element, %lu gaps lost %lu\n",
+		stalled ? "stalled" : "reading", sc.elements, sc.batches,
+		sc.elements ? (double) sc.bytes / sc.elements : 0, sc.gaps, sc.lost);
+	close(fd);
+}
+
+int main()
+{
+	struct timespec start, end;
+	struct syncs_server *s;
+	struct syncs_connect *reader;
+	uint8_t element[STREAM_ELEMENT];
+	uint64_t us;
+	uint32_t i;
+	int ms;
+
+	s = syncs_server_create("127.0.0.1", STREAM_PORT, "bench");
+	if (s == NULL)
+		die("server create");
+	if (syncs_server_define_stream(s, "bench/stream", STREAM_DEPTH, STREAM_ELEMENT))
+		die("define stream");
+	sleep(1);
+
+	printf("#----- Stream of %d elements, ring depth %d, %d bytes each -----\n", STREAM_BURST, STREAM_DEPTH, STREAM_ELEMENT);
+	stream_raw_run(s, 0);
+	stream_raw_run(s, 1);
+
+	reader = syncs_connect_simple("127.0.0.1", STREAM_PORT, "reader");
+	syncs_set_protocol(reader, SYNCS_PROTOCOL_V3 | SYNCS_PROTOCOL_HANDLE | SYNCS_PROTOCOL_STREAM);
+	if (syncs_connect_wait(reader, 3))
+		die("connect");
+	syncs_subscribe_stream(reader, 0, "bench/stream", stream_value_cb, stream_gap_cb, NULL);
+	usleep(200000);
+
+	printf("#----- Library subscriber, %d writes -----\n", STREAM_WRITES);
+	memset(element, 0, sizeof(element));
+	client_next = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < STREAM_WRITES; i++) {
+		*(uint32_t *) element = i;
+		syncs_server_write(s, SYNCS_TYPE_VAR_STREAM, "bench/stream", element, sizeof(element));
+	}
+	for (ms = 0; (client_elements + client_lost < STREAM_WRITES) && (ms < 10000); ms++)
+		usleep(1000);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	us = tt_clockusdiff(start, end) + 1;
+	printf("%lu elements %9.0f elements/sec, lost %lu, out of order %u\n", client_elements,
+		(double) client_elements * 1000000 / us, client_lost, client_disorder);
+
+	syncs_disconnect(reader);
+	return 0;
+}
@@ -0,0 +1,100 @@
+/**************************************************************
+ * Description: Utility and test tools to support SyncScribe library
+ * Copyright (c) 2022 Alexander Krapivniy (a.krapivniy@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <syncs-server.h>
+#include <syncs-client.h>
+
+#define MODULE_NAME "syncs-test-subscriptions"
+#include <syncs-debug.h>
+#include <test_tools.h>
+
+#define SUBSCRIPTIONS_PORT	4495
+#define SUBSCRIPTIONS_WRITES	200000
+
+static const int subscriptions_counts[] = { 1, 64, 256 };
+
+static volatile uint32_t event_count;
+
+static void subscriptions_event_cb(void *args, char *id, void *data, uint32_t size)
+{
+	__atomic_fetch_add(&event_count, 1, __ATOMIC_RELAXED);
+}
+
+/* full ids are sent, so every event is looked up by id on the client */
+static void subscriptions_run(int count, int port)
+{
+	struct syncs_connect *client;
+	struct timespec start, end;
+	struct syncs_server *s;
+	char id[32];
+	uint64_t us;
+	int i, ms;
+
+	s = syncs_server_create("127.0.0.1", port, "bench");
+	if (s == NULL)
+		die("server create");
+	for (i = 0; i < count; i++) {
+		snprintf(id, sizeof(id), "bench/value%d", i);
+		syncs_server_define(s, id, SYNCS_TYPE_VAR_INT32, NULL, 0);
+	}
+	sleep(1);
+
+	client = syncs_connect_simple("127.0.0.1", port, "client");
+	if ((client == NULL) || syncs_connect_wait(client, 3))
+		die("connect");
+	for (i = 0; i < count; i++) {
+		snprintf(id, sizeof(id), "bench/value%d", i);
+		if (syncs_subscribe_event(client, SYNCS_TYPE_VAR_INT32, id, subscriptions_event_cb, NULL))
+			die("subscribe");
+	}
+	usleep(300000);
+
+	event_count = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < SUBSCRIPTIONS_WRITES; i++) {
+		// the last subscription is the farthest one for the scan of all of them
+		snprintf(id, sizeof(id), "bench/value%d", count - 1 - i % count);
+		syncs_server_write_int32(s, 0, id, i);
+		if ((i % 64) == 63)
+			usleep(50);
+	}
+	for (ms = 0; (event_count < SUBSCRIPTIONS_WRITES) && (ms < 30000); ms++)
+		usleep(1000);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (event_count < SUBSCRIPTIONS_WRITES)
+		die("events lost");
+	us = tt_clockusdiff(start, end) + 1;
+
+	printf("%3d subscriptions %9.0f events/sec\n", count, (double) SUBSCRIPTIONS_WRITES * 1000000 / us);
+	// the client stays until exit, like the server of the run
+}
+
+int main()
+{
+	uint32_t i;
+
+	printf("#----- 1 client, %d events of the server -----\n", SUBSCRIPTIONS_WRITES);
+	for (i = 0; i < sizeof(subscriptions_counts) / sizeof(subscriptions_counts[0]); i++)
+		subscriptions_run(subscriptions_counts[i], SUBSCRIPTIONS_PORT + i);
+	return 0;
+}
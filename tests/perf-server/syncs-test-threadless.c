@@ -0,0 +1,146 @@
+/**************************************************************
+ * Description: Utility and test tools to support SyncScribe library
+ * Copyright (c) 2022 Alexander Krapivniy (a.krapivniy@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <syncs-server.h>
+#include <syncs-client.h>
+
+#define MODULE_NAME "syncs-test-threadless"
+#include <syncs-debug.h>
+#include <test_tools.h>
+
+#define THREADLESS_PORT		4493
+#define THREADLESS_CLIENTS	64
+#define THREADLESS_WRITES	2000
+
+static volatile uint32_t event_count;
+
+static void threadless_event_cb(void *args, char *id, void *data, uint32_t size)
+{
+	__atomic_fetch_add(&event_count, 1, __ATOMIC_RELAXED);
+}
+
+static int threadless_threads(void)
+{
+	char line[128];
+	int threads = 0;
+	FILE *f;
+
+	if ((f = fopen("/proc/self/status", "r")) == NULL)
+		return 0;
+	while (fgets(line, sizeof(line), f) != NULL)
+		if (sscanf(line, "Threads: %d", &threads) == 1)
+			break;
+	fclose(f);
+	return threads;
+}
+
+/* one loop serves every connection, the way an application embeds them */
+static void threadless_poll(struct syncs_connect **clients, int count, int timeout)
+{
+	struct pollfd pfd[THREADLESS_CLIENTS];
+	int i, next;
+
+	for (i = 0; i < count; i++) {
+		pfd[i].fd = syncs_get_fd(clients[i], &pfd[i].events);
+		pfd[i].revents = 0;
+		next = syncs_next_timeout(clients[i]);
+		if ((next >= 0) && (next < timeout))
+			timeout = next;
+	}
+	poll(pfd, count, timeout);
+	for (i = 0; i < count; i++)
+		if (pfd[i].revents || (pfd[i].fd < 0))
+			syncs_process(clients[i]);
+}
+
+static void threadless_run(int threadless, int port)
+{
+	struct syncs_connect *clients[THREADLESS_CLIENTS];
+	struct timespec start, end;
+	struct syncs_server *s;
+	uint32_t total = THREADLESS_WRITES * THREADLESS_CLIENTS;
+	char name[32];
+	uint64_t us;
+	int i, threads, loops = 0;
+
+	s = syncs_server_create("127.0.0.1", port, "bench");
+	if (s == NULL)
+		die("server create");
+	syncs_server_define(s, "bench/value", SYNCS_TYPE_VAR_INT32, NULL, 0);
+	sleep(1);
+
+	threads = threadless_threads();
+	for (i = 0; i < THREADLESS_CLIENTS; i++) {
+		snprintf(name, sizeof(name), "client%d", i);
+		if (threadless)
+			clients[i] = syncs_connect_threadless("127.0.0.1", port, name, NULL, NULL);
+		else
+			clients[i] = syncs_connect_simple("127.0.0.1", port, name);
+		// waiting of the threadless connection processes it by itself
+		if ((clients[i] == NULL) || syncs_connect_wait(clients[i], 3))
+			die("connect");
+		syncs_subscribe_event(clients[i], SYNCS_TYPE_VAR_INT32, "bench/value", threadless_event_cb, NULL);
+	}
+	threads = threadless_threads() - threads;
+	usleep(300000);
+	if (threadless)
+		threadless_poll(clients, THREADLESS_CLIENTS, 0);
+
+	event_count = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	end = start;
+	for (i = 0; i < THREADLESS_WRITES; i++) {
+		syncs_server_write_int32(s, 0, "bench/value", i);
+		if ((i % 16) == 15) {
+			if (threadless)
+				threadless_poll(clients, THREADLESS_CLIENTS, 0);
+			else
+				usleep(100);
+		}
+	}
+	while ((event_count < total) && (tt_clockusdiff(start, end) < 30000000)) {
+		if (threadless)
+			threadless_poll(clients, THREADLESS_CLIENTS, 10);
+		else
+			usleep(1000);
+		loops++;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (event_count < total)
+		die("events lost");
+	us = tt_clockusdiff(start, end) + 1;
+
+	printf("%-10s %3d threads for %d clients, %9.0f events/sec, %u events\n", threadless ? "threadless" : "thread",
+		threads, THREADLESS_CLIENTS, (double) total * 1000000 / us, event_count);
+	// clients stay until exit, like the server of the run
+}
+
+int main()
+{
+	printf("#----- %d clients subscribed to 1 variable, %d writes of the server -----\n", THREADLESS_CLIENTS, THREADLESS_WRITES);
+	threadless_run(0, THREADLESS_PORT);
+	threadless_run(1, THREADLESS_PORT + 1);
+	return 0;
+}
@@ -0,0 +1,150 @@
+/**************************************************************
+ * Description: Utility and test tools to support SyncScribe library
+ * Copyright (c) 2022 Alexander Krapivniy (a.krapivniy@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <syncs-server.h>
+#include <syncs-client.h>
+
+#define MODULE_NAME "syncs-test-udp"
+#include <syncs-debug.h>
+#include <test_tools.h>
+
+#define UDP_PORT		4475
+#define UDP_WRITERS		4
+#define UDP_SUBSCRIBERS		8
+#define UDP_WRITES		20000
+#define UDP_BURST		64
+
+static const uint32_t udp_budgets[] = { SYNCS_BUNDLE_NONE, 0 };
+
+struct udp_writer {
+	pthread_t thread;
+	struct syncs_connect *connect;
+};
+
+static volatile uint32_t write_count;
+static volatile uint32_t event_count;
+
+static void udp_write_cb(void *args, char *id, void *data, uint32_t size)
+{
+	__atomic_fetch_add(&write_count, 1, __ATOMIC_RELAXED);
+}
+
+static void udp_event_cb(void *args, char *id, void *data, uint32_t size)
+{
+	__atomic_fetch_add(&event_count, 1, __ATOMIC_RELAXED);
+}
+
+static struct syncs_connect *udp_connect(int port, const char *name)
+{
+	struct syncs_connect *connect;
+
+	connect = syncs_udpconnect("127.0.0.1", port, name);
+	if ((connect == NULL) || syncs_connect_wait(connect, 3))
+		die("connect");
+	return connect;
+}
+
+/* writer sends bursts of datagrams, the server finds a burst queued on the socket */
+static void *udp_writer_thread(void *args)
+{
+	struct udp_writer *w = args;
+	int i;
+
+	for (i = 0; i < UDP_WRITES; i++) {
+		syncs_write_int32(w->connect, 0, "bench/value", i);
+		if ((i % UDP_BURST) == (UDP_BURST - 1))
+			usleep(500);
+	}
+	return NULL;
+}
+
+static void udp_run(uint32_t budget, int port)
+{
+	struct syncs_server_options options = { .reactors = 1, .bundle_us = budget };
+	struct syncs_connect *subscribers[UDP_SUBSCRIBERS];
+	struct udp_writer writers[UDP_WRITERS];
+	struct syncs_server_stats before, after;
+	struct timespec start, end;
+	struct syncs_server *s;
+	char name[32];
+	uint64_t us, rx, rx_calls, tx, tx_calls;
+	uint32_t total = UDP_WRITERS * UDP_WRITES;
+	int i;
+
+	s = syncs_server_create_ex("127.0.0.1", port, "bench", &options);
+	if (s == NULL)
+		die("server create");
+	syncs_server_define(s, "bench/value", SYNCS_TYPE_VAR_INT32, NULL, 0);
+	syncs_server_subscribe_event(s, SYNCS_TYPE_VAR_INT32, "bench/value", udp_write_cb, NULL);
+	sleep(1);
+
+	for (i = 0; i < UDP_SUBSCRIBERS; i++) {
+		snprintf(name, sizeof(name), "subscriber%d", i);
+		subscribers[i] = udp_connect(port, name);
+		syncs_subscribe_event(subscribers[i], SYNCS_TYPE_VAR_INT32, "bench/value", udp_event_cb, NULL);
+	}
+	for (i = 0; i < UDP_WRITERS; i++) {
+		snprintf(name, sizeof(name), "writer%d", i);
+		writers[i].connect = udp_connect(port, name);
+	}
+	usleep(300000);
+
+	write_count = 0;
+	event_count = 0;
+	syncs_server_get_stats(s, &before);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < UDP_WRITERS; i++)
+		pthread_create(&writers[i].thread, NULL, udp_writer_thread, &writers[i]);
+	for (i = 0; i < UDP_WRITERS; i++)
+		pthread_join(writers[i].thread, NULL);
+	// datagrams may be lost, so the rest is waited for a while only
+	usleep(300000);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	syncs_server_get_stats(s, &after);
+	us = tt_clockusdiff(start, end) + 1;
+	rx = after.udp_rx_datagrams - before.udp_rx_datagrams;
+	rx_calls = after.udp_rx_syscalls - before.udp_rx_syscalls;
+	tx = after.udp_tx_datagrams - before.udp_tx_datagrams;
+	tx_calls = after.udp_tx_syscalls - before.udp_tx_syscalls;
+
+	// udp connections stay until exit, like the server of the run
+	if (budget == SYNCS_BUNDLE_NONE)
+		printf("no bundling ");
+	else
+		printf("budget %4u us", budget);
+	printf(" %8.0f writes/sec (%5.1f%% lost), %8.0f pkts/sec out, %6.2f pkts/recvmmsg, %6.2f pkts/send, %u events\n",
+		(double) write_count * 1000000 / us, 100.0 - (double) write_count * 100 / total,
+		(double) tx * 1000000 / us, rx_calls ? (double) rx / rx_calls : 0,
+		tx_calls ? (double) tx / tx_calls : 0, event_count);
+}
+
+int main()
+{
+	uint32_t i;
+
+	printf("#----- %d udp writers, %d writes each, %d udp subscribers -----\n", UDP_WRITERS, UDP_WRITES, UDP_SUBSCRIBERS);
+	for (i = 0; i < sizeof(udp_budgets) / sizeof(udp_budgets[0]); i++)
+		udp_run(udp_budgets[i], UDP_PORT + i);
+	return 0;
+}
@@ -0,0 +1,237 @@
+/**************************************************************
+ * Description: Utility and test tools to support SyncScribe library
+ * Copyright (c) 2022 Alexander Krapivniy (a.krapivniy@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <syncs-server.h>
+
+#define MODULE_NAME "syncs-test-uring"
+#include <syncs-debug.h>
+#include <test_tools.h>
+
+#define URING_PORT		4477
+#define URING_WRITERS		4
+#define URING_SUBSCRIBERS	4
+#define URING_WRITES		50000
+#define URING_BURST		32
+
+static const uint32_t uring_backends[] = { SYNCS_BACKEND_EPOLL, SYNCS_BACKEND_URING };
+
+struct uring_client {
+	pthread_t thread;
+	int fd;
+	uint32_t handle;
+	volatile int stop;
+};
+
+static volatile uint32_t write_count;
+
+static void uring_write_cb(void *args, char *id, void *data, uint32_t size)
+{
+	__atomic_fetch_add(&write_count, 1, __ATOMIC_RELAXED);
+}
+
+static void uring_header(struct syncs_header *h, const char *id, uint32_t type)
+{
+	memset(h, 0, sizeof(struct syncs_header));
+	h->magic = SYNCS_PACKET_MAGIC;
+	h->magic_data = SYNCS_PACKET_MAGIC_DATA;
+	h->type = type;
+	snprintf(h->id.c, sizeof(syncsid_t), "%s", id);
+}
+
+static void uring_recv(int fd, void *buffer, int size)
+{
+	int ret;
+
+	while (size > 0) {
+		ret = recv(fd, buffer, size, 0);
+		if (ret <= 0)
+			die("recv");
+		buffer = (uint8_t *) buffer + ret;
+		size -= ret;
+	}
+}
+
+static int uring_connect(int port, const char *name)
+{
+	struct sockaddr_in addr;
+	struct syncs_header h;
+	int fd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if ((fd < 0) || connect(fd, (struct sockaddr *) &addr, sizeof(addr)))
+		die("connect");
+	uring_header(&h, name, SYNCS_TYPE_CLIENT_ID);
+	h.sync.data0 = SYNCS_VERSION_MAJOR;
+	h.sync.data1 = SYNCS_VERSION_MINOR;
+	h.update_counter = ((uint64_t) SYNCS_PROTOCOL_SIGNATURE << 32) | SYNCS_PROTOCOL_HANDLE;
+	if (send(fd, &h, sizeof(h), 0) != sizeof(h))
+		die("send");
+	uring_recv(fd, &h, sizeof(h));
+	return fd;
+}
+
+static uint32_t uring_request(int fd, const char *id, uint32_t type)
+{
+	struct syncs_packet packet;
+
+	uring_header(&packet.header, id, type | SYNCS_TYPE_VAR_INT32);
+	packet.header.update_counter = UINT64_MAX;
+	if (send(fd, &packet, sizeof(struct syncs_header), 0) != sizeof(struct syncs_header))
+		die("send");
+	uring_recv(fd, &packet, sizeof(struct syncs_header) + sizeof(uint32_t));
+	if ((packet.header.type & SYNCS_TYPE_MSG_MASK) != SYNCS_TYPE_ACK)
+		die("ack");
+	return *(uint32_t *) packet.buffer;
+}
+
+/* writer sends bursts of values, the server sees a burst in one read */
+static void *uring_writer_thread(void *args)
+{
+	struct uring_client *w = args;
+	uint8_t buffer[URING_BURST * (sizeof(struct syncs_handle_header) + sizeof(int32_t))];
+	struct syncs_handle_header *header;
+	int size = sizeof(struct syncs_handle_header) + sizeof(int32_t);
+	int i;
+
+	for (i = 0; i < URING_BURST; i++) {
+		header = (struct syncs_handle_header *) (buffer + i * size);
+		header->magic = SYNCS_PACKET_MAGIC_HANDLE;
+		header->magic_data = SYNCS_PACKET_MAGIC_DATA;
+		header->data_size = sizeof(int32_t);
+		header->type = SYNCS_TYPE_WRITE | SYNCS_TYPE_VAR_INT32;
+		header->handle = w->handle;
+		header->update_counter = 0;
+		*(int32_t *) (header + 1) = i;
+	}
+	for (i = 0; i < URING_WRITES; i += URING_BURST) {
+		if (send(w->fd, buffer, sizeof(buffer), 0) != sizeof(buffer))
+			die("send");
+		usleep(100);
+	}
+	return NULL;
+}
+
+static void *uring_subscriber_thread(void *args)
+{
+	struct uring_client *sub = args;
+	uint8_t buffer[64 * 1024];
+
+	while (!sub->stop)
+		if (recv(sub->fd, buffer, sizeof(buffer), 0) <= 0)
+			break;
+	return NULL;
+}
+
+static void uring_run(uint32_t backend, int port)
+{
+	struct syncs_server_options options = { .reactors = 1, .backend = backend };
+	struct uring_client writers[URING_WRITERS];
+	struct uring_client subscribers[URING_SUBSCRIBERS];
+	struct syncs_server_stats before, after;
+	struct timespec start, end;
+	struct syncs_server *s;
+	char id[32];
+	uint64_t us, frames, syscalls, cpu_us;
+	uint32_t total = URING_WRITERS * URING_WRITES;
+	int i, j, ms;
+
+	s = syncs_server_create_ex("127.0.0.1", port, "bench", &options);
+	if (s == NULL)
+		die("server create");
+	for (i = 0; i < URING_WRITERS; i++) {
+		snprintf(id, sizeof(id), "bench/value%d", i);
+		syncs_server_define(s, id, SYNCS_TYPE_VAR_INT32, NULL, 0);
+		syncs_server_subscribe_event(s, SYNCS_TYPE_VAR_INT32, id, uring_write_cb, NULL);
+	}
+	sleep(1);
+
+	for (i = 0; i < URING_SUBSCRIBERS; i++) {
+		snprintf(id, sizeof(id), "subscriber%d", i);
+		subscribers[i].fd = uring_connect(port, id);
+		for (j = 0; j < URING_WRITERS; j++) {
+			snprintf(id, sizeof(id), "bench/value%d", j);
+			uring_request(subscribers[i].fd, id, SYNCS_TYPE_SUBSCRIBE);
+		}
+		subscribers[i].stop = 0;
+		pthread_create(&subscribers[i].thread, NULL, uring_subscriber_thread, &subscribers[i]);
+	}
+	for (i = 0; i < URING_WRITERS; i++) {
+		snprintf(id, sizeof(id), "writer%d", i);
+		writers[i].fd = uring_connect(port, id);
+		snprintf(id, sizeof(id), "bench/value%d", i);
+		writers[i].handle = uring_request(writers[i].fd, id, SYNCS_TYPE_DEFINE | SYNCS_TYPE_FORCE);
+	}
+	usleep(100000);
+
+	write_count = 0;
+	syncs_server_get_stats(s, &before);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < URING_WRITERS; i++)
+		pthread_create(&writers[i].thread, NULL, uring_writer_thread, &writers[i]);
+	for (ms = 0; (write_count < total) && (ms < 60000); ms++)
+		usleep(1000);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (write_count < total)
+		die("writes lost");
+	us = tt_clockusdiff(start, end) + 1;
+	usleep(300000);
+	syncs_server_get_stats(s, &after);
+	frames = after.tx_frames - before.tx_frames;
+	syscalls = after.tx_syscalls - before.tx_syscalls + after.rx_syscalls - before.rx_syscalls;
+	cpu_us = after.reactor_cpu_us - before.reactor_cpu_us;
+
+	for (i = 0; i < URING_WRITERS; i++) {
+		pthread_join(writers[i].thread, NULL);
+		close(writers[i].fd);
+	}
+	for (i = 0; i < URING_SUBSCRIBERS; i++) {
+		subscribers[i].stop = 1;
+		shutdown(subscribers[i].fd, SHUT_RDWR);
+		pthread_join(subscribers[i].thread, NULL);
+		close(subscribers[i].fd);
+	}
+	// events are the writes which come in and the frames which go out
+	printf("%-8s %9.0f events/sec, %8.0f syscalls per 1M events, %6.1f reactor cpu ms per 1M events\n",
+		(after.backend == SYNCS_BACKEND_URING) ? "io_uring" : "epoll",
+		(double) (total + frames) * 1000000 / us, (double) syscalls * 1000000 / (total + frames),
+		(double) cpu_us * 1000 / (total + frames));
+}
+
+int main()
+{
+	uint32_t i;
+
+	printf("#----- %d writers in bursts of %d, %d subscribers -----\n", URING_WRITERS, URING_BURST, URING_SUBSCRIBERS);
+	for (i = 0; i < sizeof(uring_backends) / sizeof(uring_backends[0]); i++)
+		uring_run(uring_backends[i], URING_PORT + i);
+	return 0;
+}
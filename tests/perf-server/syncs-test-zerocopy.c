@@ -0,0 +1,126 @@
+/**************************************************************
+ * Description: Utility and test tools to support SyncScribe library
+ * Copyright (c) 2022 Alexander Krapivniy (a.krapivniy@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <syncs-server.h>
+#include <syncs-client.h>
+
+#define MODULE_NAME "syncs-test-zerocopy"
+#include <syncs-debug.h>
+#include <test_tools.h>
+
+#define ZC_PORT		4479
+#define ZC_CLIENTS	16
+#define ZC_THRESHOLD	2048
+#define ZC_BYTES	(32 * 1024 * 1024)
+
+static const uint32_t zc_sizes[] = { 4 * 1024, 64 * 1024 };
+
+struct zc_subscriber {
+	struct syncs_connect *connect;
+	volatile uint32_t values;
+};
+
+static struct zc_subscriber subscribers[ZC_CLIENTS];
+static uint8_t *zc_value;
+
+/* every byte of the value is its number, a frame reused too early shows up as a mix */
+static void zc_value_cb(void *args, char *id, void *data, uint32_t size)
+{
+	struct zc_subscriber *sub = args;
+	uint8_t *p = data;
+	uint32_t i;
+
+	for (i = 1; i < size; i++)
+		if (p[i] != p[0])
+			die("value is damaged");
+	sub->values++;
+}
+
+static void zc_wait(volatile uint32_t *counter, uint32_t count)
+{
+	int ms;
+
+	for (ms = 0; (*counter < count) && (ms < 30000); ms++)
+		usleep(100);
+	if (*counter < count)
+		die("values lost");
+}
+
+static void zc_run(uint32_t threshold, int port)
+{
+	struct syncs_server_options options = { .reactors = 1, .zerocopy_bytes = threshold };
+	struct syncs_server_stats before, after;
+	struct timespec start, end;
+	struct syncs_server *s;
+	uint64_t us, bytes, cpu_us;
+	uint32_t i, j, k, writes, base;
+
+	s = syncs_server_create_ex("127.0.0.1", port, "bench", &options);
+	if (s == NULL)
+		die("server create");
+	syncs_server_define(s, "bench/huge", SYNCS_TYPE_VAR_HUGE, NULL, 0);
+	sleep(1);
+	for (i = 0; i < ZC_CLIENTS; i++) {
+		subscribers[i].values = 0;
+		subscribers[i].connect = syncs_connect_simple("127.0.0.1", port, "subscriber");
+		syncs_set_protocol(subscribers[i].connect, SYNCS_PROTOCOL_V3 | SYNCS_PROTOCOL_HANDLE | SYNCS_PROTOCOL_HUGE);
+		if (syncs_connect_wait(subscribers[i].connect, 3))
+			die("connect");
+		syncs_subscribe_event(subscribers[i].connect, SYNCS_TYPE_VAR_HUGE, "bench/huge", zc_value_cb, &subscribers[i]);
+	}
+	usleep(200000);
+
+	for (i = 0; i < sizeof(zc_sizes) / sizeof(zc_sizes[0]); i++) {
+		writes = ZC_BYTES / ZC_CLIENTS / zc_sizes[i];
+		base = subscribers[0].values;
+		syncs_server_get_stats(s, &before);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (k = 0; k < writes; k++) {
+			memset(zc_value, k, zc_sizes[i]);
+			syncs_server_write(s, SYNCS_TYPE_VAR_HUGE, "bench/huge", zc_value, zc_sizes[i]);
+			// next value would replace this one if it isn't started yet
+			for (j = 0; j < ZC_CLIENTS; j++)
+				zc_wait(&subscribers[j].values, base + k + 1);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		syncs_server_get_stats(s, &after);
+		us = tt_clockusdiff(start, end) + 1;
+		bytes = (uint64_t) writes * zc_sizes[i] * ZC_CLIENTS;
+		cpu_us = after.reactor_cpu_us - before.reactor_cpu_us;
+		printf("%-9s %6u bytes %8.1f MB/s, reactor cpu %6.2f ms per MB, %7lu zero-copy sends (%lu copied)\n",
+			threshold ? "zero-copy" : "copy", zc_sizes[i], (double) bytes / us, (double) cpu_us * 1024 * 1024 / 1000 / bytes,
+			after.zerocopy_sends - before.zerocopy_sends, after.zerocopy_copied - before.zerocopy_copied);
+	}
+	// connections stay until exit, like the server of the run
+}
+
+int main()
+{
+	zc_value = malloc(zc_sizes[1]);
+	if (zc_value == NULL)
+		die("malloc");
+	printf("#----- Huge values to %d subscribers, zero-copy from %d bytes -----\n", ZC_CLIENTS, ZC_THRESHOLD);
+	zc_run(0, ZC_PORT);
+	zc_run(ZC_THRESHOLD, ZC_PORT + 1);
+	return 0;
+}
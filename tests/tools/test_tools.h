@@ -51,7 +51,7 @@ void tt_thread_output (uint32_t mask);
 uint64_t tt_clockusdiff(struct timespec start, struct timespec stop);
 
 
-void die(char *s);
+void die(char *s) __attribute__((noreturn));
 
 
 #ifdef __cplusplus